@@ -0,0 +1,60 @@
+# Generate C++ bindings for a schema with pbnjson_bindgen
+#
+# pbnjson_generate_bindings(<sources variable> <schema> [NAMESPACE <namespace>] [INCLUDE_DIRS <dir>...])
+#
+# Generates <schema name>.h & <schema name>.cpp in the current binary directory & appends them to the sources
+# variable.  The generated code needs pbnjson_cpp & the binary directory in the include path.  References in the
+# schema are resolved next to it & in INCLUDE_DIRS - every schema found there is a dependency of the generated code.
+function(pbnjson_generate_bindings SOURCES_VAR SCHEMA)
+	set(_namespace)
+	set(_include_dirs ${CMAKE_CURRENT_SOURCE_DIR})
+	set(_state)
+	foreach (_arg ${ARGN})
+		if (_arg STREQUAL "NAMESPACE" OR _arg STREQUAL "INCLUDE_DIRS")
+			set(_state ${_arg})
+		elseif (_state STREQUAL "NAMESPACE")
+			set(_namespace ${_arg})
+		elseif (_state STREQUAL "INCLUDE_DIRS")
+			list(APPEND _include_dirs ${_arg})
+		else ()
+			message(FATAL_ERROR "pbnjson_generate_bindings: unexpected argument ${_arg}")
+		endif ()
+	endforeach ()
+
+	get_filename_component(_schema ${SCHEMA} ABSOLUTE)
+	get_filename_component(_schema_dir ${_schema} PATH)
+	get_filename_component(_name ${_schema} NAME_WE)
+	set(_output ${CMAKE_CURRENT_BINARY_DIR}/${_name})
+
+	set(_args)
+	set(_depends ${_schema})
+	foreach (_dir ${_schema_dir} ${_include_dirs})
+		get_filename_component(_dir ${_dir} ABSOLUTE)
+		list(APPEND _args -I ${_dir})
+		file(GLOB _schemas ${_dir}/*.schema)
+		list(APPEND _depends ${_schemas})
+	endforeach ()
+	if (_namespace)
+		list(APPEND _args -n ${_namespace})
+	endif ()
+
+	if (TARGET pbnjson_bindgen)
+		set(_bindgen pbnjson_bindgen)
+		list(APPEND _depends pbnjson_bindgen)
+	else ()
+		find_program(PBNJSON_BINDGEN pbnjson_bindgen)
+		if (NOT PBNJSON_BINDGEN)
+			message(FATAL_ERROR "pbnjson_generate_bindings: pbnjson_bindgen not found")
+		endif ()
+		set(_bindgen ${PBNJSON_BINDGEN})
+	endif ()
+
+	list(REMOVE_DUPLICATES _depends)
+	add_custom_command(OUTPUT ${_output}.h ${_output}.cpp
+		COMMAND ${_bindgen} ${_args} -o ${_output} ${_schema}
+		DEPENDS ${_depends}
+		COMMENT "Generating C++ bindings for ${_name}"
+		VERBATIM)
+
+	set(${SOURCES_VAR} ${${SOURCES_VAR}} ${_output}.h ${_output}.cpp PARENT_SCOPE)
+endfunction()
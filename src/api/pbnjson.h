@@ -167,8 +167,13 @@ extern "C" {
 #include "pbnjson/c/japi.h"
 #include "pbnjson/c/jobject.h"
 #include "pbnjson/c/jschema.h"
+#include "pbnjson/c/jschema_registry.h"
 #include "pbnjson/c/jgen_stream.h"
 #include "pbnjson/c/jparse_stream.h"
+#include "pbnjson/c/jcbor.h"
+#include "pbnjson/c/jsnapshot.h"
+#include "pbnjson/c/jstats.h"
+#include "pbnjson/c/jallocator.h"
 
 #ifdef __cplusplus
 }
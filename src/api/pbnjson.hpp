@@ -167,6 +167,9 @@ LICENSE@@@ */
 #include "pbnjson/cxx/JDomParser.h"
 #include "pbnjson/cxx/JSchemaFile.h"
 #include "pbnjson/cxx/JSchemaFragment.h"
+#include "pbnjson/cxx/JSchemaRegistry.h"
 #include "pbnjson/cxx/JResolver.h"
+#include "pbnjson/cxx/JBinding.h"
+#include "pbnjson/cxx/JAllocator.h"
 
 #endif /* PJSONCXX_H_ */
@@ -0,0 +1,71 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JALLOCATOR_H_
+#define JALLOCATOR_H_
+
+#include <stddef.h>
+#include "japi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Where pbnjson gets its memory from.  The functions follow the contract of malloc/realloc/free: m_malloc &
+ * m_realloc return NULL if they can't allocate, m_realloc(ctxt, NULL, size) allocates & m_free(ctxt, NULL)
+ * is never called.  m_ctxt is handed to each of them as is.
+ *
+ * Every value remembers the allocator it was created with, so the memory it holds (the value itself, the
+ * copy of a string or number, the tables of an object & array elements) goes back to the same allocator
+ * when it's released - an allocator has to outlive every value created with it.
+ *
+ * Buffers that are handed over to the caller (e.g. jstring_get, jvalue_to_cbor or a finished jstream) are
+ * always allocated with malloc so they can be released with free.
+ */
+typedef struct JAllocator {
+	void* (*m_malloc)(void *ctxt, size_t size);
+	void* (*m_realloc)(void *ctxt, void *ptr, size_t size);
+	void (*m_free)(void *ctxt, void *ptr);
+	void *m_ctxt;
+} JAllocator;
+
+typedef const JAllocator* JAllocatorRef;
+
+/**
+ * Change the allocator used by everything that doesn't have one of its own: values created through the
+ * jobject.h API or parsed without one (see jparser_set_allocator), schemas, parsers & the state used while
+ * parsing, validating & generating.
+ *
+ * This isn't synchronized with anything else - set it before the library is used (it isn't safe to change
+ * while memory allocated by the previous one other than values is still around).
+ *
+ * @param allocator The allocator to use from now on (NULL to go back to malloc).  It isn't copied.
+ */
+PJSON_API void jallocator_set_default(JAllocatorRef allocator);
+
+/**
+ * @return The allocator set by jallocator_set_default (one that uses malloc if none was set).
+ */
+PJSON_API JAllocatorRef jallocator_default(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JALLOCATOR_H_ */
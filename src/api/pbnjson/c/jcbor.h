@@ -0,0 +1,81 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JCBOR_H_
+#define JCBOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "japi.h"
+#include "jschema.h"
+#include "jobject.h"
+#include "jcallbacks.h"
+#include "jparse_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Encode a JSON value as CBOR (RFC 7049) - a compact binary form that's cheaper to produce & parse than JSON text.
+ *
+ * Integers are encoded as integers, using the fewest bytes that hold them.  Floating point numbers are encoded as
+ * single precision if that is exact & double precision otherwise.  A number parsed from text is encoded as an
+ * integer if it is one that fits in 64 bits, otherwise as a double (possibly losing precision).
+ *
+ * The value isn't validated against any schema.
+ *
+ * @param val The value to encode.
+ * @param length Set to the number of bytes in the encoding.
+ * @return The encoding (to be released with free), or NULL if the value couldn't be encoded.
+ *
+ * @see jdom_parse_cbor
+ */
+PJSON_API char* jvalue_to_cbor(jvalue_ref val, size_t *length) NON_NULL(2);
+
+/**
+ * Returns the DOM of a CBOR data item (e.g. one produced by jvalue_to_cbor).  Integers & floating point numbers
+ * become numbers holding the native value - there's no conversion through text.
+ *
+ * Byte strings & simple values other than false, true, null & undefined (which becomes null) have no JSON
+ * equivalent and are rejected, as are maps with keys that aren't text strings.  Tags are ignored.
+ *
+ * @param input The encoded value.  It isn't referenced by the DOM once parsing is done.
+ * @param schemaInfo The schema to validate the value against, along with any other callbacks necessary (such as
+ *                   schema resolver, error handler).
+ * @return An opaque reference handle to the DOM.  Use jis_null to determine whether or
+ *         not parsing succeeded.
+ *
+ * @see jdom_parse
+ */
+PJSON_API jvalue_ref jdom_parse_cbor(raw_buffer input, JSchemaInfoRef schemaInfo) NON_NULL(2);
+
+/**
+ * Walk a CBOR data item, firing the same callbacks (validated the same way) as jsax_parse_ex would for the
+ * equivalent JSON text.  Numbers are handed to the m_number callback as text.
+ *
+ * @see jsax_parse_ex
+ * @see jdom_parse_cbor
+ */
+PJSON_API bool jsax_parse_cbor(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **data, bool logError) NON_NULL(3);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JCBOR_H_ */
@@ -86,6 +86,17 @@ extern "C" {
  */
 PJSON_API jvalue_ref jvalue_copy(jvalue_ref val) NON_NULL(1);
 
+/**
+ * Create a deep copy of the JSON value so that modifications in val are guaranteed to not
+ * be seen in the copy.
+ *
+ * No reference counts are shared between val & the copy, so the copy may be handed over to another thread.
+ *
+ * @param val The value to copy
+ * @return The copy (owned by the caller), or NULL if it couldn't be made.
+ */
+PJSON_API jvalue_ref jvalue_duplicate(jvalue_ref val) NON_NULL(1);
+
 /**
  * Release ownership from *val.  *val has an undefined value afterwards.  It is an error
  * to call this on references for which ownership does not preside with the caller
@@ -649,6 +660,19 @@ PJSON_API jvalue_ref jstring_create_nocopy(raw_buffer val);
  */
 PJSON_API jvalue_ref jstring_create_nocopy_full(raw_buffer val, jdeallocator buffer_dealloc);
 
+/**
+ * Like jstring_create_nocopy_full, except that the buffer belongs to some other object (e.g. a C++ std::string)
+ * which is released once the library is done with the buffer.
+ *
+ * @param val The UTF string to set.  It must stay valid until owner is released.
+ * @param release Called with owner when the JSON string is destroyed
+ * @param owner What keeps val alive
+ * @return A reference to the JSON string (owner has already been released if it's the empty string)
+ *
+ * @see jstring_create_nocopy_full
+ */
+PJSON_API jvalue_ref jstring_create_nocopy_owned(raw_buffer val, jdeallocator release, void *owner) NON_NULL(2, 3);
+
 /**
  * Return the number of bytes in the buffer backing the JSON string.  Convenience method.
  * Equivalent to jstring_get(str).m_len
@@ -992,6 +1016,20 @@ PJSON_API ConversionResultFlags jnumber_get_f64(jvalue_ref num, double *number)
  */
 PJSON_API ConversionResultFlags jnumber_get_raw(jvalue_ref num, raw_buffer *result);
 
+/**
+ * Convert the text of a JSON number (e.g. as handed to a SAX callback) without creating a JSON value for it.  The
+ * conversion is the same as jnumber_get_i64 & jnumber_get_f64 of a number created from str.
+ *
+ * @param str The numeric string (need not be NULL-terminated)
+ * @param number The converted number
+ * @return The conversion result flags
+ *
+ * @see jnumber_get_i64
+ * @see jnumber_get_f64
+ */
+PJSON_API ConversionResultFlags jnumber_raw_to_i64(raw_buffer str, int64_t *number) NON_NULL(2);
+PJSON_API ConversionResultFlags jnumber_raw_to_f64(raw_buffer str, double *number) NON_NULL(2);
+
 /*** JSON Boolean operations ***/
 PJSON_API bool jis_boolean(jvalue_ref jval) NON_NULL(1);
 
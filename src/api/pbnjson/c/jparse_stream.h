@@ -25,6 +25,7 @@ LICENSE@@@ */
 #include "jobject.h"
 #include "jcallbacks.h"
 #include "jparse_types.h"
+#include "jallocator.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,21 +34,66 @@ extern "C" {
 /**
  * Returns the DOM structure of the JSON document contained within the given file.
  *
+ * A gzip compressed file is recognized by its contents & inflated as it's parsed, so only a small window of it is
+ * ever held in memory (if pbnjson was built without zlib such a file fails to parse).
+ *
  * @param file The c-string representing the path to parse.
  * @param schemaInfo The schema to use for validation of the input, along with any other callbacks necessary (such as schema resolver,
  *                   error handler).
- * @param opts The optimization mode to use when parsing the file.
+ * @param opts The optimization mode to use when parsing the file.  Ignored for compressed files.
  * @return An opaque reference handle to the DOM.  Use jis_null to determine whether or
  *         not parsing succeeded.
  */
 PJSON_API jvalue_ref jdom_parse_file(const char *file, JSchemaInfoRef schemaInfo, JFileOptimizationFlags opts) NON_NULL(1, 2);
 
+/**
+ * Same as jsax_parse_ex for the contents of a file.  The file is read (& inflated if it's gzip compressed) a chunk
+ * at a time, so the memory needed doesn't depend on its size.
+ *
+ * @param file The c-string representing the path to parse.
+ *
+ * @see jsax_parse_ex
+ * @see jdom_parse_file
+ */
+PJSON_API bool jsax_parse_file(PJSAXCallbacks *parser, const char *file, JSchemaInfoRef schemaInfo, void **data, bool logError) NON_NULL(2, 3);
+
+/**
+ * Same as jsax_parse_ex for input supplied by a reader a chunk at a time (e.g. a request body straight off a socket).
+ * Only a bounded window of the input is held in memory at once; the parser & validation state are carried over
+ * from one chunk to the next.  Gzip compressed input is recognized & inflated, just like with jsax_parse_file.
+ *
+ * Reading stops once the document is complete (unless the input is compressed, in which case it's read to the end
+ * so that any damage is noticed).  Whatever the last chunk read holds past the end of the document is discarded
+ * though, so read mustn't supply anything that's meant to be read after the document (such as the next request
+ * on the same connection).
+ *
+ * @param read Supplies the input.
+ * @param readCtxt Passed through to read.
+ *
+ * @see jsax_parse_ex
+ * @see jsax_parse_file
+ */
+PJSON_API bool jsax_parse_reader(PJSAXCallbacks *parser, jinput_reader read, void *readCtxt, JSchemaInfoRef schemaInfo, void **data, bool logError) NON_NULL(2, 4);
+
+/**
+ * Same as jdom_parse for input supplied by a reader a chunk at a time (see jsax_parse_reader).  The chunks are
+ * re-used, so the DOM always holds copies of its strings & numbers.
+ *
+ * @param read Supplies the input.
+ * @param readCtxt Passed through to read.
+ * @return An opaque reference handle to the DOM.  Use jis_null to determine whether or
+ *         not parsing succeeded.
+ *
+ * @see jdom_parse
+ */
+PJSON_API jvalue_ref jdom_parse_reader(jinput_reader read, void *readCtxt, JSchemaInfoRef schemaInfo) NON_NULL(1, 3);
+
 /**
  * Returns the DOM structure of the JSON document.
  *
  * @param input The input string to parse.
- *              NOTE: It is unspecified if a DOM will be constructed if the input does not contain a top-level
- *              object or array.
+ *              NOTE: The top-level value may be a scalar (e.g. "5" or "\"s\"") as well as an object or array.  A
+ *              document that is just null can't be told apart from a failure by the result.
  *              NOTE: Need not be a null-terminated string
  * @param optimizationMode Additional information about the input string that lets us optimize the creation process of the DOM.
  * @param schemaInfo The schema to use for validation of the input, along with any other callbacks necessary (such as schema resolver,
@@ -57,6 +103,21 @@ PJSON_API jvalue_ref jdom_parse_file(const char *file, JSchemaInfoRef schemaInfo
  */
 PJSON_API jvalue_ref jdom_parse(raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo) NON_NULL(3);
 
+/**
+ * Same as jdom_parse but with additional parser checks enabled.
+ *
+ * @param input The input string to parse.
+ * @param optimizationMode Additional information about the input string that lets us optimize the creation process of the DOM.
+ * @param schemaInfo The schema to use for validation of the input, along with any other callbacks necessary (such as schema resolver,
+ *                   error handler).
+ * @param parseOpts A bit-wise combination of ::JParseOption values.
+ * @return An opaque reference handle to the DOM.  Use jis_null to determine whether or
+ *         not parsing succeeded.
+ *
+ * @see jdom_parse
+ */
+PJSON_API jvalue_ref jdom_parse_opts(raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, JParseOptionFlags parseOpts) NON_NULL(3);
+
 /**
  * Parse the input using SAX callbacks.  Much faster in that no memory is allocated for a DOM & data is
  * processed on the fly, but less flexible & more complicated to handle in some cases.
@@ -64,8 +125,8 @@ PJSON_API jvalue_ref jdom_parse(raw_buffer input, JDOMOptimizationFlags optimiza
  * @param parser A pointer to a SAXCallbacks structure with pointers to functions that handle the appropriate
  *               parsing events.
  * @param input The input string to parse
- *              NOTE: It is unspecified if the error handlers will be called if the input does not contain a top-level
- *              object or array.
+ *              NOTE: The top-level value may be a scalar as well as an object or array.  A number that ends the
+ *              input is taken to be complete.
  * @param schemaInfo The schema to use for validation of the input, along with any other callbacks necessary (such as schema resolver,
  *              error handler).
  * @param data The ctxt parameter during parsing.
@@ -85,6 +146,199 @@ PJSON_API bool jsax_parse_ex(PJSAXCallbacks *parser, raw_buffer input, JSchemaIn
  */
 PJSON_API bool jsax_parse(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo) NON_NULL(3);
 
+/**
+ * Same as jsax_parse_ex but with additional parser checks enabled.
+ *
+ * @param parseOpts A bit-wise combination of ::JParseOption values.
+ *
+ * @see jsax_parse_ex
+ */
+PJSON_API bool jsax_parse_opts(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **data, bool logError, JParseOptionFlags parseOpts) NON_NULL(3);
+
+/**
+ * Create a parser that can be re-used for many documents.
+ *
+ * @param parseOpts A bit-wise combination of ::JParseOption values applied to every document parsed with it.
+ * @return The parser or NULL if it couldn't be allocated.  Must be released with jparser_release.
+ *
+ * @see jparser_ref
+ */
+PJSON_API jparser_ref jparser_create(JParseOptionFlags parseOpts);
+
+/**
+ * Release the parser & everything it has cached.  Sets *parser to NULL.
+ */
+PJSON_API void jparser_release(jparser_ref *parser) NON_NULL(1);
+
+/**
+ * Set where the DOMs parsed with the parser are allocated from (a per-request arena for example).  The
+ * parser's own state still comes from the default allocator, so it may outlive allocator as long as no more
+ * documents are parsed with it until another allocator is set.
+ *
+ * @param parser The parser to use (see jparser_create).
+ * @param allocator The allocator for every value of the documents parsed from now on (NULL for the default
+ *                  allocator - see jallocator_set_default).  It isn't copied.
+ *
+ * @see jdom_parse_with_parser
+ */
+PJSON_API void jparser_set_allocator(jparser_ref parser, JAllocatorRef allocator) NON_NULL(1);
+
+/**
+ * Same as jdom_parse but re-uses the state held by parser instead of setting it up from scratch.
+ *
+ * @param parser The parser to use (see jparser_create).
+ *
+ * @see jdom_parse
+ */
+PJSON_API jvalue_ref jdom_parse_with_parser(jparser_ref parser, raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo) NON_NULL(1, 4);
+
+/**
+ * Same as jdom_parse_reader but the DOM is allocated as set up for parser (see jparser_set_allocator) & the input
+ * is parsed with the options parser was created with (e.g. JPARSE_OPT_VALIDATE_UTF8).
+ *
+ * @param parser The parser to use (see jparser_create).
+ *
+ * @see jdom_parse_reader
+ */
+PJSON_API jvalue_ref jdom_parse_reader_with_parser(jparser_ref parser, jinput_reader read, void *readCtxt, JSchemaInfoRef schemaInfo) NON_NULL(1, 2, 4);
+
+/**
+ * Make dom responsible for the input it was parsed from.  Parsing with DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE
+ * avoids copying the strings & numbers out of the input; handing the input over to the DOM afterwards means
+ * the caller doesn't have to keep track of when the last reference to the DOM goes away.
+ *
+ * NOTE: Only the DOM itself holds on to the input (just like the file contents held by jdom_parse_file).
+ *       Values within it that are kept around (see jvalue_copy) after the DOM has been released still refer to the
+ *       input - use jvalue_duplicate for those.
+ *
+ * @param dom The top-level value returned by jdom_parse (or jdom_parse_with_parser).  If it's a constant (e.g. the JSON
+ *            null returned when parsing fails, or the DOM of the document "") it can't refer to the input, so owner
+ *            is released immediately.
+ * @param release Invoked with owner once the DOM is released.
+ * @param owner Whatever keeps the input alive (a reference counted buffer for example).
+ * @return False if dom is already responsible for an input (e.g. it was returned by jdom_parse_file) - owner is
+ *         left to the caller.
+ */
+PJSON_API bool jdom_adopt_input(jvalue_ref dom, jdeallocator release, void *owner) NON_NULL(1, 2);
+
+/**
+ * Same as jsax_parse_ex but re-uses the state held by parser instead of setting it up from scratch.
+ *
+ * @param parser The parser to use (see jparser_create).
+ * @param callbacks The SAX callbacks to invoke for this document.
+ *
+ * @see jsax_parse_ex
+ */
+PJSON_API bool jsax_parse_with_parser(jparser_ref parser, PJSAXCallbacks *callbacks, raw_buffer input, JSchemaInfoRef schemaInfo, void **data, bool logError) NON_NULL(1, 4);
+
+/**
+ * Parse a sequence of documents from the one buffer - newline-delimited (NDJSON) or simply concatenated with
+ * optional whitespace in between.  The parser state is set up once for the whole sequence while every
+ * document is validated against the schema individually.
+ *
+ * If a document is malformed or rejected by the schema, parsing resumes at the start of the following line.
+ *
+ * @param input The buffer containing the documents.
+ * @param schemaInfo The schema every document is validated against, along with any other callbacks necessary
+ *                   (such as schema resolver, error handler).
+ * @param onDocument Invoked with every document (or a JSON null for documents that failed).  Parsing stops
+ *                   early if it returns false.
+ * @param ctxt Passed through to onDocument.
+ * @return True if every document that was reached parsed successfully, false otherwise.
+ *
+ * @see jdom_parse
+ */
+PJSON_API bool jdom_parse_multi(raw_buffer input, JSchemaInfoRef schemaInfo, jdom_multi_callback onDocument, void *ctxt) NON_NULL(2, 3);
+
+/**
+ * SAX equivalent of jdom_parse_multi.
+ *
+ * @param parser The SAX callbacks invoked for the contents of every document.
+ * @param input The buffer containing the documents.
+ * @param schemaInfo The schema every document is validated against.
+ * @param data The ctxt parameter during parsing.  Carried over from one document to the next & set to its final
+ *             value once parsing stops.
+ * @param onDocument Optional.  Invoked at the end of every document.  Parsing stops early if it returns false.
+ * @return True if every document that was reached parsed successfully, false otherwise.
+ *
+ * @see jdom_parse_multi
+ * @see jsax_parse_ex
+ */
+PJSON_API bool jsax_parse_multi(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **data, jsax_multi_callback onDocument) NON_NULL(3);
+
+/**
+ * Parse newline-delimited JSON (NDJSON) on several threads at once.  The input is split into chunks at line
+ * boundaries which are parsed & validated by a pool of workers, each with a parser of its own.
+ *
+ * Every document must be on a line of its own.  onDocument is never invoked by two threads at the same time,
+ * although it will be invoked from the worker threads.  The same goes for the error handlers & resolver in
+ * schemaInfo, which each worker uses with a private copy of the schema.
+ *
+ * @param input The buffer containing the documents.
+ * @param schemaInfo The schema every document is validated against, along with any other callbacks necessary
+ *                   (such as schema resolver, error handler).
+ * @param nthreads The number of threads to parse with (including the calling thread).  0 picks one per CPU.
+ * @param opts A bit-wise combination of ::JParallelOption values.
+ * @param onDocument Invoked with every document (or a JSON null for documents that failed).  Parsing stops
+ *                   early if it returns false.
+ * @param ctxt Passed through to onDocument.
+ * @return True if every document handed to onDocument parsed successfully, false otherwise.  As with
+ *         jdom_parse_multi, documents after the one onDocument asked to stop at don't count - even if some of
+ *         them had already been parsed (whichever ::JParallelOption is used).
+ *
+ * @see jdom_parse_multi
+ */
+PJSON_API bool jparse_parallel_ndjson(raw_buffer input, JSchemaInfoRef schemaInfo, unsigned int nthreads, JParallelOptionFlags opts, jdom_multi_callback onDocument, void *ctxt) NON_NULL(2, 5);
+
+/**
+ * Same as jparse_parallel_ndjson for the contents of a file.  The file is only kept in memory for the duration
+ * of the call.
+ *
+ * @param file The c-string representing the path to parse.
+ * @param flags How the file should be read.
+ *
+ * @see jparse_parallel_ndjson
+ * @see jdom_parse_file
+ */
+PJSON_API bool jparse_parallel_ndjson_file(const char *file, JSchemaInfoRef schemaInfo, JFileOptimizationFlags flags, unsigned int nthreads, JParallelOptionFlags opts, jdom_multi_callback onDocument, void *ctxt) NON_NULL(1, 2, 6);
+
+/**
+ * Parse a document consisting of (or containing) one large array on several threads at once.  A quick
+ * structural scan finds where the elements of the array begin & end, the elements are parsed into DOMs by
+ * a pool of workers & the results are put together into the final array.
+ *
+ * The schema applies to every element of the array rather than to the array itself.  The error handlers &
+ * resolver in schemaInfo may be invoked from several threads, each with a private copy of the schema.
+ *
+ * @param input The buffer containing the document.
+ * @param path A JSON pointer (RFC 6901) leading from the top-level object to the array through object keys only
+ *             (e.g. "/data/records"; '~' & '/' within a key are written as "~0" & "~1", so key "a/b" is "/a~1b").
+ *             NULL or empty if the document is the array itself.  Keys are compared as they appear in the input,
+ *             so a key containing JSON escape sequences won't be found.  Only the array is parsed - the rest of the
+ *             document is merely skipped over (the objects around the array have to be well-formed, but the
+ *             other values in them aren't looked into).
+ * @param optimizationMode Additional information about the input string (see jdom_parse).
+ * @param schemaInfo The schema every element is validated against, along with any other callbacks necessary (such as
+ *                   schema resolver, error handler).
+ * @param nthreads The number of threads to parse with (including the calling thread).  0 picks one per CPU.
+ * @return The array or a JSON null if there is no array at path or any of its elements failed.
+ *
+ * @see jdom_parse
+ */
+PJSON_API jvalue_ref jdom_parse_array_parallel(raw_buffer input, const char *path, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, unsigned int nthreads) NON_NULL(4);
+
+/**
+ * Same as jdom_parse_array_parallel for the contents of a file.
+ *
+ * @param file The c-string representing the path to parse.
+ * @param flags How the file should be read.  The array refers to the contents of the file directly, which stay
+ *              in memory for as long as the array is around.
+ *
+ * @see jdom_parse_array_parallel
+ * @see jdom_parse_file
+ */
+PJSON_API jvalue_ref jdom_parse_file_array_parallel(const char *file, const char *path, JSchemaInfoRef schemaInfo, JFileOptimizationFlags flags, unsigned int nthreads) NON_NULL(1, 3);
+
 /**
  * @see jparse_stream.c for an example of how the library uses it to implement the dom_parse functionality.
  */
@@ -25,7 +25,107 @@ LICENSE@@@ */
 #ifndef JPARSE_TYPES_H_
 #define JPARSE_TYPES_H_
 
+#include "jtypes.h"
 #include "jdom_types.h"
 #include "jsax_types.h"
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Additional checks the parser can perform on the input on top of the JSON grammar & the schema.
+ * These are independent of the ::JDOMOptimization hints & apply equally to SAX & DOM parsing.
+ */
+typedef enum {
+	/**
+	 * Default behaviour - accept whatever bytes are found within strings (as long as they aren't control characters).
+	 */
+	JPARSE_OPT_NONE = 0,
+	/**
+	 * Reject the input if any string or object key is not well-formed UTF-8 (overlong encodings, surrogates,
+	 * code points beyond U+10FFFF & truncated sequences are all rejected).  The failure is reported through
+	 * JErrorCallbacks::m_parser.
+	 */
+	JPARSE_OPT_VALIDATE_UTF8 = 1,
+} JParseOption;
+
+/**
+ * Convenience type representing a bit-wise combination of ::JParseOption values.
+ */
+typedef unsigned int JParseOptionFlags;
+
+/**
+ * Opaque handle to a parser that can be re-used across many documents.  The lexer, its buffers & the
+ * validation & DOM-building state are allocated once and reset between documents rather than being set up
+ * & torn down on every parse.
+ *
+ * A parser may only be used for one document at a time (i.e. it cannot be used from within its own callbacks
+ * or by multiple threads simultaneously without external locking).
+ *
+ * @see jparser_create
+ * @see jdom_parse_with_parser
+ * @see jsax_parse_with_parser
+ */
+typedef struct jparser* jparser_ref;
+
+/**
+ * Invoked by jdom_parse_multi for every document found in the input.
+ *
+ * @param ctxt The context pointer given to jdom_parse_multi.
+ * @param dom The document - ownership is transferred to the callback.  If the document could not be parsed or
+ *            was rejected by the schema, this is a JSON null (use jis_null).
+ * @return True to carry on with the next document, false to stop.
+ */
+typedef bool (*jdom_multi_callback)(void *ctxt, jvalue_ref dom);
+
+/**
+ * Invoked by jsax_parse_multi after every document found in the input.
+ *
+ * @param ctxt The SAX context as it was at the end of the document (see jsax_changeContext).
+ * @param parsedOK Whether or not the document was parsed successfully & accepted by the schema.
+ * @return True to carry on with the next document, false to stop.
+ */
+typedef bool (*jsax_multi_callback)(void *ctxt, bool parsedOK);
+
+/**
+ * Supplies input a chunk at a time (e.g. from a socket).
+ *
+ * @param ctxt The context handed over along with the reader.
+ * @param buffer Where to store the next chunk.
+ * @param size How many bytes fit into buffer.
+ * @return The number of bytes stored, 0 at the end of the input or -1 if it couldn't be read.
+ *
+ * @see jsax_parse_reader
+ * @see jdom_parse_reader
+ */
+typedef ssize_t (*jinput_reader)(void *ctxt, char *buffer, size_t size);
+
+/**
+ * How documents parsed by several threads at once are handed over.
+ *
+ * @see jparse_parallel_ndjson
+ */
+typedef enum {
+	/**
+	 * Documents are delivered as soon as they have been parsed, i.e. in no particular order.
+	 */
+	JPARALLEL_OPT_NONE = 0,
+	/**
+	 * Documents are delivered in the order they appear in the input.  Documents parsed ahead of time are held
+	 * until those before them have been delivered.
+	 */
+	JPARALLEL_OPT_ORDERED = 1,
+} JParallelOption;
+
+/**
+ * Convenience type representing a bit-wise combination of ::JParallelOption values.
+ */
+typedef unsigned int JParallelOptionFlags;
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* JPARSE_TYPES_H_ */
@@ -44,8 +44,9 @@ PJSON_API jschema_ref jschema_all();
  * Returns some kind of copy of the schema.  Since schemas are immutable in the sense of being independant of state
  * it is likely this is a reference-counted structure.
  *
- * Schemas may still be modified as external references are resolved dynamically as they are encountered during validation.
- * Thus, this does not necessarily return a copy safe to use across threads.
+ * Schemas may still be modified as external references are resolved dynamically as they are encountered during validation
+ * (the resolved schemas are cached & shared by all copies).  Thus, this does not necessarily return a copy safe to use
+ * across threads unless jschema_resolve_all succeeded on it first.
  *
  * @param schema The schema to retain ownership over.
  * @return A reference to the copy (may simply return schema or another object).  In other words, the implementation
@@ -53,7 +54,7 @@ PJSON_API jschema_ref jschema_all();
  *         counting.
  *
  * @see jschema_duplicate
- * @see jschema_resolve
+ * @see jschema_resolve_all
  */
 PJSON_API jschema_ref jschema_copy(jschema_ref schema) NON_NULL(1);
 
@@ -67,20 +68,30 @@ PJSON_API jschema_ref jschema_copy(jschema_ref schema) NON_NULL(1);
  */
 PJSON_API jschema_ref jschema_duplicate(jschema_ref schema) NON_NULL(1);
 
-#if 0
 /**
- * Resolves any and all external references.  This is an expensive operation and you should consider carefully
- * whether or not you need it.  After a successful call to this method, the schema is guaranteed to be
- * immutable & thus the same reference will be thread-safe.
+ * Compiles the schema into the form the validator uses up-front instead of piecemeal as documents are validated
+ * against it.  Calling this is optional - the parts of the schema a document reaches are compiled on first use either way.
  *
- * @NOTE: For now, this API is unexposed - please discuss with the maintainer about exposing.
+ * Parts of the schema behind an external reference ($ref) can't be compiled before the reference is resolved & are
+ * still compiled the first time validation reaches them (using the resolver given for that validation).
+ *
+ * @param schema The schema to compile.
+ * @return False if the schema (as far as it could be compiled) is invalid.
+ */
+PJSON_API bool jschema_compile(jschema_ref schema) NON_NULL(1);
+
+/**
+ * Resolves any and all external references & compiles the whole schema.  Each distinct reference is handed to the
+ * resolver once - what it resolves to is cached with the schema (as it is when references are resolved during
+ * validation) so this assumes the resolver always gives the same answer for the same reference.
+ *
+ * After a successful call, validating against the schema never calls a resolver (or touches the filesystem) again.
  *
  * @param schema The schema to resolve.
- * @return True if the schema resolved fully, false if some error occured.
- *         If some error occurred, you will typically want to remember to free the reference before-hand.
+ * @param resolver The resolver to use for external references.  NULL fails on any external reference.
+ * @return True if the schema resolved fully, false if some reference couldn't be resolved or the schema is invalid.
  */
-PJSON_API bool jschema_resolve(jschema_ref schema) NON_NULL(1);
-#endif
+PJSON_API bool jschema_resolve_all(jschema_ref schema, JSchemaResolverRef resolver) NON_NULL(1);
 
 /**
  * NOTE: you should only release those schema you parsed or are sure that you have gotten ownership over.
@@ -150,6 +161,29 @@ PJSON_API jschema_ref jschema_parse(raw_buffer input, JSchemaOptimizationFlags i
  */
 PJSON_API void jschema_info_init(JSchemaInfoRef schemaInfo, jschema_ref schema, JSchemaResolverRef resolver, JErrorCallbacksRef errHandler);
 
+/**
+ * Validate a DOM against a schema directly (rather than generating it & parsing the result).  The DOM is walked
+ * in the same order that jvalue_tostring would generate it & every value is checked exactly as the parser would
+ * check it, numbers included (ones that aren't raw are checked the way they'd be generated).
+ *
+ * Like jdom_parse, properties that are missing but have a default in the schema are added to the objects they
+ * are missing from.  The error handlers in schemaInfo are invoked for every failure & may ask for the walk
+ * to continue.
+ *
+ * @param val The DOM to validate
+ * @param schemaInfo The schema to validate against, along with any other callbacks necessary (such as schema
+ *                   resolver, error handler).
+ * @param failure Optional.  Filled in with what failed & where.  If it's given it must eventually be cleared
+ *                with jvalidation_failure_clear (whether or not validation succeeded).
+ * @return True if the DOM is valid, false otherwise.
+ */
+PJSON_API bool jvalue_validate(jvalue_ref val, JSchemaInfoRef schemaInfo, JValidationFailure *failure) NON_NULL(1, 2);
+
+/**
+ * Release what jvalue_validate filled in.  The structure can be re-used afterwards.
+ */
+PJSON_API void jvalidation_failure_clear(JValidationFailure *failure) NON_NULL(1);
+
 #ifdef __cplusplus
 }
 #endif
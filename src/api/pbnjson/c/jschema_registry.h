@@ -0,0 +1,126 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef J_SCHEMA_REGISTRY_H_
+#define J_SCHEMA_REGISTRY_H_
+
+#include "japi.h"
+#include "jschema_types.h"
+#include "compiler/nonnull_attribute.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A set of schema files that are parsed once & shared.
+ *
+ * Every schema in the registry is fully resolved & compiled when it is loaded, so the schemas handed out may be
+ * used from any number of threads at once.  Each call that hands out a schema returns a new reference that the
+ * caller releases with jschema_release - the schema stays valid for as long as that reference is held, even if
+ * the registry reloads the file or is released in the meantime.
+ *
+ * External references ($ref) are resolved against the registry itself: a reference names a registered schema
+ * either by its path or by its file name without the extension (i.e. "Contact" for /schemas/Contact.schema).
+ * The schemas a file refers to need to be registered before (or along with) the file.
+ *
+ * All of the functions may be called from several threads at once.  Looking schemas up never waits for
+ * files to be loaded or parsed.
+ */
+typedef struct jschema_registry* jschema_registry_ref;
+
+/**
+ * @return A new, empty registry or NULL if out of memory.
+ */
+PJSON_API jschema_registry_ref jschema_registry_create(void);
+
+/**
+ * Release the registry.  The schemas handed out by it remain valid until they are released.
+ *
+ * @param registry The registry to release.
+ */
+PJSON_API void jschema_registry_release(jschema_registry_ref *registry) NON_NULL(1);
+
+/**
+ * Register every schema file (*.schema & *.json) in a directory.  The files are parsed & compiled on several
+ * threads at once.
+ *
+ * Files that are already registered (by path) are skipped.  Files whose contents are identical to a registered
+ * schema share that schema.  Files that fail to parse or to resolve are logged & skipped.
+ *
+ * @param registry The registry to add the schemas to.
+ * @param dir The directory to load the schemas from (not recursive).
+ * @param nthreads The number of threads to parse with (including the calling thread).  0 picks one per CPU.
+ * @return The number of schemas newly registered or -1 if the directory couldn't be read.
+ */
+PJSON_API int jschema_registry_load_dir(jschema_registry_ref registry, const char *dir, unsigned int nthreads) NON_NULL(1, 2);
+
+/**
+ * Get the schema for a file, registering it first if it isn't yet.
+ *
+ * @param registry The registry to look the schema up in.
+ * @param path The path of the schema file.
+ * @return A reference to the schema (release it with jschema_release) or NULL if the file couldn't be loaded.
+ */
+PJSON_API jschema_ref jschema_registry_load(jschema_registry_ref registry, const char *path) NON_NULL(1, 2);
+
+/**
+ * Look up a registered schema.  This never touches the filesystem unless key isn't registered under the
+ * path as given (i.e. a relative path to a registered file).
+ *
+ * @param registry The registry to look the schema up in.
+ * @param key The path of the schema file or its name (the file name without the extension).
+ * @return A reference to the schema (release it with jschema_release) or NULL if no such schema is registered.
+ */
+PJSON_API jschema_ref jschema_registry_get(jschema_registry_ref registry, const char *key) NON_NULL(1, 2);
+
+/**
+ * Re-read a registered schema file & swap in the new version if the contents changed.  Lookups that happen
+ * while the file is reloaded get the old version, those afterwards get the new one.  Anyone still holding
+ * the old version keeps using it until they release it.
+ *
+ * Registered schemas that refer to the reloaded one (directly or through others) are rebuilt along with it so
+ * that they pick up the new version.  One that fails to rebuild (e.g. because its file became invalid in the
+ * meantime) keeps its old version.
+ *
+ * @param registry The registry the file is registered with.
+ * @param path The path of the schema file.
+ * @return False if the file isn't registered or the new contents aren't a valid schema (in which case the
+ *         old version stays registered).
+ */
+PJSON_API bool jschema_registry_reload(jschema_registry_ref registry, const char *path) NON_NULL(1, 2);
+
+/**
+ * Reload every registered file whose modification time or size changed since it was (re)loaded.
+ *
+ * @param registry The registry to refresh.
+ * @return The number of schemas that were reloaded, including the ones rebuilt because a schema they refer to
+ *         changed.
+ *
+ * @see jschema_registry_reload
+ */
+PJSON_API int jschema_registry_refresh(jschema_registry_ref registry) NON_NULL(1);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* J_SCHEMA_REGISTRY_H_ */
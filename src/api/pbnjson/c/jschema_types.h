@@ -79,6 +79,33 @@ typedef struct JSchemaInfo {
 	void *m_padding[2]; /// Padding for future binary compatibility
 } JSchemaInfo, *JSchemaInfoRef;
 
+/**
+ * Which check a DOM failed (see jvalue_validate).
+ */
+typedef enum {
+	JVALIDATION_OK = 0, /// nothing failed
+	JVALIDATION_VALUE, /// the value isn't allowed where it is (its type, range, length, pattern, enumeration, ...)
+	JVALIDATION_KEY, /// the object doesn't allow a property with this key
+	JVALIDATION_OBJECT, /// the object is missing a property (that has no default) or one that another property requires
+	JVALIDATION_ARRAY, /// the array has too few or too many items
+	JVALIDATION_ERROR, /// the schema couldn't be used at all (the reason is logged)
+} JValidationCheck;
+
+typedef struct JValidationFailure {
+	JValidationCheck m_check;
+	/**
+	 * The value that failed (for JVALIDATION_KEY the value under the key).  Not referenced - it's only valid for as
+	 * long as the DOM it belongs to.
+	 */
+	jvalue_ref m_value;
+	/**
+	 * Where m_value is within the DOM as a JSON pointer (RFC 6901, e.g. "/items/3/name").  The top-level value is "".
+	 * NULL if nothing failed (or there wasn't enough memory to describe where).  Released by
+	 * jvalidation_failure_clear.
+	 */
+	char *m_path;
+} JValidationFailure;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,75 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JSNAPSHOT_H_
+#define JSNAPSHOT_H_
+
+#include <stdbool.h>
+#include "japi.h"
+#include "jobject.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Save a JSON value as a snapshot - a binary image of the DOM that jvalue_open_snapshot can use in place without
+ * any parsing.  Containers refer to their members by offset, so the file can be mapped anywhere, & the members of
+ * every object are sorted by key so they can be looked up with a binary search.
+ *
+ * The file is written next to path & renamed over it once complete, so processes that still have the previous
+ * snapshot open keep a consistent view of it.
+ *
+ * NOTE: Snapshots are in the byte order of the machine that saved them & can only be opened on machines that
+ *       share it.
+ *
+ * @param val The value to save.
+ * @param path Where to save it.
+ * @return True if the snapshot was written, false otherwise (the reason is logged).
+ *
+ * @see jvalue_open_snapshot
+ */
+PJSON_API bool jvalue_save_snapshot(jvalue_ref val, const char *path) NON_NULL(2);
+
+/**
+ * Open a snapshot saved with jvalue_save_snapshot.  The file is mapped read-only, so its pages are shared by
+ * every process that has it open, & the DOM returned is a view of it: members of arrays & objects are only turned
+ * into values the first time they are accessed (object keys are found with a binary search) & strings point
+ * straight into the mapping.
+ *
+ * The DOM is read-only - any attempt to modify it fails.
+ *
+ * NOTE: Like the DOM from jdom_parse_file with JFileOptMMap, the mapping is released along with the returned
+ *       value, so values within it must not be used once it has been released.
+ * NOTE: Members are created on access, so a snapshot must not be read from several threads at once without
+ *       locking (just like any other DOM).
+ *
+ * @param path The snapshot to open.
+ * @return An opaque reference handle to the DOM.  Use jis_null to determine whether or
+ *         not the snapshot could be opened.
+ *
+ * @see jvalue_save_snapshot
+ * @see jdom_parse_file
+ */
+PJSON_API jvalue_ref jvalue_open_snapshot(const char *path) NON_NULL(1);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSNAPSHOT_H_ */
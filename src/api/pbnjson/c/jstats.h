@@ -0,0 +1,110 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JSTATS_H_
+#define JSTATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "japi.h"
+#include "compiler/nonnull_attribute.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The kinds of JSON values allocations are counted for (JSON null is never allocated).
+ */
+typedef enum {
+	JSTATS_BOOLEAN = 0,
+	JSTATS_NUMBER,
+	JSTATS_STRING,
+	JSTATS_ARRAY,
+	JSTATS_OBJECT,
+	JSTATS_NUM_TYPES,
+} JStatsType;
+
+/**
+ * What made a value fail validation.  Keywords that are checked together share a category.
+ */
+typedef enum {
+	JSTATS_FAIL_TYPE = 0, /// type/disallow (including a number where an integer is expected)
+	JSTATS_FAIL_ENUM,
+	JSTATS_FAIL_LENGTH, /// minLength/maxLength
+	JSTATS_FAIL_PATTERN,
+	JSTATS_FAIL_RANGE, /// minimum/maximum
+	JSTATS_FAIL_ITEMS, /// minItems/maxItems/additionalItems
+	JSTATS_FAIL_PROPERTIES, /// additionalProperties
+	JSTATS_FAIL_REQUIRED, /// a property that isn't optional (& has no default) or that another one depends on is missing
+	JSTATS_FAIL_SCHEMA, /// the schema couldn't be used (e.g. a reference couldn't be resolved)
+	JSTATS_NUM_FAILS,
+} JStatsFailure;
+
+typedef struct jstats_allocation {
+	uint64_t m_nodes; /// values created
+	uint64_t m_bytes; /// memory allocated for them (including what they hold, e.g. the contents of strings)
+} jstats_allocation;
+
+/**
+ * Counters of the work pbnjson has done since statistics were enabled (or last reset).
+ */
+typedef struct jstats {
+	uint64_t m_documentsParsed; /// documents parsed (JSON text or CBOR), whether or not they were valid
+	uint64_t m_parseFailures; /// documents that failed to parse or validate
+	uint64_t m_bytesParsed;
+	jstats_allocation m_allocations[JSTATS_NUM_TYPES]; /// indexed by JStatsType
+	uint64_t m_hashProbes; /// bucket tables looked at to find or insert an object key
+	uint64_t m_schemaStates; /// validation states pushed (one for every value validated against a schema)
+	uint64_t m_resolverCalls; /// external schema references handed to a resolver
+	uint64_t m_validationFailures[JSTATS_NUM_FAILS]; /// indexed by JStatsFailure
+	uint64_t m_parseTime; /// nanoseconds spent parsing (including validation during the parse)
+	uint64_t m_validateTime; /// nanoseconds spent validating DOMs (jvalue_validate)
+	uint64_t m_generateTime; /// nanoseconds spent serializing DOMs (jvalue_tostring, jvalue_to_cbor)
+} jstats;
+
+/**
+ * Turn collecting statistics on or off.  They're off by default & cost no more than a test of a flag while off.
+ * While on, every thread counts into counters of its own, so collecting them needs no locking.
+ *
+ * Counters keep their values while collection is off.
+ *
+ * @see jstats_snapshot
+ */
+PJSON_API void jstats_enable(bool enable);
+
+/**
+ * Add up the counters of every thread (including threads that have exited since).
+ *
+ * NOTE: The counters of threads that are still running are read while they may be updated, so the snapshot is only
+ *       a close approximation of a single point in time.
+ *
+ * @param stats Where to store the totals.
+ */
+PJSON_API void jstats_snapshot(jstats *stats) NON_NULL(1);
+
+/**
+ * Set every counter back to 0.  Threads that are counting at the same time may lose some of their updates.
+ */
+PJSON_API void jstats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSTATS_H_ */
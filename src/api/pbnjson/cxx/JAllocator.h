@@ -0,0 +1,131 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JALLOCATOR_CXX_H_
+#define JALLOCATOR_CXX_H_
+
+#include "../c/jallocator.h"
+#include <stddef.h>
+#include <string.h>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+namespace pbnjson {
+
+/**
+ * Hands pbnjson memory from a C++ memory resource - anything with the allocate/deallocate members of
+ * std::pmr::memory_resource:
+ *
+ * @code
+ * void* allocate(size_t bytes, size_t alignment);
+ * void deallocate(void *p, size_t bytes, size_t alignment);
+ * @endcode
+ *
+ * The resource is told the size of what's released, which a JAllocator isn't, so every block is prefixed by
+ * its size.  The adapter & the resource have to outlive everything allocated through them.
+ *
+ * @code
+ * std::pmr::monotonic_buffer_resource arena;
+ * pbnjson::JMemoryResourceAllocator allocator(&arena);
+ * parser.setAllocator(allocator.get());
+ * @endcode
+ */
+template <class Resource>
+class JAllocatorAdapter
+{
+public:
+	explicit JAllocatorAdapter(Resource *resource)
+		: m_resource(resource)
+	{
+		m_allocator.m_malloc = allocate;
+		m_allocator.m_realloc = reallocate;
+		m_allocator.m_free = deallocate;
+		m_allocator.m_ctxt = this;
+	}
+
+	/**
+	 * @return The allocator to hand to jallocator_set_default, jparser_set_allocator or JDomParser::setAllocator.
+	 */
+	JAllocatorRef get() const { return &m_allocator; }
+
+	Resource* resource() const { return m_resource; }
+
+private:
+	/// the size prefix - big enough to keep the memory after it aligned for anything
+	union Header {
+		size_t m_size;
+		long double m_alignLongDouble;
+		long long m_alignLongLong;
+		void *m_alignPointer;
+	};
+
+	static const size_t ALIGNMENT = sizeof(Header);
+
+	static void* allocate(void *ctxt, size_t size)
+	{
+		JAllocatorAdapter *adapter = static_cast<JAllocatorAdapter *>(ctxt);
+		if (size > (size_t)-1 - sizeof(Header))
+			return NULL;
+		Header *header;
+		try {
+			header = static_cast<Header *>(adapter->m_resource->allocate(sizeof(Header) + size, ALIGNMENT));
+		} catch (...) {
+			return NULL;
+		}
+		if (header == NULL)
+			return NULL;
+		header->m_size = size;
+		return header + 1;
+	}
+
+	static void* reallocate(void *ctxt, void *ptr, size_t size)
+	{
+		if (ptr == NULL)
+			return allocate(ctxt, size);
+
+		size_t oldSize = (static_cast<Header *>(ptr) - 1)->m_size;
+		void *grown = allocate(ctxt, size);
+		if (grown == NULL)
+			return NULL;
+		memcpy(grown, ptr, oldSize < size ? oldSize : size);
+		deallocate(ctxt, ptr);
+		return grown;
+	}
+
+	static void deallocate(void *ctxt, void *ptr)
+	{
+		JAllocatorAdapter *adapter = static_cast<JAllocatorAdapter *>(ctxt);
+		Header *header = static_cast<Header *>(ptr) - 1;
+		adapter->m_resource->deallocate(header, sizeof(Header) + header->m_size, ALIGNMENT);
+	}
+
+	Resource *m_resource;
+	JAllocator m_allocator;
+
+	JAllocatorAdapter(const JAllocatorAdapter &other); // not implemented - m_ctxt points at the adapter
+	JAllocatorAdapter& operator=(const JAllocatorAdapter &other); // not implemented
+};
+
+#if __cplusplus >= 201703L
+typedef JAllocatorAdapter<std::pmr::memory_resource> JMemoryResourceAllocator;
+#endif
+
+}
+
+#endif /* JALLOCATOR_CXX_H_ */
@@ -0,0 +1,195 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JBINDING_H_
+#define JBINDING_H_
+
+#include "japi.h"
+#include "JParser.h"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace pbnjson {
+
+struct JBindingType;
+
+/**
+ * A property of a bound object.  The accessors take the address of the C++ object & return the address of
+ * the member the property is stored in.
+ */
+struct JBindingMember {
+	const char *m_key;
+	size_t m_keyLen;
+	const JBindingType *m_type;
+	void* (*m_value)(void *object);
+	bool* (*m_present)(void *object);	/// the flag set when an optional property is seen (NULL if it's required)
+};
+
+/**
+ * Describes how a JSON value is stored in C++.  pbnjson_bindgen generates these tables for the structs it generates
+ * from a schema - there is little reason to write them by hand.
+ *
+ * @see JBindingParser
+ * @see JBindingGenerator
+ */
+struct JBindingType {
+	enum Kind {
+		BIND_STRING,	/// std::string
+		BIND_INTEGER,	/// int64_t
+		BIND_NUMBER,	/// double
+		BIND_BOOLEAN,	/// bool
+		BIND_OBJECT,	/// a struct, one member per property
+		BIND_ARRAY,	/// std::vector
+	};
+
+	Kind m_kind;
+
+	/// objects: the bound properties, sorted by key
+	const JBindingMember *m_members;
+	size_t m_memberCount;
+
+	/// arrays: the type of the elements & how to grow & walk the container
+	const JBindingType *m_items;
+	void* (*m_append)(void *array);
+	size_t (*m_size)(const void *array);
+	void* (*m_at)(void *array, size_t index);
+};
+
+extern PJSONCXX_API const JBindingType JBindingString;
+extern PJSONCXX_API const JBindingType JBindingInteger;
+extern PJSONCXX_API const JBindingType JBindingNumber;
+extern PJSONCXX_API const JBindingType JBindingBoolean;
+
+/**
+ * The container accessors of a BIND_ARRAY type stored as a std::vector<T>.
+ */
+template <class T>
+struct JBindingVector {
+	static void* append(void *array)
+	{
+		std::vector<T> &elements = *static_cast<std::vector<T> *>(array);
+		elements.push_back(T());
+		return &elements.back();
+	}
+
+	static size_t size(const void *array)
+	{
+		return static_cast<const std::vector<T> *>(array)->size();
+	}
+
+	static void* at(void *array, size_t index)
+	{
+		return &(*static_cast<std::vector<T> *>(array))[index];
+	}
+};
+
+/**
+ * Parses straight into C++ objects described by a JBindingType - no DOM is built.  The input is validated
+ * against the schema as it's parsed (just like any other JParser), so by the time a value reaches its member it's
+ * known to be valid; defaults the schema specifies for missing properties are stored like any other value.
+ *
+ * Properties that aren't bound (e.g. additional properties) are validated but otherwise skipped.
+ *
+ * If parsing fails, the target is left partially filled.
+ */
+class PJSONCXX_API JBindingParser : public JParser
+{
+public:
+	/**
+	 * @param type The layout of the top-level value (an object or an array, like any JSON document)
+	 * @param target The object to fill
+	 * @param resolver Resolves external references in the schema parsed with
+	 */
+	JBindingParser(const JBindingType &type, void *target, JResolver *resolver = NULL);
+	JBindingParser(const JBindingParser &other);
+	virtual ~JBindingParser();
+
+	using JParser::parse;
+
+	/**
+	 * Parse the input into the target (see JParser::parse).  The parser can be used again afterwards; it
+	 * fills the same target each time.
+	 */
+	bool parse(const std::string& input, const JSchema &schema, JErrorHandler *errors = NULL);
+
+	/**
+	 * Parse input read a chunk at a time into the target (see JParser::parse(JInputReader&, const JSchema&,
+	 * JErrorHandler*)).  The std::istream & file descriptor variants of JParser end up here as well.
+	 */
+	bool parse(JInputReader& input, const JSchema &schema, JErrorHandler *errors = NULL);
+
+protected:
+	bool jsonObjectOpen();
+	bool jsonObjectKeyView(JStringView key);
+	bool jsonObjectClose();
+	bool jsonArrayOpen();
+	bool jsonArrayClose();
+	bool jsonStringView(JStringView s);
+	bool jsonNumber(const std::string& n);
+	bool jsonNumber(int64_t number);
+	bool jsonNumber(double &number, ConversionResultFlags asFloat);
+	bool jsonBoolean(bool truth);
+	bool jsonNull();
+
+	NumberType conversionToUse() const { return JParser::JNUM_CONV_NATIVE; }
+
+private:
+	enum Slot {
+		SLOT_ERROR,	/// the value doesn't fit where it's to be stored
+		SLOT_SKIP,	/// the value isn't bound
+		SLOT_BOUND,
+	};
+
+	/// an object or array being filled
+	struct Frame {
+		const JBindingType *m_type;
+		void *m_value;
+	};
+
+	void reset();
+	Slot nextSlot(JBindingType::Kind kind, void **value, const JBindingType **type);
+	bool open(JBindingType::Kind kind);
+	bool close();
+
+	const JBindingType *m_type;
+	void *m_target;
+	std::vector<Frame> m_frames;
+	const JBindingMember *m_member;	/// where the value of the last key goes (NULL if the key isn't bound)
+	size_t m_skipDepth;	/// how many unbound objects/arrays are open
+	bool m_started;
+};
+
+/**
+ * Serializes C++ objects described by a JBindingType through jstream.
+ */
+class PJSONCXX_API JBindingGenerator
+{
+public:
+	/**
+	 * @param type The layout of value
+	 * @param value The object to serialize
+	 * @param asStr Where to write the JSON
+	 * @return False if the JSON couldn't be generated (asStr is emptied).
+	 */
+	static bool toString(const JBindingType &type, const void *value, std::string &asStr);
+};
+
+}
+
+#endif /* JBINDING_H_ */
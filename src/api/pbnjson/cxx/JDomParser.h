@@ -28,6 +28,11 @@ LICENSE@@@ */
 #include "JParser.h"
 #include "JValue.h"
 #include "../c/jparse_types.h"
+#include "../c/jallocator.h"
+
+#if __cplusplus >= 201103L
+#include <memory>
+#endif
 
 namespace pbnjson {
 
@@ -51,6 +56,11 @@ public:
  	 * @see JResolver
  	 */
 	JDomParser(JResolver *resolver = NULL);
+
+	/**
+	 * The copy gets its own underlying parser state - only the configuration is shared.
+	 */
+	JDomParser(const JDomParser& other);
 	virtual ~JDomParser();
 
 	/**
@@ -63,6 +73,18 @@ public:
 	 */
 	void changeOptimization(JDOMOptimization optLevel) { m_optimization = optLevel; }
 
+	/**
+	 * Allocate the DOMs parsed from now on from allocator instead of the default allocator.  It has to
+	 * outlive them (see jparser_set_allocator).
+	 *
+	 * @param allocator The allocator to use (NULL for the default one).
+	 *
+	 * @see JAllocatorAdapter
+	 */
+	void setAllocator(JAllocatorRef allocator) { m_allocator = allocator; }
+
+	using JParser::parse;
+
 	/**
 	 * Parse the input using the given schema.
 	 *
@@ -78,6 +100,74 @@ public:
 	 */
 	bool parse(const std::string& input, const JSchema& schema, JErrorHandler *errors = NULL);
 
+	/**
+	 * Same as parse for input that isn't held in a std::string.  Whether the DOM refers to the input directly
+	 * depends on the optimization level (see changeOptimization) - with DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE, input
+	 * must stay around & unchanged until the DOM is gone.
+	 *
+	 * @param input The JSON text (need not be null-terminated).
+	 * @param length The number of bytes of input.
+	 *
+	 * @see parse(const std::string&, const JSchema&, JErrorHandler*)
+	 */
+	bool parse(const char *input, size_t length, const JSchema& schema, JErrorHandler *errors = NULL);
+
+	/**
+	 * Parse input without copying any of it - the strings & numbers of the DOM refer to the input directly
+	 * (DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE, whatever the optimization level is).  The DOM keeps the input alive
+	 * through owner, so there is no lifetime for the caller to manage.
+	 *
+	 * NOTE: Just like the contents of a file parsed with parseFile, the input is released along with the DOM
+	 *       itself.  Values taken out of the DOM that should outlive it have to be duplicated (see jvalue_duplicate).
+	 *
+	 * @param input The JSON text (need not be null-terminated).  It mustn't change while owner is held.
+	 * @param length The number of bytes of input.
+	 * @param release Invoked with owner once the DOM is gone (or right away if parsing fails).
+	 * @param owner Whatever keeps input alive (e.g. a reference to a reference counted buffer).
+	 *
+	 * @see jdom_adopt_input
+	 */
+	bool parse(const char *input, size_t length, jdeallocator release, void *owner, const JSchema& schema, JErrorHandler *errors = NULL);
+
+#if __cplusplus >= 201103L
+	/**
+	 * Parse input in place - the DOM takes over its buffer instead of copying out of it.
+	 *
+	 * @param input The JSON text (left empty).
+	 *
+	 * @see parse(const char*, size_t, jdeallocator, void*, const JSchema&, JErrorHandler*)
+	 */
+	bool parse(std::string&& input, const JSchema& schema, JErrorHandler *errors = NULL)
+	{
+		std::string *owner = new std::string(std::move(input));
+		return parse(owner->data(), owner->size(), releaseString, owner, schema, errors);
+	}
+
+	/**
+	 * Parse a shared buffer in place - the DOM holds a reference to it for as long as it's around.
+	 *
+	 * @param input The JSON text.  It mustn't change while the DOM is around.
+	 *
+	 * @see parse(const char*, size_t, jdeallocator, void*, const JSchema&, JErrorHandler*)
+	 */
+	bool parse(const std::shared_ptr<const std::string>& input, const JSchema& schema, JErrorHandler *errors = NULL)
+	{
+		std::shared_ptr<const std::string> *owner = new std::shared_ptr<const std::string>(input);
+		return parse(input->data(), input->size(), releaseShared, owner, schema, errors);
+	}
+#endif
+
+	/**
+	 * Same as parse for input read a chunk at a time - the DOM holds copies of the strings & numbers, so none of
+	 * the input has to be kept around (see JParser::parse(JInputReader&, const JSchema&, JErrorHandler*)).  The
+	 * std::istream & file descriptor variants of JParser build a DOM through this as well.
+	 *
+	 * @param input Supplies the JSON text.
+	 *
+	 * @see jdom_parse_reader
+	 */
+	bool parse(JInputReader& input, const JSchema& schema, JErrorHandler *errors = NULL);
+
 	/**
 	 * Parse the input file using the given schema.
 	 * @param file The JSON string to parse.  Must be a JSON object or an array.  Behaviour is undefined
@@ -107,6 +197,19 @@ protected:
 	JParser::NumberType conversionToUse() const { return JParser::JNUM_CONV_RAW; }
 
 private:
+#if __cplusplus >= 201103L
+	static void releaseString(void *owner)
+	{
+		delete static_cast<std::string *>(owner);
+	}
+
+	static void releaseShared(void *owner)
+	{
+		delete static_cast<std::shared_ptr<const std::string> *>(owner);
+	}
+#endif
+
+	bool parseInput(raw_buffer input, JDOMOptimizationFlags optimization, const JSchema& schema, JErrorHandler *errors);
 	JSchemaInfo prepare(const JSchema& schema, const JSchemaResolver& resolver, const JErrorCallbacks& cErrCbs, JErrorHandler *errors);
 	inline JSchemaResolver prepareResolver() const;
 	inline JErrorCallbacks prepareCErrorCallbacks() const;
@@ -118,6 +221,14 @@ private:
 	JValue m_dom;
 	JDOMOptimization m_optimization;
 	JResolver *m_resolver;
+	/**
+	 * Lazily created & re-used by every call to parse so that the set-up cost is only paid once
+	 * per JDomParser instead of once per document.
+	 */
+	jparser_ref m_parser;
+	JAllocatorRef m_allocator;
+
+	JDomParser& operator=(const JDomParser& other); // not implemented
 
 	friend JSchemaResolutionResult dom_bounce_resolver(JSchemaResolverRef, jschema_ref *);
 };
@@ -21,8 +21,13 @@ LICENSE@@@ */
 
 #include "japi.h"
 
+#include <iosfwd>
 #include <stack>
 #include <string>
+#include <sys/types.h>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 #include "JSchema.h"
 
@@ -34,6 +39,53 @@ class JErrorHandler;
 class JSchema;
 class JResolver;
 
+/**
+ * A key, string or raw number straight out of the parser's buffers - nothing is copied, so it's only valid until the
+ * callback it's passed to returns.  Copy it (str()) to keep it.
+ */
+class JStringView
+{
+public:
+	JStringView(const char *data, size_t size) : m_data(data), m_size(size) {}
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	std::string str() const { return std::string(m_data, m_size); }
+
+	bool operator==(const std::string& other) const { return other.compare(0, std::string::npos, m_data, m_size) == 0; }
+	bool operator!=(const std::string& other) const { return !(*this == other); }
+
+#if __cplusplus >= 201703L
+	operator std::string_view() const { return std::string_view(m_data, m_size); }
+#endif
+
+private:
+	const char *m_data;
+	size_t m_size;
+};
+
+/**
+ * Supplies the input of a parser a chunk at a time - implement this to parse straight from wherever the input
+ * comes from (a socket, a decompressor, ...) without assembling it in memory first.
+ *
+ * @see JParser::parse(JInputReader&, const JSchema&, JErrorHandler*)
+ */
+class PJSONCXX_API JInputReader
+{
+public:
+	virtual ~JInputReader() {}
+
+	/**
+	 * Read the next chunk of input.
+	 *
+	 * @param buffer Where to store it.
+	 * @param size How many bytes fit into buffer.
+	 * @return The number of bytes stored, 0 at the end of the input or -1 if it couldn't be read.
+	 */
+	virtual ssize_t read(char *buffer, size_t size) = 0;
+};
+
 extern "C" JSchemaResolutionResult sax_schema_resolver(JSchemaResolverRef resolver, jschema_ref *resolvedSchema);
 
 /**
@@ -75,6 +127,36 @@ public:
 	 */
 	virtual bool parse(const std::string& input, const JSchema &schema, JErrorHandler *errors = NULL);
 
+	/**
+	 * Same as parse for input read a chunk at a time.  Only a bounded window of the input is held in memory at
+	 * once; parsing & validation simply carry on where they left off with every chunk.  Reading stops once the
+	 * document is complete (gzip compressed input is recognized & inflated, in which case it's read to the end).
+	 * Anything read past the end of the document is discarded.
+	 *
+	 * @param input Supplies the JSON text.
+	 *
+	 * @see jsax_parse_reader
+	 */
+	virtual bool parse(JInputReader& input, const JSchema &schema, JErrorHandler *errors = NULL);
+
+	/**
+	 * Same as parse(JInputReader&, const JSchema&, JErrorHandler*) for the contents of a stream.  Each chunk is
+	 * whatever the stream has buffered, so it only waits for as much input as has to arrive anyway.
+	 *
+	 * @param input The stream to read the JSON text from.  Reading failures (badbit) fail the parse.  Whatever
+	 *              the stream had buffered past the end of the document is consumed & lost.
+	 */
+	bool parse(std::istream& input, const JSchema &schema, JErrorHandler *errors = NULL);
+
+	/**
+	 * Same as parse(JInputReader&, const JSchema&, JErrorHandler*) for whatever is read from a file descriptor
+	 * (a pipe or a socket for example).
+	 *
+	 * @param fd The file descriptor to read from.  It's left open, but whatever was read past the end of the
+	 *           document is lost - it's no use for reading anything that follows the document.
+	 */
+	bool parseFd(int fd, const JSchema &schema, JErrorHandler *errors = NULL);
+
 	JErrorHandler* getErrorHandler() const;
 	ParserPosition getPosition() const;
 
@@ -169,6 +251,17 @@ protected:
 	 */
 	virtual bool jsonNull() { return false; }
 
+	/**
+	 * The same as jsonObjectKey, jsonString & jsonNumber(const std::string&) except that the text isn't copied into a
+	 * std::string first - override these instead to parse without allocating anything per key/string/number.  By
+	 * default they call the std::string versions.
+	 *
+	 * @see JStringView
+	 */
+	virtual bool jsonObjectKeyView(JStringView key) { return jsonObjectKey(key.str()); }
+	virtual bool jsonStringView(JStringView s) { return jsonString(s.str()); }
+	virtual bool jsonNumberView(JStringView n) { return jsonNumber(n.str()); }
+
 	/**
 	 * Called when the schema should be resolved.  By default, this does not need to be overridden
 	 * (it invokes the resolver you created this class with).
@@ -198,6 +291,8 @@ protected:
 	JErrorHandler* errorHandlers() const;
 	void setErrorHandlers(JErrorHandler* errors);
 private:
+	bool parseInput(const raw_buffer *input, JInputReader *reader, const JSchema &schema, JErrorHandler *errors);
+
 	std::stack<std::string> m_keyStack;
 	std::stack<DocumentState> m_stateStack;
 	JErrorHandler* m_errors;
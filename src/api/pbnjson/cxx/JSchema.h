@@ -130,6 +130,7 @@ public:
 	friend class JParser;
 	friend class JGenerator;
 	friend class JDomParser;
+	friend class JSchemaRegistry;
 };
 
 }
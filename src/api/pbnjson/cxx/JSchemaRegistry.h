@@ -0,0 +1,105 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JSCHEMA_REGISTRY_CXX_H_
+#define JSCHEMA_REGISTRY_CXX_H_
+
+#include "japi.h"
+#include "JSchema.h"
+#include "../c/jschema_registry.h"
+#include <string>
+
+namespace pbnjson {
+
+/**
+ * Schema files that are parsed, resolved & compiled once and shared, instead of being parsed again every time
+ * a JSchemaFile is constructed.
+ *
+ * Unlike the other schema classes, a registry is thread safe - any number of threads may look schemas up,
+ * load & reload them at once.  The JSchema objects handed out follow the usual rules (don't share one object
+ * between threads), but the schema behind them is shared & may be used from every thread.
+ *
+ * External references within the schemas resolve to other registered schemas by file name (without the
+ * extension) or path.
+ *
+ * @see jschema_registry_ref
+ */
+class PJSONCXX_API JSchemaRegistry
+{
+public:
+	JSchemaRegistry();
+	~JSchemaRegistry();
+
+	/**
+	 * The registry shared by the whole process.
+	 */
+	static JSchemaRegistry& instance();
+
+	/**
+	 * Register every schema file (*.schema & *.json) in a directory, parsing them on several threads.
+	 *
+	 * @param dir The directory to load the schemas from.
+	 * @param threads The number of threads to parse with.  0 picks one per CPU.
+	 * @return The number of schemas newly registered or -1 if the directory couldn't be read.
+	 */
+	int loadDirectory(const std::string &dir, unsigned int threads = 0);
+
+	/**
+	 * Get the schema for a file, registering it first if it isn't yet.
+	 *
+	 * @return The schema (not initialized if the file couldn't be loaded).
+	 *
+	 * @see JSchema::isInitialized
+	 */
+	JSchema load(const std::string &path);
+
+	/**
+	 * Look up a registered schema by its path or its name (the file name without the extension).
+	 *
+	 * @return The schema (not initialized if there is no such schema).
+	 *
+	 * @see JSchema::isInitialized
+	 */
+	JSchema get(const std::string &key) const;
+
+	/**
+	 * Re-read a registered file & swap in the new version.  Schemas handed out before keep the old version.
+	 *
+	 * @return False if the file isn't registered or isn't a valid schema anymore (the old version stays).
+	 */
+	bool reload(const std::string &path);
+
+	/**
+	 * Reload every registered file that changed on disk.
+	 *
+	 * @return The number of schemas reloaded.
+	 */
+	int refresh();
+
+private:
+	JSchemaRegistry(const JSchemaRegistry &other);
+	JSchemaRegistry& operator=(const JSchemaRegistry &other);
+
+	static JSchema wrap(jschema_ref schema);
+
+	jschema_registry_ref m_registry;
+};
+
+}
+
+#endif /* JSCHEMA_REGISTRY_CXX_H_ */
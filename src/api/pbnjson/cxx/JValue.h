@@ -25,6 +25,7 @@ LICENSE@@@ */
 #include "../c/compiler/nonnull_attribute.h"
 #include "../c/jcallbacks.h"
 #include "../c/jtypes.h"
+#include "../c/jobject.h"
 
 #include <iostream>
 #include <string>
@@ -74,6 +75,23 @@ private:
 	{
 		return JNULL;
 	}
+
+#if __cplusplus >= 201103L
+	static void releaseAdopted(void *owner)
+	{
+		delete static_cast<std::string *>(owner);
+	}
+
+	static jvalue_ref adopt(std::string *owner)
+	{
+		jvalue_ref adopted = jstring_create_nocopy_owned(j_str_to_buffer(owner->data(), owner->size()), releaseAdopted, owner);
+		if (adopted == NULL) {
+			delete owner;
+			return JNULL.m_jval;
+		}
+		return adopted;
+	}
+#endif
 protected:
 	jvalue_ref peekRaw() const {
 		return m_jval;
@@ -146,6 +164,32 @@ public:
 	 */
 	template <class V>
 	JValue(const V& v);
+
+#if __cplusplus >= 201103L
+	/**
+	 * Take over the JSON value of other (which is left a JSON null) - no reference counts are touched.
+	 *
+	 * @param[in] other
+	 */
+	JValue(JValue&& other)
+		: m_jval(other.m_jval), m_input(std::move(other.m_input))
+#if PBNJSON_ZERO_COPY_STL_STR
+		, m_children(std::move(other.m_children))
+#endif
+	{
+		other.m_jval = JNULL.m_jval;
+	}
+
+	/**
+	 * Construct a JSON string that adopts the contents of value instead of copying them.
+	 *
+	 * @param[in] value The string (left empty)
+	 */
+	JValue(std::string&& value)
+		: m_jval(adopt(new std::string(std::move(value))))
+	{
+	}
+#endif
 	//@}
 	~JValue();
 
@@ -159,6 +203,28 @@ public:
 	 */
 	JValue& operator=(const JValue& other);
 
+#if __cplusplus >= 201103L
+	/**
+	 * Take over the JSON value of other (which is left a JSON null).
+	 *
+	 * @param[in] other The JSON value to move.
+	 * @return The reference to this object.
+	 */
+	JValue& operator=(JValue&& other)
+	{
+		if (this != &other) {
+			j_release(&m_jval);
+			m_jval = other.m_jval;
+			other.m_jval = JNULL.m_jval;
+			m_input = std::move(other.m_input);
+#if PBNJSON_ZERO_COPY_STL_STR
+			m_children = std::move(other.m_children);
+#endif
+		}
+		return *this;
+	}
+#endif
+
 	/**
 	 * Convenience method - negation of what the equality operator would return
 	 *
@@ -357,6 +423,60 @@ public:
 	}
 	//@}
 
+#if __cplusplus >= 201103L
+	//{@
+	/**
+	 * The same as the put overloads taking a const JValue&, except that the value is moved in instead of
+	 * copied - if it's inserted, value is left a JSON null.
+	 */
+	bool put(long i, JValue&& value)
+	{
+		if (i < 0)
+			return false;
+		return put((size_t)i, std::move(value));
+	}
+
+	bool put(int i, JValue&& value)
+	{
+		return put((long)i, std::move(value));
+	}
+
+	bool put(size_t index, JValue&& value)
+	{
+#if PBNJSON_ZERO_COPY_STL_STR
+		return put(index, static_cast<const JValue&>(value));
+#else
+		if (!jarray_put(m_jval, index, value.m_jval))
+			return false;
+		value.m_jval = JNULL.m_jval;
+		return true;
+#endif
+	}
+
+	bool put(const std::string& key, JValue&& value);
+
+	bool put(const JValue& key, JValue&& value)
+	{
+#if PBNJSON_ZERO_COPY_STL_STR
+		return put(key, static_cast<const JValue&>(value));
+#else
+		jvalue_ref keyCopy = jvalue_copy(key.m_jval);
+		if (!jobject_put(m_jval, keyCopy, value.m_jval)) {
+			j_release(&keyCopy);
+			return false;
+		}
+		value.m_jval = JNULL.m_jval;
+		return true;
+#endif
+	}
+
+	bool put(const char *key, JValue&& value)
+	{
+		return put(std::string(key), std::move(value));
+	}
+	//@}
+#endif
+
 	/**
 	 * Convenience method for appending an element to an array.
 	 *
@@ -385,6 +505,38 @@ public:
 	 */
 	bool append(const JValue& value);
 
+#if __cplusplus >= 201103L
+	/**
+	 * The same as the operator<< overloads & append taking a const reference, except that the element/value is
+	 * moved in instead of copied.
+	 */
+	JValue& operator<<(JValue&& element)
+	{
+		if (!append(std::move(element)))
+			return Null();
+		return *this;
+	}
+
+	JValue& operator<<(KeyValue&& pair)
+	{
+		if (!put(pair.first, std::move(pair.second)))
+			return Null();
+		return *this;
+	}
+
+	bool append(JValue&& value)
+	{
+#if PBNJSON_ZERO_COPY_STL_STR
+		return append(static_cast<const JValue&>(value));
+#else
+		if (!jarray_append(m_jval, value.m_jval))
+			return false;
+		value.m_jval = JNULL.m_jval;
+		return true;
+#endif
+	}
+#endif
+
 	/**
 	 * Determines whether or not this JSON value represents a NULL
 	 * @return True if this is a JSON null, false otherwise
@@ -848,6 +1000,13 @@ template<>
 JValue::JValue(const NumericString& value);
 //@}
 
+#if __cplusplus >= 201103L
+inline bool JValue::put(const std::string& key, JValue&& value)
+{
+	return put(JValue(key), std::move(value));
+}
+#endif
+
 /*! \name asNumber template specializations
  * The different explicit specializations of the templatized asNumber
  * @see JValue::asNumber(T&) const
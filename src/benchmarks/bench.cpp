@@ -18,12 +18,19 @@ LICENSE@@@ */
 
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
 #include <boost/program_options.hpp>
 
 #include "bench_yajl.h"
 #include "bench_pbnjson.h"
 #include "bench_mjson.h"
 #include "bench_cjson.h"
+#ifdef HAVE_YAJL
+#include <yajl/yajl_gen.h>
+#endif
 
 #include <pbnjson.h>	// for raw_buffer definition
 
@@ -39,6 +46,7 @@ enum ExitCodes {
 	EXIT_ERRARGS_INPUT,     	/* invalid input file */
 	EXIT_ERRARGS_PARSE_TYPE,	/* invalid parse type for pbnjson library */
 	EXIT_RUN_ERROR,         	/* error running the benchmark */
+	EXIT_ERRARGS_WORKLOAD,  	/* invalid workload or output format */
 	EXIT_NUM_EXITCODES,
 };
 
@@ -54,6 +62,13 @@ enum ExitCodes {
 #define OPT_ENGINES "engines"
 #define OPT_NOOP_CALLBACKS "sax-noop"
 #define OPT_STATISTICS "json-info"
+#define OPT_PARALLEL_SCALING "parallel-scaling"
+#define OPT_ARRAY_PATH "array-path"
+#define OPT_ALLOCATIONS "allocations"
+#define OPT_CBOR "cbor"
+#define OPT_SNAPSHOT "snapshot"
+#define OPT_WORKLOADS "workloads"
+#define OPT_FORMAT "format"
 
 #define ENGINE_YAJL "yajl"
 #define ENGINE_PBNJSON_C "pbnjson_c"
@@ -74,6 +89,635 @@ struct JSONStats {
 	size_t numNulls;
 };
 
+#ifdef __GLIBC__
+extern "C" {
+	void *__libc_malloc(size_t size);
+	void *__libc_calloc(size_t nmemb, size_t size);
+	void *__libc_realloc(void *ptr, size_t size);
+}
+
+// counts every heap allocation made by the process (the library included) for --allocations
+static size_t numAllocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+	__sync_fetch_and_add(&numAllocations, 1);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+	__sync_fetch_and_add(&numAllocations, 1);
+	return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+	__sync_fetch_and_add(&numAllocations, 1);
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+static int noop_callback(JSAXContextRef)
+{
+	return 1;
+}
+
+static int noop_callback(JSAXContextRef, const char *, size_t)
+{
+	return 1;
+}
+
+static int noop_callback(JSAXContextRef, bool)
+{
+	return 1;
+}
+
+/**
+ * Count the heap allocations made validating the input against the schema, once per document with a parser that's
+ * reused & once with a parser per document.  Past the first document (which is when the schema gets compiled &
+ * the parser's buffers grow) the count must be the same for every document.
+ */
+static int allocations(const string &jsonInput, const string &schemaPath, size_t iterations)
+{
+#ifdef __GLIBC__
+	benchmark::utils::MemoryMap inputData(jsonInput, benchmark::utils::MemoryMap::MapReadOnly);
+	jschema_ref schema = schemaPath.empty() ? jschema_all() : jschema_parse_file(schemaPath.c_str(), NULL);
+	if (schema == NULL) {
+		cerr << "Schema " << schemaPath << " isn't valid\n";
+		return EXIT_ERRARGS_SCHEMA;
+	}
+
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, schema, NULL, NULL);
+
+	PJSAXCallbacks callbacks = {
+		noop_callback, noop_callback, noop_callback,
+		noop_callback, noop_callback,
+		noop_callback, noop_callback, noop_callback, noop_callback,
+	};
+	jparser_ref parser = jparser_create(0);
+	int result = EXIT_OK;
+
+	for (int reuse = 1; reuse >= 0; reuse--) {
+		size_t steady = 0;
+		for (size_t i = 0; i < iterations; i++) {
+			size_t before = numAllocations;
+			bool parsed = reuse ?
+				jsax_parse_with_parser(parser, &callbacks, inputData, &schemaInfo, NULL, false) :
+				jsax_parse(&callbacks, inputData, &schemaInfo);
+			size_t allocated = numAllocations - before;
+
+			if (!parsed) {
+				cerr << "Unable to parse " << jsonInput << "\n";
+				result = EXIT_RUN_ERROR;
+				break;
+			}
+			if (i == 1)
+				steady = allocated;
+			else if (i > 1 && allocated != steady) {
+				cerr << "Document " << i << " made " << allocated << " allocations instead of " << steady << "\n";
+				result = EXIT_RUN_ERROR;
+			}
+			if (i <= 1)
+				cout << (reuse ? "reused parser" : "parser per document") << ", document " << i << ": " << allocated << " allocations\n";
+		}
+		if (result != EXIT_OK)
+			break;
+	}
+
+	jparser_release(&parser);
+	jschema_release(&schema);
+	return result;
+#else
+	cerr << "Counting allocations is only supported with glibc\n";
+	return EXIT_RUN_ERROR;
+#endif
+}
+
+/**
+ * Time generating & parsing (into a DOM & through no-op SAX callbacks) the input as JSON text & as CBOR.
+ */
+static int cbor(const string &jsonInput, const string &schemaPath, size_t iterations)
+{
+	enum Operation { GENERATE, PARSE_DOM, PARSE_SAX, NUM_OPERATIONS };
+	static const char *operationNames[NUM_OPERATIONS] = { "generate", "DOM parse", "SAX parse" };
+
+	benchmark::utils::MemoryMap inputData(jsonInput, benchmark::utils::MemoryMap::MapReadOnly);
+	jschema_ref schema = schemaPath.empty() ? jschema_all() : jschema_parse_file(schemaPath.c_str(), NULL);
+	if (schema == NULL) {
+		cerr << "Schema " << schemaPath << " isn't valid\n";
+		return EXIT_ERRARGS_SCHEMA;
+	}
+
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, schema, NULL, NULL);
+
+	PJSAXCallbacks callbacks = {
+		noop_callback, noop_callback, noop_callback,
+		noop_callback, noop_callback,
+		noop_callback, noop_callback, noop_callback, noop_callback,
+	};
+
+	jvalue_ref dom = jdom_parse(inputData, DOMOPT_NOOPT, &schemaInfo);
+	size_t cborLength = 0;
+	char *cborData = jis_null(dom) ? NULL : jvalue_to_cbor(dom, &cborLength);
+	raw_buffer cborInput = j_str_to_buffer(cborData, cborLength);
+	int result = EXIT_OK;
+
+	if (cborData == NULL) {
+		cerr << "Unable to convert " << jsonInput << " to CBOR\n";
+		result = EXIT_RUN_ERROR;
+		goto done;
+	}
+
+	cout << "text: " << inputData.size() << " bytes, CBOR: " << cborLength << " bytes\n";
+
+	for (int operation = 0; operation < NUM_OPERATIONS; operation++) {
+		double runtime[2];
+
+		for (int binary = 0; binary <= 1; binary++) {
+			benchmark::utils::Timer start;
+			for (size_t i = 0; i < iterations; i++) {
+				bool ok = true;
+				switch (operation) {
+					case GENERATE:
+						if (binary) {
+							size_t length;
+							char *encoded = jvalue_to_cbor(dom, &length);
+							ok = (encoded != NULL);
+							free(encoded);
+						} else {
+							ok = (jvalue_tostring(dom, schema) != NULL);
+						}
+						break;
+					case PARSE_DOM:
+					{
+						jvalue_ref parsed = binary ?
+							jdom_parse_cbor(cborInput, &schemaInfo) :
+							jdom_parse(inputData, DOMOPT_NOOPT, &schemaInfo);
+						ok = !jis_null(parsed);
+						j_release(&parsed);
+						break;
+					}
+					case PARSE_SAX:
+						ok = binary ?
+							jsax_parse_cbor(&callbacks, cborInput, &schemaInfo, NULL, false) :
+							jsax_parse(&callbacks, inputData, &schemaInfo);
+						break;
+				}
+				if (!ok) {
+					cerr << operationNames[operation] << " failed for " << (binary ? "CBOR" : "text") << "\n";
+					result = EXIT_RUN_ERROR;
+					goto done;
+				}
+			}
+			runtime[binary] = (benchmark::utils::Timer() - start) / iterations;
+		}
+
+		cout << operationNames[operation] << ": text " << runtime[0] << " s, CBOR " << runtime[1] << " s (" <<
+			runtime[0] / runtime[1] << "x)\n";
+	}
+
+done:
+	free(cborData);
+	j_release(&dom);
+	jschema_release(&schema);
+	return result;
+}
+
+/**
+ * Time getting a DOM of the input by parsing it (mapped) & by opening a snapshot of it, both on its own & followed
+ * by a walk of the whole DOM.
+ */
+static int snapshot(const string &jsonInput, const string &snapshotPath, size_t iterations)
+{
+	enum Operation { OPEN, OPEN_WALK, NUM_OPERATIONS };
+	static const char *operationNames[NUM_OPERATIONS] = { "open", "open & walk" };
+
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+	jvalue_ref dom = jdom_parse_file(jsonInput.c_str(), &schemaInfo, JFileOptMMap);
+	if (jis_null(dom) || !jvalue_save_snapshot(dom, snapshotPath.c_str())) {
+		cerr << "Unable to save a snapshot of " << jsonInput << " to " << snapshotPath << "\n";
+		j_release(&dom);
+		return EXIT_RUN_ERROR;
+	}
+	j_release(&dom);
+
+	for (int operation = 0; operation < NUM_OPERATIONS; operation++) {
+		double runtime[2];
+
+		for (int binary = 0; binary <= 1; binary++) {
+			benchmark::utils::Timer start;
+			for (size_t i = 0; i < iterations; i++) {
+				jvalue_ref opened = binary ?
+					jvalue_open_snapshot(snapshotPath.c_str()) :
+					jdom_parse_file(jsonInput.c_str(), &schemaInfo, JFileOptMMap);
+				bool ok = !jis_null(opened);
+				if (ok && operation == OPEN_WALK)
+					ok = (jvalue_tostring(opened, jschema_all()) != NULL);
+				j_release(&opened);
+				if (!ok) {
+					cerr << operationNames[operation] << " failed for " << (binary ? "the snapshot" : "text") << "\n";
+					return EXIT_RUN_ERROR;
+				}
+			}
+			runtime[binary] = (benchmark::utils::Timer() - start) / iterations;
+		}
+
+		cout << operationNames[operation] << ": text " << runtime[0] << " s, snapshot " << runtime[1] << " s (" <<
+			runtime[0] / runtime[1] << "x)\n";
+	}
+
+	return EXIT_OK;
+}
+
+/// one line of the --workloads results
+struct WorkloadResult {
+	string workload;
+	string engine;
+	size_t size;	/// the number of members/elements worked on (0 when working on the input)
+	size_t operations;
+	double runtime;	/// seconds spent in the timed operations
+};
+
+static const char *workloadNames[] = {
+	"generate", "object_lookup", "object_insert", "array_append", "array_splice", "duplicate", "release",
+};
+
+/// the sizes of the objects & arrays built by the size-dependent workloads
+static const size_t workloadSizes[] = { 8, 64, 512, 4096 };
+
+static void streamValue(jvalue_ref value, JStreamRef stream)
+{
+	if (jis_object(value)) {
+		jobject_key_value pair;
+		stream->o_begin(stream);
+		for (jobject_iter i = jobj_iter_init(value); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
+			jobj_iter_deref(i, &pair);
+			stream->string(stream, jstring_get_fast(pair.key));
+			streamValue(pair.value, stream);
+		}
+		stream->o_end(stream);
+	} else if (jis_array(value)) {
+		stream->a_begin(stream);
+		for (ssize_t i = 0; i < jarray_size(value); i++)
+			streamValue(jarray_get(value, i), stream);
+		stream->a_end(stream);
+	} else if (jis_string(value)) {
+		stream->string(stream, jstring_get_fast(value));
+	} else if (jis_number(value)) {
+		raw_buffer raw;
+		int64_t integer;
+		double floating;
+		if (jnumber_get_raw(value, &raw) == CONV_OK)
+			stream->number(stream, raw);
+		else if (jnumber_get_i64(value, &integer) == CONV_OK)
+			stream->integer(stream, integer);
+		else {
+			jnumber_get_f64(value, &floating);
+			stream->floating(stream, floating);
+		}
+	} else if (jis_boolean(value)) {
+		bool truth = false;
+		jboolean_get(value, &truth);
+		stream->boolean(stream, truth);
+	} else {
+		stream->null_value(stream);
+	}
+}
+
+#ifdef HAVE_YAJL
+static void generateValue(jvalue_ref value, yajl_gen generator)
+{
+	if (jis_object(value)) {
+		jobject_key_value pair;
+		yajl_gen_map_open(generator);
+		for (jobject_iter i = jobj_iter_init(value); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
+			jobj_iter_deref(i, &pair);
+			raw_buffer key = jstring_get_fast(pair.key);
+			yajl_gen_string(generator, (const unsigned char *)key.m_str, key.m_len);
+			generateValue(pair.value, generator);
+		}
+		yajl_gen_map_close(generator);
+	} else if (jis_array(value)) {
+		yajl_gen_array_open(generator);
+		for (ssize_t i = 0; i < jarray_size(value); i++)
+			generateValue(jarray_get(value, i), generator);
+		yajl_gen_array_close(generator);
+	} else if (jis_string(value)) {
+		raw_buffer str = jstring_get_fast(value);
+		yajl_gen_string(generator, (const unsigned char *)str.m_str, str.m_len);
+	} else if (jis_number(value)) {
+		raw_buffer raw;
+		int64_t integer;
+		double floating;
+		if (jnumber_get_raw(value, &raw) == CONV_OK)
+			yajl_gen_number(generator, raw.m_str, raw.m_len);
+		else if (jnumber_get_i64(value, &integer) == CONV_OK)
+			yajl_gen_integer(generator, integer);
+		else {
+			jnumber_get_f64(value, &floating);
+			yajl_gen_double(generator, floating);
+		}
+	} else if (jis_boolean(value)) {
+		bool truth = false;
+		jboolean_get(value, &truth);
+		yajl_gen_bool(generator, truth);
+	} else {
+		yajl_gen_null(generator);
+	}
+}
+#endif
+
+/**
+ * Time generating the input with every engine that can: pbnjson through jvalue_tostring, a jstream fed from the
+ * DOM & JGenerator; yajl_gen & cJSON when they're available.
+ */
+static bool generateWorkload(const string &input, jvalue_ref dom, jschema_ref schema, size_t iterations, vector<WorkloadResult> &results)
+{
+	WorkloadResult result = { "generate", "", 0, iterations, 0 };
+	benchmark::utils::Timer start;
+
+	result.engine = ENGINE_PBNJSON_C "/jvalue_tostring";
+	start.reset();
+	for (size_t i = 0; i < iterations; i++) {
+		if (jvalue_tostring(dom, schema) == NULL)
+			return false;
+	}
+	result.runtime = benchmark::utils::Timer() - start;
+	results.push_back(result);
+
+	result.engine = ENGINE_PBNJSON_C "/jstream";
+	start.reset();
+	for (size_t i = 0; i < iterations; i++) {
+		StreamStatus status;
+		JStreamRef stream = jstream(schema);
+		streamValue(dom, stream);
+		char *generated = stream->finish(stream, &status);
+		if (generated == NULL)
+			return false;
+		free(generated);
+	}
+	result.runtime = benchmark::utils::Timer() - start;
+	results.push_back(result);
+
+	pbnjson::JDomParser parser;
+	pbnjson::JSchemaFragment anySchema("{}");
+	if (!parser.parse(input, anySchema))
+		return false;
+	pbnjson::JValue parsed = parser.getDom();
+	result.engine = ENGINE_PBNJSON_CPP "/JGenerator";
+	start.reset();
+	for (size_t i = 0; i < iterations; i++) {
+		if (pbnjson::JGenerator::serialize(parsed, anySchema).empty())
+			return false;
+	}
+	result.runtime = benchmark::utils::Timer() - start;
+	results.push_back(result);
+
+#ifdef HAVE_YAJL
+	result.engine = ENGINE_YAJL "/yajl_gen";
+	start.reset();
+	for (size_t i = 0; i < iterations; i++) {
+		yajl_gen_config config = { 0, NULL };
+		yajl_gen generator = yajl_gen_alloc(&config, NULL);
+		const unsigned char *generated;
+		unsigned int length;
+		generateValue(dom, generator);
+		bool ok = (yajl_gen_get_buf(generator, &generated, &length) == yajl_gen_status_ok);
+		yajl_gen_free(generator);
+		if (!ok)
+			return false;
+	}
+	result.runtime = benchmark::utils::Timer() - start;
+	results.push_back(result);
+#endif
+
+#ifdef HAVE_CJSON
+	json_t *tree = json_parse_document(input.c_str());
+	if (!tree)
+		return false;
+	result.engine = ENGINE_CJSON "/json_tree_to_string";
+	start.reset();
+	for (size_t i = 0; i < iterations; i++) {
+		char *generated = NULL;
+		bool ok = (json_tree_to_string(tree, &generated) == JSON_OK);
+		free(generated);
+		if (!ok) {
+			json_free_value(&tree);
+			return false;
+		}
+	}
+	result.runtime = benchmark::utils::Timer() - start;
+	results.push_back(result);
+	json_free_value(&tree);
+#endif
+
+	return true;
+}
+
+/**
+ * Time the operations whose cost depends on the size of the object or array they work on.  Each iteration does one
+ * operation per member/element; building & releasing the containers isn't timed.
+ */
+static bool containerWorkload(const string &workload, size_t size, size_t iterations, vector<WorkloadResult> &results)
+{
+	WorkloadResult result = { workload, ENGINE_PBNJSON_C, size, iterations * size, 0 };
+	vector<string> keys(size);
+	for (size_t i = 0; i < size; i++) {
+		char key[32];
+		snprintf(key, sizeof(key), "key%zu", i);
+		keys[i] = key;
+	}
+
+	for (size_t iteration = 0; iteration < iterations; iteration++) {
+		jvalue_ref container;
+		jvalue_ref source = NULL;
+		bool ok = true;
+
+		if (workload == "object_lookup") {
+			container = jobject_create();
+			for (size_t i = 0; i < size; i++)
+				jobject_put(container, jstring_create_copy(j_str_to_buffer(keys[i].c_str(), keys[i].size())), jnumber_create_i64(i));
+		} else if (workload == "array_splice") {
+			container = jarray_create(NULL);
+			source = jarray_create(NULL);
+			for (size_t i = 0; i < size; i++)
+				jarray_append(container, jnumber_create_i64(i));
+			jarray_append(source, jnumber_create_i64(size));
+		} else {
+			container = workload == "object_insert" ? jobject_create() : jarray_create(NULL);
+		}
+
+		benchmark::utils::Timer start;
+		for (size_t i = 0; i < size && ok; i++) {
+			if (workload == "object_lookup")
+				ok = !jis_null(jobject_get(container, j_str_to_buffer(keys[i].c_str(), keys[i].size())));
+			else if (workload == "object_insert")
+				ok = jobject_put(container, jstring_create_copy(j_str_to_buffer(keys[i].c_str(), keys[i].size())), jnumber_create_i64(i));
+			else if (workload == "array_append")
+				ok = jarray_append(container, jnumber_create_i64(i));
+			else
+				ok = jarray_splice(container, i, 1, source, 0, 1, SPLICE_COPY);
+		}
+		result.runtime += benchmark::utils::Timer() - start;
+
+		j_release(&source);
+		j_release(&container);
+		if (!ok)
+			return false;
+	}
+
+	results.push_back(result);
+	return true;
+}
+
+static void printWorkloads(const vector<WorkloadResult> &results, const string &format)
+{
+	if (format == "json") {
+		jvalue_ref rows = jarray_create(NULL);
+		for (size_t i = 0; i < results.size(); i++) {
+			const WorkloadResult &result = results[i];
+			jarray_append(rows, jobject_create_var(
+				jkeyval(J_CSTR_TO_JVAL("workload"), jstring_create(result.workload.c_str())),
+				jkeyval(J_CSTR_TO_JVAL("engine"), jstring_create(result.engine.c_str())),
+				jkeyval(J_CSTR_TO_JVAL("size"), jnumber_create_i64(result.size)),
+				jkeyval(J_CSTR_TO_JVAL("operations"), jnumber_create_i64(result.operations)),
+				jkeyval(J_CSTR_TO_JVAL("ns_per_op"), jnumber_create_f64(result.runtime * 1e9 / result.operations)),
+				jkeyval(J_CSTR_TO_JVAL("ops_per_s"), jnumber_create_f64(result.operations / result.runtime)),
+				J_END_OBJ_DECL));
+		}
+		cout << jvalue_tostring(rows, jschema_all()) << "\n";
+		j_release(&rows);
+		return;
+	}
+
+	if (format == "csv")
+		cout << "workload,engine,size,operations,ns_per_op,ops_per_s\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const WorkloadResult &result = results[i];
+		double nsPerOp = result.runtime * 1e9 / result.operations;
+		double opsPerSecond = result.operations / result.runtime;
+		if (format == "csv") {
+			cout << result.workload << "," << result.engine << "," << result.size << "," << result.operations << "," <<
+				nsPerOp << "," << opsPerSecond << "\n";
+		} else {
+			cout << result.workload << " (" << result.engine;
+			if (result.size)
+				cout << ", size " << result.size;
+			cout << "): " << nsPerOp << " ns/op, " << opsPerSecond << " ops/s\n";
+		}
+	}
+}
+
+/**
+ * Time the non-parsing workloads: generating the input (with every engine that can), looking up & inserting
+ * object members, appending & splicing array elements (at each of the workloadSizes) & duplicating & releasing
+ * the DOM of the input.  The results are printed as text, JSON or CSV.
+ */
+static int workloads(const string &jsonInput, const string &schemaPath, const string &selected, const string &format,
+                     size_t iterations)
+{
+	static const size_t numWorkloads = sizeof(workloadNames) / sizeof(workloadNames[0]);
+	vector<string> names;
+	istringstream list(selected);
+	string name;
+	while (getline(list, name, ',')) {
+		if (name == "all") {
+			names.insert(names.end(), workloadNames, workloadNames + numWorkloads);
+			continue;
+		}
+		if (find(workloadNames, workloadNames + numWorkloads, name) == workloadNames + numWorkloads) {
+			cerr << "Unknown workload '" << name << "'\n";
+			return EXIT_ERRARGS_WORKLOAD;
+		}
+		names.push_back(name);
+	}
+	if (format != "text" && format != "json" && format != "csv") {
+		cerr << "Unknown output format '" << format << "'\n";
+		return EXIT_ERRARGS_WORKLOAD;
+	}
+
+	bool needsInput = false;
+	for (size_t i = 0; i < names.size(); i++)
+		needsInput |= (names[i] == "generate" || names[i] == "duplicate" || names[i] == "release");
+	if (needsInput && jsonInput.empty()) {
+		cerr << "Need to specify an input file\n";
+		return EXIT_ERRARGS_INPUT;
+	}
+
+	jschema_ref schema = schemaPath.empty() ? jschema_all() : jschema_parse_file(schemaPath.c_str(), NULL);
+	if (schema == NULL) {
+		cerr << "Schema " << schemaPath << " isn't valid\n";
+		return EXIT_ERRARGS_SCHEMA;
+	}
+
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, schema, NULL, NULL);
+
+	string input;
+	jvalue_ref dom = jnull();
+	if (needsInput) {
+		benchmark::utils::MemoryMap inputData(jsonInput, benchmark::utils::MemoryMap::MapReadOnly);
+		input.assign(inputData.map<char>(), inputData.size());
+		dom = jdom_parse(j_str_to_buffer(input.c_str(), input.size()), DOMOPT_NOOPT, &schemaInfo);
+		if (jis_null(dom)) {
+			cerr << "Unable to parse " << jsonInput << "\n";
+			jschema_release(&schema);
+			return EXIT_RUN_ERROR;
+		}
+	}
+
+	vector<WorkloadResult> results;
+	int result = EXIT_OK;
+
+	for (size_t n = 0; n < names.size() && result == EXIT_OK; n++) {
+		WorkloadResult timed = { names[n], ENGINE_PBNJSON_C, 0, iterations, 0 };
+		bool ok = true;
+
+		if (names[n] == "generate") {
+			ok = generateWorkload(input, dom, schema, iterations, results);
+		} else if (names[n] == "duplicate" || names[n] == "release") {
+			// the copies/parses made for each iteration aren't timed, only the operation itself
+			for (size_t i = 0; i < iterations && ok; i++) {
+				jvalue_ref tree;
+				if (names[n] == "duplicate") {
+					benchmark::utils::Timer start;
+					tree = jvalue_duplicate(dom);
+					timed.runtime += benchmark::utils::Timer() - start;
+					ok = (tree != NULL);
+					j_release(&tree);
+				} else {
+					tree = jdom_parse(j_str_to_buffer(input.c_str(), input.size()), DOMOPT_NOOPT, &schemaInfo);
+					ok = !jis_null(tree);
+					benchmark::utils::Timer start;
+					j_release(&tree);
+					timed.runtime += benchmark::utils::Timer() - start;
+				}
+			}
+			results.push_back(timed);
+		} else {
+			for (size_t i = 0; i < sizeof(workloadSizes) / sizeof(workloadSizes[0]) && ok; i++)
+				ok = containerWorkload(names[n], workloadSizes[i], iterations, results);
+		}
+
+		if (!ok) {
+			cerr << "The " << names[n] << " workload failed\n";
+			result = EXIT_RUN_ERROR;
+		}
+	}
+
+	if (result == EXIT_OK)
+		printWorkloads(results, format);
+
+	j_release(&dom);
+	jschema_release(&schema);
+	return result;
+}
+
 static void statistics(pbnjson::JValue json, JSONStats &stats)
 {
 	if (json.isObject()) {
@@ -108,7 +752,10 @@ int main(int argc, char **argv)
 	string jsonEngine;
 	string jsonInput;
 	string schemaPath;
+	string arrayPath;
+	unsigned int maxThreads;
 	bool utf8Validation = false;
+	string format;
 	bool sax = false;
 	size_t iterations;
 	double runLength;
@@ -128,6 +775,13 @@ int main(int argc, char **argv)
 		(OPT_ENGINES, "list the engines supported for benchmarking")
 		(OPT_NOOP_CALLBACKS, "use noop callbacks")
 		(OPT_STATISTICS, "print statistics about the input json")
+		(OPT_PARALLEL_SCALING, po::value<unsigned int>(&maxThreads), "time parsing the input's array with 1 up to this many threads")
+		(OPT_ARRAY_PATH, po::value<string>(&arrayPath), "the JSON pointer to the array to parse in parallel (the top-level array by default)")
+		(OPT_ALLOCATIONS, "check that validating the input against the schema allocates the same amount for every document")
+		(OPT_CBOR, "compare generating & parsing the input as text with doing the same as CBOR")
+		(OPT_SNAPSHOT, po::value<string>(), "compare parsing the input with opening a snapshot of it (saved to the path given)")
+		(OPT_WORKLOADS, po::value<string>(), "time the comma separated workloads (generate, object_lookup, object_insert, array_append, array_splice, duplicate, release or all)")
+		(OPT_FORMAT, po::value<string>(&format)->default_value("text"), "how to print the " OPT_WORKLOADS " results (text, json or csv)")
 	;
 
 	po::variables_map vm;
@@ -157,6 +811,56 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	if (vm.count(OPT_PARALLEL_SCALING)) {
+		benchmark::utils::MemoryMap inputData(jsonInput, benchmark::utils::MemoryMap::MapReadOnly);
+		JSchemaInfo schemaInfo;
+		jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+		if (!vm.count(OPT_TEST_ITERATIONS))
+			iterations = 10;
+
+		double baseline = 0;
+		for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+			benchmark::utils::Timer start;
+			for (size_t i = 0; i < iterations; i++) {
+				jvalue_ref parsed = jdom_parse_array_parallel(inputData, arrayPath.c_str(), DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE, &schemaInfo, threads);
+				if (jis_null(parsed)) {
+					cerr << "Unable to parse the array in " << jsonInput << "\n";
+					return EXIT_RUN_ERROR;
+				}
+				j_release(&parsed);
+			}
+			double runtime = benchmark::utils::Timer() - start;
+			if (threads == 1)
+				baseline = runtime;
+			cout << threads << " threads: " << runtime / iterations << " s/parse, " << baseline / runtime << "x speedup\n";
+		}
+		return 0;
+	}
+
+	if (vm.count(OPT_ALLOCATIONS)) {
+		if (!vm.count(OPT_TEST_ITERATIONS))
+			iterations = 10;
+		return allocations(jsonInput, schemaPath, iterations);
+	}
+
+	if (vm.count(OPT_CBOR)) {
+		if (!vm.count(OPT_TEST_ITERATIONS))
+			iterations = 100;
+		return cbor(jsonInput, schemaPath, iterations);
+	}
+
+	if (vm.count(OPT_SNAPSHOT)) {
+		if (!vm.count(OPT_TEST_ITERATIONS))
+			iterations = 100;
+		return snapshot(jsonInput, vm[OPT_SNAPSHOT].as<string>(), iterations);
+	}
+
+	if (vm.count(OPT_WORKLOADS)) {
+		if (!vm.count(OPT_TEST_ITERATIONS))
+			iterations = 100;
+		return workloads(jsonInput, schemaPath, vm[OPT_WORKLOADS].as<string>(), format, iterations);
+	}
+
 	if (!vm.count(OPT_ENGINE)) {
 		cerr << "Need to specify the engine to benchmark\n";
 		cerr << desc << "\n";
@@ -20,6 +20,7 @@ LICENSE@@@ */
 #define BENCH_JSON_H_
 
 #include <string>
+#include <time.h>
 #include <pbnjson.h>
 
 #include <stdexcept>
@@ -130,12 +130,12 @@ namespace json {
 			public:
 				NoopSaxparser() : JParser(NULL) {}
 				virtual bool jsonObjectOpen() { return true; }
-				virtual bool jsonObjectKey(const std::string& key) { return true; }
+				virtual bool jsonObjectKeyView(JStringView key) { return true; }
 				virtual bool jsonObjectClose() { return true; }
 				virtual bool jsonArrayOpen() { return true; }
 				virtual bool jsonArrayClose() { return true; }
-				virtual bool jsonString(const std::string& s) { return true; }
-				virtual bool jsonNumber(const std::string& n) { return true; }
+				virtual bool jsonStringView(JStringView s) { return true; }
+				virtual bool jsonNumberView(JStringView n) { return true; }
 				virtual bool jsonNumber(int64_t number) { return false; }
 				virtual bool jsonNumber(double &number, ConversionResultFlags asFloat) { return false; }
 				virtual bool jsonBoolean(bool truth) { return true; }
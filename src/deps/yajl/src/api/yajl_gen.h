@@ -103,6 +103,12 @@ extern "C" {
     yajl_gen_status YAJL_API yajl_gen_string(yajl_gen hand,
                                              const unsigned char * str,
                                              unsigned int len);
+    /** generate a string that the caller guarantees contains nothing
+     *  that needs escaping (no quote, backslash or control chars).  the
+     *  bytes are copied verbatim, skipping the escaping pass entirely */
+    yajl_gen_status YAJL_API yajl_gen_string_noescape(yajl_gen hand,
+                                                      const unsigned char * str,
+                                                      unsigned int len);
     yajl_gen_status YAJL_API yajl_gen_null(yajl_gen hand);
     yajl_gen_status YAJL_API yajl_gen_bool(yajl_gen hand, int boolean);    
     yajl_gen_status YAJL_API yajl_gen_map_open(yajl_gen hand);
@@ -135,6 +135,12 @@ extern "C" {
     /** free a parser handle */    
     void YAJL_API yajl_free(yajl_handle handle);
 
+    /** return a parser handle to the state it was in right after
+     *  yajl_alloc so that it can be used for another json text.  the
+     *  callbacks, context, configuration and any buffers already grown
+     *  by previous parses are kept */
+    void YAJL_API yajl_reset(yajl_handle handle);
+
     /** Parse some json!
      *  \param hand - a handle to the json parser allocated with yajl_alloc
      *  \param jsonText - a pointer to the UTF8 json text to be parsed
@@ -154,6 +160,17 @@ extern "C" {
      *  \param hand - a handle to the json parser allocated with yajl_alloc
      */
     yajl_status yajl_parse_complete(yajl_handle hand);
+
+    /** get the amount of data consumed from the last chunk passed to
+     *  yajl_parse.
+     *
+     *  once a json text has been parsed successfully, this is where it
+     *  ended within the chunk, which allows a client to detect junk at
+     *  the end of the input or to find where the next of several
+     *  concatenated json texts begins.  after an error, it is the offset
+     *  into the chunk where the error was encountered.
+     */
+    unsigned int YAJL_API yajl_get_bytes_consumed(yajl_handle hand);
     
     /** get an error string describing the state of the
      *  parse.
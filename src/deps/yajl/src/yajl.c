@@ -96,6 +96,7 @@ yajl_alloc(const yajl_callbacks * callbacks,
     hand->ctx = ctx;
     hand->lexer = yajl_lex_alloc(&(hand->alloc), allowComments, validateUTF8);
     hand->errorOffset = 0;
+    hand->bytesConsumed = 0;
     hand->decodeBuf = yajl_buf_alloc(&(hand->alloc));
     yajl_bs_init(hand->stateStack, &(hand->alloc));
 
@@ -113,6 +114,19 @@ yajl_free(yajl_handle handle)
     YA_FREE(&(handle->alloc), handle);
 }
 
+void
+yajl_reset(yajl_handle handle)
+{
+    yajl_lex_reset(handle->lexer);
+    handle->parseError = NULL;
+    handle->errorOffset = 0;
+    handle->bytesConsumed = 0;
+    yajl_buf_clear(handle->decodeBuf);
+    /* the stack memory itself is kept for the next parse */
+    handle->stateStack.used = 0;
+    yajl_bs_push(handle->stateStack, yajl_state_start);
+}
+
 yajl_status
 yajl_parse(yajl_handle hand, const unsigned char * jsonText,
            unsigned int jsonTextLen)
@@ -120,9 +134,16 @@ yajl_parse(yajl_handle hand, const unsigned char * jsonText,
     unsigned int offset = 0;
     yajl_status status;
     status = yajl_do_parse(hand, &offset, jsonText, jsonTextLen);
+    hand->bytesConsumed = offset;
     return status;
 }
 
+unsigned int
+yajl_get_bytes_consumed(yajl_handle hand)
+{
+    return hand->bytesConsumed;
+}
+
 yajl_status
 yajl_parse_complete(yajl_handle hand)
 {
@@ -130,9 +151,11 @@ yajl_parse_complete(yajl_handle hand)
      * Further input consisting of digits could cause our interpretation
      * of the number to change (buffered "1" but "2" comes in).
      * A very simple approach to this is to inject whitespace to terminate
-     * any number in the lex buffer.
+     * any number in the lex buffer.  The injected whitespace isn't part
+     * of the client's input so it doesn't count towards bytesConsumed.
      */
-    return yajl_parse(hand, (const unsigned char *)" ", 1);
+    unsigned int offset = 0;
+    return yajl_do_parse(hand, &offset, (const unsigned char *)" ", 1);
 }
 
 unsigned char *
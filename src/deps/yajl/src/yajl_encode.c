@@ -44,6 +44,28 @@ static void CharToHex(unsigned char c, char * hexBuf)
     hexBuf[1] = hexchar[c & 0x0F];
 }
 
+/* word-at-a-time helpers.  a string is scanned a machine word at a time
+ * and runs that need no escaping are copied with a single append; only
+ * words containing a quote, backslash or control char take the slow path */
+typedef unsigned long yajl_word;
+
+#define YAJL_WORD_ONES (((yajl_word) -1) / 0xFF)
+#define YAJL_WORD_HIGHS (YAJL_WORD_ONES * 0x80)
+/* non-zero if any byte in x is zero */
+#define YAJL_WORD_HAS_ZERO(x) (((x) - YAJL_WORD_ONES) & ~(x) & YAJL_WORD_HIGHS)
+/* non-zero if any byte in x is less than n (n <= 128) */
+#define YAJL_WORD_HAS_LESS(x, n) (((x) - YAJL_WORD_ONES * (n)) & ~(x) & YAJL_WORD_HIGHS)
+
+static int
+yajl_word_needs_escape(const unsigned char * str)
+{
+    yajl_word w;
+    memcpy(&w, str, sizeof(w));
+    return (YAJL_WORD_HAS_LESS(w, 0x20) |
+            YAJL_WORD_HAS_ZERO(w ^ (YAJL_WORD_ONES * '"')) |
+            YAJL_WORD_HAS_ZERO(w ^ (YAJL_WORD_ONES * '\\'))) != 0;
+}
+
 void
 yajl_string_encode(yajl_buf buf, const unsigned char * str,
                    unsigned int len)
@@ -56,6 +78,15 @@ yajl_string_encode(yajl_buf buf, const unsigned char * str,
 
     while (end < len) {
         const char * escaped = NULL;
+
+        /* fast path - skip over words that need no escaping */
+        while (len - end >= sizeof(yajl_word) &&
+               !yajl_word_needs_escape(str + end))
+        {
+            end += sizeof(yajl_word);
+        }
+        if (end >= len) break;
+
         switch (str[end]) {
             case '\r': escaped = "\\r"; break;
             case '\n': escaped = "\\n"; break;
@@ -80,7 +111,7 @@ yajl_string_encode(yajl_buf buf, const unsigned char * str,
             ++end;
         }
     }
-    yajl_buf_append(buf, str + beg, end - beg);
+    yajl_buf_append(buf, str + beg, len - beg);
 }
 
 static void hexToDigit(unsigned int * val, const unsigned char * hex)
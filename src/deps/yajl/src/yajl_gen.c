@@ -209,6 +209,19 @@ yajl_gen_string(yajl_gen g, const unsigned char * str,
     return yajl_gen_status_ok;
 }
 
+yajl_gen_status
+yajl_gen_string_noescape(yajl_gen g, const unsigned char * str,
+                         unsigned int len)
+{
+    ENSURE_VALID_STATE; INSERT_SEP; INSERT_WHITESPACE;
+    yajl_buf_append(g->buf, "\"", 1);
+    yajl_buf_append(g->buf, str, len);
+    yajl_buf_append(g->buf, "\"", 1);
+    APPENDED_ATOM;
+    FINAL_NEWLINE;
+    return yajl_gen_status_ok;
+}
+
 yajl_gen_status
 yajl_gen_null(yajl_gen g)
 {
@@ -137,6 +137,17 @@ yajl_lex_free(yajl_lexer lxr)
     return;
 }
 
+void
+yajl_lex_reset(yajl_lexer lxr)
+{
+    lxr->lineOff = 0;
+    lxr->charOff = 0;
+    lxr->error = yajl_lex_e_ok;
+    lxr->bufOff = 0;
+    lxr->bufInUse = 0;
+    yajl_buf_clear(lxr->buf);
+}
+
 /* a lookup table which lets us quickly determine three things:
  * VEC - valid escaped conrol char
  * IJC - invalid json char
@@ -69,6 +69,10 @@ yajl_lexer yajl_lex_alloc(yajl_alloc_funcs * alloc,
 
 void yajl_lex_free(yajl_lexer lexer);
 
+/* forget all state from previous input, keeping the configuration and
+ * the storage of the lex buffer */
+void yajl_lex_reset(yajl_lexer lexer);
+
 /**
  * run/continue a lex. "offset" is an input/output parameter.
  * It should be initialized to zero for a
@@ -59,6 +59,9 @@ struct yajl_handle_t {
     yajl_lexer lexer;
     const char * parseError;
     unsigned int errorOffset;
+    /* the number of bytes of the last chunk handed to yajl_parse that
+     * were used up (see yajl_get_bytes_consumed) */
+    unsigned int bytesConsumed;
     /* temporary storage for decoded strings */
     yajl_buf decodeBuf;
     /* a stack of states.  access with yajl_state_XXX routines */
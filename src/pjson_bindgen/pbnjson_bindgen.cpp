@@ -0,0 +1,935 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+/***
+ * pbnjson_bindgen - generate C++ structs & the tables to parse/serialize them from a schema.
+ *
+ * pbnjson_bindgen [-I <dir>]... [-n <namespace>] -o <output> <schema>
+ *
+ * Writes <output>.h & <output>.cpp.  The header declares a struct for every object schema (properties map to
+ * members: strings to std::string, integers to int64_t, numbers to double, booleans to bool, arrays to
+ * std::vector), a parse function that validates the input against the schema while filling the struct
+ * (JBindingParser - there is no DOM) & a toString function that serializes it through jstream
+ * (JBindingGenerator).
+ *
+ * External references ("$ref" & string "extends") are resolved to <name> or <name>.schema next to the schema that
+ * refers to them, then in every -I directory, & are inlined so that the generated code carries a self-contained copy
+ * of the schema.  Recursive schemas can't be inlined (nor stored by value) & are rejected.
+ *
+ * Optional properties whose schema allows more than one type (or null, or anything) aren't bound - they are still
+ * validated but the parser skips them.  A required property like that is an error: the struct couldn't hold it, so
+ * what toString produces would be rejected by parse.
+ */
+
+#include <pbnjson.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const char *program = "pbnjson_bindgen";
+
+static void usage()
+{
+	fprintf(stderr, "Usage: %s [-I <dir>]... [-n <namespace>] -o <output> <schema>\n", program);
+}
+
+static bool read_file(const std::string &path, std::string &contents)
+{
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+	std::ostringstream buffer;
+	buffer << file.rdbuf();
+	contents = buffer.str();
+	return true;
+}
+
+static bool write_file(const std::string &path, const std::string &contents)
+{
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file || !(file << contents) || !file.flush()) {
+		fprintf(stderr, "%s: failed to write %s\n", program, path.c_str());
+		return false;
+	}
+	return true;
+}
+
+static std::string directory_of(const std::string &path)
+{
+	std::string::size_type slash = path.rfind('/');
+	return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+static std::string file_name_of(const std::string &path)
+{
+	std::string::size_type slash = path.rfind('/');
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/**
+ * Blank out Javascript-style comments (which schemas may contain) so that the plain DOM parser accepts the schema.
+ * Newlines are kept so that positions in error messages still line up.
+ */
+static void strip_comments(std::string &json)
+{
+	bool inString = false;
+
+	for (std::string::size_type i = 0; i < json.size(); i++) {
+		if (inString) {
+			if (json[i] == '\\')
+				i++;
+			else if (json[i] == '"')
+				inString = false;
+		} else if (json[i] == '"') {
+			inString = true;
+		} else if (json.compare(i, 2, "//") == 0) {
+			for (; i < json.size() && json[i] != '\n'; i++)
+				json[i] = ' ';
+		} else if (json.compare(i, 2, "/*") == 0) {
+			std::string::size_type end = json.find("*/", i + 2);
+			end = (end == std::string::npos) ? json.size() : end + 2;
+			for (; i < end; i++) {
+				if (json[i] != '\n')
+					json[i] = ' ';
+			}
+			i--;
+		}
+	}
+}
+
+static std::string to_string(jvalue_ref str)
+{
+	raw_buffer buf = jstring_get_fast(str);
+	return std::string(buf.m_str, buf.m_len);
+}
+
+static jvalue_ref get(jvalue_ref obj, const char *key)
+{
+	return jis_object(obj) ? jobject_get(obj, j_cstr_to_buffer(key)) : jnull();
+}
+
+/**
+ * Serialize JSON with the object keys sorted so that the same schema always generates the same code.
+ */
+static void canonical(jvalue_ref value, std::string &out)
+{
+	if (jis_object(value)) {
+		std::map<std::string, jvalue_ref> sorted;
+		jobject_key_value pair;
+		for (jobject_iter i = jobj_iter_init(value); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
+			jobj_iter_deref(i, &pair);
+			sorted[to_string(pair.key)] = pair.value;
+		}
+
+		out += '{';
+		for (std::map<std::string, jvalue_ref>::const_iterator i = sorted.begin(); i != sorted.end(); ++i) {
+			if (i != sorted.begin())
+				out += ',';
+			jvalue_ref key = jstring_create_copy(j_str_to_buffer(i->first.data(), i->first.size()));
+			canonical(key, out);
+			j_release(&key);
+			out += ':';
+			canonical(i->second, out);
+		}
+		out += '}';
+	} else if (jis_array(value)) {
+		out += '[';
+		for (ssize_t i = 0; i < jarray_size(value); i++) {
+			if (i > 0)
+				out += ',';
+			canonical(jarray_get(value, i), out);
+		}
+		out += ']';
+	} else if (jis_string(value)) {
+		static const char hex[] = "0123456789abcdef";
+		raw_buffer str = jstring_get_fast(value);
+		out += '"';
+		for (long i = 0; i < str.m_len; i++) {
+			unsigned char c = str.m_str[i];
+			if (c == '"' || c == '\\') {
+				out += '\\';
+				out += c;
+			} else if (c < 0x20) {
+				out += "\\u00";
+				out += hex[c >> 4];
+				out += hex[c & 0xf];
+			} else {
+				out += c;
+			}
+		}
+		out += '"';
+	} else if (jis_number(value)) {
+		raw_buffer raw;
+		if (jnumber_get_raw(value, &raw) == CONV_OK) {
+			out.append(raw.m_str, raw.m_len);
+		} else {
+			double number = 0;
+			char buf[32];
+			jnumber_get_f64(value, &number);
+			snprintf(buf, sizeof(buf), "%.17g", number);
+			out += buf;
+		}
+	} else if (jis_boolean(value)) {
+		bool truth = false;
+		jboolean_get(value, &truth);
+		out += truth ? "true" : "false";
+	} else {
+		out += "null";
+	}
+}
+
+/**
+ * Loads schema files & inlines their references.
+ */
+class SchemaLoader {
+public:
+	SchemaLoader(const std::vector<std::string> &includeDirs)
+		: m_includeDirs(includeDirs)
+	{
+	}
+
+	~SchemaLoader()
+	{
+		for (std::map<std::string, jvalue_ref>::iterator i = m_documents.begin(); i != m_documents.end(); ++i)
+			j_release(&i->second);
+	}
+
+	/**
+	 * @return The parsed file (owned by the loader) or NULL if it can't be read or isn't JSON.
+	 */
+	jvalue_ref load(const std::string &path)
+	{
+		std::map<std::string, jvalue_ref>::iterator found = m_documents.find(path);
+		if (found != m_documents.end())
+			return found->second;
+
+		std::string contents;
+		if (!read_file(path, contents)) {
+			fprintf(stderr, "%s: failed to read %s\n", program, path.c_str());
+			return NULL;
+		}
+		strip_comments(contents);
+
+		JSchemaInfo schemaInfo;
+		jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+		jvalue_ref parsed = jdom_parse(j_str_to_buffer(contents.data(), contents.size()), DOMOPT_NOOPT, &schemaInfo);
+		if (!jis_object(parsed)) {
+			fprintf(stderr, "%s: %s isn't a valid schema\n", program, path.c_str());
+			j_release(&parsed);
+			return NULL;
+		}
+		m_documents[path] = parsed;
+		return parsed;
+	}
+
+	/**
+	 * Copy a schema, replacing every reference within it by the schema it refers to.
+	 *
+	 * @param schema The schema to expand
+	 * @param document The file it comes from
+	 * @return The expanded schema (the caller owns it) or NULL if a reference couldn't be resolved.
+	 */
+	jvalue_ref expand(jvalue_ref schema, const std::string &document)
+	{
+		if (!jis_object(schema))
+			return jvalue_copy(schema);
+
+		jvalue_ref ref = get(schema, "$ref");
+		if (jis_string(ref))
+			return expandReference(to_string(ref), document);
+
+		jvalue_ref expanded = jobject_create();
+		jobject_key_value pair;
+		for (jobject_iter i = jobj_iter_init(schema); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
+			jobj_iter_deref(i, &pair);
+			std::string key = to_string(pair.key);
+			jvalue_ref value;
+
+			if (key == "properties" || key == "patternProperties")
+				value = expandEach(pair.value, document, true);
+			else if (key == "items" || key == "extends")
+				value = jis_string(pair.value) ? expandReference(to_string(pair.value), document) :
+						expandEach(pair.value, document, false);
+			else if (key == "additionalProperties" || key == "additionalItems")
+				value = expand(pair.value, document);
+			else
+				value = jvalue_copy(pair.value);
+
+			if (value == NULL) {
+				j_release(&expanded);
+				return NULL;
+			}
+			jobject_put(expanded, jvalue_copy(pair.key), value);
+		}
+		return expanded;
+	}
+
+private:
+	/**
+	 * Expand a schema, an array of schemas or (if isMap) every value of an object.
+	 */
+	jvalue_ref expandEach(jvalue_ref schemas, const std::string &document, bool isMap)
+	{
+		if (jis_array(schemas)) {
+			jvalue_ref expanded = jarray_create(NULL);
+			for (ssize_t i = 0; i < jarray_size(schemas); i++) {
+				jvalue_ref element = expand(jarray_get(schemas, i), document);
+				if (element == NULL) {
+					j_release(&expanded);
+					return NULL;
+				}
+				jarray_append(expanded, element);
+			}
+			return expanded;
+		}
+		if (!isMap || !jis_object(schemas))
+			return expand(schemas, document);
+
+		jvalue_ref expanded = jobject_create();
+		jobject_key_value pair;
+		for (jobject_iter i = jobj_iter_init(schemas); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
+			jobj_iter_deref(i, &pair);
+			jvalue_ref value = expand(pair.value, document);
+			if (value == NULL) {
+				j_release(&expanded);
+				return NULL;
+			}
+			jobject_put(expanded, jvalue_copy(pair.key), value);
+		}
+		return expanded;
+	}
+
+	jvalue_ref expandReference(const std::string &ref, const std::string &document)
+	{
+		std::string::size_type hash = ref.find('#');
+		std::string name = ref.substr(0, hash);
+		std::string pointer = (hash == std::string::npos) ? "" : ref.substr(hash + 1);
+		std::string path = name.empty() ? document : locate(name, document);
+
+		if (path.empty()) {
+			fprintf(stderr, "%s: can't resolve reference \"%s\" in %s\n", program, ref.c_str(), document.c_str());
+			return NULL;
+		}
+
+		std::string key = path + "#" + pointer;
+		if (std::find(m_active.begin(), m_active.end(), key) != m_active.end()) {
+			fprintf(stderr, "%s: reference \"%s\" in %s is recursive - recursive schemas can't be bound\n",
+					program, ref.c_str(), document.c_str());
+			return NULL;
+		}
+
+		jvalue_ref target = load(path);
+		if (target == NULL)
+			return NULL;
+		if (!pointer.empty() && (target = follow(target, pointer)) == NULL) {
+			fprintf(stderr, "%s: reference \"%s\" in %s points to nothing\n", program, ref.c_str(), document.c_str());
+			return NULL;
+		}
+
+		m_active.push_back(key);
+		jvalue_ref expanded = expand(target, path);
+		m_active.pop_back();
+		return expanded;
+	}
+
+	/**
+	 * @return The value a JSON pointer ("/a/b") selects or NULL.
+	 */
+	static jvalue_ref follow(jvalue_ref value, const std::string &pointer)
+	{
+		std::string::size_type start = 0;
+
+		while (start < pointer.size()) {
+			if (pointer[start] != '/')
+				return NULL;
+			std::string::size_type end = pointer.find('/', start + 1);
+			std::string token = pointer.substr(start + 1, end == std::string::npos ? std::string::npos : end - start - 1);
+			for (std::string::size_type i; (i = token.find("~1")) != std::string::npos; )
+				token.replace(i, 2, "/");
+			for (std::string::size_type i; (i = token.find("~0")) != std::string::npos; )
+				token.replace(i, 2, "~");
+
+			if (jis_object(value)) {
+				if (!jobject_get_exists(value, j_str_to_buffer(token.data(), token.size()), &value))
+					return NULL;
+			} else if (jis_array(value)) {
+				char *end;
+				long index = strtol(token.c_str(), &end, 10);
+				if (token.empty() || *end != '\0' || index < 0 || index >= jarray_size(value))
+					return NULL;
+				value = jarray_get(value, index);
+			} else {
+				return NULL;
+			}
+			start = (end == std::string::npos) ? pointer.size() : end;
+		}
+		return value;
+	}
+
+	std::string locate(const std::string &name, const std::string &document)
+	{
+		std::vector<std::string> dirs;
+		dirs.push_back(directory_of(document));
+		dirs.insert(dirs.end(), m_includeDirs.begin(), m_includeDirs.end());
+
+		for (std::vector<std::string>::const_iterator i = dirs.begin(); i != dirs.end(); ++i) {
+			std::string candidates[] = { *i + "/" + name, *i + "/" + name + ".schema" };
+			for (size_t j = 0; j < sizeof(candidates) / sizeof(candidates[0]); j++) {
+				if (access(candidates[j].c_str(), R_OK) == 0)
+					return candidates[j];
+			}
+		}
+		return "";
+	}
+
+	std::vector<std::string> m_includeDirs;
+	std::map<std::string, jvalue_ref> m_documents;
+	std::vector<std::string> m_active;	/// the references being expanded
+};
+
+struct Struct;
+
+struct Type {
+	enum Kind { STRING, INTEGER, NUMBER, BOOLEAN, OBJECT, ARRAY } m_kind;
+	Struct *m_struct;	/// OBJECT
+	Type *m_items;	/// ARRAY
+	std::string m_table;	/// ARRAY: the name of the generated JBindingType
+};
+
+struct Member {
+	std::string m_key;
+	std::string m_field;
+	Type *m_type;
+	bool m_optional;
+};
+
+struct Struct {
+	std::string m_name;
+	std::vector<Member> m_members;	/// sorted by key
+};
+
+static bool is_keyword(const std::string &word)
+{
+	static const char *keywords[] = {
+		"and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char", "class",
+		"compl", "const", "const_cast", "continue", "default", "delete", "do", "double", "dynamic_cast", "else",
+		"enum", "explicit", "export", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int",
+		"long", "mutable", "namespace", "new", "not", "not_eq", "operator", "or", "or_eq", "private", "protected",
+		"public", "register", "reinterpret_cast", "return", "short", "signed", "sizeof", "static",
+		"static_cast", "struct", "switch", "template", "this", "throw", "true", "try", "typedef", "typeid",
+		"typename", "union", "unsigned", "using", "virtual", "void", "volatile", "wchar_t", "while", "xor",
+		"xor_eq",
+		"has",	// the presence flags of optional members
+	};
+	for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+		if (word == keywords[i])
+			return true;
+	}
+	return false;
+}
+
+static std::string identifier(const std::string &name)
+{
+	std::string id;
+	for (std::string::size_type i = 0; i < name.size(); i++) {
+		char c = name[i];
+		id += ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) ? c : '_';
+	}
+	if (id.empty() || (id[0] >= '0' && id[0] <= '9'))
+		id = "_" + id;
+	// leading underscores followed by a capital (or 2 of them) are reserved
+	while (id.size() > 1 && id[0] == '_' && (id[1] == '_' || (id[1] >= 'A' && id[1] <= 'Z')))
+		id.erase(0, 1);
+	if (is_keyword(id))
+		id += '_';
+	return id;
+}
+
+static std::string capitalize(const std::string &name)
+{
+	std::string capitalized = name;
+	if (!capitalized.empty() && capitalized[0] >= 'a' && capitalized[0] <= 'z')
+		capitalized[0] += 'A' - 'a';
+	return capitalized;
+}
+
+/**
+ * Builds the structs for an expanded schema.
+ */
+class Binder {
+public:
+	Binder() : m_failed(false) {}
+
+	~Binder()
+	{
+		for (size_t i = 0; i < m_structs.size(); i++)
+			delete m_structs[i];
+		for (size_t i = 0; i < m_types.size(); i++)
+			delete m_types[i];
+	}
+
+	/**
+	 * @return The type of values of the schema or NULL if they can't be bound.
+	 */
+	Type* bind(jvalue_ref schema, const std::string &name)
+	{
+		std::vector<jvalue_ref> chain;
+		collect(schema, chain);
+
+		std::string type;
+		bool hasProperties = false;
+		for (size_t i = 0; i < chain.size(); i++) {
+			jvalue_ref declared = get(chain[i], "type");
+			if (type.empty() && !jis_null(declared)) {
+				if (!jis_string(declared))
+					return NULL;
+				type = to_string(declared);
+			}
+			hasProperties = hasProperties || jis_object(get(chain[i], "properties"));
+		}
+		if (type.empty() && hasProperties)
+			type = "object";
+
+		if (type == "string")
+			return create(Type::STRING);
+		if (type == "integer")
+			return create(Type::INTEGER);
+		if (type == "number")
+			return create(Type::NUMBER);
+		if (type == "boolean")
+			return create(Type::BOOLEAN);
+		if (type == "array")
+			return bindArray(chain, name);
+		if (type == "object" && hasProperties)
+			return bindObject(schema, chain, name);
+		return NULL;
+	}
+
+	const std::vector<Struct *>& structs() const { return m_structs; }
+
+	/**
+	 * @return True if a required property couldn't be bound (the reason has been reported).
+	 */
+	bool failed() const { return m_failed; }
+
+private:
+	/**
+	 * The schema & everything it extends, most derived first.
+	 */
+	static void collect(jvalue_ref schema, std::vector<jvalue_ref> &chain)
+	{
+		if (!jis_object(schema))
+			return;
+		chain.push_back(schema);
+
+		jvalue_ref extends = get(schema, "extends");
+		if (jis_array(extends)) {
+			for (ssize_t i = 0; i < jarray_size(extends); i++)
+				collect(jarray_get(extends, i), chain);
+		} else {
+			collect(extends, chain);
+		}
+	}
+
+	Type* create(Type::Kind kind)
+	{
+		Type *type = new Type;
+		type->m_kind = kind;
+		type->m_struct = NULL;
+		type->m_items = NULL;
+		m_types.push_back(type);
+		return type;
+	}
+
+	Type* bindArray(const std::vector<jvalue_ref> &chain, const std::string &name)
+	{
+		for (size_t i = 0; i < chain.size(); i++) {
+			jvalue_ref items = get(chain[i], "items");
+			if (jis_null(items))
+				continue;
+			// tuples would need a struct of their own
+			Type *itemType = jis_object(items) ? bind(items, name + "Item") : NULL;
+			if (itemType == NULL)
+				return NULL;
+			Type *type = create(Type::ARRAY);
+			type->m_items = itemType;
+			type->m_table = name + "_type";
+			return type;
+		}
+		return NULL;
+	}
+
+	Type* bindObject(jvalue_ref schema, const std::vector<jvalue_ref> &chain, const std::string &suggested)
+	{
+		std::string text;
+		canonical(schema, text);
+		std::map<std::string, Struct *>::iterator same = m_bound.find(text);
+		if (same != m_bound.end()) {
+			Type *type = create(Type::OBJECT);
+			type->m_struct = same->second;
+			return type;
+		}
+
+		jvalue_ref id = get(schema, "id");
+		std::string name = identifier(jis_string(id) ? to_string(id) : suggested);
+		std::string unique = name;
+		for (int n = 2; m_names.count(unique) > 0; n++) {
+			std::ostringstream numbered;
+			numbered << name << n;
+			unique = numbered.str();
+		}
+		m_names[unique] = true;
+
+		// the most derived schema of a property decides how it's bound
+		std::map<std::string, jvalue_ref> properties;
+		jobject_key_value pair;
+		for (size_t i = 0; i < chain.size(); i++) {
+			jvalue_ref props = get(chain[i], "properties");
+			if (!jis_object(props))
+				continue;
+			for (jobject_iter j = jobj_iter_init(props); jobj_iter_is_valid(j); j = jobj_iter_next(j)) {
+				jobj_iter_deref(j, &pair);
+				std::string key = to_string(pair.key);
+				if (properties.find(key) == properties.end())
+					properties[key] = pair.value;
+			}
+		}
+
+		Struct *bound = new Struct;
+		bound->m_name = unique;
+		std::map<std::string, bool> fields;
+		for (std::map<std::string, jvalue_ref>::const_iterator i = properties.begin(); i != properties.end(); ++i) {
+			Member member;
+			member.m_key = i->first;
+			member.m_field = identifier(i->first);
+			while (fields.count(member.m_field) > 0)
+				member.m_field += '_';
+			jvalue_ref optional = get(i->second, "optional");
+			bool truth = false;
+			member.m_optional = jis_boolean(optional) && jboolean_get(optional, &truth) == CONV_OK && truth;
+			member.m_type = bind(i->second, unique + capitalize(member.m_field));
+			if (member.m_type == NULL) {
+				if (!member.m_optional) {
+					fprintf(stderr, "%s: required property \"%s\" of %s can't be bound (its schema doesn't have exactly "
+							"one type that maps to C++)\n", program, i->first.c_str(), unique.c_str());
+					m_failed = true;
+				} else {
+					fprintf(stderr, "%s: warning: property \"%s\" of %s isn't bound (its schema doesn't have exactly one "
+							"type that maps to C++)\n", program, i->first.c_str(), unique.c_str());
+				}
+				continue;
+			}
+			fields[member.m_field] = true;
+			bound->m_members.push_back(member);
+		}
+
+		// a member named like its struct or like any struct it refers to doesn't compile (the nested structs have
+		// all been named by now)
+		fields.clear();
+		for (std::vector<Member>::iterator i = bound->m_members.begin(); i != bound->m_members.end(); ++i) {
+			while (fields.count(i->m_field) > 0 || m_names.count(i->m_field) > 0)
+				i->m_field += '_';
+			fields[i->m_field] = true;
+			if (i->m_type->m_kind == Type::ARRAY)
+				rename_tables(i->m_type, unique + "_" + i->m_field);
+		}
+
+		// members the bound structs depend on are generated first
+		m_structs.push_back(bound);
+		m_bound[text] = bound;
+
+		Type *type = create(Type::OBJECT);
+		type->m_struct = bound;
+		return type;
+	}
+
+	static void rename_tables(Type *type, const std::string &prefix)
+	{
+		for (std::string name = prefix; type->m_kind == Type::ARRAY; type = type->m_items, name += "_items")
+			type->m_table = name + "_type";
+	}
+
+	std::vector<Struct *> m_structs;	/// in the order they must be declared
+	std::vector<Type *> m_types;
+	std::map<std::string, Struct *> m_bound;	/// by canonical schema, so that a schema referred to repeatedly is bound once
+	std::map<std::string, bool> m_names;
+	bool m_failed;
+};
+
+static std::string cxx_type(const Type *type)
+{
+	switch (type->m_kind) {
+		case Type::STRING: return "std::string";
+		case Type::INTEGER: return "int64_t";
+		case Type::NUMBER: return "double";
+		case Type::BOOLEAN: return "bool";
+		case Type::OBJECT: return type->m_struct->m_name;
+		case Type::ARRAY:
+		{
+			std::string items = cxx_type(type->m_items);
+			// avoid >> for older compilers
+			return "std::vector<" + items + (items[items.size() - 1] == '>' ? " >" : ">");
+		}
+	}
+	return "";
+}
+
+static std::string binding_table(const Type *type)
+{
+	switch (type->m_kind) {
+		case Type::STRING: return "&pbnjson::JBindingString";
+		case Type::INTEGER: return "&pbnjson::JBindingInteger";
+		case Type::NUMBER: return "&pbnjson::JBindingNumber";
+		case Type::BOOLEAN: return "&pbnjson::JBindingBoolean";
+		case Type::OBJECT: return "&" + type->m_struct->m_name + "_type";
+		case Type::ARRAY: return "&" + type->m_table;
+	}
+	return "";
+}
+
+static std::string c_literal(const std::string &text)
+{
+	std::string literal = "\"";
+	for (std::string::size_type i = 0; i < text.size(); i++) {
+		unsigned char c = text[i];
+		if (i > 0 && i % 100 == 0)
+			literal += "\"\n\t\"";
+		if (c == '"' || c == '\\') {
+			literal += '\\';
+			literal += c;
+		} else if (c < 0x20 || c >= 0x7f) {
+			char octal[8];
+			snprintf(octal, sizeof(octal), "\\%03o", c);
+			literal += octal;
+		} else {
+			literal += c;
+		}
+	}
+	return literal + "\"";
+}
+
+static void array_tables(std::ostream &out, const Type *type)
+{
+	if (type->m_kind != Type::ARRAY)
+		return;
+	array_tables(out, type->m_items);
+
+	std::string accessors = "pbnjson::JBindingVector<" + cxx_type(type->m_items) + " >";
+	out << "const pbnjson::JBindingType " << type->m_table << " = {\n"
+		<< "\tpbnjson::JBindingType::BIND_ARRAY, NULL, 0, " << binding_table(type->m_items) << ",\n"
+		<< "\t&" << accessors << "::append, &" << accessors << "::size, &" << accessors << "::at\n"
+		<< "};\n\n";
+}
+
+static void generate(const Binder &binder, const Struct *root, const std::string &schemaText, const std::string &schemaFile,
+		const std::string &ns, const std::string &output, std::string &header, std::string &source)
+{
+	std::vector<std::string> namespaces;
+	for (std::string::size_type start = 0; !ns.empty() && start != std::string::npos; ) {
+		std::string::size_type end = ns.find("::", start);
+		namespaces.push_back(ns.substr(start, end == std::string::npos ? std::string::npos : end - start));
+		start = (end == std::string::npos) ? end : end + 2;
+	}
+
+	std::string guard = identifier(file_name_of(output));
+	std::transform(guard.begin(), guard.end(), guard.begin(), ::toupper);
+	guard += "_H_";
+
+	const std::vector<Struct *> &structs = binder.structs();
+	std::ostringstream h, cpp;
+	std::string banner = "/* Generated by pbnjson_bindgen from " + file_name_of(schemaFile) + " - do not edit */\n\n";
+
+	h << banner
+	  << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+	  << "#include <pbnjson.hpp>\n#include <stdint.h>\n#include <string>\n#include <vector>\n\n";
+	for (size_t i = 0; i < namespaces.size(); i++)
+		h << "namespace " << namespaces[i] << " {\n";
+	if (!namespaces.empty())
+		h << "\n";
+
+	for (size_t i = 0; i < structs.size(); i++) {
+		const Struct *s = structs[i];
+		std::vector<const Member *> scalars, optionals;
+
+		h << "struct " << s->m_name << " {\n";
+		for (size_t j = 0; j < s->m_members.size(); j++) {
+			const Member &member = s->m_members[j];
+			h << "\t" << cxx_type(member.m_type) << " " << member.m_field << ";\n";
+			if (member.m_type->m_kind == Type::INTEGER || member.m_type->m_kind == Type::NUMBER ||
+					member.m_type->m_kind == Type::BOOLEAN)
+				scalars.push_back(&member);
+			if (member.m_optional)
+				optionals.push_back(&member);
+		}
+
+		if (!optionals.empty()) {
+			h << "\n\t/** which of the optional members were set */\n\tstruct Present {\n";
+			for (size_t j = 0; j < optionals.size(); j++)
+				h << "\t\tbool " << optionals[j]->m_field << ";\n";
+			h << "\n\t\tPresent() : ";
+			for (size_t j = 0; j < optionals.size(); j++)
+				h << (j > 0 ? ", " : "") << optionals[j]->m_field << "(false)";
+			h << " {}\n\t} has;\n";
+		}
+		if (!scalars.empty()) {
+			h << "\n\t" << s->m_name << "() : ";
+			for (size_t j = 0; j < scalars.size(); j++)
+				h << (j > 0 ? ", " : "") << scalars[j]->m_field << "(" << (scalars[j]->m_type->m_kind == Type::BOOLEAN ? "false" : "0") << ")";
+			h << " {}\n";
+		}
+		h << "};\n\n";
+	}
+
+	h << "/**\n"
+	  << " * Parse JSON straight into value, validating it against " << file_name_of(schemaFile) << ".\n"
+	  << " *\n"
+	  << " * @return False if the input isn't valid (value is left partially filled).\n"
+	  << " */\n"
+	  << "bool parse(const std::string &input, " << root->m_name << " &value, pbnjson::JErrorHandler *errors = NULL);\n\n"
+	  << "/**\n"
+	  << " * Serialize value (optional members that aren't set are left out).\n"
+	  << " */\n"
+	  << "bool toString(const " << root->m_name << " &value, std::string &asStr);\n\n";
+	for (size_t i = namespaces.size(); i > 0; i--)
+		h << "}\n";
+	if (!namespaces.empty())
+		h << "\n";
+	h << "#endif /* " << guard << " */\n";
+
+	cpp << banner
+	    << "#include \"" << file_name_of(output) << ".h\"\n\n";
+	for (size_t i = 0; i < namespaces.size(); i++)
+		cpp << "namespace " << namespaces[i] << " {\n";
+	cpp << "\nnamespace {\n\n"
+	    << "/* " << file_name_of(schemaFile) << " with every reference inlined */\n"
+	    << "const char schemaText[] =\n\t" << c_literal(schemaText) << ";\n\n";
+
+	for (size_t i = 0; i < structs.size(); i++) {
+		const Struct *s = structs[i];
+
+		for (size_t j = 0; j < s->m_members.size(); j++) {
+			const Member &member = s->m_members[j];
+			array_tables(cpp, member.m_type);
+			cpp << "void* " << s->m_name << "_" << member.m_field << "(void *object)\n{\n"
+			    << "\treturn &static_cast<" << s->m_name << " *>(object)->" << member.m_field << ";\n}\n\n";
+			if (member.m_optional) {
+				cpp << "bool* " << s->m_name << "_has_" << member.m_field << "(void *object)\n{\n"
+				    << "\treturn &static_cast<" << s->m_name << " *>(object)->has." << member.m_field << ";\n}\n\n";
+			}
+		}
+
+		if (!s->m_members.empty()) {
+			cpp << "const pbnjson::JBindingMember " << s->m_name << "_members[] = {\n";
+			for (size_t j = 0; j < s->m_members.size(); j++) {
+				const Member &member = s->m_members[j];
+				cpp << "\t{ " << c_literal(member.m_key) << ", " << member.m_key.size() << ", "
+				    << binding_table(member.m_type) << ", " << s->m_name << "_" << member.m_field << ", "
+				    << (member.m_optional ? s->m_name + "_has_" + member.m_field : "NULL") << " },\n";
+			}
+			cpp << "};\n\n";
+		}
+
+		cpp << "const pbnjson::JBindingType " << s->m_name << "_type = {\n"
+		    << "\tpbnjson::JBindingType::BIND_OBJECT, "
+		    << (s->m_members.empty() ? "NULL" : s->m_name + "_members") << ", " << s->m_members.size()
+		    << ", NULL, NULL, NULL, NULL\n};\n\n";
+	}
+
+	cpp << "}\n\n"
+	    << "bool parse(const std::string &input, " << root->m_name << " &value, pbnjson::JErrorHandler *errors)\n{\n"
+	    << "\tstatic const pbnjson::JSchemaFragment schema(schemaText);\n\n"
+	    << "\tvalue = " << root->m_name << "();\n"
+	    << "\tpbnjson::JBindingParser parser(" << root->m_name << "_type, &value);\n"
+	    << "\treturn parser.parse(input, schema, errors);\n}\n\n"
+	    << "bool toString(const " << root->m_name << " &value, std::string &asStr)\n{\n"
+	    << "\treturn pbnjson::JBindingGenerator::toString(" << root->m_name << "_type, &value, asStr);\n}\n\n";
+	for (size_t i = namespaces.size(); i > 0; i--)
+		cpp << "}\n";
+
+	header = h.str();
+	source = cpp.str();
+}
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> includeDirs;
+	std::string ns, output, schemaFile;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "I:n:o:h")) != -1) {
+		switch (opt) {
+			case 'I':
+				includeDirs.push_back(optarg);
+				break;
+			case 'n':
+				ns = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				usage();
+				return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1 || output.empty()) {
+		usage();
+		return EXIT_FAILURE;
+	}
+	schemaFile = argv[optind];
+
+	SchemaLoader loader(includeDirs);
+	jvalue_ref document = loader.load(schemaFile);
+	if (document == NULL)
+		return EXIT_FAILURE;
+
+	jvalue_ref expanded = loader.expand(document, schemaFile);
+	if (expanded == NULL)
+		return EXIT_FAILURE;
+
+	Binder binder;
+	Type *root = binder.bind(expanded, identifier(capitalize(file_name_of(schemaFile).substr(0,
+			file_name_of(schemaFile).find('.')))));
+	if (root == NULL || root->m_kind != Type::OBJECT) {
+		fprintf(stderr, "%s: %s must describe an object with properties\n", program, schemaFile.c_str());
+		j_release(&expanded);
+		return EXIT_FAILURE;
+	}
+	if (binder.failed()) {
+		j_release(&expanded);
+		return EXIT_FAILURE;
+	}
+
+	std::string schemaText, header, source;
+	canonical(expanded, schemaText);
+	generate(binder, root->m_struct, schemaText, schemaFile, ns, output, header, source);
+	j_release(&expanded);
+
+	if (!write_file(output + ".h", header) || !write_file(output + ".cpp", source))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -32,4 +32,10 @@ typedef enum TopLevelType TopLevelType;
 
 PJSON_LOCAL JStreamRef jstreamInternal(jschema_ref schema, TopLevelType type);
 
+/**
+ * Append a string that is known to contain nothing requiring escaping (no quote, backslash
+ * or control characters).  The bytes are copied verbatim into the output.
+ */
+PJSON_LOCAL JStreamRef jstream_string_noescape(JStreamRef stream, raw_buffer str);
+
 #endif /* GEN_STREAM_H_ */
@@ -0,0 +1,102 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include "jallocator_internal.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys_malloc.h>
+#include <compiler/unused_attribute.h>
+
+static void* system_malloc(void *ctxt UNUSED_VAR, size_t size)
+{
+	return malloc(size);
+}
+
+static void* system_realloc(void *ctxt UNUSED_VAR, void *ptr, size_t size)
+{
+	return realloc(ptr, size);
+}
+
+static void system_free(void *ctxt UNUSED_VAR, void *ptr)
+{
+	free(ptr);
+}
+
+static const JAllocator system_allocator = {
+	system_malloc,
+	system_realloc,
+	system_free,
+	NULL,
+};
+
+JAllocatorRef j_allocator = &system_allocator;
+
+void jallocator_set_default(JAllocatorRef allocator)
+{
+	j_allocator = (allocator != NULL ? allocator : &system_allocator);
+}
+
+JAllocatorRef jallocator_default(void)
+{
+	return j_allocator;
+}
+
+char* j_strdup(const char *str)
+{
+	size_t length = strlen(str) + 1;
+	char *copy = (char *)j_malloc(length);
+	CHECK_ALLOC_RETURN_NULL(copy);
+	memcpy(copy, str, length);
+	return copy;
+}
+
+void j_free_dealloc(void *ptr)
+{
+	j_free(ptr);
+}
+
+void j_value_dealloc(void *ptr UNUSED_VAR)
+{
+	PJ_LOG_ERR("Memory owned by a value was released without the value");
+	assert(false);
+}
+
+static void* yajl_adapter_malloc(void *ctxt, unsigned int size)
+{
+	return j_malloc_with((JAllocatorRef)ctxt, size);
+}
+
+static void* yajl_adapter_realloc(void *ctxt, void *ptr, unsigned int size)
+{
+	return j_realloc_with((JAllocatorRef)ctxt, ptr, size);
+}
+
+static void yajl_adapter_free(void *ctxt, void *ptr)
+{
+	j_free_with((JAllocatorRef)ctxt, ptr);
+}
+
+void j_allocator_yajl(JAllocatorRef allocator, yajl_alloc_funcs *funcs)
+{
+	funcs->malloc = yajl_adapter_malloc;
+	funcs->realloc = yajl_adapter_realloc;
+	funcs->free = yajl_adapter_free;
+	// yajl hands the context back as is - it never writes through it
+	funcs->ctx = (void *)allocator;
+}
@@ -0,0 +1,91 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JALLOCATOR_INTERNAL_H_
+#define JALLOCATOR_INTERNAL_H_
+
+#include <japi.h>
+#include <jallocator.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <compiler/nonnull_attribute.h>
+#include <yajl/yajl_common.h>
+#include "liblog.h"
+
+/*
+ * Everything the library allocates goes through these.  The j_* forms use the default allocator (see
+ * jallocator_set_default); memory owned by a value uses the allocator the value was created with.
+ */
+
+extern PJSON_LOCAL JAllocatorRef j_allocator;
+
+static inline void* j_malloc_with(JAllocatorRef allocator, size_t size)
+{
+	return allocator->m_malloc(allocator->m_ctxt, size);
+}
+
+static inline void* j_calloc_with(JAllocatorRef allocator, size_t count, size_t size)
+{
+	void *ptr;
+	if (UNLIKELY(size != 0 && count > SIZE_MAX / size))
+		return NULL;
+	ptr = allocator->m_malloc(allocator->m_ctxt, count * size);
+	if (LIKELY(ptr != NULL))
+		memset(ptr, 0, count * size);
+	return ptr;
+}
+
+static inline void* j_realloc_with(JAllocatorRef allocator, void *ptr, size_t size)
+{
+	return allocator->m_realloc(allocator->m_ctxt, ptr, size);
+}
+
+static inline void j_free_with(JAllocatorRef allocator, void *ptr)
+{
+	if (ptr != NULL)
+		allocator->m_free(allocator->m_ctxt, ptr);
+}
+
+#define j_malloc(size) j_malloc_with(j_allocator, size)
+#define j_calloc(count, size) j_calloc_with(j_allocator, count, size)
+#define j_realloc(ptr, size) j_realloc_with(j_allocator, ptr, size)
+#define j_free(ptr) j_free_with(j_allocator, ptr)
+
+/**
+ * @return A copy of str made with the default allocator (NULL if it couldn't be allocated).
+ */
+PJSON_LOCAL char* j_strdup(const char *str) NON_NULL(1);
+
+/**
+ * Release a buffer with the default allocator - for the places that take a jdeallocator.
+ */
+PJSON_LOCAL void j_free_dealloc(void *ptr);
+
+/**
+ * A jdeallocator that is never called - it marks the string/number copy of a value as memory that has to go
+ * back to the allocator of the value.
+ */
+PJSON_LOCAL void j_value_dealloc(void *ptr);
+
+/**
+ * Fill in the allocation functions for a yajl handle so its memory comes from allocator.
+ */
+PJSON_LOCAL void j_allocator_yajl(JAllocatorRef allocator, yajl_alloc_funcs *funcs) NON_NULL(1, 2);
+
+#endif /* JALLOCATOR_INTERNAL_H_ */
@@ -0,0 +1,641 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include <jcbor.h>
+#include <jobject.h>
+#include "liblog.h"
+#include "jallocator_internal.h"
+#include "jobject_internal.h"
+#include "jcbor_internal.h"
+#include "jstats_internal.h"
+#include <assert.h>
+#include <float.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The major types (the top 3 bits of the initial byte of every data item).
+ */
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
+#define CBOR_SIMPLE 7
+
+/*
+ * Additional information (the low 5 bits) of the initial byte.
+ */
+#define CBOR_INFO_UINT8 24
+#define CBOR_INFO_INDEFINITE 31
+
+#define CBOR_FALSE 20
+#define CBOR_TRUE 21
+#define CBOR_NULL 22
+#define CBOR_UNDEFINED 23
+#define CBOR_HALF 25
+#define CBOR_FLOAT 26
+#define CBOR_DOUBLE 27
+
+#define CBOR_BREAK 0xff
+
+/**
+ * How deep a data item can nest before the decoder has to go to the heap for its frame stack.
+ */
+#define CBOR_PREALLOCATED_DEPTH 32
+
+typedef struct CborEncoder {
+	char *m_data;
+	size_t m_length;
+	size_t m_capacity;
+} CborEncoder;
+
+static bool cbor_reserve(CborEncoder *encoder, size_t length)
+{
+	size_t capacity;
+	char *data;
+
+	if (LIKELY(encoder->m_capacity - encoder->m_length >= length))
+		return true;
+
+	capacity = encoder->m_capacity * 2;
+	if (capacity < encoder->m_length + length)
+		capacity = encoder->m_length + length;
+
+	data = realloc(encoder->m_data, capacity);
+	CHECK_ALLOC_RETURN_VALUE(data, false);
+
+	encoder->m_data = data;
+	encoder->m_capacity = capacity;
+	return true;
+}
+
+static inline void cbor_put_be(CborEncoder *encoder, uint64_t value, size_t length)
+{
+	for (size_t i = length; i > 0; i--)
+		encoder->m_data[encoder->m_length++] = (char)(value >> (8 * (i - 1)));
+}
+
+/**
+ * Write the initial byte of a data item & its argument in the shortest form that holds it.
+ */
+static bool cbor_put_head(CborEncoder *encoder, int major, uint64_t argument)
+{
+	size_t length;
+	int info;
+
+	if (argument < CBOR_INFO_UINT8) {
+		length = 0;
+		info = (int)argument;
+	} else if (argument <= UINT8_MAX) {
+		length = 1;
+		info = CBOR_INFO_UINT8;
+	} else if (argument <= UINT16_MAX) {
+		length = 2;
+		info = CBOR_INFO_UINT8 + 1;
+	} else if (argument <= UINT32_MAX) {
+		length = 4;
+		info = CBOR_INFO_UINT8 + 2;
+	} else {
+		length = 8;
+		info = CBOR_INFO_UINT8 + 3;
+	}
+
+	if (UNLIKELY(!cbor_reserve(encoder, 1 + length)))
+		return false;
+
+	encoder->m_data[encoder->m_length++] = (char)((major << 5) | info);
+	cbor_put_be(encoder, argument, length);
+	return true;
+}
+
+static bool cbor_put_text(CborEncoder *encoder, raw_buffer str)
+{
+	if (UNLIKELY(!cbor_put_head(encoder, CBOR_TEXT, str.m_len)))
+		return false;
+	if (UNLIKELY(!cbor_reserve(encoder, str.m_len)))
+		return false;
+
+	memcpy(encoder->m_data + encoder->m_length, str.m_str, str.m_len);
+	encoder->m_length += str.m_len;
+	return true;
+}
+
+static bool cbor_put_integer(CborEncoder *encoder, int64_t integer)
+{
+	if (integer >= 0)
+		return cbor_put_head(encoder, CBOR_UNSIGNED, (uint64_t)integer);
+	// -1 - n without overflowing for INT64_MIN
+	return cbor_put_head(encoder, CBOR_NEGATIVE, ~(uint64_t)integer);
+}
+
+static bool cbor_put_floating(CborEncoder *encoder, double floating)
+{
+	CHECK_CONDITION_RETURN_VALUE(!isfinite(floating), false, "%g has no representation in JSON", floating);
+
+	if (!cbor_reserve(encoder, 9))
+		return false;
+
+	if (floating >= -FLT_MAX && floating <= FLT_MAX && (double)(float)floating == floating) {
+		float single = (float)floating;
+		uint32_t bits;
+		memcpy(&bits, &single, sizeof(bits));
+		encoder->m_data[encoder->m_length++] = (char)((CBOR_SIMPLE << 5) | CBOR_FLOAT);
+		cbor_put_be(encoder, bits, sizeof(bits));
+	} else {
+		uint64_t bits;
+		memcpy(&bits, &floating, sizeof(bits));
+		encoder->m_data[encoder->m_length++] = (char)((CBOR_SIMPLE << 5) | CBOR_DOUBLE);
+		cbor_put_be(encoder, bits, sizeof(bits));
+	}
+	return true;
+}
+
+static bool cbor_put_number(CborEncoder *encoder, jvalue_ref num)
+{
+	int64_t integer;
+	double floating;
+
+	switch (num->value.val_num.m_type) {
+		case NUM_INT:
+			return cbor_put_integer(encoder, num->value.val_num.value.integer);
+		case NUM_FLOAT:
+			return cbor_put_floating(encoder, num->value.val_num.value.floating);
+		case NUM_RAW:
+			if (jnumber_get_i64(num, &integer) == CONV_OK)
+				return cbor_put_integer(encoder, integer);
+			jnumber_get_f64(num, &floating);
+			return cbor_put_floating(encoder, floating);
+		default:
+			PJ_LOG_ERR("internal error - numeric type is unrecognized (%d)", (int)num->value.val_num.m_type);
+			return false;
+	}
+}
+
+static bool cbor_put_value(CborEncoder *encoder, jvalue_ref val)
+{
+	switch (val->m_type) {
+		case JV_NULL:
+			if (UNLIKELY(!cbor_reserve(encoder, 1)))
+				return false;
+			encoder->m_data[encoder->m_length++] = (char)((CBOR_SIMPLE << 5) | CBOR_NULL);
+			return true;
+		case JV_BOOL:
+			if (UNLIKELY(!cbor_reserve(encoder, 1)))
+				return false;
+			encoder->m_data[encoder->m_length++] = (char)((CBOR_SIMPLE << 5) | (jboolean_deref(val) ? CBOR_TRUE : CBOR_FALSE));
+			return true;
+		case JV_NUM:
+			return cbor_put_number(encoder, val);
+		case JV_STR:
+			return cbor_put_text(encoder, jstring_get_fast(val));
+		case JV_ARRAY:
+		{
+			ssize_t size = jarray_size(val);
+
+			if (UNLIKELY(!cbor_put_head(encoder, CBOR_ARRAY, size)))
+				return false;
+			for (ssize_t i = 0; i < size; i++) {
+				if (UNLIKELY(!cbor_put_value(encoder, jarray_get(val, i))))
+					return false;
+			}
+			return true;
+		}
+		case JV_OBJECT:
+		{
+			jobject_key_value keyval;
+
+			if (UNLIKELY(!cbor_put_head(encoder, CBOR_MAP, jobject_size(val))))
+				return false;
+			for (jobject_iter i = jobj_iter_init(val); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
+				jobj_iter_deref(i, &keyval);
+				if (UNLIKELY(!cbor_put_text(encoder, jstring_get_fast(keyval.key))))
+					return false;
+				if (UNLIKELY(!cbor_put_value(encoder, keyval.value)))
+					return false;
+			}
+			return true;
+		}
+		default:
+			PJ_LOG_ERR("internal error - value type is unrecognized (%d)", (int)val->m_type);
+			return false;
+	}
+}
+
+char* jvalue_to_cbor(jvalue_ref val, size_t *length)
+{
+	CborEncoder encoder = { 0 };
+	uint64_t start = jstats_start();
+
+	CHECK_POINTER_RETURN_NULL(val);
+
+	if (!cbor_put_value(&encoder, val)) {
+		free(encoder.m_data);
+		return NULL;
+	}
+
+	JSTATS_ADD_TIME(m_generateTime, start);
+	*length = encoder.m_length;
+	return encoder.m_data;
+}
+
+/**
+ * An array or map being decoded.
+ */
+typedef struct CborFrame {
+	uint64_t m_remaining; /// items (array) or pairs (map) still to come - unused if the length is indefinite
+	bool m_indefinite;
+	bool m_isObject;
+	bool m_wantKey; /// the next item is a map key
+} CborFrame;
+
+typedef struct CborDecoder {
+	const unsigned char *m_input;
+	size_t m_length;
+	size_t m_offset;
+	CborFrame *m_stack; /// m_preallocated until it needs to grow
+	size_t m_depth;
+	size_t m_capacity;
+	char *m_chunks; /// indefinite-length strings are put back together here
+	size_t m_chunksCapacity;
+	CborFrame m_preallocated[CBOR_PREALLOCATED_DEPTH];
+} CborDecoder;
+
+/**
+ * Read the initial byte of a data item & its argument.  The argument of an indefinite length is 0.
+ */
+static CborStatus cbor_get_head(CborDecoder *decoder, int *major, int *info, uint64_t *argument)
+{
+	size_t length;
+	unsigned char initial;
+
+	if (UNLIKELY(decoder->m_offset == decoder->m_length))
+		return CBOR_TRUNCATED;
+
+	initial = decoder->m_input[decoder->m_offset++];
+	*major = initial >> 5;
+	*info = initial & 0x1f;
+	*argument = 0;
+
+	if (*info < CBOR_INFO_UINT8) {
+		*argument = *info;
+		return CBOR_OK;
+	}
+	if (*info == CBOR_INFO_INDEFINITE)
+		return CBOR_OK;
+	if (UNLIKELY(*info > CBOR_INFO_UINT8 + 3)) {
+		PJ_LOG_WARN("Reserved additional information %d at offset %zu", *info, decoder->m_offset - 1);
+		return CBOR_INVALID;
+	}
+
+	length = (size_t)1 << (*info - CBOR_INFO_UINT8);
+	if (UNLIKELY(decoder->m_length - decoder->m_offset < length))
+		return CBOR_TRUNCATED;
+
+	for (size_t i = 0; i < length; i++)
+		*argument = (*argument << 8) | decoder->m_input[decoder->m_offset++];
+	return CBOR_OK;
+}
+
+/**
+ * Read the contents of a text string whose initial byte has already been read.
+ */
+static CborStatus cbor_get_text(CborDecoder *decoder, int info, uint64_t argument, const unsigned char **str, unsigned int *strLen)
+{
+	size_t length = 0;
+
+	if (info != CBOR_INFO_INDEFINITE) {
+		if (UNLIKELY(argument > decoder->m_length - decoder->m_offset))
+			return CBOR_TRUNCATED;
+		if (UNLIKELY(argument > UINT_MAX)) {
+			PJ_LOG_WARN("String at offset %zu is too long", decoder->m_offset);
+			return CBOR_INVALID;
+		}
+		*str = decoder->m_input + decoder->m_offset;
+		*strLen = (unsigned int)argument;
+		decoder->m_offset += argument;
+		return CBOR_OK;
+	}
+
+	// a series of definite-length chunks ended by a break
+	for (;;) {
+		CborStatus status;
+		int major;
+
+		if (UNLIKELY(decoder->m_offset == decoder->m_length))
+			return CBOR_TRUNCATED;
+		if (decoder->m_input[decoder->m_offset] == CBOR_BREAK) {
+			decoder->m_offset++;
+			break;
+		}
+
+		status = cbor_get_head(decoder, &major, &info, &argument);
+		if (UNLIKELY(status != CBOR_OK))
+			return status;
+		if (UNLIKELY(major != CBOR_TEXT || info == CBOR_INFO_INDEFINITE)) {
+			PJ_LOG_WARN("Chunk of an indefinite-length string at offset %zu isn't a definite-length text string", decoder->m_offset);
+			return CBOR_INVALID;
+		}
+		if (UNLIKELY(argument > decoder->m_length - decoder->m_offset))
+			return CBOR_TRUNCATED;
+		if (UNLIKELY(length + argument > UINT_MAX)) {
+			PJ_LOG_WARN("String at offset %zu is too long", decoder->m_offset);
+			return CBOR_INVALID;
+		}
+
+		if (length + argument > decoder->m_chunksCapacity) {
+			size_t capacity = 2 * (length + argument);
+			char *chunks = j_realloc(decoder->m_chunks, capacity);
+			CHECK_ALLOC_RETURN_VALUE(chunks, CBOR_INVALID);
+			decoder->m_chunks = chunks;
+			decoder->m_chunksCapacity = capacity;
+		}
+		memcpy(decoder->m_chunks + length, decoder->m_input + decoder->m_offset, argument);
+		length += argument;
+		decoder->m_offset += argument;
+	}
+
+	*str = (const unsigned char *)decoder->m_chunks;
+	*strLen = (unsigned int)length;
+	return CBOR_OK;
+}
+
+static CborStatus cbor_push(CborDecoder *decoder, bool isObject, int info, uint64_t argument)
+{
+	CborFrame *frame;
+
+	if (UNLIKELY(decoder->m_depth == decoder->m_capacity)) {
+		size_t capacity = decoder->m_capacity * 2;
+		CborFrame *stack;
+
+		if (decoder->m_stack == decoder->m_preallocated) {
+			stack = j_malloc(capacity * sizeof(CborFrame));
+			if (stack != NULL)
+				memcpy(stack, decoder->m_stack, decoder->m_depth * sizeof(CborFrame));
+		} else {
+			stack = j_realloc(decoder->m_stack, capacity * sizeof(CborFrame));
+		}
+		CHECK_ALLOC_RETURN_VALUE(stack, CBOR_INVALID);
+
+		decoder->m_stack = stack;
+		decoder->m_capacity = capacity;
+	}
+
+	frame = &decoder->m_stack[decoder->m_depth++];
+	frame->m_remaining = argument;
+	frame->m_indefinite = (info == CBOR_INFO_INDEFINITE);
+	frame->m_isObject = isObject;
+	frame->m_wantKey = isObject;
+	return CBOR_OK;
+}
+
+/**
+ * Integers beyond the range of int64_t are handed over as text.
+ */
+static int cbor_big_integer(const CborCallbacks *callbacks, void *ctxt, bool negative, uint64_t argument)
+{
+	char number[24];
+	int numberLen;
+
+	if (!negative)
+		numberLen = snprintf(number, sizeof(number), "%" PRIu64, argument);
+	else if (argument == UINT64_MAX)
+		numberLen = snprintf(number, sizeof(number), "-18446744073709551616");
+	else
+		numberLen = snprintf(number, sizeof(number), "-%" PRIu64, argument + 1);
+
+	return callbacks->m_number(ctxt, number, (unsigned int)numberLen);
+}
+
+/**
+ * Single & half precision are widened to double precision.
+ */
+static CborStatus cbor_get_floating(CborDecoder *decoder, int info, uint64_t argument, double *floating)
+{
+	switch (info) {
+		case CBOR_HALF:
+		{
+			int exponent = (argument >> 10) & 0x1f;
+			double mantissa = (double)(argument & 0x3ff);
+
+			if (exponent == 0x1f) {
+				*floating = (mantissa == 0 ? INFINITY : NAN);
+			} else if (exponent == 0) {
+				*floating = mantissa / (1 << 24);
+			} else {
+				mantissa += 1024;
+				*floating = (exponent >= 25 ? mantissa * (1 << (exponent - 25)) : mantissa / (1 << (25 - exponent)));
+			}
+			if (argument & 0x8000)
+				*floating = -*floating;
+			break;
+		}
+		case CBOR_FLOAT:
+		{
+			uint32_t bits = (uint32_t)argument;
+			float single;
+			memcpy(&single, &bits, sizeof(single));
+			*floating = single;
+			break;
+		}
+		case CBOR_DOUBLE:
+			memcpy(floating, &argument, sizeof(*floating));
+			break;
+		default:
+			PJ_LOG_WARN("Simple value %d at offset %zu has no representation in JSON", info, decoder->m_offset - 1);
+			return CBOR_INVALID;
+	}
+
+	if (UNLIKELY(!isfinite(*floating))) {
+		PJ_LOG_WARN("%g at offset %zu has no representation in JSON", *floating, decoder->m_offset);
+		return CBOR_INVALID;
+	}
+	return CBOR_OK;
+}
+
+#define CBOR_CALLBACK(callback, ...) \
+	do { \
+		if (UNLIKELY(!(callback)(__VA_ARGS__))) \
+			return CBOR_CANCELED; \
+	} while (0)
+
+/**
+ * Arrays & maps are tracked on a stack of their own rather than by recursion, so that no input can run the
+ * decoder out of machine stack.
+ */
+static CborStatus cbor_decode(CborDecoder *decoder, const CborCallbacks *callbacks, void *ctxt)
+{
+	CborStatus status;
+	CborFrame *frame = NULL;
+	bool started = false;
+	const unsigned char *str;
+	unsigned int strLen;
+	uint64_t argument;
+	double floating;
+	int major, info;
+
+	for (;;) {
+		if (decoder->m_depth == 0) {
+			if (started)
+				break;
+			started = true;
+			frame = NULL;
+		} else {
+			frame = &decoder->m_stack[decoder->m_depth - 1];
+			if (!frame->m_indefinite && frame->m_remaining == 0 && frame->m_wantKey == frame->m_isObject) {
+				decoder->m_depth--;
+				CBOR_CALLBACK(frame->m_isObject ? callbacks->m_objEnd : callbacks->m_arrEnd, ctxt);
+				continue;
+			}
+		}
+
+		if (decoder->m_offset < decoder->m_length && decoder->m_input[decoder->m_offset] == CBOR_BREAK) {
+			if (UNLIKELY(frame == NULL || !frame->m_indefinite || frame->m_wantKey != frame->m_isObject)) {
+				PJ_LOG_WARN("Unexpected break at offset %zu", decoder->m_offset);
+				return CBOR_INVALID;
+			}
+			decoder->m_offset++;
+			decoder->m_depth--;
+			CBOR_CALLBACK(frame->m_isObject ? callbacks->m_objEnd : callbacks->m_arrEnd, ctxt);
+			continue;
+		}
+
+		// tags only tell the application how to interpret the item that follows
+		do {
+			status = cbor_get_head(decoder, &major, &info, &argument);
+			if (UNLIKELY(status != CBOR_OK))
+				return status;
+		} while (major == CBOR_TAG && info != CBOR_INFO_INDEFINITE);
+
+		if (UNLIKELY(info == CBOR_INFO_INDEFINITE && major != CBOR_TEXT && major != CBOR_ARRAY && major != CBOR_MAP)) {
+			PJ_LOG_WARN("Indefinite length for major type %d at offset %zu", major, decoder->m_offset - 1);
+			return CBOR_INVALID;
+		}
+
+		if (frame != NULL && frame->m_isObject && frame->m_wantKey) {
+			if (UNLIKELY(major != CBOR_TEXT)) {
+				PJ_LOG_WARN("Map key at offset %zu isn't a text string", decoder->m_offset - 1);
+				return CBOR_INVALID;
+			}
+			status = cbor_get_text(decoder, info, argument, &str, &strLen);
+			if (UNLIKELY(status != CBOR_OK))
+				return status;
+			frame->m_wantKey = false;
+			CBOR_CALLBACK(callbacks->m_objKey, ctxt, str, strLen);
+			continue;
+		}
+
+		if (frame != NULL) {
+			if (frame->m_isObject)
+				frame->m_wantKey = true;
+			if (!frame->m_indefinite)
+				frame->m_remaining--;
+		}
+
+		switch (major) {
+			case CBOR_UNSIGNED:
+				if (argument > INT64_MAX) {
+					CBOR_CALLBACK(cbor_big_integer, callbacks, ctxt, false, argument);
+					break;
+				}
+				CBOR_CALLBACK(callbacks->m_integer, ctxt, (int64_t)argument);
+				break;
+			case CBOR_NEGATIVE:
+				if (argument > INT64_MAX) {
+					CBOR_CALLBACK(cbor_big_integer, callbacks, ctxt, true, argument);
+					break;
+				}
+				CBOR_CALLBACK(callbacks->m_integer, ctxt, -1 - (int64_t)argument);
+				break;
+			case CBOR_BYTES:
+				PJ_LOG_WARN("Byte string at offset %zu has no representation in JSON", decoder->m_offset - 1);
+				return CBOR_INVALID;
+			case CBOR_TEXT:
+				status = cbor_get_text(decoder, info, argument, &str, &strLen);
+				if (UNLIKELY(status != CBOR_OK))
+					return status;
+				CBOR_CALLBACK(callbacks->m_string, ctxt, str, strLen);
+				break;
+			case CBOR_ARRAY:
+			case CBOR_MAP:
+				status = cbor_push(decoder, major == CBOR_MAP, info, argument);
+				if (UNLIKELY(status != CBOR_OK))
+					return status;
+				CBOR_CALLBACK(major == CBOR_MAP ? callbacks->m_objStart : callbacks->m_arrStart, ctxt);
+				break;
+			case CBOR_SIMPLE:
+				switch (info) {
+					case CBOR_FALSE:
+					case CBOR_TRUE:
+						CBOR_CALLBACK(callbacks->m_boolean, ctxt, info == CBOR_TRUE);
+						break;
+					case CBOR_NULL:
+					case CBOR_UNDEFINED:
+						CBOR_CALLBACK(callbacks->m_null, ctxt);
+						break;
+					default:
+						status = cbor_get_floating(decoder, info, argument, &floating);
+						if (UNLIKELY(status != CBOR_OK))
+							return status;
+						CBOR_CALLBACK(callbacks->m_floating, ctxt, floating);
+						break;
+				}
+				break;
+			default:
+				// tags have all been skipped
+				assert(false);
+				return CBOR_INVALID;
+		}
+	}
+
+	if (UNLIKELY(decoder->m_offset != decoder->m_length)) {
+		PJ_LOG_WARN("Unexpected data after the end of the value at offset %zu", decoder->m_offset);
+		return CBOR_INVALID;
+	}
+	return CBOR_OK;
+}
+
+CborStatus jcbor_parse(raw_buffer input, const CborCallbacks *callbacks, void *ctxt, size_t *offset)
+{
+	CborDecoder decoder;
+	CborStatus status;
+
+	decoder.m_input = (const unsigned char *)input.m_str;
+	decoder.m_length = input.m_len;
+	decoder.m_offset = 0;
+	decoder.m_stack = decoder.m_preallocated;
+	decoder.m_depth = 0;
+	decoder.m_capacity = CBOR_PREALLOCATED_DEPTH;
+	decoder.m_chunks = NULL;
+	decoder.m_chunksCapacity = 0;
+
+	status = cbor_decode(&decoder, callbacks, ctxt);
+
+	if (offset != NULL)
+		*offset = decoder.m_offset;
+	if (decoder.m_stack != decoder.m_preallocated)
+		j_free(decoder.m_stack);
+	j_free(decoder.m_chunks);
+	return status;
+}
@@ -0,0 +1,64 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JCBOR_INTERNAL_H_
+#define JCBOR_INTERNAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <japi.h>
+#include <jtypes.h>
+#include <compiler/nonnull_attribute.h>
+
+/**
+ * The events fired by the CBOR decoder.  Apart from numbers they have the same signatures as the yajl callbacks
+ * so the functions the text parser dispatches to can be used as they are.  Numbers are handed over natively.
+ */
+typedef struct CborCallbacks {
+	int (*m_null)(void *ctxt);
+	int (*m_boolean)(void *ctxt, int boolVal);
+	int (*m_integer)(void *ctxt, int64_t integer);
+	int (*m_floating)(void *ctxt, double floating);
+	/// integers that don't fit in an int64_t, as JSON text
+	int (*m_number)(void *ctxt, const char *numberVal, unsigned int numberLen);
+	int (*m_string)(void *ctxt, const unsigned char *str, unsigned int strLen);
+	int (*m_objStart)(void *ctxt);
+	int (*m_objKey)(void *ctxt, const unsigned char *key, unsigned int keyLen);
+	int (*m_objEnd)(void *ctxt);
+	int (*m_arrStart)(void *ctxt);
+	int (*m_arrEnd)(void *ctxt);
+} CborCallbacks;
+
+typedef enum {
+	CBOR_OK,
+	CBOR_CANCELED, /// a callback returned 0
+	CBOR_TRUNCATED, /// the input ended part-way through the value
+	CBOR_INVALID, /// the input is malformed or holds something JSON can't represent
+} CborStatus;
+
+/**
+ * Walk the single CBOR data item in input, firing a callback for every JSON event.
+ *
+ * Byte strings & simple values other than false, true, null & undefined (which becomes null) have no JSON
+ * equivalent and are rejected, as are maps with keys that aren't text strings.  Tags are ignored.
+ *
+ * @param offset Set to how far into the input decoding got (may be NULL)
+ */
+PJSON_LOCAL CborStatus jcbor_parse(raw_buffer input, const CborCallbacks *callbacks, void *ctxt, size_t *offset) NON_NULL(2);
+
+#endif /* JCBOR_INTERNAL_H_ */
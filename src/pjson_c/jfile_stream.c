@@ -0,0 +1,296 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include <jparse_stream.h>
+#include "liblog.h"
+#include "jallocator_internal.h"
+#include "jparse_stream_internal.h"
+#include <pjson_zlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * How much of the file is read (& at most inflated) at a time.  Together with zlib's 32KB window this bounds
+ * the memory needed to read a file of any size.
+ */
+#define FILE_STREAM_CHUNK (64 * 1024)
+
+#define GZIP_MAGIC0 0x1f
+#define GZIP_MAGIC1 0x8b
+
+struct JFileStream {
+	const char *m_file; /// for logging only
+	int m_fd; /// -1 unless the stream opened the file itself
+	jinput_reader m_read;
+	void *m_readCtxt;
+	bool m_compressed;
+	bool m_eof; /// nothing left to read from the file
+	unsigned char m_input[FILE_STREAM_CHUNK];
+	size_t m_pending; /// uncompressed: bytes read while detecting compression that haven't been handed out yet
+#ifdef HAVE_ZLIB
+	z_stream m_inflate;
+	bool m_memberDone; /// the last gzip member inflated has ended (so the file may end here)
+	unsigned char m_output[FILE_STREAM_CHUNK];
+#endif
+};
+
+static ssize_t file_stream_read_fd(void *ctxt, char *buffer, size_t size)
+{
+	JFileStream *stream = (JFileStream *)ctxt;
+	ssize_t length;
+
+	do {
+		length = read(stream->m_fd, buffer, size);
+	} while (length == -1 && errno == EINTR);
+
+	if (length == -1)
+		PJ_LOG_WARN("Failed to read '%s' (%d) : %s", stream->m_file, errno, strerror(errno));
+	return length;
+}
+
+/**
+ * @param offset How much of m_input is already taken - the chunk read is stored after it.
+ * @return The number of bytes read (0 at the end of the file) or -1 on error (logged).
+ */
+static ssize_t file_stream_fill_at(JFileStream *stream, size_t offset)
+{
+	ssize_t length;
+
+	length = stream->m_read(stream->m_readCtxt, (char *)stream->m_input + offset, sizeof(stream->m_input) - offset);
+	if (length == -1)
+		PJ_LOG_WARN("Failed to read '%s'", stream->m_file);
+	else if (length == 0)
+		stream->m_eof = true;
+	return length;
+}
+
+/**
+ * @return The number of bytes read (0 at the end of the file) or -1 on error (logged).
+ */
+static ssize_t file_stream_fill(JFileStream *stream)
+{
+	return file_stream_fill_at(stream, 0);
+}
+
+/**
+ * Read the first chunk & find out whether it's compressed.  Closes the stream on failure.
+ */
+static JFileStream* file_stream_start(JFileStream *stream)
+{
+	ssize_t length = 0;
+
+	// a reader may hand out as little as a byte at a time - the gzip magic takes two
+	while (length < 2 && !stream->m_eof) {
+		ssize_t chunk = file_stream_fill_at(stream, length);
+		if (chunk == -1) {
+			jfile_stream_close(&stream);
+			return NULL;
+		}
+		length += chunk;
+	}
+
+	stream->m_compressed = (length >= 2 && stream->m_input[0] == GZIP_MAGIC0 && stream->m_input[1] == GZIP_MAGIC1);
+	if (!stream->m_compressed) {
+		stream->m_pending = length;
+		return stream;
+	}
+
+#ifdef HAVE_ZLIB
+	// 16 + the largest window: expect a gzip header rather than a zlib one
+	if (inflateInit2(&stream->m_inflate, 16 + MAX_WBITS) != Z_OK) {
+		PJ_LOG_ERR("Failed to set up decompression of '%s'", stream->m_file);
+		stream->m_compressed = false;
+		jfile_stream_close(&stream);
+		return NULL;
+	}
+	stream->m_inflate.next_in = stream->m_input;
+	stream->m_inflate.avail_in = length;
+	return stream;
+#else
+	PJ_LOG_WARN("'%s' is gzip compressed but pbnjson was built without zlib", stream->m_file);
+	stream->m_compressed = false;
+	jfile_stream_close(&stream);
+	return NULL;
+#endif
+}
+
+JFileStream* jfile_stream_open(const char *file)
+{
+	JFileStream *stream;
+
+	stream = j_calloc(1, sizeof(JFileStream));
+	CHECK_ALLOC_RETURN_NULL(stream);
+	stream->m_file = file;
+	stream->m_read = file_stream_read_fd;
+	stream->m_readCtxt = stream;
+
+	stream->m_fd = open(file, O_RDONLY);
+	if (stream->m_fd == -1) {
+		PJ_LOG_WARN("Attempt to parse json document '%s' failed (%d) : %s", file, errno, strerror(errno));
+		j_free(stream);
+		return NULL;
+	}
+
+	return file_stream_start(stream);
+}
+
+JFileStream* jfile_stream_open_reader(jinput_reader read, void *ctxt)
+{
+	JFileStream *stream;
+
+	stream = j_calloc(1, sizeof(JFileStream));
+	CHECK_ALLOC_RETURN_NULL(stream);
+	stream->m_file = "input stream";
+	stream->m_fd = -1;
+	stream->m_read = read;
+	stream->m_readCtxt = ctxt;
+
+	return file_stream_start(stream);
+}
+
+bool jfile_stream_compressed(JFileStream *stream)
+{
+	return stream->m_compressed;
+}
+
+bool jfile_compressed(const char *file, bool *compressed)
+{
+	unsigned char magic[2];
+	size_t length = 0;
+	ssize_t chunk = 0;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd == -1) {
+		PJ_LOG_WARN("Attempt to parse json document '%s' failed (%d) : %s", file, errno, strerror(errno));
+		return false;
+	}
+
+	while (length < sizeof(magic)) {
+		chunk = pread(fd, magic + length, sizeof(magic) - length, length);
+		if (chunk == -1 && errno == EINTR)
+			continue;
+		if (chunk <= 0)
+			break;
+		length += chunk;
+	}
+
+	if (chunk == -1) {
+		PJ_LOG_WARN("Failed to read '%s' (%d) : %s", file, errno, strerror(errno));
+		close(fd);
+		return false;
+	}
+	close(fd);
+
+	*compressed = (length == sizeof(magic) && magic[0] == GZIP_MAGIC0 && magic[1] == GZIP_MAGIC1);
+	return true;
+}
+
+#ifdef HAVE_ZLIB
+static bool file_stream_inflate(JFileStream *stream, raw_buffer *chunk)
+{
+	z_stream *inflater = &stream->m_inflate;
+
+	inflater->next_out = stream->m_output;
+	inflater->avail_out = sizeof(stream->m_output);
+
+	while (inflater->avail_out == sizeof(stream->m_output)) {
+		int status;
+
+		if (inflater->avail_in == 0) {
+			ssize_t length = file_stream_fill(stream);
+			if (length == -1)
+				return false;
+			if (length == 0) {
+				if (!stream->m_memberDone) {
+					PJ_LOG_WARN("'%s' is truncated", stream->m_file);
+					return false;
+				}
+				break;
+			}
+			inflater->next_in = stream->m_input;
+			inflater->avail_in = length;
+		}
+
+		if (stream->m_memberDone) {
+			// files made by concatenating gzip files hold several members one after another
+			inflateReset(inflater);
+			stream->m_memberDone = false;
+		}
+
+		status = inflate(inflater, Z_NO_FLUSH);
+		if (status == Z_STREAM_END) {
+			stream->m_memberDone = true;
+		} else if (status != Z_OK) {
+			PJ_LOG_WARN("'%s' isn't valid gzip data (%d) : %s", stream->m_file, status,
+			            inflater->msg ? inflater->msg : "unknown error");
+			return false;
+		}
+	}
+
+	*chunk = j_str_to_buffer((const char *)stream->m_output, sizeof(stream->m_output) - inflater->avail_out);
+	return true;
+}
+#endif
+
+bool jfile_stream_read(JFileStream *stream, raw_buffer *chunk)
+{
+	ssize_t length;
+
+#ifdef HAVE_ZLIB
+	if (stream->m_compressed)
+		return file_stream_inflate(stream, chunk);
+#endif
+
+	if (stream->m_pending > 0) {
+		*chunk = j_str_to_buffer((const char *)stream->m_input, stream->m_pending);
+		stream->m_pending = 0;
+		return true;
+	}
+
+	if (stream->m_eof) {
+		*chunk = j_str_to_buffer((const char *)stream->m_input, 0);
+		return true;
+	}
+
+	length = file_stream_fill(stream);
+	if (length == -1)
+		return false;
+	*chunk = j_str_to_buffer((const char *)stream->m_input, length);
+	return true;
+}
+
+void jfile_stream_close(JFileStream **stream)
+{
+	CHECK_POINTER(stream);
+	if (*stream == NULL)
+		return;
+
+#ifdef HAVE_ZLIB
+	if ((*stream)->m_compressed)
+		inflateEnd(&(*stream)->m_inflate);
+#endif
+	if ((*stream)->m_fd != -1)
+		close((*stream)->m_fd);
+	j_free(*stream);
+	*stream = NULL;
+}
@@ -24,11 +24,11 @@ LICENSE@@@ */
 #include <sys_malloc.h>
 #include <assert.h>
 #include <inttypes.h>
-
-#include <compiler/malloc_attribute.h>
-#include <compiler/unused_attribute.h>
+#include <yajl_compat.h>
 
 #include "liblog.h"
+#include "jallocator_internal.h"
+#include "jvalue/num_conversion.h"
 
 typedef struct PJSON_LOCAL {
 	struct __JStream stream;
@@ -47,42 +47,6 @@ typedef struct PJSON_LOCAL {
 		}								\
 	} while(0)
 
-// Why is this emitting a warning - is this due to the compiler version on OSX?
-#if 0
-#define INTERNAL_MALLOC_SIZE RETURN_SIZE2(2, 3)
-#define INTERNAL_MALLOC_SIZE2 RETURN_SIZE(3)
-#else
-#define INTERNAL_MALLOC_SIZE
-#define INTERNAL_MALLOC_SIZE2
-#endif
-
-// for some reason the return size is ignored
-static void * pjson_internal_calloc(UNUSED_VAR void *ctx, size_t nmemb, size_t sz) MALLOC_FUNC INTERNAL_MALLOC_SIZE UNUSED_FUNC;
-static void * pjson_internal_malloc(UNUSED_VAR void *ctx, size_t nmemb, size_t sz) MALLOC_FUNC INTERNAL_MALLOC_SIZE UNUSED_FUNC;
-static void * pjson_internal_realloc(UNUSED_VAR void *ctx, void *ptr, unsigned int sz) UNUSED_FUNC INTERNAL_MALLOC_SIZE2;
-
-static void pjson_internal_free(UNUSED_VAR void *ctx, void * ptr) UNUSED_FUNC;
-
-static void * pjson_internal_calloc(void *ctx, size_t nmemb, size_t sz)
-{
-	return calloc(nmemb, sz);
-}
-
-static void * pjson_internal_malloc(void *ctx, size_t nmemb, size_t sz)
-{
-	return malloc(sz * nmemb);
-}
-
-static void * pjson_internal_realloc(void *ctx, void *ptr, unsigned int sz)
-{
-	return realloc(ptr, sz);
-}
-
-static void pjson_internal_free(void *ctx, void * ptr)
-{
-	return free(ptr);
-}
-
 static ActualStream* begin_object(ActualStream* __stream)
 {
 	SANITY_CHECK_POINTER(__stream);
@@ -143,8 +107,8 @@ static ActualStream* val_dbl(ActualStream* __stream, double number)
 	// yajl doesn't print properly (%g doesn't seem to do what it claims to
 	// do or something - fails for 42323.0234234)
 	// let's work around it with the  raw interface by 
-	char f[32];
-	int len = snprintf(f, sizeof(f) - 1, "%.14lg", number); 
+	char f[JDOUBLE_FORMAT_SIZE];
+	unsigned int len = jdouble_format(number, f);
 	yajl_gen_number(__stream->handle, f, len);
 #ifdef _DEBUG
 	const unsigned char *buffer;
@@ -165,6 +129,21 @@ static ActualStream* val_str(ActualStream* __stream, raw_buffer str)
 	return __stream;
 }
 
+static ActualStream* val_str_noescape(ActualStream* __stream, raw_buffer str)
+{
+	SANITY_CHECK_POINTER(__stream);
+	SANITY_CHECK_POINTER(str.m_str);
+	assert(str.m_str != NULL);
+	CHECK_HANDLE(__stream);
+#if HAVE_YAJL_GEN_STRING_NOESCAPE
+	yajl_gen_string_noescape(__stream->handle, (const unsigned char *)str.m_str, str.m_len);
+#else
+	yajl_gen_string(__stream->handle, (const unsigned char *)str.m_str, str.m_len);
+#endif
+
+	return __stream;
+}
+
 static ActualStream* val_bool(ActualStream* __stream, bool boolean)
 {
 	SANITY_CHECK_POINTER(__stream);
@@ -244,14 +223,14 @@ static char* finish_stream(ActualStream* __stream, StreamStatus *error_code)
 	}
 	yajl_gen_free(__stream->handle);
 	SANITY_KILL_POINTER(__stream->handle);
-	free(__stream);
+	j_free(__stream);
 	SANITY_KILL_POINTER(__stream);
 	return buf;
 
 stream_error:
 	if (__stream->handle)
 		yajl_gen_free(__stream->handle);
-	free(__stream);
+	j_free(__stream);
 	return NULL;
 }
 
@@ -272,30 +251,28 @@ static struct __JStream yajl_stream_generator =
 
 JStreamRef jstreamInternal(jschema_ref schema, TopLevelType type)
 {
-	ActualStream* stream = (ActualStream*)calloc(1, sizeof(ActualStream));
+	ActualStream* stream = (ActualStream*)j_calloc(1, sizeof(ActualStream));
 	if (UNLIKELY(stream == NULL)) {
 		return NULL;
 	}
 	memcpy(&stream->stream, &yajl_stream_generator, sizeof(struct __JStream));
 
-#if 0
-	// try to use custom allocators to bypass freeing the buffer & instead passing off
-	// ownership to the caller.  for now, this is too difficult - we'll duplicate the string instead
-	yajl_alloc_funcs allocators = {
-		pjson_internal_malloc,
-		pjso_internal_malloc,
-		pjso_internal_free,
-		NULL,
-	};
+	// the buffer yajl generates into comes from the default allocator too - finish_stream hands the caller
+	// a copy of it
+	yajl_alloc_funcs allocators;
+	j_allocator_yajl(j_allocator, &allocators);
 	stream->handle = yajl_gen_alloc(NULL, &allocators);
-#else
-	stream->handle = yajl_gen_alloc(NULL, NULL);
-#endif
 	stream->opened = type;
 
 	return (JStreamRef)stream;
 }
 
+JStreamRef jstream_string_noescape(JStreamRef stream, raw_buffer str)
+{
+	// every stream handed out by this file is backed by yajl
+	return (JStreamRef)val_str_noescape((ActualStream *)stream, str);
+}
+
 JStreamRef jstream(jschema_ref schema)
 {
 	return jstreamInternal(schema, TOP_None);
@@ -34,6 +34,9 @@ LICENSE@@@ */
 #include <sys_malloc.h>
 #include <sys/mman.h>
 #include "jobject_internal.h"
+#include "jallocator_internal.h"
+#include "jsnapshot_internal.h"
+#include "jstats_internal.h"
 #include "liblog.h"
 #include "jvalue/num_conversion.h"
 #include "linked_list.h"
@@ -88,7 +91,8 @@ static jvalue JEMPTY_STR = {
 		.m_data = {
 			.m_str = "",
 			.m_len = 0,
-		}
+		},
+		.m_escapeFree = true,
 	},
 	.m_type = JV_STR,
 	.m_refCnt = 1,
@@ -152,13 +156,20 @@ static void jvalue_to_string_append (jvalue_ref jref, JStreamRef generating)
  * @param type The type of JSON value to create
  * @return NULL or a reference to a valid, dynamically allocated, structure that isn't a JSON null reference.
  */
-static jvalue_ref jvalue_create (JValueType type)
+jvalue_ref jvalue_create (JValueType type)
+{
+	return jvalue_create_with (type, j_allocator);
+}
+
+jvalue_ref jvalue_create_with (JValueType type, JAllocatorRef allocator)
 {
-	jvalue_ref new_value = (jvalue_ref) calloc (1, sizeof(jvalue));
+	jvalue_ref new_value = (jvalue_ref) j_calloc_with (allocator, 1, sizeof(jvalue));
 	CHECK_ALLOC_RETURN_NULL(new_value);
 	new_value->m_refCnt = 1;
 	new_value->m_type = type;
+	new_value->m_allocator = allocator;
 	TRACE_REF("created", new_value);
+	JSTATS_ALLOCATED(type - JV_BOOL, 1, sizeof(jvalue));
 	return new_value;
 }
 
@@ -205,6 +216,7 @@ jvalue_ref jvalue_duplicate (jvalue_ref val)
 		result = jobject_create_hint (jobject_size (val));
 		jobject_iter i;
 		jobject_key_value pair;
+		jvalue_ref keyCopy;
 		jvalue_ref valueCopy;
 
 		for (i = jobj_iter_init (val); jobj_iter_is_valid (i); i = jobj_iter_next (i)) {
@@ -214,9 +226,11 @@ jvalue_ref jvalue_duplicate (jvalue_ref val)
 				break;
 			}
 			valueCopy = jvalue_duplicate (pair.value);
-			if (!jobject_put (result, jvalue_copy (pair.key), valueCopy)) {
+			// keys are duplicated too so that no reference counts are shared with val
+			keyCopy = jvalue_duplicate (pair.key);
+			if (!jobject_put (result, keyCopy, valueCopy)) {
 				j_release (&valueCopy);
-				j_release (&pair.key);
+				j_release (&keyCopy);
 				j_release (&result);
 				result = NULL;
 				break;
@@ -225,7 +239,7 @@ jvalue_ref jvalue_duplicate (jvalue_ref val)
 	} else if (jis_array (val)) {
 		ssize_t arrSize = jarray_size (val);
 		result = jarray_create_hint (NULL, arrSize);
-		for (ssize_t i = arrSize - 1; i >= 0; i--) {
+		for (ssize_t i = 0; i < arrSize; i++) {
 			if (!jarray_append (result, jvalue_duplicate (jarray_get (val, i)))) {
 				j_release (&result);
 				result = NULL;
@@ -240,6 +254,8 @@ jvalue_ref jvalue_duplicate (jvalue_ref val)
 #else
 		if (jis_string(val)) {
 			result = jstring_create_copy(jstring_get_fast(val));
+			if (val->value.val_str.m_escapeFree && jis_string(result))
+				jstring_set_escape_free(result);
 		} else if (jis_number(val)) {
 			result = jnumber_duplicate(val);
 		} else
@@ -321,13 +337,17 @@ void j_release (jvalue_ref *val)
 			if ((*val)->m_backingBufferMMap) {
 				munmap((void *)(*val)->m_backingBuffer.m_str, (*val)->m_backingBuffer.m_len);
 			} else {
-				free((void *)(*val)->m_backingBuffer.m_str);
+				j_free((void *)(*val)->m_backingBuffer.m_str);
 			}
 		}
+		if ((*val)->m_backingRelease) {
+			PJ_LOG_MEM("Releasing owner %p of the input backing %p", (*val)->m_backingOwner, *val);
+			(*val)->m_backingRelease((*val)->m_backingOwner);
+		}
 
 		SANITY_CLEAR_VAR((*val)->m_refCnt, 0);
 		PJ_LOG_MEM("Freeing %p", *val);
-		free (*val);
+		j_free_with ((*val)->m_allocator, *val);
 	} else if (UNLIKELY((*val)->m_refCnt < 0)) {
 		PJ_LOG_ERR("reference counter messed up - memory corruption and/or random crashes are possible");
 		assert(false);
@@ -367,11 +387,13 @@ static const char *jvalue_tostring_internal (jvalue_ref val, jschema_ref schema,
 
 	if (!val->m_toString) {
 		StreamStatus error;
+		uint64_t start = jstats_start();
 		JStreamRef generating = jstreamInternal (schema, TOP_None);
 		jvalue_to_string_append (val, generating);
 		val->m_toString = generating->finish (generating, &error);
 		val->m_toStringDealloc = free;
 		assert (val->m_toString != NULL);
+		JSTATS_ADD_TIME(m_generateTime, start);
 	}
 
 	return val->m_toString;
@@ -405,6 +427,11 @@ static void j_destroy_object (jvalue_ref ref)
 	SANITY_CHECK_POINTER(ref);
 	assert(jis_object(ref));
 
+	if (ref->m_snapshot) {
+		jsnapshot_destroy(ref);
+		return;
+	}
+
 	for (jobject_iter i = jobj_iter_init(ref); jobj_iter_is_valid(i); i = jobj_iter_remove(i));
 
 	toFree = DEREF_OBJ(ref).m_table.m_next;
@@ -423,14 +450,20 @@ static void j_destroy_object (jvalue_ref ref)
 
 		nextTable = toFree->m_next;
 		PJ_LOG_MEM("Freeing object bucket array %p", toFree);
-		SANITY_FREE(free, jkey_value_array *, toFree, sizeof(jkey_value_array));
+		SANITY_CLEAR_MEMORY(toFree, sizeof(jkey_value_array));
+		j_free_with(ref->m_allocator, toFree);
 		toFree = nextTable;
 	}
 }
 
 jvalue_ref jobject_create ()
 {
-	jvalue_ref new_obj = jvalue_create (JV_OBJECT);
+	return jobject_create_with (j_allocator);
+}
+
+jvalue_ref jobject_create_with (JAllocatorRef allocator)
+{
+	jvalue_ref new_obj = jvalue_create_with (JV_OBJECT, allocator);
 	CHECK_POINTER_RETURN_NULL(new_obj);
 	INIT_LIST_HEAD(&DEREF_OBJ(new_obj).m_start.list);
 	return new_obj;
@@ -447,6 +480,7 @@ static bool jobject_insert_internal (jvalue_ref object, jkey_value_array *table,
 {
 	int bucket;
 
+	JSTATS_ADD(m_hashProbes, 1);
 	bucket = key_hash (item.key);
 
 	// is a key present at the current spot in the table
@@ -455,8 +489,9 @@ static bool jobject_insert_internal (jvalue_ref object, jkey_value_array *table,
 		if (LIKELY(!jstring_equal_internal(table->m_bucket[bucket].entry.key, item.key))) {
 			// hash collision - go on to next table
 			if (!table->m_next) {
-				table->m_next = (jkey_value_array *) calloc (1, sizeof(jkey_value_array));
+				table->m_next = (jkey_value_array *) j_calloc_with (object->m_allocator, 1, sizeof(jkey_value_array));
 				CHECK_ALLOC_RETURN_VALUE(table->m_next, false);
+				JSTATS_ALLOCATED(JSTATS_OBJECT, 0, sizeof(jkey_value_array));
 			}
 			return jobject_insert_internal (object, table->m_next, item);
 		}
@@ -552,8 +587,9 @@ jvalue_ref jobject_create_hint (int capacityHint)
 
 	while (capacityHint > OBJECT_BUCKET_SIZE) {
 		assert (*expansion == NULL);
-		*expansion = calloc (1, sizeof(jkey_value_array));
+		*expansion = j_calloc_with (new_object->m_allocator, 1, sizeof(jkey_value_array));
 		CHECK_ALLOC_RETURN_VALUE(*expansion, new_object);
+		JSTATS_ALLOCATED(JSTATS_OBJECT, 0, sizeof(jkey_value_array));
 		expansion = & ( (*expansion)->m_next);
 		capacityHint -= OBJECT_BUCKET_SIZE;
 	}
@@ -579,6 +615,9 @@ size_t jobject_size (jvalue_ref obj)
 
 	CHECK_CONDITION_RETURN_VALUE(!jis_object(obj), result, "Attempt to retrieve size from something not an object");
 
+	if (obj->m_snapshot)
+		return jsnapshot_size(obj);
+
 	for (jobject_iter i = jobj_iter_init (obj); jobj_iter_is_valid (i); i = jobj_iter_next (i))
 		result++;
 
@@ -608,6 +647,7 @@ static jobject_key_value* jobject_find (jkey_value_array *toCheck, raw_buffer *k
 		// faster than an iterator.
 
 		SANITY_CHECK_POINTER(toCheck);
+		JSTATS_ADD(m_hashProbes, 1);
 		bucket = key_hash_raw (key);
 
 		keyInTable = toCheck->m_bucket [bucket].entry.key;
@@ -636,6 +676,12 @@ bool jobject_get_exists (jvalue_ref obj, raw_buffer key, jvalue_ref *value)
 	CHECK_CONDITION_RETURN_VALUE(jis_null(obj), false, "Attempt to cast null %p to object", obj);
 	CHECK_CONDITION_RETURN_VALUE(!jis_object(obj), false, "Attempt to cast type %d to object (%d)", obj->m_type, JV_OBJECT);
 
+	if (obj->m_snapshot) {
+		jvalue_ref found = jsnapshot_object_get(obj, key);
+		if (found != NULL && value) *value = found;
+		return found != NULL;
+	}
+
 	result = jobject_find (&DEREF_OBJ(obj).m_table, &key, NULL);
 	if (result != NULL) {
 		if (value) *value = result->value;
@@ -654,6 +700,12 @@ bool jobject_get_exists2 (jvalue_ref obj, jvalue_ref key, jvalue_ref *value)
 	CHECK_CONDITION_RETURN_VALUE(jis_null(obj), false, "Attempt to cast null %p to object", obj);
 	CHECK_CONDITION_RETURN_VALUE(!jis_object(obj), false, "Attempt to cast type %d to object (%d)", obj->m_type, JV_OBJECT);
 
+	if (obj->m_snapshot) {
+		jvalue_ref found = jsnapshot_object_get(obj, jstring_get_fast(key));
+		if (found != NULL && value) *value = found;
+		return found != NULL;
+	}
+
 	result = jobject_find2 (&DEREF_OBJ(obj).m_table, key, NULL);
 	if (result != NULL) {
 		if (value) *value = result->value;
@@ -681,6 +733,7 @@ bool jobject_remove (jvalue_ref obj, raw_buffer key)
 
 	CHECK_CONDITION_RETURN_VALUE(jis_null(obj), false, "Attempt to cast null %p to object", obj);
 	CHECK_CONDITION_RETURN_VALUE(!jis_object(obj), false, "Attempt to cast type %d to object (%d)", obj->m_type, JV_OBJECT);
+	CHECK_CONDITION_RETURN_VALUE(obj->m_snapshot, false, "Attempt to modify read-only snapshot %p", obj);
 
 	entry = jobject_find (&DEREF_OBJ(obj).m_table, &key, NULL);
 	if (entry == NULL) return false;
@@ -729,6 +782,7 @@ bool jobject_put (jvalue_ref obj, jvalue_ref key, jvalue_ref val)
 	CHECK_POINTER_RETURN_NULL(key);
 	CHECK_CONDITION_RETURN_VALUE(!jis_string(key), false, "%p is %d not a string (%d)", key, key->m_type, JV_STR);
 	CHECK_CONDITION_RETURN_VALUE(jstring_size(key) == 0, false, "Object instance name is the empty string");
+	CHECK_CONDITION_RETURN_VALUE(obj->m_snapshot, false, "Attempt to modify read-only snapshot %p", obj);
 
 	table = &DEREF_OBJ(obj).m_table;
 
@@ -754,6 +808,11 @@ jobject_iter jobj_iter_init (const jvalue_ref obj)
 
 	CHECK_CONDITION_RETURN_VALUE(!jis_object(obj), JO_ITER(NULL), "Cannot iterate over non-object");
 
+	if (obj->m_snapshot) {
+		list_head *members = jsnapshot_object_members(obj);
+		return JO_ITER (members ? members->next : NULL);
+	}
+
 	SANITY_CHECK_POINTER(DEREF_OBJ(obj).m_start.list.next);
 
 	return JO_ITER (DEREF_OBJ(obj).m_start.list.next);
@@ -770,6 +829,9 @@ jobject_iter jobj_iter_init_last(const jvalue_ref obj)
 
 	CHECK_CONDITION_RETURN_VALUE(!jis_object(obj), JO_ITER(NULL), "Cannot iterator over non-object");
 
+	if (obj->m_snapshot)
+		return JO_ITER (jsnapshot_object_members(obj));
+
 	SANITY_CHECK_POINTER(DEREF_OBJ(obj).m_start.list.prev);
 
 	return JO_ITER (&DEREF_OBJ(obj).m_start.list);
@@ -829,6 +891,10 @@ jobject_iter jobj_iter_remove (jobject_iter i)
 		assert(false);
 		return i;
 	}
+	if (UNLIKELY(lentry(i.m_opaque, jo_keyval_iter, list)->entry.key->m_snapshot)) {
+		PJ_LOG_WARN("Invalid use of API - cannot remove elements from a read-only snapshot");
+		return jobj_iter_next_internal(i);
+	}
 
 	jobject_iter next = jobj_iter_next_internal(i);
 
@@ -915,6 +981,12 @@ static bool valid_index_bounded (jvalue_ref arr, ssize_t index)
 static void j_destroy_array (jvalue_ref arr)
 {
 	SANITY_CHECK_POINTER(arr);
+
+	if (arr->m_snapshot) {
+		jsnapshot_destroy(arr);
+		return;
+	}
+
 	SANITY_CHECK_POINTER(DEREF_ARR(arr).m_bigBucket);
 	assert(jis_array(arr));
 
@@ -933,7 +1005,8 @@ static void j_destroy_array (jvalue_ref arr)
 	assert(jarray_size(arr) == 0);
 
 	PJ_LOG_MEM("Destroying array bucket at %p", DEREF_ARR(arr).m_bigBucket);
-	SANITY_FREE(free, jvalue_ref *, DEREF_ARR(arr).m_bigBucket, DEREF_ARR(arr).m_capacity - ARRAY_BUCKET_SIZE);
+	SANITY_CLEAR_MEMORY(DEREF_ARR(arr).m_bigBucket, DEREF_ARR(arr).m_capacity - ARRAY_BUCKET_SIZE);
+	j_free_with(arr->m_allocator, DEREF_ARR(arr).m_bigBucket);
 }
 
 static void jarray_to_string_append (jvalue_ref jref, JStreamRef generating)
@@ -964,7 +1037,12 @@ static void jarray_to_string_append (jvalue_ref jref, JStreamRef generating)
 
 jvalue_ref jarray_create (jarray_opts opts)
 {
-	jvalue_ref new_array = jvalue_create (JV_ARRAY);
+	return jarray_create_with (j_allocator);
+}
+
+jvalue_ref jarray_create_with (JAllocatorRef allocator)
+{
+	jvalue_ref new_array = jvalue_create_with (JV_ARRAY, allocator);
 	CHECK_ALLOC_RETURN_NULL(new_array);
 
 	DEREF_ARR(new_array).m_capacity = ARRAY_BUCKET_SIZE;
@@ -1027,6 +1105,8 @@ bool jis_array (jvalue_ref val)
 ssize_t jarray_size (jvalue_ref arr)
 {
 	CHECK_CONDITION_RETURN_VALUE(!valid_array(arr), 0, "Attempt to get array size of non-array %p", arr);
+	if (arr->m_snapshot)
+		return jsnapshot_size (arr);
 	return jarray_size_unsafe (arr);
 }
 
@@ -1083,6 +1163,9 @@ jvalue_ref jarray_get (jvalue_ref arr, ssize_t index)
 	CHECK_CONDITION_RETURN_VALUE(!valid_array(arr), 0, "Attempt to get array size of non-array %p", arr);
 	CHECK_CONDITION_RETURN_VALUE(!valid_index_bounded(arr, index), jnull(), "Attempt to get array element from %p with out-of-bounds index value %zd", arr, index);
 
+	if (arr->m_snapshot)
+		return jsnapshot_array_get (arr, index);
+
 	result = * (jarray_get_unsafe (arr, index));
 	if (result == NULL)
 	// need to fix up in case we haven't assigned anything to that space - it's initialized to NULL (JSON undefined)
@@ -1125,6 +1208,7 @@ bool jarray_remove (jvalue_ref arr, ssize_t index)
 
 	CHECK_CONDITION_RETURN_VALUE(!valid_array(arr), false, "Attempt to get array size of non-array %p", arr);
 	CHECK_CONDITION_RETURN_VALUE(!valid_index_bounded(arr, index), jnull(), "Attempt to get array element from %p with out-of-bounds index value %zd", arr, index);
+	CHECK_CONDITION_RETURN_VALUE(arr->m_snapshot, false, "Attempt to modify read-only snapshot %p", arr);
 
 	jarray_remove_unsafe (arr, index);
 
@@ -1149,11 +1233,12 @@ static bool jarray_expand_capacity_unsafe (jvalue_ref arr, ssize_t newSize)
 		// m_capacity is always a minimum of the bucket size
 		assert(OUTSIDE_ARR_BUCKET_RANGE(newSize));
 		assert(newSize > ARRAY_BUCKET_SIZE);
-		jvalue_ref *newBigBucket = realloc (DEREF_ARR(arr).m_bigBucket, sizeof(jvalue_ref) * (newSize - ARRAY_BUCKET_SIZE));
+		jvalue_ref *newBigBucket = j_realloc_with (arr->m_allocator, DEREF_ARR(arr).m_bigBucket, sizeof(jvalue_ref) * (newSize - ARRAY_BUCKET_SIZE));
 		if (UNLIKELY(newBigBucket == NULL)) {
 			assert(false);
 			return false;
 		}
+		JSTATS_ALLOCATED(JSTATS_ARRAY, 0, sizeof(jvalue_ref) * (newSize - DEREF_ARR(arr).m_capacity));
 
 		PJ_LOG_MEM("Resized %p from %zu bytes to %p with %zu bytes", DEREF_ARR(arr).m_bigBucket, sizeof(jvalue_ref)*(DEREF_ARR(arr).m_capacity - ARRAY_BUCKET_SIZE), newBigBucket, sizeof(jvalue_ref)*(newSize - ARRAY_BUCKET_SIZE));
 
@@ -1195,6 +1280,7 @@ bool jarray_set (jvalue_ref arr, ssize_t index, jvalue_ref val)
 
 	CHECK_CONDITION_RETURN_VALUE(!jis_array(arr), false, "Attempt to get array size of non-array %p", arr);
 	CHECK_CONDITION_RETURN_VALUE(index < 0, false, "Attempt to set array element for %p with negative index value %zd", arr, index);
+	CHECK_CONDITION_RETURN_VALUE(arr->m_snapshot, false, "Attempt to modify read-only snapshot %p", arr);
 
 	if (UNLIKELY(val == NULL)) {
 		PJ_LOG_WARN("incorrect API use - please pass an actual reference to a JSON null if that's what you want - assuming that's what you meant");
@@ -1213,6 +1299,7 @@ bool jarray_put (jvalue_ref arr, ssize_t index, jvalue_ref val)
 
 	CHECK_CONDITION_RETURN_VALUE(!jis_array(arr), false, "Attempt to insert into non-array %p", arr);
 	CHECK_CONDITION_RETURN_VALUE(index < 0, false, "Attempt to insert array element for %p with negative index value %zd", arr, index);
+	CHECK_CONDITION_RETURN_VALUE(arr->m_snapshot, false, "Attempt to modify read-only snapshot %p", arr);
 
 	if (UNLIKELY(val == NULL)) {
 		PJ_LOG_WARN("incorrect API use - please pass an actual reference to a JSON null if that's what you want - assuming that's the case");
@@ -1233,6 +1320,7 @@ bool jarray_append (jvalue_ref arr, jvalue_ref val)
 			jis_number(val) || jis_boolean(val));
 	CHECK_CONDITION_RETURN_VALUE(!jis_array(arr), false, "Attempt to append into non-array %p", arr);
 	CHECK_CONDITION_RETURN_VALUE(!valid_array(arr), false, "Attempt to append into non-array %p", arr);
+	CHECK_CONDITION_RETURN_VALUE(arr->m_snapshot, false, "Attempt to modify read-only snapshot %p", arr);
 
 	if (UNLIKELY(val == NULL)) {
 		PJ_LOG_WARN("incorrect API use - please pass an actual reference to a JSON null if that's what you want - assuming that's the case");
@@ -1265,6 +1353,7 @@ bool jarray_insert(jvalue_ref arr, ssize_t index, jvalue_ref val)
 
 	CHECK_CONDITION_RETURN_VALUE(!valid_array(arr), false, "Array to insert into isn't a valid reference to a JSON DOM node: %p", arr);
 	CHECK_CONDITION_RETURN_VALUE(index < 0, false, "Invalid index - must be >= 0: %zd", index);
+	CHECK_CONDITION_RETURN_VALUE(arr->m_snapshot, false, "Attempt to modify read-only snapshot %p", arr);
 
 	{
 		jvalue_ref *toMove, *hole;
@@ -1305,6 +1394,7 @@ bool jarray_splice (jvalue_ref array, ssize_t index, ssize_t toRemove, jvalue_re
 	CHECK_CONDITION_RETURN_VALUE(!valid_index_bounded(array2, begin), false, "Start index is invalid for second array");
 	CHECK_CONDITION_RETURN_VALUE(!valid_index_bounded(array2, end - 1), false, "End index is invalid for second array");
 	CHECK_CONDITION_RETURN_VALUE(toRemove < 0, false, "Invalid amount %zd to remove during splice", toRemove);
+	CHECK_CONDITION_RETURN_VALUE(array->m_snapshot || array2->m_snapshot, false, "Attempt to splice a read-only snapshot");
 
 	for (i = index, j = begin; removable && j < end; i++, removable--, j++) {
 		assert(valid_index_bounded(array, i));
@@ -1394,7 +1484,10 @@ bool jarray_splice_append (jvalue_ref array, jvalue_ref arrayToAppend, JSpliceOw
 
 static inline void jstring_to_string_append (jvalue_ref jref, JStreamRef generating)
 {
-	generating->string (generating, DEREF_STR(jref).m_data);
+	if (DEREF_STR(jref).m_escapeFree)
+		jstream_string_noescape (generating, DEREF_STR(jref).m_data);
+	else
+		generating->string (generating, DEREF_STR(jref).m_data);
 }
 
 static void j_destroy_string (jvalue_ref str)
@@ -1407,7 +1500,15 @@ static void j_destroy_string (jvalue_ref str)
 		return;
 	}
 #endif
-	if (DEREF_STR(str).m_dealloc) {
+	if (DEREF_STR(str).m_dealloc == j_value_dealloc) {
+		PJ_LOG_MEM("Destroying string %p", DEREF_STR(str).m_data.m_str);
+		SANITY_CLEAR_MEMORY(DEREF_STR(str).m_data.m_str, DEREF_STR(str).m_data.m_len);
+		j_free_with(str->m_allocator, (char *)DEREF_STR(str).m_data.m_str);
+	} else if (DEREF_STR(str).m_owner) {
+		PJ_LOG_MEM("Releasing owner %p of string %p", DEREF_STR(str).m_owner, DEREF_STR(str).m_data.m_str);
+		DEREF_STR(str).m_dealloc(DEREF_STR(str).m_owner);
+		SANITY_KILL_POINTER(DEREF_STR(str).m_owner);
+	} else if (DEREF_STR(str).m_dealloc) {
 		PJ_LOG_MEM("Destroying string %p", DEREF_STR(str).m_data.m_str);
 		SANITY_CLEAR_MEMORY(DEREF_STR(str).m_data.m_str, DEREF_STR(str).m_data.m_len);
 		SANITY_FREE_CUST(DEREF_STR(str).m_dealloc, char *, DEREF_STR(str).m_data.m_str, DEREF_STR(str).m_data.m_len);
@@ -1440,19 +1541,35 @@ jvalue_ref jstring_create_utf8 (const char *cstring, ssize_t length)
 }
 
 jvalue_ref jstring_create_copy (raw_buffer str)
+{
+	return jstring_create_copy_with (str, j_allocator);
+}
+
+jvalue_ref jstring_create_copy_with (raw_buffer str, JAllocatorRef allocator)
 {
 	char *copyBuffer;
-	copyBuffer = calloc (str.m_len + SAFE_TERM_NULL_LEN, sizeof(char));
+	jvalue_ref new_str;
+
+	if (str.m_len == 0)
+		return &JEMPTY_STR;
+
+	copyBuffer = j_calloc_with (allocator, str.m_len + SAFE_TERM_NULL_LEN, sizeof(char));
 	if (copyBuffer == NULL) {
 		PJ_LOG_ERR("Failed to allocate space for private string copy");
 		return jnull();
 	}
 	memcpy(copyBuffer, str.m_str, str.m_len);
+	JSTATS_ALLOCATED(JSTATS_STRING, 0, str.m_len + SAFE_TERM_NULL_LEN);
 
-	jvalue_ref new_str = jstring_create_nocopy_full(j_str_to_buffer(copyBuffer, str.m_len), free);
-	CHECK_POINTER_RETURN_NULL(new_str);
+	new_str = jvalue_create_with (JV_STR, allocator);
+	if (UNLIKELY(new_str == NULL)) {
+		j_free_with(allocator, copyBuffer);
+		return NULL;
+	}
 
-	DEREF_STR(new_str).m_data.m_len = str.m_len;
+	// released along with the value (see j_destroy_string)
+	DEREF_STR(new_str).m_dealloc = j_value_dealloc;
+	DEREF_STR(new_str).m_data = j_str_to_buffer(copyBuffer, str.m_len);
 	SANITY_CHECK_JSTR_BUFFER(new_str);
 
 	return new_str;
@@ -1481,6 +1598,22 @@ jvalue_ref jstring_create_nocopy (raw_buffer val)
 	return jstring_create_nocopy_full (val, NULL);
 }
 
+jvalue_ref jstring_create_nocopy_with (raw_buffer val, JAllocatorRef allocator)
+{
+	jvalue_ref new_string;
+
+	CHECK_CONDITION_RETURN_VALUE(val.m_str == NULL, jnull(), "Invalid string to set JSON string to NULL");
+	if (val.m_len == 0)
+		return &JEMPTY_STR;
+
+	new_string = jvalue_create_with (JV_STR, allocator);
+	CHECK_POINTER_RETURN_NULL(new_string);
+
+	DEREF_STR(new_string).m_data = val;
+
+	return new_string;
+}
+
 jvalue_ref jstring_create_nocopy_full (raw_buffer val, jdeallocator buffer_dealloc)
 {
 	jvalue_ref new_string;
@@ -1504,6 +1637,40 @@ jvalue_ref jstring_create_nocopy_full (raw_buffer val, jdeallocator buffer_deall
 	return new_string;
 }
 
+jvalue_ref jstring_create_nocopy_owned (raw_buffer val, jdeallocator release, void *owner)
+{
+	jvalue_ref new_string;
+
+	SANITY_CHECK_POINTER(val.m_str);
+	SANITY_CHECK_MEMORY(val.m_str, val.m_len);
+	CHECK_POINTER_RETURN_NULL(release);
+	CHECK_POINTER_RETURN_NULL(owner);
+	CHECK_CONDITION_RETURN_VALUE(val.m_str == NULL, jnull(), "Invalid string to set JSON string to NULL");
+	if (val.m_len == 0) {
+		release(owner);
+		return &JEMPTY_STR;
+	}
+
+	new_string = jvalue_create (JV_STR);
+	CHECK_POINTER_RETURN_NULL(new_string);
+
+	DEREF_STR(new_string).m_dealloc = release;
+	DEREF_STR(new_string).m_owner = owner;
+	DEREF_STR(new_string).m_data = val;
+
+	SANITY_CHECK_JSTR_BUFFER(new_string);
+
+	return new_string;
+}
+
+void jstring_set_escape_free (jvalue_ref str)
+{
+	assert(jis_string(str));
+	// the empty string constant is already marked
+	if (str != &JEMPTY_STR)
+		DEREF_STR(str).m_escapeFree = true;
+}
+
 ssize_t jstring_size (jvalue_ref str)
 {
 	SANITY_CHECK_JSTR_BUFFER(str);
@@ -1606,7 +1773,10 @@ static void j_destroy_number (jvalue_ref num)
 	assert(DEREF_NUM(num).value.raw.m_str != NULL);
 	SANITY_CHECK_POINTER(DEREF_NUM(num).value.raw.m_str);
 
-	if (DEREF_NUM(num).m_rawDealloc) {
+	if (DEREF_NUM(num).m_rawDealloc == j_value_dealloc) {
+		PJ_LOG_MEM("Destroying raw numeric string %p", DEREF_NUM(num).value.raw.m_str);
+		j_free_with (num->m_allocator, (char *)DEREF_NUM(num).value.raw.m_str);
+	} else if (DEREF_NUM(num).m_rawDealloc) {
 		PJ_LOG_MEM("Destroying raw numeric string %p", DEREF_NUM(num).value.raw.m_str);
 		DEREF_NUM(num).m_rawDealloc ((char *)DEREF_NUM(num).value.raw.m_str);
 	}
@@ -1661,6 +1831,11 @@ jvalue_ref jnumber_duplicate (jvalue_ref num)
 }
 
 jvalue_ref jnumber_create (raw_buffer str)
+{
+	return jnumber_create_with (str, j_allocator);
+}
+
+jvalue_ref jnumber_create_with (raw_buffer str, JAllocatorRef allocator)
 {
 	char *createdBuffer = NULL;
 	jvalue_ref new_number;
@@ -1671,19 +1846,32 @@ jvalue_ref jnumber_create (raw_buffer str)
 	CHECK_POINTER_RETURN_VALUE(str.m_str, jnull());
 	CHECK_CONDITION_RETURN_VALUE(str.m_len <= 0, jnull(), "Invalid length parameter for numeric string %s", str.m_str);
 
-	createdBuffer = (char *) calloc (str.m_len + NUM_TERM_NULL, sizeof(char));
+	createdBuffer = (char *) j_calloc_with (allocator, str.m_len + NUM_TERM_NULL, sizeof(char));
 	CHECK_ALLOC_RETURN_VALUE(createdBuffer, jnull());
 
 	memcpy (createdBuffer, str.m_str, str.m_len);
+	JSTATS_ALLOCATED(JSTATS_NUMBER, 0, str.m_len + NUM_TERM_NULL);
 	str.m_str = createdBuffer;
-	new_number = jnumber_create_unsafe(str, free);
-	if (jis_null(new_number))
-		free(createdBuffer);
+	new_number = jnumber_create_unsafe_with(str, allocator);
+	if (jis_null(new_number)) {
+		j_free_with(allocator, createdBuffer);
+		return new_number;
+	}
 
+	// released along with the value (see j_destroy_number)
+	DEREF_NUM(new_number).m_rawDealloc = j_value_dealloc;
 	return new_number;
 }
 
 jvalue_ref jnumber_create_unsafe (raw_buffer str, jdeallocator strFree)
+{
+	jvalue_ref new_number = jnumber_create_unsafe_with (str, j_allocator);
+	if (LIKELY(!jis_null(new_number)))
+		DEREF_NUM(new_number).m_rawDealloc = strFree;
+	return new_number;
+}
+
+jvalue_ref jnumber_create_unsafe_with (raw_buffer str, JAllocatorRef allocator)
 {
 	jvalue_ref new_number;
 
@@ -1693,24 +1881,28 @@ jvalue_ref jnumber_create_unsafe (raw_buffer str, jdeallocator strFree)
 	CHECK_POINTER_RETURN_VALUE(str.m_str, jnull());
 	CHECK_CONDITION_RETURN_VALUE(str.m_len == 0, jnull(), "Invalid length parameter for numeric string %s", str.m_str);
 
-	new_number = jvalue_create (JV_NUM);
+	new_number = jvalue_create_with (JV_NUM, allocator);
 	CHECK_ALLOC_RETURN_NULL(new_number);
 
 	DEREF_NUM(new_number).m_type = NUM_RAW;
 	DEREF_NUM(new_number).value.raw = str;
-	DEREF_NUM(new_number).m_rawDealloc = strFree;
 
 	return new_number;
 }
 
 jvalue_ref jnumber_create_f64 (double number)
+{
+	return jnumber_create_f64_with (number, j_allocator);
+}
+
+jvalue_ref jnumber_create_f64_with (double number, JAllocatorRef allocator)
 {
 	jvalue_ref new_number;
 
 	CHECK_CONDITION_RETURN_VALUE(isnan(number), jnull(), "NaN has no representation in JSON");
 	CHECK_CONDITION_RETURN_VALUE(isinf(number), jnull(), "Infinity has no representation in JSON");
 
-	new_number = jvalue_create (JV_NUM);
+	new_number = jvalue_create_with (JV_NUM, allocator);
 	CHECK_ALLOC_RETURN_NULL(new_number);
 
 	DEREF_NUM(new_number).m_type = NUM_FLOAT;
@@ -1725,10 +1917,15 @@ jvalue_ref jnumber_create_i32 (int32_t number)
 }
 
 jvalue_ref jnumber_create_i64 (int64_t number)
+{
+	return jnumber_create_i64_with (number, j_allocator);
+}
+
+jvalue_ref jnumber_create_i64_with (int64_t number, JAllocatorRef allocator)
 {
 	jvalue_ref new_number;
 
-	new_number = jvalue_create (JV_NUM);
+	new_number = jvalue_create_with (JV_NUM, allocator);
 	CHECK_ALLOC_RETURN_NULL(new_number);
 
 	DEREF_NUM(new_number).m_type = NUM_INT;
@@ -1744,7 +1941,9 @@ jvalue_ref jnumber_create_converted(raw_buffer raw)
 	new_number = jvalue_create(JV_NUM);
 	CHECK_ALLOC_RETURN_NULL(new_number);
 
+	DEREF_NUM(new_number).m_type = NUM_INT;
 	if (CONV_OK != jstr_to_i64(&raw, &DEREF_NUM(new_number).value.integer)) {
+		DEREF_NUM(new_number).m_type = NUM_FLOAT;
 		DEREF_NUM(new_number).m_error = jstr_to_double(&raw, &DEREF_NUM(new_number).value.floating);
 		if (DEREF_NUM(new_number).m_error != CONV_OK) {
 			PJ_LOG_ERR("Number '%.*s' doesn't convert perfectly to a native type",
@@ -2005,6 +2204,22 @@ ConversionResultFlags jnumber_get_raw (jvalue_ref num, raw_buffer *result)
 	}
 }
 
+ConversionResultFlags jnumber_raw_to_i64 (raw_buffer str, int64_t *number)
+{
+	CHECK_POINTER_RETURN_VALUE(number, CONV_BAD_ARGS);
+	CHECK_POINTER_RETURN_VALUE(str.m_str, CONV_BAD_ARGS);
+
+	return jstr_to_i64 (&str, number);
+}
+
+ConversionResultFlags jnumber_raw_to_f64 (raw_buffer str, double *number)
+{
+	CHECK_POINTER_RETURN_VALUE(number, CONV_BAD_ARGS);
+	CHECK_POINTER_RETURN_VALUE(str.m_str, CONV_BAD_ARGS);
+
+	return jstr_to_double (&str, number);
+}
+
 #undef DEREF_NUM
 /*** JSON Boolean operations ***/
 #define DEREF_BOOL(ref) ((ref)->value.val_bool)
@@ -2027,7 +2242,12 @@ bool jis_boolean (jvalue_ref jval)
 
 jvalue_ref jboolean_create (bool value)
 {
-	jvalue_ref new_bool = jvalue_create (JV_BOOL);
+	return jboolean_create_with (value, j_allocator);
+}
+
+jvalue_ref jboolean_create_with (bool value, JAllocatorRef allocator)
+{
+	jvalue_ref new_bool = jvalue_create_with (JV_BOOL, allocator);
 	if (LIKELY(new_bool != NULL)) {
 		DEREF_BOOL(new_bool).value = value;
 	}
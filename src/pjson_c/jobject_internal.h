@@ -21,6 +21,8 @@ LICENSE@@@ */
 
 #include <japi.h>
 #include <jtypes.h>
+#include <jallocator.h>
+#include <compiler/nonnull_attribute.h>
 #include "linked_list.h"
 
 #define ARRAY_BUCKET_SIZE (1 << 4)
@@ -66,7 +68,14 @@ typedef struct PJSON_LOCAL {
 
 typedef struct PJSON_LOCAL {
 	jdeallocator m_dealloc;
+	void *m_owner;	/// if set, m_dealloc is called with this instead of the buffer (see jstring_create_nocopy_owned)
 	raw_buffer m_data;
+	/**
+	 * Set when the string is known to contain nothing that needs escaping in JSON
+	 * (quote, backslash or control characters) so the generator can copy it verbatim.
+	 * False just means we don't know.
+	 */
+	bool m_escapeFree;
 } jstring;
 
 typedef struct PJSON_LOCAL {
@@ -97,6 +106,21 @@ typedef struct {
 
 // iterator already has a typedef
 
+struct jsnapshot_node;
+
+/**
+ * An array or object that still lives in a mapped snapshot (see jsnapshot.c).  Members are only turned into
+ * jvalues the first time they're asked for.
+ */
+typedef struct PJSON_LOCAL {
+	const char *m_base;	/// the start of the mapping
+	size_t m_size;
+	const struct jsnapshot_node *m_node;
+	jvalue_ref *m_elements;	/// arrays: the elements created so far (allocated on first access)
+	jo_keyval_iter *m_members;	/// objects: one per member followed by the list head (allocated on first access)
+	bool m_linked;	/// objects: every member has been created & linked into the list for iteration
+} jsnapshot_view;
+
 struct jvalue {
 	union {
 		jbool val_bool;
@@ -104,6 +128,7 @@ struct jvalue {
 		jstring val_str;
 		jarray val_array;
 		jobject val_obj;
+		jsnapshot_view val_snap;
 	} value;
 	JValueType m_type;
 	ssize_t m_refCnt;
@@ -111,6 +136,18 @@ struct jvalue {
 	jdeallocator m_toStringDealloc;
 	raw_buffer m_backingBuffer;
 	bool m_backingBufferMMap;
+	jdeallocator m_backingRelease;	/// called with m_backingOwner once the DOM is gone (see jdom_adopt_input)
+	void *m_backingOwner;
+	/**
+	 * Set on values that belong to a snapshot - they're read-only & arrays/objects use val_snap instead of
+	 * val_array/val_obj.
+	 */
+	bool m_snapshot;
+	/**
+	 * Where the value & everything it owns (its string/number copy, bucket tables & elements) was
+	 * allocated from.  NULL for the constants, which are never released.
+	 */
+	JAllocatorRef m_allocator;
 };
 
 typedef struct PJSON_LOCAL jvalue jvalue;
@@ -118,17 +155,30 @@ typedef struct PJSON_LOCAL jvalue jvalue;
 extern PJSON_LOCAL jvalue JNULL;
 
 /**
- * The number of key/value pairs
+ * NOTE: The structure returned (if not null) is always initialized to 0 except for the
+ * reference count (1) and the type (set to the first parameter)
  */
-PJSON_LOCAL size_t jobject_size(jvalue_ref obj);
+PJSON_LOCAL jvalue_ref jvalue_create(JValueType type);
+
+/*
+ * The same as the public constructors except that the value (& whatever it allocates later on) comes from
+ * allocator rather than the default one.
+ */
+PJSON_LOCAL jvalue_ref jvalue_create_with(JValueType type, JAllocatorRef allocator) NON_NULL(2);
+PJSON_LOCAL jvalue_ref jobject_create_with(JAllocatorRef allocator) NON_NULL(1);
+PJSON_LOCAL jvalue_ref jarray_create_with(JAllocatorRef allocator) NON_NULL(1);
+PJSON_LOCAL jvalue_ref jstring_create_copy_with(raw_buffer str, JAllocatorRef allocator) NON_NULL(2);
+PJSON_LOCAL jvalue_ref jstring_create_nocopy_with(raw_buffer str, JAllocatorRef allocator) NON_NULL(2);
+PJSON_LOCAL jvalue_ref jnumber_create_with(raw_buffer str, JAllocatorRef allocator) NON_NULL(2);
+PJSON_LOCAL jvalue_ref jnumber_create_unsafe_with(raw_buffer str, JAllocatorRef allocator) NON_NULL(2);
+PJSON_LOCAL jvalue_ref jnumber_create_i64_with(int64_t number, JAllocatorRef allocator) NON_NULL(2);
+PJSON_LOCAL jvalue_ref jnumber_create_f64_with(double number, JAllocatorRef allocator) NON_NULL(2);
+PJSON_LOCAL jvalue_ref jboolean_create_with(bool value, JAllocatorRef allocator) NON_NULL(2);
 
 /**
- * Create a deep copy of the JSON value so that modifications in val are guaranteed to not
- * be seen in the copy.
- *
- * The implementation may cheat however with immutable objects by still doing a reference count.
+ * The number of key/value pairs
  */
-extern PJSON_LOCAL jvalue_ref jvalue_duplicate(jvalue_ref val);
+PJSON_LOCAL size_t jobject_size(jvalue_ref obj);
 
 extern PJSON_LOCAL int64_t jnumber_deref_i64(jvalue_ref num);
 
@@ -138,4 +188,11 @@ extern PJSON_LOCAL bool jbuffer_equal(raw_buffer buffer1, raw_buffer buffer2);
 
 extern PJSON_LOCAL raw_buffer jnumber_deref_raw(jvalue_ref num);
 
+/**
+ * Mark the string as not needing any escaping when it is serialized.
+ *
+ * NOTE: It is the caller's responsibility to make sure this is actually true.
+ */
+PJSON_LOCAL void jstring_set_escape_free(jvalue_ref str);
+
 #endif /* JOBJECT_INTERNAL_H_ */
@@ -0,0 +1,861 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include <jparse_stream.h>
+#include <jobject.h>
+#include "liblog.h"
+#include "jallocator_internal.h"
+#include "jparse_stream_internal.h"
+#include "jobject_internal.h"
+#include "jschema_internal.h"
+#include <pjson_pthread.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#if HAVE_PTHREAD
+/**
+ * Bounds on how much of the input a worker claims at a time.  Chunks are small enough that the work evens
+ * out between the workers & large enough that claiming one is noise compared to parsing it.
+ */
+#define PARALLEL_MIN_CHUNK_SIZE (16 * 1024)
+#define PARALLEL_MAX_CHUNK_SIZE (8 * 1024 * 1024)
+
+/**
+ * How many chunks (per worker) may be parsed ahead of the one being delivered when delivering in order.
+ * Bounds the number of parsed documents being held at any one time.
+ */
+#define PARALLEL_CHUNKS_IN_FLIGHT 2
+
+typedef struct ParallelChunk {
+	raw_buffer m_input; /// the elements to parse (array chunks)
+	jvalue_ref *m_documents; /// the documents parsed so far
+	size_t m_numDocuments;
+	size_t m_capacity;
+	bool m_parsedOK;
+	bool m_done; /// parsed & waiting to be delivered (ordered NDJSON delivery)
+} ParallelChunk;
+
+typedef struct ParallelWorker {
+	void *m_shared; /// state shared by all the workers of one parse
+	jparser_ref m_parser;
+	struct JSchemaInfo m_schemaInfo; /// every worker but the first holds a reference to the schema or, unless it's fully compiled, a private duplicate
+	ParallelChunk *m_chunk; /// the chunk being parsed
+	pthread_t m_thread;
+	bool m_started;
+} ParallelWorker;
+
+/**
+ * Pick the number of workers & how much of the input they should claim at a time.
+ */
+static unsigned int parallel_plan(unsigned int nthreads, size_t inputLen, size_t *chunkSize)
+{
+	if (nthreads == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (online > 0 ? (unsigned int)online : 1);
+	}
+	// no point in having more workers than there are chunks
+	if (nthreads > inputLen / PARALLEL_MIN_CHUNK_SIZE + 1)
+		nthreads = inputLen / PARALLEL_MIN_CHUNK_SIZE + 1;
+
+	*chunkSize = inputLen / (nthreads * 8);
+	if (*chunkSize < PARALLEL_MIN_CHUNK_SIZE)
+		*chunkSize = PARALLEL_MIN_CHUNK_SIZE;
+	else if (*chunkSize > PARALLEL_MAX_CHUNK_SIZE)
+		*chunkSize = PARALLEL_MAX_CHUNK_SIZE;
+
+	return nthreads;
+}
+
+/**
+ * Set up a parser & a schema for every worker.  The first worker is run by the calling thread.
+ *
+ * @return NULL if not even the first worker could be set up.
+ */
+static ParallelWorker* parallel_workers_create(unsigned int nthreads, JSchemaInfoRef schemaInfo, void *shared)
+{
+	ParallelWorker *workers = j_calloc(nthreads, sizeof(ParallelWorker));
+	CHECK_ALLOC_RETURN_NULL(workers);
+
+	// lazily initialized - make sure that happens before there is any chance of a race
+	(void)jschema_all();
+
+	for (unsigned int i = 0; i < nthreads; i++) {
+		ParallelWorker *worker = &workers[i];
+		// schemas are compiled (& their references resolved) as validation reaches them, so unless that has all
+		// been done up front (jschema_compile/jschema_resolve_all) every other thread validates against a schema of
+		// its own.  Reference counts are atomic, so a fully compiled schema is simply shared.
+		jschema_ref schema = schemaInfo->m_schema;
+		if (i > 0)
+			schema = (jschema_fully_compiled(schema) ? jschema_copy(schema) : jschema_duplicate(schema));
+
+		worker->m_shared = shared;
+		worker->m_parser = jparser_create(JPARSE_OPT_NONE);
+		jschema_info_init(&worker->m_schemaInfo, schema, schemaInfo->m_resolver, schemaInfo->m_errHandler);
+
+		if (UNLIKELY(i == 0 && worker->m_parser == NULL)) {
+			j_free(workers);
+			return NULL;
+		}
+	}
+
+	return workers;
+}
+
+/**
+ * Run routine on every worker that could be set up & wait for all of them to finish.
+ */
+static void parallel_workers_run(ParallelWorker *workers, unsigned int nthreads, void* (*routine)(void *))
+{
+	for (unsigned int i = 1; i < nthreads; i++) {
+		ParallelWorker *worker = &workers[i];
+		if (worker->m_parser == NULL || worker->m_schemaInfo.m_schema == NULL)
+			continue;
+
+		if (pthread_create(&worker->m_thread, NULL, routine, worker) == 0)
+			worker->m_started = true;
+		else
+			PJ_LOG_WARN("Failed to start parser thread %u - carrying on with fewer", i);
+	}
+
+	routine(&workers[0]);
+
+	for (unsigned int i = 1; i < nthreads; i++) {
+		if (workers[i].m_started)
+			pthread_join(workers[i].m_thread, NULL);
+	}
+}
+
+static void parallel_workers_release(ParallelWorker *workers, unsigned int nthreads)
+{
+	for (unsigned int i = 0; i < nthreads; i++) {
+		ParallelWorker *worker = &workers[i];
+		jparser_release(&worker->m_parser);
+		if (i > 0 && worker->m_schemaInfo.m_schema != NULL)
+			jschema_release(&worker->m_schemaInfo.m_schema);
+	}
+	j_free(workers);
+}
+
+/**
+ * Keep a document of the chunk being parsed by the worker.
+ */
+static bool parallel_collect(void *ctxt, jvalue_ref dom)
+{
+	ParallelWorker *worker = (ParallelWorker *)ctxt;
+	ParallelChunk *chunk = worker->m_chunk;
+
+	if (chunk->m_numDocuments == chunk->m_capacity) {
+		size_t capacity = (chunk->m_capacity != 0 ? chunk->m_capacity * 2 : 64);
+		jvalue_ref *documents = j_realloc(chunk->m_documents, capacity * sizeof(jvalue_ref));
+		if (UNLIKELY(documents == NULL)) {
+			PJ_LOG_ERR("Out of memory");
+			j_release(&dom);
+			chunk->m_parsedOK = false;
+			return false;
+		}
+		chunk->m_documents = documents;
+		chunk->m_capacity = capacity;
+	}
+
+	chunk->m_documents[chunk->m_numDocuments++] = dom;
+	return true;
+}
+
+typedef struct ParallelNdjson {
+	raw_buffer m_input;
+	size_t m_chunkSize;
+	bool m_ordered;
+	jdom_multi_callback m_onDocument;
+	void *m_ctxt;
+
+	pthread_mutex_t m_lock; /// protects everything below
+	pthread_cond_t m_chunkDelivered;
+	size_t m_offset; /// where the next chunk starts
+	size_t m_nextChunk; /// index of the next chunk to hand out
+	size_t m_nextDelivery; /// index of the next chunk to deliver (ordered delivery)
+	bool m_delivering; /// some thread is delivering documents (ordered delivery)
+	ParallelChunk *m_window; /// ring of chunks indexed by chunk index (ordered delivery)
+	size_t m_windowSize;
+	bool m_stop;
+
+	pthread_mutex_t m_callbackLock; /// serializes m_onDocument for unordered delivery
+	bool m_callbackStopped;
+
+	bool m_allOK; /// every document delivered parsed OK - only touched by the thread delivering documents
+} ParallelNdjson;
+
+/**
+ * Claim the next chunk of the input, waiting for the chunks ahead of it to be delivered if need be.
+ *
+ * @return False once there is nothing left to parse.
+ */
+static bool ndjson_next_chunk(ParallelNdjson *shared, raw_buffer *chunk, ParallelChunk **slot)
+{
+	bool claimed = false;
+	size_t end;
+
+	pthread_mutex_lock(&shared->m_lock);
+
+	while (shared->m_ordered && !shared->m_stop &&
+	       shared->m_nextChunk - shared->m_nextDelivery >= shared->m_windowSize) {
+		pthread_cond_wait(&shared->m_chunkDelivered, &shared->m_lock);
+	}
+
+	if (!shared->m_stop && shared->m_offset < shared->m_input.m_len) {
+		// records never span lines, so the chunk can end at any newline
+		if (shared->m_input.m_len - shared->m_offset > shared->m_chunkSize)
+			end = next_line(shared->m_input, shared->m_offset + shared->m_chunkSize);
+		else
+			end = shared->m_input.m_len;
+
+		*chunk = j_str_to_buffer(shared->m_input.m_str + shared->m_offset, end - shared->m_offset);
+		shared->m_offset = end;
+
+		if (shared->m_ordered) {
+			*slot = &shared->m_window[shared->m_nextChunk % shared->m_windowSize];
+			assert(!(*slot)->m_done && (*slot)->m_numDocuments == 0);
+			(*slot)->m_parsedOK = true;
+		}
+		shared->m_nextChunk++;
+		claimed = true;
+	}
+
+	pthread_mutex_unlock(&shared->m_lock);
+	return claimed;
+}
+
+/**
+ * Hand over every consecutive chunk that is ready starting at m_nextDelivery.  Called with m_lock held by
+ * whichever thread happens to finish the chunk that is next in line - the lock is dropped while the
+ * callback runs so that the other workers can keep claiming chunks.
+ */
+static void ndjson_deliver_ordered(ParallelNdjson *shared)
+{
+	ParallelChunk *slot;
+	bool stopped;
+
+	shared->m_delivering = true;
+
+	while (shared->m_nextDelivery < shared->m_nextChunk) {
+		slot = &shared->m_window[shared->m_nextDelivery % shared->m_windowSize];
+		if (!slot->m_done)
+			break;
+
+		stopped = shared->m_stop;
+		pthread_mutex_unlock(&shared->m_lock);
+
+		// documents that couldn't be kept were lost before they could be delivered
+		if (!stopped && !slot->m_parsedOK)
+			shared->m_allOK = false;
+		for (size_t i = 0; i < slot->m_numDocuments; i++) {
+			if (stopped) {
+				j_release(&slot->m_documents[i]);
+				continue;
+			}
+			shared->m_allOK = shared->m_allOK && !jis_null(slot->m_documents[i]);
+			stopped = !shared->m_onDocument(shared->m_ctxt, slot->m_documents[i]);
+		}
+
+		pthread_mutex_lock(&shared->m_lock);
+		slot->m_numDocuments = 0;
+		slot->m_done = false;
+		shared->m_nextDelivery++;
+		shared->m_stop = shared->m_stop || stopped;
+		pthread_cond_broadcast(&shared->m_chunkDelivered);
+	}
+
+	shared->m_delivering = false;
+}
+
+static void ndjson_chunk_done(ParallelNdjson *shared, ParallelChunk *slot)
+{
+	pthread_mutex_lock(&shared->m_lock);
+
+	slot->m_done = true;
+	if (!shared->m_delivering)
+		ndjson_deliver_ordered(shared);
+
+	pthread_mutex_unlock(&shared->m_lock);
+}
+
+static bool ndjson_deliver_unordered(void *ctxt, jvalue_ref dom)
+{
+	ParallelNdjson *shared = (ParallelNdjson *)((ParallelWorker *)ctxt)->m_shared;
+	bool stopped;
+
+	pthread_mutex_lock(&shared->m_callbackLock);
+	if (shared->m_callbackStopped) {
+		j_release(&dom);
+	} else {
+		shared->m_allOK = shared->m_allOK && !jis_null(dom);
+		shared->m_callbackStopped = !shared->m_onDocument(shared->m_ctxt, dom);
+	}
+	stopped = shared->m_callbackStopped;
+	pthread_mutex_unlock(&shared->m_callbackLock);
+
+	if (stopped) {
+		pthread_mutex_lock(&shared->m_lock);
+		shared->m_stop = true;
+		pthread_mutex_unlock(&shared->m_lock);
+	}
+	return !stopped;
+}
+
+static void* ndjson_worker(void *arg)
+{
+	ParallelWorker *worker = (ParallelWorker *)arg;
+	ParallelNdjson *shared = (ParallelNdjson *)worker->m_shared;
+	MultiParse multi = {
+		.m_onDom = (shared->m_ordered ? parallel_collect : ndjson_deliver_unordered),
+		.m_ctxt = worker,
+	};
+	raw_buffer chunk;
+
+	while (ndjson_next_chunk(shared, &chunk, &worker->m_chunk)) {
+		// how the documents parsed is accounted for as they are delivered - documents parsed after onDocument
+		// asked to stop don't count, the same as for jdom_parse_multi
+		(void)jparse_multi_internal(worker->m_parser, chunk, &worker->m_schemaInfo, &multi);
+		if (shared->m_ordered)
+			ndjson_chunk_done(shared, worker->m_chunk);
+	}
+
+	return NULL;
+}
+
+static bool jparse_parallel_ndjson_internal(raw_buffer input, JSchemaInfoRef schemaInfo, unsigned int nthreads, JParallelOptionFlags opts, jdom_multi_callback onDocument, void *ctxt)
+{
+	ParallelNdjson shared = {
+		.m_input = input,
+		.m_ordered = (opts & JPARALLEL_OPT_ORDERED) != 0,
+		.m_onDocument = onDocument,
+		.m_ctxt = ctxt,
+		.m_allOK = true,
+	};
+	ParallelWorker *workers;
+
+	nthreads = parallel_plan(nthreads, input.m_len, &shared.m_chunkSize);
+
+	if (shared.m_ordered) {
+		shared.m_windowSize = nthreads * PARALLEL_CHUNKS_IN_FLIGHT;
+		shared.m_window = j_calloc(shared.m_windowSize, sizeof(ParallelChunk));
+		CHECK_ALLOC_RETURN_VALUE(shared.m_window, false);
+	}
+
+	workers = parallel_workers_create(nthreads, schemaInfo, &shared);
+	if (UNLIKELY(workers == NULL)) {
+		j_free(shared.m_window);
+		return false;
+	}
+
+	pthread_mutex_init(&shared.m_lock, NULL);
+	pthread_cond_init(&shared.m_chunkDelivered, NULL);
+	pthread_mutex_init(&shared.m_callbackLock, NULL);
+
+	parallel_workers_run(workers, nthreads, ndjson_worker);
+	parallel_workers_release(workers, nthreads);
+
+	for (size_t i = 0; i < shared.m_windowSize; i++) {
+		assert(shared.m_window[i].m_numDocuments == 0);
+		j_free(shared.m_window[i].m_documents);
+	}
+	j_free(shared.m_window);
+
+	pthread_mutex_destroy(&shared.m_callbackLock);
+	pthread_cond_destroy(&shared.m_chunkDelivered);
+	pthread_mutex_destroy(&shared.m_lock);
+
+	return shared.m_allOK;
+}
+#endif /* HAVE_PTHREAD */
+
+bool jparse_parallel_ndjson(raw_buffer input, JSchemaInfoRef schemaInfo, unsigned int nthreads, JParallelOptionFlags opts, jdom_multi_callback onDocument, void *ctxt)
+{
+	CHECK_POINTER_RETURN_VALUE(schemaInfo, false);
+	CHECK_POINTER_RETURN_VALUE(onDocument, false);
+
+#if HAVE_PTHREAD
+	if (nthreads != 1)
+		return jparse_parallel_ndjson_internal(input, schemaInfo, nthreads, opts, onDocument, ctxt);
+#endif
+
+	// single-threaded - documents come out in order regardless
+	return jdom_parse_multi(input, schemaInfo, onDocument, ctxt);
+}
+
+bool jparse_parallel_ndjson_file(const char *file, JSchemaInfoRef schemaInfo, JFileOptimizationFlags flags, unsigned int nthreads, JParallelOptionFlags opts, jdom_multi_callback onDocument, void *ctxt)
+{
+	CHECK_POINTER_RETURN_VALUE(file, false);
+
+	raw_buffer input;
+	bool result;
+
+	if (!jparse_load_file(file, flags, &input))
+		return false;
+
+	// the documents are built without referring to the input, so it can go away as soon as parsing is done
+	result = jparse_parallel_ndjson(input, schemaInfo, nthreads, opts, onDocument, ctxt);
+	jparse_unload_file(input, flags);
+	return result;
+}
+
+/**
+ * Find the end of the string starting at offset (which must be the opening quote).  Only the escapes that
+ * matter for finding the end are looked at - the string is properly lexed once it is parsed.
+ *
+ * @return The offset just past the closing quote or 0 if the string isn't terminated.
+ */
+static inline size_t scan_string(raw_buffer input, size_t offset)
+{
+	assert(input.m_str[offset] == '"');
+
+	for (offset++; offset < input.m_len; offset++) {
+		switch (input.m_str[offset]) {
+			case '\\':
+				offset++;
+				break;
+			case '"':
+				return offset + 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Find the end of the value starting at offset without parsing it.  Brackets are counted without being
+ * matched up - anything malformed within the value is caught once it is parsed.
+ *
+ * @return The offset just past the value or 0 if the value doesn't end within the input.
+ */
+static size_t scan_value(raw_buffer input, size_t offset)
+{
+	size_t depth = 0;
+
+	if (offset >= input.m_len)
+		return 0;
+
+	switch (input.m_str[offset]) {
+		case '"':
+			return scan_string(input, offset);
+		case '{':
+		case '[':
+			break;
+		default:
+			// a number or a literal
+			while (offset < input.m_len) {
+				switch (input.m_str[offset]) {
+					case ',': case ']': case '}':
+					case ' ': case '\t': case '\n': case '\r':
+						return offset;
+				}
+				offset++;
+			}
+			return offset;
+	}
+
+	while (offset < input.m_len) {
+		switch (input.m_str[offset]) {
+			case '"':
+				offset = scan_string(input, offset);
+				if (offset == 0)
+					return 0;
+				continue;
+			case '{':
+			case '[':
+				depth++;
+				break;
+			case '}':
+			case ']':
+				if (--depth == 0)
+					return offset + 1;
+				break;
+		}
+		offset++;
+	}
+	return 0;
+}
+
+/**
+ * Compare a key as it appears in the input with a JSON pointer reference token, in which '~' & '/' are
+ * escaped as "~0" & "~1".  A token with any other '~' sequence doesn't match anything.
+ */
+static bool pointer_token_equals(const char *token, size_t tokenLen, const char *key, size_t keyLen)
+{
+	size_t i = 0;
+	size_t j = 0;
+
+	while (i < tokenLen && j < keyLen) {
+		char c = token[i++];
+
+		if (c == '~') {
+			if (i == tokenLen || (token[i] != '0' && token[i] != '1'))
+				return false;
+			c = (token[i++] == '0' ? '~' : '/');
+		}
+		if (c != key[j++])
+			return false;
+	}
+	return i == tokenLen && j == keyLen;
+}
+
+/**
+ * Find the array at path within the document.
+ *
+ * @param path A JSON pointer to the array made up of object keys only (NULL or empty for the top-level value).
+ *             Keys are compared as they appear in the input, so a key containing escape sequences can't be found.
+ * @param depth Set to the number of objects enclosing the array.
+ * @return The offset of the opening bracket of the array or input.m_len if there isn't one.
+ */
+static size_t scan_to_array(raw_buffer input, const char *path, size_t *depth)
+{
+	size_t offset = skip_whitespace(input, 0);
+
+	*depth = 0;
+	if (path != NULL && *path != '\0' && *path != '/')
+		return input.m_len;
+
+	while (path != NULL && *path == '/') {
+		const char *token = path + 1;
+		const char *separator = strchr(token, '/');
+		size_t tokenLen = (separator != NULL ? (size_t)(separator - token) : strlen(token));
+		bool found = false;
+
+		if (offset >= input.m_len || input.m_str[offset] != '{')
+			return input.m_len;
+		offset = skip_whitespace(input, offset + 1);
+
+		while (!found && offset < input.m_len && input.m_str[offset] == '"') {
+			size_t keyEnd = scan_string(input, offset);
+			if (keyEnd == 0)
+				return input.m_len;
+
+			found = pointer_token_equals(token, tokenLen, input.m_str + offset + 1, keyEnd - offset - 2);
+
+			offset = skip_whitespace(input, keyEnd);
+			if (offset >= input.m_len || input.m_str[offset] != ':')
+				return input.m_len;
+			offset = skip_whitespace(input, offset + 1);
+
+			if (!found) {
+				offset = scan_value(input, offset);
+				if (offset == 0)
+					return input.m_len;
+				offset = skip_whitespace(input, offset);
+				if (offset < input.m_len && input.m_str[offset] == ',')
+					offset = skip_whitespace(input, offset + 1);
+			}
+		}
+
+		if (!found)
+			return input.m_len;
+		path = token + tokenLen;
+		(*depth)++;
+	}
+
+	if (offset >= input.m_len || input.m_str[offset] != '[')
+		return input.m_len;
+	return offset;
+}
+
+/**
+ * Check that nothing but the rest of the objects enclosing the array follows it.  Their other members are
+ * skipped over like in scan_to_array.
+ *
+ * @param offset Just past the closing bracket of the array.
+ * @param depth The number of objects enclosing the array.
+ */
+static bool scan_document_end(raw_buffer input, size_t offset, size_t depth)
+{
+	while (depth > 0) {
+		size_t valueStart;
+
+		offset = skip_whitespace(input, offset);
+		if (offset < input.m_len && input.m_str[offset] == '}') {
+			offset++;
+			depth--;
+			continue;
+		}
+
+		if (offset >= input.m_len || input.m_str[offset] != ',')
+			return false;
+		offset = skip_whitespace(input, offset + 1);
+		if (offset >= input.m_len || input.m_str[offset] != '"')
+			return false;
+		offset = scan_string(input, offset);
+		if (offset == 0)
+			return false;
+		offset = skip_whitespace(input, offset);
+		if (offset >= input.m_len || input.m_str[offset] != ':')
+			return false;
+		valueStart = skip_whitespace(input, offset + 1);
+		offset = scan_value(input, valueStart);
+		if (offset == 0 || offset == valueStart)
+			return false;
+	}
+
+	return skip_whitespace(input, offset) == input.m_len;
+}
+
+/**
+ * Find the next element of an array starting at offset (just past the opening bracket or a comma).
+ *
+ * @param element Set to the element.
+ * @param offset Updated to be at the element following the comma after this one, or at the closing bracket.
+ * @return False if there are no more elements.  *offset is set to input.m_len if the array is malformed
+ *         (which includes a comma right before the closing bracket).
+ */
+static bool scan_element(raw_buffer input, size_t *offset, raw_buffer *element)
+{
+	size_t start = skip_whitespace(input, *offset);
+	size_t end;
+
+	if (start >= input.m_len) {
+		*offset = input.m_len;
+		return false;
+	}
+	if (input.m_str[start] == ']') {
+		*offset = start;
+		return false;
+	}
+
+	end = scan_value(input, start);
+	if (end == 0 || end == start) {
+		*offset = input.m_len;
+		return false;
+	}
+	*element = j_str_to_buffer(input.m_str + start, end - start);
+
+	end = skip_whitespace(input, end);
+	if (end < input.m_len && input.m_str[end] == ',') {
+		end = skip_whitespace(input, end + 1);
+		if (end < input.m_len && input.m_str[end] == ']')
+			end = input.m_len;
+	} else if (end >= input.m_len || input.m_str[end] != ']')
+		end = input.m_len;
+	*offset = end;
+	return true;
+}
+
+#if HAVE_PTHREAD
+typedef struct ParallelArray {
+	ParallelChunk *m_chunks;
+	size_t m_numChunks;
+	JDOMOptimizationFlags m_optimization;
+
+	pthread_mutex_t m_lock; /// protects everything below
+	size_t m_nextChunk;
+	bool m_failed;
+} ParallelArray;
+
+static void* array_worker(void *arg)
+{
+	ParallelWorker *worker = (ParallelWorker *)arg;
+	ParallelArray *shared = (ParallelArray *)worker->m_shared;
+	ParallelChunk *chunk;
+	raw_buffer element;
+	jvalue_ref value;
+	size_t offset;
+
+	for (;;) {
+		pthread_mutex_lock(&shared->m_lock);
+		chunk = (!shared->m_failed && shared->m_nextChunk < shared->m_numChunks ? &shared->m_chunks[shared->m_nextChunk++] : NULL);
+		pthread_mutex_unlock(&shared->m_lock);
+		if (chunk == NULL)
+			break;
+
+		worker->m_chunk = chunk;
+		chunk->m_parsedOK = true;
+		offset = 0;
+		// the pre-scan has already checked the structure in between the elements
+		while (chunk->m_parsedOK && scan_element(chunk->m_input, &offset, &element)) {
+			if (!jdom_parse_value(worker->m_parser, element, shared->m_optimization, &worker->m_schemaInfo, false, JPARSE_OPT_NONE, &value)) {
+				chunk->m_parsedOK = false;
+				break;
+			}
+			parallel_collect(worker, value);
+		}
+
+		if (!chunk->m_parsedOK) {
+			pthread_mutex_lock(&shared->m_lock);
+			shared->m_failed = true;
+			pthread_mutex_unlock(&shared->m_lock);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Split the elements of the array starting at offset into chunks of roughly chunkSize bytes.
+ *
+ * @param depth The number of objects enclosing the array (see scan_document_end).
+ * @return False if the document is malformed or memory ran out.
+ */
+static bool array_split(raw_buffer input, size_t offset, size_t depth, size_t chunkSize, ParallelArray *shared, size_t *numElements)
+{
+	size_t capacity = 0;
+	size_t chunkStart;
+	raw_buffer element;
+	bool last;
+
+	assert(input.m_str[offset] == '[');
+	chunkStart = ++offset;
+	*numElements = 0;
+
+	while (scan_element(input, &offset, &element)) {
+		(*numElements)++;
+
+		// chunks end just after an element so that the worker can find its elements again the same way
+		last = (offset >= input.m_len || input.m_str[offset] == ']');
+		if ((size_t)(element.m_str + element.m_len - (input.m_str + chunkStart)) < chunkSize && !last)
+			continue;
+
+		if (shared->m_numChunks == capacity) {
+			ParallelChunk *chunks;
+			capacity = (capacity != 0 ? capacity * 2 : 64);
+			chunks = j_realloc(shared->m_chunks, capacity * sizeof(ParallelChunk));
+			CHECK_ALLOC_RETURN_VALUE(chunks, false);
+			shared->m_chunks = chunks;
+		}
+		shared->m_chunks[shared->m_numChunks++] = (ParallelChunk) {
+			.m_input = j_str_to_buffer(input.m_str + chunkStart, element.m_str + element.m_len - (input.m_str + chunkStart)),
+		};
+		chunkStart = offset;
+	}
+
+	return offset < input.m_len && scan_document_end(input, offset + 1, depth);
+}
+
+static jvalue_ref jdom_parse_array_parallel_internal(raw_buffer input, size_t arrayStart, size_t depth, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, unsigned int nthreads)
+{
+	ParallelArray shared = {
+		.m_optimization = optimizationMode,
+	};
+	ParallelWorker *workers;
+	jvalue_ref result = jnull();
+	size_t chunkSize;
+	size_t numElements;
+
+	nthreads = parallel_plan(nthreads, input.m_len, &chunkSize);
+
+	if (!array_split(input, arrayStart, depth, chunkSize, &shared, &numElements)) {
+		PJ_LOG_WARN("Malformed array in '%.*s'", (int)(input.m_len < 64 ? input.m_len : 64), input.m_str);
+		goto cleanup;
+	}
+
+	workers = parallel_workers_create(nthreads, schemaInfo, &shared);
+	if (UNLIKELY(workers == NULL))
+		goto cleanup;
+
+	pthread_mutex_init(&shared.m_lock, NULL);
+	parallel_workers_run(workers, nthreads, array_worker);
+	pthread_mutex_destroy(&shared.m_lock);
+	parallel_workers_release(workers, nthreads);
+
+	if (!shared.m_failed) {
+		result = jarray_create_hint(NULL, numElements);
+		for (size_t i = 0; i < shared.m_numChunks; i++) {
+			ParallelChunk *chunk = &shared.m_chunks[i];
+			for (size_t j = 0; j < chunk->m_numDocuments; j++)
+				jarray_append(result, chunk->m_documents[j]);
+			chunk->m_numDocuments = 0;
+		}
+	}
+
+cleanup:
+	for (size_t i = 0; i < shared.m_numChunks; i++) {
+		ParallelChunk *chunk = &shared.m_chunks[i];
+		for (size_t j = 0; j < chunk->m_numDocuments; j++)
+			j_release(&chunk->m_documents[j]);
+		j_free(chunk->m_documents);
+	}
+	j_free(shared.m_chunks);
+	return result;
+}
+#endif /* HAVE_PTHREAD */
+
+/**
+ * Single-threaded equivalent used when threads aren't available.
+ */
+static jvalue_ref jdom_parse_array_serial(raw_buffer input, size_t arrayStart, size_t depth, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo)
+{
+	jvalue_ref result;
+	jvalue_ref value;
+	raw_buffer element;
+	size_t offset = arrayStart + 1;
+	jparser_ref parser = jparser_create(JPARSE_OPT_NONE);
+
+	CHECK_ALLOC_RETURN_VALUE(parser, jnull());
+
+	result = jarray_create(NULL);
+	while (scan_element(input, &offset, &element)) {
+		if (!jdom_parse_value(parser, element, optimizationMode, schemaInfo, false, JPARSE_OPT_NONE, &value)) {
+			offset = input.m_len;
+			break;
+		}
+		jarray_append(result, value);
+	}
+
+	if (offset >= input.m_len || !scan_document_end(input, offset + 1, depth)) {
+		j_release(&result);
+		result = jnull();
+	}
+
+	jparser_release(&parser);
+	return result;
+}
+
+jvalue_ref jdom_parse_array_parallel(raw_buffer input, const char *path, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, unsigned int nthreads)
+{
+	CHECK_POINTER_RETURN_VALUE(schemaInfo, jnull());
+
+	size_t depth;
+	size_t arrayStart = scan_to_array(input, path, &depth);
+	if (arrayStart >= input.m_len) {
+		PJ_LOG_WARN("No array found at '%s'", path != NULL ? path : "");
+		return jnull();
+	}
+
+#if HAVE_PTHREAD
+	if (nthreads != 1)
+		return jdom_parse_array_parallel_internal(input, arrayStart, depth, optimizationMode, schemaInfo, nthreads);
+#endif
+	return jdom_parse_array_serial(input, arrayStart, depth, optimizationMode, schemaInfo);
+}
+
+jvalue_ref jdom_parse_file_array_parallel(const char *file, const char *path, JSchemaInfoRef schemaInfo, JFileOptimizationFlags flags, unsigned int nthreads)
+{
+	CHECK_POINTER_RETURN_NULL(file);
+
+	raw_buffer input;
+	jvalue_ref result;
+
+	if (!jparse_load_file(file, flags, &input))
+		return jnull();
+
+	result = jdom_parse_array_parallel(input, path, DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE, schemaInfo, nthreads);
+
+	if (UNLIKELY(jis_null(result))) {
+		jparse_unload_file(input, flags);
+	} else {
+		result->m_backingBuffer = input;
+		result->m_backingBufferMMap = flags & JFileOptMMap;
+	}
+
+	return result;
+}
@@ -17,38 +17,103 @@
 LICENSE@@@ */
 
 #include <jparse_stream.h>
+#include <jcbor.h>
 #include <jobject.h>
 #include <yajl/yajl_parse.h>
 #include "liblog.h"
+#include "jallocator_internal.h"
 #include "jparse_stream_internal.h"
 #include "jobject_internal.h"
 #include "jschema_internal.h"
+#include "jcbor_internal.h"
+#include "jstats_internal.h"
+#include "jvalue/num_conversion.h"
+#include "utf8_validate.h"
+#include <yajl_compat.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 
-typedef struct DomInfo {
+/**
+ * How deep a document can nest before the DOM builder has to go to the heap for its frame stack.
+ */
+#define DOM_PREALLOCATED_DEPTH 32
+
+typedef struct DomFrame {
+	/**
+	 * The object or array being filled in.  Not reference counted - it's owned by its parent (or is the
+	 * top-level value).
+	 */
+	jvalue_ref m_container;
+	/**
+	 * If m_container is an object & we are waiting for the value of a key/value pair, this is the key.
+	 * NULL otherwise.
+	 */
+	jvalue_ref m_key;
+	/**
+	 * Resolved once when the container is opened so that every value doesn't need to re-check the type
+	 * of its parent.
+	 */
+	bool m_isObject;
+} DomFrame;
+
+typedef struct DomBuilder {
 	JDOMOptimization m_optInformation;
+	jvalue_ref m_root; /// the top-level value
+	DomFrame *m_stack; /// m_preallocated (or a stack handed over by a jparser_ref) until it needs to grow
+	size_t m_depth;
+	size_t m_capacity;
+	DomFrame m_preallocated[DOM_PREALLOCATED_DEPTH];
+	JAllocatorRef m_allocator; /// where the values come from
+} DomBuilder;
+
+struct __JSAXContext {
+	void *ctxt;
+	yajl_callbacks *m_handlers;
+	ValidationStateRef m_validation;
+	JErrorCallbacksRef m_errors;
+	JParseOptionFlags m_parseOpts;
+	/**
+	 * The buffer being parsed.  yajl hands us strings without escape sequences as pointers
+	 * straight into it, so anything found in here is known not to need escaping.
+	 * Left empty for binary input, whose strings aren't escaped at all.
+	 */
+	raw_buffer m_input;
 	/**
-	 * This cannot be null unless we are in a top-level object or array.
-	 * m_prev->m_value is the object or array that is our parent.
+	 * Numbers decoded from binary input are handed to these natively (once validated) if they are set.
+	 * Otherwise they go to m_handlers as text.
 	 */
-	struct DomInfo *m_prev;
+	int (*m_integer)(JSAXContextRef ctxt, int64_t integer);
+	int (*m_floating)(JSAXContextRef ctxt, double floating);
+};
 
+/**
+ * @see jparser_ref
+ */
+struct jparser {
 	/**
-	 * If we are setting the value for an object key, this is the key (string-type).
-	 * If we are parsing the key for an object, this is NULL
-	 * If we are parsing an element within an array this is NULL.
+	 * yajl is handed a pointer to this when the handle is allocated so it has to stay put for the lifetime
+	 * of the parser.
 	 */
-	jvalue_ref m_value;
-} DomInfo;
+	struct __JSAXContext m_context;
+	yajl_handle m_saxHandle; /// dispatches through my_bounce (i.e. validates) - created on first use
+	yajl_handle m_domHandle; /// dispatches through dom_direct for schema-less DOM parsing - created on first use
+	yajl_handle m_lastHandle; /// whichever of the two handles parsed the last document
+	struct ValidationState m_validation;
+	DomFrame *m_domStack; /// frame stack kept from a previous document that nested deeper than DOM_PREALLOCATED_DEPTH
+	size_t m_domStackCapacity;
+	JParseOptionFlags m_parseOpts;
+	JAllocatorRef m_allocator; /// the documents parsed into a DOM (NULL for the default allocator)
+};
 
-static bool jsax_parse_internal(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError, bool comments);
+static bool jsax_parse_internal(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError, bool comments, JParseOptionFlags parseOpts);
 
 static bool file_size(int fd, off_t *s)
 {
@@ -60,429 +125,491 @@ static bool file_size(int fd, off_t *s)
 	return true;
 }
 
-static inline jvalue_ref createOptimalString(JDOMOptimization opt, const char *str, size_t strLen)
+static inline bool jsax_input_contains(JSAXContextRef ctxt, const char *str)
 {
-	if (opt == DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE)
-		return jstring_create_nocopy(j_str_to_buffer(str, strLen));
-	return jstring_create_copy(j_str_to_buffer(str, strLen));
+	return str >= ctxt->m_input.m_str && str < ctxt->m_input.m_str + ctxt->m_input.m_len;
 }
 
-static inline jvalue_ref createOptimalNumber(JDOMOptimization opt, const char *str, size_t strLen)
+static inline jvalue_ref createOptimalString(JSAXContextRef ctxt, DomBuilder *builder, const char *str, size_t strLen)
 {
-	if (opt == DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE)
-		return jnumber_create_unsafe(j_str_to_buffer(str, strLen), NULL);
-	return jnumber_create(j_str_to_buffer(str, strLen));
+	jvalue_ref jstr;
+	if (builder->m_optInformation == DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE)
+		jstr = jstring_create_nocopy_with(j_str_to_buffer(str, strLen), builder->m_allocator);
+	else
+		jstr = jstring_create_copy_with(j_str_to_buffer(str, strLen), builder->m_allocator);
+
+	if (jsax_input_contains(ctxt, str) && jis_string(jstr))
+		jstring_set_escape_free(jstr);
+	return jstr;
 }
 
-static inline DomInfo* getDOMContext(JSAXContextRef ctxt)
+static inline jvalue_ref createOptimalNumber(DomBuilder *builder, const char *str, size_t strLen)
 {
-	return (DomInfo*)jsax_getContext(ctxt);
+	if (builder->m_optInformation == DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE)
+		return jnumber_create_unsafe_with(j_str_to_buffer(str, strLen), builder->m_allocator);
+	return jnumber_create_with(j_str_to_buffer(str, strLen), builder->m_allocator);
 }
 
-static inline void changeDOMContext(JSAXContextRef ctxt, DomInfo *domCtxt)
+static void dom_builder_init(DomBuilder *builder, jparser_ref parser)
 {
-	jsax_changeContext(ctxt, domCtxt);
+	builder->m_optInformation = DOMOPT_NOOPT;
+	builder->m_root = NULL;
+	builder->m_depth = 0;
+	builder->m_allocator = (parser != NULL && parser->m_allocator != NULL ? parser->m_allocator : j_allocator);
+
+	if (parser != NULL && parser->m_domStack != NULL) {
+		// borrowed until dom_builder_finish
+		builder->m_stack = parser->m_domStack;
+		builder->m_capacity = parser->m_domStackCapacity;
+		parser->m_domStack = NULL;
+	} else {
+		builder->m_stack = builder->m_preallocated;
+		builder->m_capacity = DOM_PREALLOCATED_DEPTH;
+	}
 }
 
-static int dom_null(JSAXContextRef ctxt)
+/**
+ * Release everything the builder owns apart from m_root (i.e. keys still waiting for their value if parsing
+ * failed part-way through).  A stack that had to be grown is kept by the parser for the next document.
+ */
+static void dom_builder_finish(DomBuilder *builder, jparser_ref parser)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	// no handle to the context
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "null encountered without any context");
-	// no parent node
-	CHECK_CONDITION_RETURN_VALUE(data->m_prev == NULL, 0, "unexpected state - how is this possible?");
-
-	SANITY_CHECK_POINTER(ctxt);
-	SANITY_CHECK_POINTER(data->m_prev);
-
-	if (data->m_value == NULL) {
-		CHECK_CONDITION_RETURN_VALUE(!jis_array(data->m_prev->m_value), 0, "Improper place for null");
-		jarray_append(data->m_prev->m_value, jnull());
-	} else if (jis_string(data->m_value)) {
-		CHECK_CONDITION_RETURN_VALUE(!jis_object(data->m_prev->m_value), 0, "Improper place for null");
-		jobject_put(data->m_prev->m_value, data->m_value, jnull());
-		data->m_value = NULL;
-	} else {
-		PJ_LOG_ERR("value portion of key-value pair but not a key");
-		return 0;
+	for (size_t i = 0; i < builder->m_depth; i++) {
+		if (builder->m_stack[i].m_key != NULL)
+			j_release(&builder->m_stack[i].m_key);
 	}
+	builder->m_depth = 0;
 
-	return 1;
+	if (builder->m_stack == builder->m_preallocated)
+		return;
+
+	if (parser != NULL) {
+		assert(parser->m_domStack == NULL);
+		parser->m_domStack = builder->m_stack;
+		parser->m_domStackCapacity = builder->m_capacity;
+	} else {
+		j_free(builder->m_stack);
+	}
 }
 
-static int dom_boolean(JSAXContextRef ctxt, bool value)
+static bool dom_builder_grow(DomBuilder *builder)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "boolean encountered without any context");
-	CHECK_CONDITION_RETURN_VALUE(data->m_prev == NULL, 0, "unexpected state - how is this possible?");
-
-	if (data->m_value == NULL) {
-		CHECK_CONDITION_RETURN_VALUE(!jis_array(data->m_prev->m_value), 0, "Improper place for boolean");
-		jarray_append(data->m_prev->m_value, jboolean_create(value));
-	} else if (jis_string(data->m_value)) {
-		CHECK_CONDITION_RETURN_VALUE(!jis_object(data->m_prev->m_value), 0, "Improper place for boolean");
-		jobject_put(data->m_prev->m_value, data->m_value, jboolean_create(value));
-		data->m_value = NULL;
+	size_t capacity = builder->m_capacity * 2;
+	DomFrame *stack;
+
+	if (builder->m_stack == builder->m_preallocated) {
+		stack = j_malloc(capacity * sizeof(DomFrame));
+		if (stack != NULL)
+			memcpy(stack, builder->m_stack, builder->m_depth * sizeof(DomFrame));
 	} else {
-		PJ_LOG_ERR("value portion of key-value pair but not a key");
-		return 0;
+		stack = j_realloc(builder->m_stack, capacity * sizeof(DomFrame));
 	}
+	CHECK_ALLOC_RETURN_VALUE(stack, false);
 
-	return 1;
+	builder->m_stack = stack;
+	builder->m_capacity = capacity;
+	return true;
 }
 
-static int dom_number(JSAXContextRef ctxt, const char *number, size_t numberLen)
+static inline DomBuilder* getDOMContext(JSAXContextRef ctxt)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	jvalue_ref jnum;
-
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "number encountered without any context");
-	CHECK_CONDITION_RETURN_VALUE(data->m_prev == NULL, 0, "unexpected state - how is this possible?");
-	CHECK_POINTER_RETURN_VALUE(number, 0);
-	CHECK_CONDITION_RETURN_VALUE(numberLen <= 0, 0, "unexpected - numeric string doesn't actually contain a number");
+	return (DomBuilder*)jsax_getContext(ctxt);
+}
 
-	jnum = createOptimalNumber(data->m_optInformation, number, numberLen);
+/**
+ * Add a value to the object or array that is currently open.  Ownership of value is transferred.
+ */
+static inline int dom_insert(DomBuilder *builder, jvalue_ref value)
+{
+	DomFrame *parent;
 
-	if (data->m_value == NULL) {
-		if (UNLIKELY(!jis_array(data->m_prev->m_value))) {
-			PJ_LOG_ERR("Improper place for number");
-			j_release(&jnum);
-			return 0;
+	if (UNLIKELY(builder->m_depth == 0)) {
+		// a lone scalar is a document of its own
+		if (builder->m_root == NULL) {
+			builder->m_root = value;
+			return 1;
 		}
-		jarray_append(data->m_prev->m_value, jnum);
-	} else if (jis_string(data->m_value)) {
-		if (UNLIKELY(!jis_object(data->m_prev->m_value))) {
-			PJ_LOG_ERR("Improper place for number");
-			j_release(&jnum);
+		PJ_LOG_ERR("Improper place for a value - not within an object or array");
+		j_release(&value);
+		return 0;
+	}
+
+	parent = &builder->m_stack[builder->m_depth - 1];
+	if (parent->m_isObject) {
+		if (UNLIKELY(parent->m_key == NULL)) {
+			PJ_LOG_ERR("value portion of key-value pair but not a key");
+			j_release(&value);
 			return 0;
 		}
-		jobject_put(data->m_prev->m_value, data->m_value, jnum);
-		data->m_value = NULL;
+		jobject_put(parent->m_container, parent->m_key, value);
+		parent->m_key = NULL;
 	} else {
-		PJ_LOG_ERR("value portion of key-value pair but not a key");
-		return 0;
+		jarray_append(parent->m_container, value);
 	}
 
 	return 1;
 }
 
-static int dom_string(JSAXContextRef ctxt, const char *string, size_t stringLen)
+static inline int dom_open(DomBuilder *builder, jvalue_ref container, bool isObject)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "string encountered without any context");
-	CHECK_CONDITION_RETURN_VALUE(data->m_prev == NULL, 0, "unexpected state - how is this possible?");
+	DomFrame *frame;
 
-	jvalue_ref jstr = createOptimalString(data->m_optInformation, string, stringLen);
+	if (UNLIKELY(jis_null(container))) {
+		PJ_LOG_ERR("Failed to allocate space for new %s", isObject ? "object" : "array");
+		return 0;
+	}
 
-	if (data->m_value == NULL) {
-		if (UNLIKELY(!jis_array(data->m_prev->m_value))) {
-			PJ_LOG_ERR("Improper place for string");
-			j_release(&jstr);
-			return 0;
-		}
-		jarray_append(data->m_prev->m_value, jstr);
-	} else if (jis_string(data->m_value)) {
-		if (UNLIKELY(!jis_object(data->m_prev->m_value))) {
-			PJ_LOG_ERR("Improper place for string");
-			j_release(&jstr);
+	if (builder->m_depth == 0) {
+		if (UNLIKELY(builder->m_root != NULL)) {
+			PJ_LOG_ERR("More than one top-level value");
+			j_release(&container);
 			return 0;
 		}
-		jobject_put(data->m_prev->m_value, data->m_value, jstr);
-		data->m_value = NULL;
-	} else {
-		PJ_LOG_ERR("value portion of key-value pair but not a key");
+		builder->m_root = container;
+	} else if (UNLIKELY(!dom_insert(builder, container))) {
 		return 0;
 	}
 
+	if (UNLIKELY(builder->m_depth == builder->m_capacity) && !dom_builder_grow(builder))
+		return 0;
+
+	frame = &builder->m_stack[builder->m_depth++];
+	frame->m_container = container;
+	frame->m_key = NULL;
+	frame->m_isObject = isObject;
+
 	return 1;
 }
 
-static int dom_object_start(JSAXContextRef ctxt)
+static inline int dom_close(DomBuilder *builder, bool isObject)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	jvalue_ref newParent;
-	DomInfo *newChild;
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "object encountered without any context");
-
-	newParent = jobject_create();
-	newChild = calloc(1, sizeof(DomInfo));
-	if (UNLIKELY(newChild == NULL || jis_null(newParent))) {
-		PJ_LOG_ERR("Failed to allocate space for new object");
-		j_release(&newParent);
-		free(newChild);
-		return 0;
-	}
-	newChild->m_prev = data;
-	newChild->m_optInformation = data->m_optInformation;
-	changeDOMContext(ctxt, newChild);
-
-	if (data->m_prev != NULL) {
-		if (jis_array(data->m_prev->m_value)) {
-			assert(data->m_value == NULL);
-			jarray_append(data->m_prev->m_value, newParent);
-		} else {
-			assert(jis_object(data->m_prev->m_value));
-			CHECK_CONDITION_RETURN_VALUE(!jis_string(data->m_value), 0, "improper place for a child object");
-			jobject_put(data->m_prev->m_value, data->m_value, newParent);
-		}
-	}
+	DomFrame *frame;
 
-	// not using reference counting here on purpose
-	data->m_value = newParent;
+	CHECK_CONDITION_RETURN_VALUE(builder->m_depth == 0, 0, "%s end encountered without any context", isObject ? "object" : "array");
+	frame = &builder->m_stack[builder->m_depth - 1];
+	CHECK_CONDITION_RETURN_VALUE(frame->m_isObject != isObject, 0, "%s end encountered, but not in an %s", isObject ? "object" : "array", isObject ? "object" : "array");
+	CHECK_CONDITION_RETURN_VALUE(frame->m_key != NULL, 0, "mismatch between key/value count");
 
+	builder->m_depth--;
 	return 1;
 }
 
-static int dom_object_key(JSAXContextRef ctxt, const char *key, size_t keyLen)
+static int dom_null(JSAXContextRef ctxt)
+{
+	return dom_insert(getDOMContext(ctxt), jnull());
+}
+
+static int dom_boolean(JSAXContextRef ctxt, bool value)
+{
+	DomBuilder *builder = getDOMContext(ctxt);
+	return dom_insert(builder, jboolean_create_with(value, builder->m_allocator));
+}
+
+static int dom_number(JSAXContextRef ctxt, const char *number, size_t numberLen)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "object key encountered without any context");
-	CHECK_CONDITION_RETURN_VALUE(data->m_value != NULL, 0, "Improper place for an object key");
-	CHECK_CONDITION_RETURN_VALUE(data->m_prev == NULL, 0, "object key encountered without any parent object");
-	CHECK_CONDITION_RETURN_VALUE(!jis_object(data->m_prev->m_value), 0, "object key encountered without any parent object");
+	DomBuilder *builder = getDOMContext(ctxt);
 
-	// Need to be careful here - typically, m_value isn't reference counted
-	// thus if parsing fails and m_value hasn't been inserted into a bigger object that is
-	// tracked, we will leak.
-	// The alternate behaviour is to insert into the parent value with a null value.
-	// Then when inserting the value of the key/value pair into an object, we first remove the key & re-insert
-	// a key/value pair (we don't currently have a replace mechanism).
-	data->m_value = createOptimalString(data->m_optInformation, key, keyLen);
+	CHECK_POINTER_RETURN_VALUE(number, 0);
+	CHECK_CONDITION_RETURN_VALUE(numberLen <= 0, 0, "unexpected - numeric string doesn't actually contain a number");
 
-	return 1;
+	return dom_insert(builder, createOptimalNumber(builder, number, numberLen));
 }
 
-static int dom_object_end(JSAXContextRef ctxt)
+static int dom_integer(JSAXContextRef ctxt, int64_t integer)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "object end encountered without any context");
-	CHECK_CONDITION_RETURN_VALUE(data->m_value != NULL, 0, "mismatch between key/value count");
-	CHECK_CONDITION_RETURN_VALUE(!jis_object(data->m_prev->m_value), 0, "object end encountered, but not in an object");
+	DomBuilder *builder = getDOMContext(ctxt);
+	return dom_insert(builder, jnumber_create_i64_with(integer, builder->m_allocator));
+}
 
-	assert(data->m_prev != NULL);
-	changeDOMContext(ctxt, data->m_prev);
-	if (data->m_prev->m_prev != NULL)
-		data->m_prev->m_value = NULL;
-	free(data);
+static int dom_floating(JSAXContextRef ctxt, double floating)
+{
+	DomBuilder *builder = getDOMContext(ctxt);
+	return dom_insert(builder, jnumber_create_f64_with(floating, builder->m_allocator));
+}
 
-	return 1;
+static int dom_string(JSAXContextRef ctxt, const char *string, size_t stringLen)
+{
+	DomBuilder *builder = getDOMContext(ctxt);
+	return dom_insert(builder, createOptimalString(ctxt, builder, string, stringLen));
 }
 
-static int dom_array_start(JSAXContextRef ctxt)
+static int dom_object_start(JSAXContextRef ctxt)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	jvalue_ref newParent;
-	DomInfo *newChild;
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "object encountered without any context");
-
-	newParent = jarray_create(NULL);
-	newChild = calloc(1, sizeof(DomInfo));
-	if (UNLIKELY(newChild == NULL || jis_null(newParent))) {
-		PJ_LOG_ERR("Failed to allocate space for new array node");
-		j_release(&newParent);
-		free(newChild);
-		return 0;
-	}
-	newChild->m_prev = data;
-	newChild->m_optInformation = data->m_optInformation;
-	changeDOMContext(ctxt, newChild);
+	DomBuilder *builder = getDOMContext(ctxt);
+	return dom_open(builder, jobject_create_with(builder->m_allocator), true);
+}
 
-	if (data->m_prev != NULL) {
-		if (jis_array(data->m_prev->m_value)) {
-			assert(data->m_value == NULL);
-			jarray_append(data->m_prev->m_value, newParent);
-		} else {
-			assert(jis_object(data->m_prev->m_value));
-			if (UNLIKELY(!jis_string(data->m_value))) {
-				PJ_LOG_ERR("improper place for a child object");
-				j_release(&newParent);
-				return 0;
-			}
-			jobject_put(data->m_prev->m_value, data->m_value, newParent);
-		}
-	}
+static int dom_object_key(JSAXContextRef ctxt, const char *key, size_t keyLen)
+{
+	DomBuilder *builder = getDOMContext(ctxt);
+	DomFrame *frame;
+
+	CHECK_CONDITION_RETURN_VALUE(builder->m_depth == 0, 0, "object key encountered without any parent object");
+	frame = &builder->m_stack[builder->m_depth - 1];
+	CHECK_CONDITION_RETURN_VALUE(!frame->m_isObject, 0, "object key encountered without any parent object");
+	CHECK_CONDITION_RETURN_VALUE(frame->m_key != NULL, 0, "Improper place for an object key");
 
-	// not using reference counting here on purpose
-	data->m_value = newParent;
+	// Need to be careful here - the key isn't inserted into the object until we have its value
+	// thus if parsing fails before then, dom_builder_finish is responsible for releasing it.
+	frame->m_key = createOptimalString(ctxt, builder, key, keyLen);
 
 	return 1;
 }
 
-static int dom_array_end(JSAXContextRef ctxt)
+static int dom_object_end(JSAXContextRef ctxt)
 {
-	DomInfo *data = getDOMContext(ctxt);
-	CHECK_CONDITION_RETURN_VALUE(data == NULL, 0, "array end encountered without any context");
-	CHECK_CONDITION_RETURN_VALUE(data->m_value != NULL, 0, "key/value for array");
-	CHECK_CONDITION_RETURN_VALUE(!jis_array(data->m_prev->m_value), 0, "array end encountered, but not in an array");
+	return dom_close(getDOMContext(ctxt), true);
+}
 
-	assert(data->m_prev != NULL);
-	changeDOMContext(ctxt, data->m_prev);
-	if (data->m_prev->m_prev != NULL)
-		data->m_prev->m_value = NULL;
-	free(data);
+static int dom_array_start(JSAXContextRef ctxt)
+{
+	DomBuilder *builder = getDOMContext(ctxt);
+	return dom_open(builder, jarray_create_with(builder->m_allocator), false);
+}
 
-	return 1;
+static int dom_array_end(JSAXContextRef ctxt)
+{
+	return dom_close(getDOMContext(ctxt), false);
 }
 
-jvalue_ref jdom_parse_ex(raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, bool allowComments)
+static const PJSAXCallbacks dom_callbacks = {
+	dom_object_start, // m_objStart
+	dom_object_key, // m_objKey
+	dom_object_end, // m_objEnd
+
+	dom_array_start, // m_arrStart
+	dom_array_end, // m_arrEnd
+
+	dom_string, // m_string
+	dom_number, // m_number
+	dom_boolean, // m_boolean
+	dom_null, // m_null
+};
+
+static bool jsax_parse_with_parser_internal(jparser_ref parser, PJSAXCallbacks *callbacks, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError);
+static bool jdom_parse_direct(jparser_ref parser, DomBuilder *builder, raw_buffer input, JSchemaInfoRef schemaInfo, bool allowComments, JParseOptionFlags parseOpts);
+static bool jdom_parse_result(jparser_ref parser, DomBuilder *builder, bool parsedOK, raw_buffer input, JDOMOptimizationFlags optimizationMode, jvalue_ref *value);
+static bool jsax_parse_stream(JFileStream *stream, PJSAXCallbacks *parser, JSchemaInfoRef schemaInfo, void **ctxt, bool logError, JParseOptionFlags parseOpts);
+static bool jdom_parse_stream(jparser_ref parser, JFileStream *stream, JSchemaInfoRef schemaInfo, jvalue_ref *value);
+
+/**
+ * @param parser The parser whose state should be re-used or NULL to set up everything for this parse only.
+ *               allowComments & parseOpts are ignored if a parser is provided.
+ */
+bool jdom_parse_value(jparser_ref parser, raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, bool allowComments, JParseOptionFlags parseOpts, jvalue_ref *value)
 {
-	jvalue_ref result;
-	PJSAXCallbacks callbacks = {
-		dom_object_start, // m_objStart
-		dom_object_key, // m_objKey
-		dom_object_end, // m_objEnd
-
-		dom_array_start, // m_arrStart
-		dom_array_end, // m_arrEnd
-
-		dom_string, // m_string
-		dom_number, // m_number
-		dom_boolean, // m_boolean
-		dom_null, // m_null
-	};
-	DomInfo *topLevelContext = calloc(1, sizeof(struct DomInfo));
-	CHECK_POINTER_RETURN_NULL(topLevelContext);
-	void *domCtxt = topLevelContext;
+	PJSAXCallbacks callbacks = dom_callbacks;
+	DomBuilder builder;
+	void *domCtxt = &builder;
+	bool parsedOK;
 
-	bool parsedOK = jsax_parse_internal(&callbacks, input, schemaInfo, &domCtxt, false /* don't log errors*/, allowComments);
+	dom_builder_init(&builder, parser);
 
-	result = topLevelContext->m_value;
+	if (schemaInfo->m_schema == jschema_all())
+		parsedOK = jdom_parse_direct(parser, &builder, input, schemaInfo, allowComments, parseOpts);
+	else if (parser != NULL)
+		parsedOK = jsax_parse_with_parser_internal(parser, &callbacks, input, schemaInfo, &domCtxt, false /* don't log errors*/);
+	else
+		parsedOK = jsax_parse_internal(&callbacks, input, schemaInfo, &domCtxt, false /* don't log errors*/, allowComments, parseOpts);
+
+	return jdom_parse_result(parser, &builder, parsedOK, input, optimizationMode, value);
+}
+
+/**
+ * Hand over whatever the builder ended up with (cleaning up after it).
+ */
+static bool jdom_parse_result(jparser_ref parser, DomBuilder *builder, bool parsedOK, raw_buffer input, JDOMOptimizationFlags optimizationMode, jvalue_ref *value)
+{
+	jvalue_ref result = builder->m_root;
 
-	if (domCtxt != topLevelContext) {
+	if (builder->m_depth != 0) {
 		// unbalanced state machine (probably a result of parser failure)
-		// cleanup so there's no memory leak
 		PJ_LOG_ERR("state machine indicates invalid input");
 		parsedOK = false;
-		DomInfo *ctxt = domCtxt;
-		DomInfo *parentCtxt;
-		while (ctxt) {
-#ifdef _DEBUG
-			if (ctxt == topLevelContext) {
-				assert(ctxt->m_prev == NULL);
-			} else {
-				assert(ctxt->m_prev != NULL);
-			}
-#endif
-
-			parentCtxt = ctxt->m_prev;
-
-			// top-level json value can only be an object or array,
-			// thus we do not need to check that we aren't releasing topLevelContext->m_value.
-			// the only other object type that m_value will contain is string (representing the key of an object).
-			//if (ctxt->m_value && !jis_array(ctxt->m_value) && !jis_object(ctxt->m_value)) {
-			if (ctxt->m_value && jis_string(ctxt->m_value)) {
-				j_release(&ctxt->m_value);
-			}
-			free(ctxt);
-
-			ctxt = parentCtxt;
-		}
-		topLevelContext = NULL;
 	}
-
-	free(topLevelContext);
+	// cleanup so there's no memory leak.  any object or array is reachable from the result which
+	// gets released below if parsing failed.
+	dom_builder_finish(builder, parser);
 
 	if (!parsedOK) {
 		PJ_LOG_ERR("Parser failure");
 		j_release(&result);
-		return jnull();
+		*value = jnull();
+		return false;
 	}
 
-	if (result == NULL)
+	if (result == NULL) {
 		PJ_LOG_ERR("result was NULL - unexpected. input was '%.*s'", (int)input.m_len, input.m_str);
-	else if (result == jnull())
-		PJ_LOG_WARN("result was NULL JSON - unexpected.  input was '%.*s'", (int)input.m_len, input.m_str);
-	else {
+		*value = jnull();
+		return false;
+	}
+
+	if (result->m_allocator != NULL) {
+		// constants (null, the empty string) are shared by every DOM so they can't point into this input
 		if ((optimizationMode & (DOMOPT_INPUT_NOCHANGE | DOMOPT_INPUT_OUTLIVES_DOM | DOMOPT_INPUT_NULL_TERMINATED)) && input.m_str[input.m_len] == '\0') {
 			result->m_toString = (char *)input.m_str;
 			result->m_toStringDealloc = NULL;
 		}
 	}
 
+	*value = result;
+	return true;
+}
+
+static jvalue_ref jdom_parse_internal(jparser_ref parser, raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, bool allowComments, JParseOptionFlags parseOpts)
+{
+	jvalue_ref result;
+	jdom_parse_value(parser, input, optimizationMode, schemaInfo, allowComments, parseOpts, &result);
 	return result;
 }
 
+jvalue_ref jdom_parse_ex(raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, bool allowComments)
+{
+	return jdom_parse_internal(NULL, input, optimizationMode, schemaInfo, allowComments, JPARSE_OPT_NONE);
+}
+
 jvalue_ref jdom_parse(raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo)
 {
 	return jdom_parse_ex(input, optimizationMode, schemaInfo, false);
 }
 
-jvalue_ref jdom_parse_file(const char *file, JSchemaInfoRef schemaInfo, JFileOptimizationFlags flags)
+jvalue_ref jdom_parse_opts(raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, JParseOptionFlags parseOpts)
 {
-	CHECK_POINTER_RETURN_NULL(file);
-	CHECK_POINTER_RETURN_NULL(schemaInfo);
+	return jdom_parse_internal(NULL, input, optimizationMode, schemaInfo, false, parseOpts);
+}
+
+bool jdom_adopt_input(jvalue_ref dom, jdeallocator release, void *owner)
+{
+	CHECK_POINTER_RETURN_VALUE(dom, false);
+	CHECK_POINTER_RETURN_VALUE(release, false);
+
+	if (dom->m_allocator == NULL) {
+		// constants (null, the empty string) never point into the input
+		release(owner);
+		return true;
+	}
+
+	if (UNLIKELY(dom->m_backingBuffer.m_str || dom->m_backingRelease || dom->m_snapshot)) {
+		PJ_LOG_WARN("DOM %p already has a backing buffer", dom);
+		return false;
+	}
+
+	dom->m_backingRelease = release;
+	dom->m_backingOwner = owner;
+	return true;
+}
+
+jvalue_ref jdom_parse_with_parser(jparser_ref parser, raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo)
+{
+	CHECK_POINTER_RETURN_VALUE(parser, jnull());
+	return jdom_parse_internal(parser, input, optimizationMode, schemaInfo, false, JPARSE_OPT_NONE);
+}
 
+bool jparse_load_file(const char *file, JFileOptimizationFlags flags, raw_buffer *input)
+{
 	int fd;
 	off_t fileSize;
-	raw_buffer input = { 0 };
-	jvalue_ref result;
 	char *err_msg;
 
+	*input = (raw_buffer) { 0 };
+
 	fd = open(file, O_RDONLY);
 	if (fd == -1) {
-		goto errno_parse_failure;
+		goto errno_load_failure;
 	}
 
 	if (!file_size(fd, &fileSize)) {
-		goto errno_parse_failure;
+		goto errno_load_failure;
 	}
 
-	input.m_len = fileSize;
-	if (input.m_len != fileSize) {
+	input->m_len = fileSize;
+	if (input->m_len != fileSize) {
 		PJ_LOG_ERR("File too big - currently unsupported by this API");
 		close(fd);
+		return false;
 	}
 
 	if (flags & JFileOptMMap) {
-		input.m_str = (char *)mmap(NULL, input.m_len, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+		input->m_str = (char *)mmap(NULL, input->m_len, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
 
-		if (input.m_str == NULL || input.m_str == MAP_FAILED) {
-			goto errno_parse_failure;
+		if (input->m_str == NULL || input->m_str == MAP_FAILED) {
+			input->m_str = NULL;
+			goto errno_load_failure;
 		}
 	} else {
-		input.m_str = (char *)malloc(input.m_len + 1);
-		if (input.m_len != read(fd, (char *)input.m_str, input.m_len)) {
-			goto errno_parse_failure;
+		input->m_str = (char *)j_malloc(input->m_len + 1);
+		if (input->m_str == NULL || input->m_len != read(fd, (char *)input->m_str, input->m_len)) {
+			goto errno_load_failure;
 		}
-		((char *)input.m_str)[input.m_len] = 0;
+		((char *)input->m_str)[input->m_len] = 0;
 	}
 
-	result = jdom_parse(input, DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE, schemaInfo);
-
-return_result:
 	close(fd);
+	return true;
 
-	if (UNLIKELY(jis_null(result))) {
-		if (input.m_str) {
-			if (flags & JFileOptMMap) {
-				munmap((void *)input.m_str, input.m_len);
-			} else {
-				free((void *)input.m_str);
-			}
-		}
+errno_load_failure:
+	err_msg = strdup(strerror(errno));
+	PJ_LOG_WARN("Attempt to parse json document '%s' failed (%d) : %s", file, errno, err_msg);
+	free(err_msg);
+
+	if (fd != -1)
+		close(fd);
+	if (!(flags & JFileOptMMap))
+		j_free((void *)input->m_str);
+	return false;
+}
+
+void jparse_unload_file(raw_buffer input, JFileOptimizationFlags flags)
+{
+	if (input.m_str == NULL)
+		return;
+
+	if (flags & JFileOptMMap) {
+		munmap((void *)input.m_str, input.m_len);
+	} else {
+		j_free((void *)input.m_str);
+	}
+}
+
+jvalue_ref jdom_parse_file(const char *file, JSchemaInfoRef schemaInfo, JFileOptimizationFlags flags)
+{
+	CHECK_POINTER_RETURN_NULL(file);
+	CHECK_POINTER_RETURN_NULL(schemaInfo);
+
+	raw_buffer input;
+	jvalue_ref result;
+	JFileStream *stream;
+	bool compressed;
+
+	if (!jfile_compressed(file, &compressed))
+		return jnull();
+
+	if (compressed) {
+		// the decompressed text never exists in full, so there's nothing for the DOM to point into
+		stream = jfile_stream_open(file);
+		if (stream == NULL)
+			return jnull();
+		jdom_parse_stream(NULL, stream, schemaInfo, &result);
+		jfile_stream_close(&stream);
+		return result;
+	}
+
+	if (!jparse_load_file(file, flags, &input))
+		return jnull();
+
+	result = jdom_parse(input, DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE, schemaInfo);
+
+	if (UNLIKELY(jis_null(result) || result->m_allocator == NULL)) {
+		// a constant (e.g. the document "") is shared & has nothing in the input to hold on to
+		jparse_unload_file(input, flags);
 	} else {
 		result->m_backingBuffer = input;
 		result->m_backingBufferMMap = flags & JFileOptMMap;
 	}
 
 	return result;
-
-errno_parse_failure:
-	err_msg = strdup(strerror(errno));
-	PJ_LOG_WARN("Attempt to parse json document '%s' failed (%d) : %s", file, errno, err_msg);
-	free(err_msg);
-
-	result = jnull();
-	goto return_result;
 }
 
-struct __JSAXContext {
-	void *ctxt;
-	yajl_callbacks *m_handlers;
-	ValidationStateRef m_validation;
-	JErrorCallbacksRef m_errors;
-};
-
 void jsax_changeContext(JSAXContextRef saxCtxt, void *userCtxt)
 {
 	saxCtxt->ctxt = userCtxt;
@@ -524,6 +651,25 @@ static void bounce_breakpoint()
 
 #define SCHEMA_HANDLER_FAILED(ctxt) ERR_HANDLER_FAILED((ctxt)->m_errors, m_schema, (ctxt))
 
+/**
+ * Strings & keys are checked as yajl hands them to us, while they are still hot in the cache
+ * from lexing.  Outside of strings the grammar only admits ASCII, so this covers the whole input.
+ *
+ * This isn't one of the extensions of the bundled yajl (see yajl_compat.h) since pbnjson may be built against
+ * a stock yajl, & validation has to work the same either way.
+ */
+static inline bool check_utf8(JSAXContextRef spring, const unsigned char *str, unsigned int strLen)
+{
+	if (LIKELY(!(spring->m_parseOpts & JPARSE_OPT_VALIDATE_UTF8)))
+		return true;
+
+	if (LIKELY(utf8_validate((const char *)str, strLen)))
+		return true;
+
+	PJ_LOG_WARN("Invalid UTF-8 sequence within '%.*s'", strLen, str);
+	return !(ERR_HANDLER_FAILED(spring->m_errors, m_parser, spring));
+}
+
 static int my_bounce_start_map(void *ctxt)
 {
 	bounce_breakpoint();
@@ -532,7 +678,7 @@ static int my_bounce_start_map(void *ctxt)
 	JSAXContextRef spring = (JSAXContextRef)ctxt;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_obj(spring, spring->m_validation)) {
@@ -550,9 +696,11 @@ static int my_bounce_map_key(void *ctxt, const unsigned char *str, unsigned int
 	PJ_LOG_TRACE("%.*s", strLen, str);
 
 	JSAXContextRef spring = (JSAXContextRef)ctxt;
+	if (UNLIKELY(!check_utf8(spring, str, strLen)))
+		return 0;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_key(spring, spring->m_validation, j_str_to_buffer((char *)str, strLen))) {
@@ -572,7 +720,7 @@ static int my_bounce_end_map(void *ctxt)
 	JSAXContextRef spring = (JSAXContextRef)ctxt;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_obj_end(spring, spring->m_validation)) {
@@ -592,7 +740,7 @@ static int my_bounce_start_array(void *ctxt)
 	JSAXContextRef spring = (JSAXContextRef)ctxt;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_arr(spring, spring->m_validation)) {
@@ -612,7 +760,7 @@ static int my_bounce_end_array(void *ctxt)
 	JSAXContextRef spring = (JSAXContextRef)ctxt;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_arr_end(spring, spring->m_validation)) {
@@ -630,9 +778,11 @@ static int my_bounce_string(void *ctxt, const unsigned char *str, unsigned int s
 	PJ_LOG_TRACE("%.*s", strLen, str);
 
 	JSAXContextRef spring = (JSAXContextRef)ctxt;
+	if (UNLIKELY(!check_utf8(spring, str, strLen)))
+		return 0;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_str(spring, spring->m_validation, j_str_to_buffer((char *)str, strLen))) {
@@ -644,26 +794,71 @@ static int my_bounce_string(void *ctxt, const unsigned char *str, unsigned int s
 	DEREF_CALLBACK(spring->m_handlers->yajl_string, ctxt, str, strLen);
 }
 
-static int my_bounce_number(void *ctxt, const char *numberVal, unsigned int numberLen)
+static inline bool bounce_check_number(JSAXContextRef spring, const char *numberVal, unsigned int numberLen)
 {
-	bounce_breakpoint(numberVal);
-	PJ_LOG_TRACE("%.*s", numberLen, numberVal);
-
-	JSAXContextRef spring = (JSAXContextRef)ctxt;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_num(spring, spring->m_validation, j_str_to_buffer((char *)numberVal, numberLen))) {
 			if (SCHEMA_HANDLER_FAILED(spring))
-				return 0;
+				return false;
 		}
 	}
 #endif
+	return true;
+}
+
+static int my_bounce_number(void *ctxt, const char *numberVal, unsigned int numberLen)
+{
+	bounce_breakpoint(numberVal);
+	PJ_LOG_TRACE("%.*s", numberLen, numberVal);
+
+	JSAXContextRef spring = (JSAXContextRef)ctxt;
+	if (!bounce_check_number(spring, numberVal, numberLen))
+		return 0;
 	DEREF_CALLBACK(spring->m_handlers->yajl_number, ctxt, numberVal, numberLen);
 }
 
+/*
+ * Numbers decoded from binary input.  The schema checks numbers as text, as do handlers that don't take the
+ * native value.
+ */
+static int my_bounce_integer(void *ctxt, int64_t integer)
+{
+	char numberVal[24];
+	unsigned int numberLen = snprintf(numberVal, sizeof(numberVal), "%" PRId64, integer);
+
+	JSAXContextRef spring = (JSAXContextRef)ctxt;
+	if (spring->m_integer == NULL)
+		return my_bounce_number(ctxt, numberVal, numberLen);
+
+	bounce_breakpoint(numberVal);
+	PJ_LOG_TRACE("%.*s", numberLen, numberVal);
+
+	if (!bounce_check_number(spring, numberVal, numberLen))
+		return 0;
+	return spring->m_integer(spring, integer);
+}
+
+static int my_bounce_floating(void *ctxt, double floating)
+{
+	char numberVal[JDOUBLE_FORMAT_SIZE];
+	unsigned int numberLen = jdouble_format(floating, numberVal);
+
+	JSAXContextRef spring = (JSAXContextRef)ctxt;
+	if (spring->m_floating == NULL)
+		return my_bounce_number(ctxt, numberVal, numberLen);
+
+	bounce_breakpoint(numberVal);
+	PJ_LOG_TRACE("%.*s", numberLen, numberVal);
+
+	if (!bounce_check_number(spring, numberVal, numberLen))
+		return 0;
+	return spring->m_floating(spring, floating);
+}
+
 static int my_bounce_boolean(void *ctxt, int boolVal)
 {
 	bounce_breakpoint();
@@ -672,7 +867,7 @@ static int my_bounce_boolean(void *ctxt, int boolVal)
 	JSAXContextRef spring = (JSAXContextRef)ctxt;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_bool(spring, spring->m_validation, boolVal)) {
@@ -692,7 +887,7 @@ static int my_bounce_null(void *ctxt)
 	JSAXContextRef spring = (JSAXContextRef)ctxt;
 #if !BYPASS_SCHEMA
 #if SHORTCUT_SCHEMA_ALL
-	if (spring->m_validation->m_state->m_schema != jschema_all())
+	if (spring->m_validation->m_schema != jschema_all())
 #endif
 	{
 		if (!jschema_null(spring, spring->m_validation)) {
@@ -718,17 +913,119 @@ static yajl_callbacks my_bounce = {
 	my_bounce_end_array,
 };
 
-static struct JErrorCallbacks null_err_handler = { 0 };
+/*
+ * Schema-less DOM parsing doesn't need the validation layer - yajl calls straight into the DOM builder.
+ */
+static int dom_direct_null(void *ctxt)
+{
+	return dom_null((JSAXContextRef)ctxt);
+}
 
-static bool jsax_parse_internal(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError, bool comments)
+static int dom_direct_boolean(void *ctxt, int boolVal)
 {
-	yajl_status parseResult;
+	return dom_boolean((JSAXContextRef)ctxt, boolVal);
+}
 
-	PJ_LOG_TRACE("Parsing '%.*s'", RB_PRINTF(input));
+static int dom_direct_number(void *ctxt, const char *numberVal, unsigned int numberLen)
+{
+	return dom_number((JSAXContextRef)ctxt, numberVal, numberLen);
+}
 
-	if (parser == NULL)
-		parser = &no_callbacks;
+static int dom_direct_string(void *ctxt, const unsigned char *str, unsigned int strLen)
+{
+	JSAXContextRef spring = (JSAXContextRef)ctxt;
+	if (UNLIKELY(!check_utf8(spring, str, strLen)))
+		return 0;
+	return dom_string(spring, (const char *)str, strLen);
+}
+
+static int dom_direct_start_map(void *ctxt)
+{
+	return dom_object_start((JSAXContextRef)ctxt);
+}
+
+static int dom_direct_map_key(void *ctxt, const unsigned char *str, unsigned int strLen)
+{
+	JSAXContextRef spring = (JSAXContextRef)ctxt;
+	if (UNLIKELY(!check_utf8(spring, str, strLen)))
+		return 0;
+	return dom_object_key(spring, (const char *)str, strLen);
+}
+
+static int dom_direct_end_map(void *ctxt)
+{
+	return dom_object_end((JSAXContextRef)ctxt);
+}
 
+static int dom_direct_start_array(void *ctxt)
+{
+	return dom_array_start((JSAXContextRef)ctxt);
+}
+
+static int dom_direct_end_array(void *ctxt)
+{
+	return dom_array_end((JSAXContextRef)ctxt);
+}
+
+static yajl_callbacks dom_direct = {
+	dom_direct_null,
+	dom_direct_boolean,
+	NULL, // yajl_integer,
+	NULL, // yajl_double
+	dom_direct_number,
+	dom_direct_string,
+	dom_direct_start_map,
+	dom_direct_map_key,
+	dom_direct_end_map,
+	dom_direct_start_array,
+	dom_direct_end_array,
+};
+
+static int dom_direct_integer(void *ctxt, int64_t integer)
+{
+	return dom_integer((JSAXContextRef)ctxt, integer);
+}
+
+static int dom_direct_floating(void *ctxt, double floating)
+{
+	return dom_floating((JSAXContextRef)ctxt, floating);
+}
+
+/*
+ * CBOR input is dispatched to the same callbacks as text.
+ */
+static const CborCallbacks cbor_bounce = {
+	my_bounce_null,
+	my_bounce_boolean,
+	my_bounce_integer,
+	my_bounce_floating,
+	my_bounce_number,
+	my_bounce_string,
+	my_bounce_start_map,
+	my_bounce_map_key,
+	my_bounce_end_map,
+	my_bounce_start_array,
+	my_bounce_end_array,
+};
+
+static const CborCallbacks cbor_dom_direct = {
+	dom_direct_null,
+	dom_direct_boolean,
+	dom_direct_integer,
+	dom_direct_floating,
+	dom_direct_number,
+	dom_direct_string,
+	dom_direct_start_map,
+	dom_direct_map_key,
+	dom_direct_end_map,
+	dom_direct_start_array,
+	dom_direct_end_array,
+};
+
+static struct JErrorCallbacks null_err_handler = { 0 };
+
+static bool jsax_parse_prepare(JSchemaInfoRef schemaInfo)
+{
 	if (jis_null_schema(schemaInfo->m_schema)) {
 		PJ_LOG_WARN("Cannot match against schema that matches nothing: Schema pointer = %p", schemaInfo->m_schema);
 		return false;
@@ -745,10 +1042,11 @@ static bool jsax_parse_internal(PJSAXCallbacks *parser, raw_buffer input, JSchem
 	if (schemaInfo->m_errHandler == NULL)
 		schemaInfo->m_errHandler = &null_err_handler;
 
-#ifdef _DEBUG
-	logError = true;
-#endif
+	return true;
+}
 
+static inline yajl_callbacks jsax_yajl_callbacks(PJSAXCallbacks *parser)
+{
 	yajl_callbacks yajl_cb = {
 		(pj_yajl_null)parser->m_null, // yajl_null
 		(pj_yajl_boolean)parser->m_boolean, // yajl_boolean
@@ -762,62 +1060,131 @@ static bool jsax_parse_internal(PJSAXCallbacks *parser, raw_buffer input, JSchem
 		(pj_yajl_start_array)parser->m_arrStart, // yajl_start_array
 		(pj_yajl_end_array)parser->m_arrEnd, // yajl_end_array
 	};
+	return yajl_cb;
+}
 
-	yajl_parser_config yajl_opts = {
-		comments, // comments are not allowed
-		0, // currently only UTF-8 will be supported for input.
-	};
-
-	PJSAXContext internalCtxt = {
-		.ctxt = (ctxt != NULL ? *ctxt : NULL),
-		.m_handlers = &yajl_cb,
-		.m_errors = schemaInfo->m_errHandler,
-	};
+static bool jsax_parse_result(yajl_handle handle, JSAXContextRef internalCtxt, yajl_status parseResult, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError);
 
-#if !BYPASS_SCHEMA
-	internalCtxt.m_validation = jschema_init(schemaInfo);
-	if (internalCtxt.m_validation == NULL) {
-		PJ_LOG_WARN("Failed to initialize validation state machine");
-		return false;
+/**
+ * Count a document parsed (or that failed to) for jstats_snapshot.
+ *
+ * @param start What jstats_start returned before the parse started.
+ */
+static inline void jsax_parse_stats(uint64_t start, size_t length, bool parsedOK)
+{
+	if (UNLIKELY(jstats_collecting)) {
+		jstats *counters = jstats_counters();
+		if (counters != NULL) {
+			counters->m_documentsParsed++;
+			counters->m_parseFailures += !parsedOK;
+			counters->m_bytesParsed += length;
+		}
+		JSTATS_ADD_TIME(m_parseTime, start);
 	}
-#endif
+}
 
-	yajl_handle handle = yajl_alloc(&my_bounce, &yajl_opts, NULL, &internalCtxt);
+/**
+ * Feed the input through a handle whose context & validation state have already been set up.
+ * Cleaning up either is left to the caller.
+ */
+static bool jsax_parse_run(yajl_handle handle, JSAXContextRef internalCtxt, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	yajl_status parseResult;
+	uint64_t start = jstats_start();
+	bool parsedOK;
 
 	parseResult = yajl_parse(handle, (unsigned char *)input.m_str, input.m_len);
-	if (ctxt != NULL) *ctxt = jsax_getContext(&internalCtxt);
+	if (parseResult == yajl_status_insufficient_data) {
+		// a number that ends the input can't be told apart from a truncated one until yajl knows no more is coming
+		parseResult = yajl_parse_complete(handle);
+	}
+
+	parsedOK = jsax_parse_result(handle, internalCtxt, parseResult, input, schemaInfo, ctxt, logError);
+	jsax_parse_stats(start, input.m_len, parsedOK);
+	return parsedOK;
+}
+
+/**
+ * Same as jsax_parse_run but the input is read from a stream a chunk at a time.  Whatever follows a complete
+ * document is ignored.  If the input is compressed it's still read so that damage to the compressed data is
+ * noticed - otherwise reading stops with the document, so input that isn't closed after it (a pipe whose writer
+ * carries on) doesn't hold up the parse.  The rest of the last chunk is dropped all the same.
+ */
+static bool jsax_parse_run_stream(yajl_handle handle, JSAXContextRef internalCtxt, JFileStream *stream, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	yajl_status parseResult = yajl_status_insufficient_data;
+	raw_buffer chunk = { 0 };
+	uint64_t start = jstats_start();
+	size_t parsed = 0;
+	bool parsedOK;
+
+	while (parseResult == yajl_status_insufficient_data) {
+		if (!jfile_stream_read(stream, &chunk))
+			goto read_failure;
+		if (chunk.m_len == 0) {
+			parseResult = yajl_parse_complete(handle);
+			break;
+		}
+
+		internalCtxt->m_input = chunk;
+		parseResult = yajl_parse(handle, (unsigned char *)chunk.m_str, chunk.m_len);
+		parsed += chunk.m_len;
+	}
+
+	if (parseResult == yajl_status_ok && jfile_stream_compressed(stream)) {
+		raw_buffer rest = chunk;
+		while (rest.m_len != 0) {
+			if (!jfile_stream_read(stream, &rest))
+				goto read_failure;
+		}
+	}
+
+	// only the last chunk is around for reporting errors
+	parsedOK = jsax_parse_result(handle, internalCtxt, parseResult, chunk, schemaInfo, ctxt, logError);
+	jsax_parse_stats(start, parsed, parsedOK);
+	return parsedOK;
+
+read_failure:
+	if (ctxt != NULL) *ctxt = jsax_getContext(internalCtxt);
+	jsax_parse_stats(start, parsed, false);
+	return false;
+}
+
+/**
+ * Deal with the outcome of feeding input to a handle.
+ *
+ * @param input The input that was fed last.
+ */
+static bool jsax_parse_result(yajl_handle handle, JSAXContextRef internalCtxt, yajl_status parseResult, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	if (ctxt != NULL) *ctxt = jsax_getContext(internalCtxt);
 
 	switch (parseResult) {
 		case yajl_status_ok:
 			break;
 		case yajl_status_client_canceled:
-			if (ERR_HANDLER_FAILED(schemaInfo->m_errHandler, m_unknown, &internalCtxt))
+			if (ERR_HANDLER_FAILED(schemaInfo->m_errHandler, m_unknown, internalCtxt))
 				goto parse_failure;
 			PJ_LOG_WARN("Client claims they handled an unknown error in '%.*s'", (int)input.m_len, input.m_str);
 			break;
 		case yajl_status_insufficient_data:
-			if (ERR_HANDLER_FAILED(schemaInfo->m_errHandler, m_parser, &internalCtxt))
+			if (ERR_HANDLER_FAILED(schemaInfo->m_errHandler, m_parser, internalCtxt))
 				goto parse_failure;
 			PJ_LOG_WARN("Client claims they handled incomplete JSON input provided '%.*s'", (int)input.m_len, input.m_str);
 			break;
 		case yajl_status_error:
 		default:
-			if (ERR_HANDLER_FAILED(schemaInfo->m_errHandler, m_unknown, &internalCtxt))
+			if (ERR_HANDLER_FAILED(schemaInfo->m_errHandler, m_unknown, internalCtxt))
 				goto parse_failure;
 
 			PJ_LOG_WARN("Client claims they handled an unknown error in '%.*s'", (int)input.m_len, input.m_str);
 			break;
 	}
 
-#if !BYPASS_SCHEMA
-	jschema_state_release(&internalCtxt.m_validation);
-#endif
-
 #ifndef NDEBUG
 	assert(yajl_get_error(handle, 0, NULL, 0) == NULL);
 #endif
 
-	yajl_free(handle);
 	return true;
 
 parse_failure:
@@ -827,16 +1194,504 @@ parse_failure:
 		yajl_free_error(handle, errMsg);
 	}
 
+	return false;
+}
+
+/**
+ * yajl_alloc with the handle's memory coming from the default allocator.
+ */
+static yajl_handle jparse_yajl_alloc(const yajl_callbacks *callbacks, const yajl_parser_config *config, void *ctxt)
+{
+	yajl_alloc_funcs allocators;
+	j_allocator_yajl(j_allocator, &allocators);
+	return yajl_alloc(callbacks, config, &allocators, ctxt);
+}
+
+static bool jsax_parse_internal(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError, bool comments, JParseOptionFlags parseOpts)
+{
+	bool parsedOK;
+
+	PJ_LOG_TRACE("Parsing '%.*s'", RB_PRINTF(input));
+
+	if (parser == NULL)
+		parser = &no_callbacks;
+
+	if (!jsax_parse_prepare(schemaInfo))
+		return false;
+
+#ifdef _DEBUG
+	logError = true;
+#endif
+
+	yajl_callbacks yajl_cb = jsax_yajl_callbacks(parser);
+
+	yajl_parser_config yajl_opts = {
+		comments, // comments are not allowed
+		0, // currently only UTF-8 will be supported for input.
+	};
+
+	PJSAXContext internalCtxt = {
+		.ctxt = (ctxt != NULL ? *ctxt : NULL),
+		.m_handlers = &yajl_cb,
+		.m_errors = schemaInfo->m_errHandler,
+		.m_parseOpts = parseOpts,
+		.m_input = input,
+	};
+
+#if !BYPASS_SCHEMA
+	internalCtxt.m_validation = jschema_init(schemaInfo);
+	if (internalCtxt.m_validation == NULL) {
+		PJ_LOG_WARN("Failed to initialize validation state machine");
+		return false;
+	}
+#endif
+
+	yajl_handle handle = jparse_yajl_alloc(&my_bounce, &yajl_opts, &internalCtxt);
+
+	parsedOK = jsax_parse_run(handle, &internalCtxt, input, schemaInfo, ctxt, logError);
+
 #if !BYPASS_SCHEMA
 	jschema_state_release(&internalCtxt.m_validation);
 #endif
 	yajl_free(handle);
-	return false;
+	return parsedOK;
+}
+
+jparser_ref jparser_create(JParseOptionFlags parseOpts)
+{
+	jparser_ref parser = j_calloc(1, sizeof(struct jparser));
+	CHECK_ALLOC_RETURN_NULL(parser);
+
+	parser->m_parseOpts = parseOpts;
+	return parser;
+}
+
+void jparser_set_allocator(jparser_ref parser, JAllocatorRef allocator)
+{
+	parser->m_allocator = allocator;
+}
+
+void jparser_release(jparser_ref *parser)
+{
+	CHECK_POINTER(parser);
+	if (*parser == NULL)
+		return;
+
+#if !BYPASS_SCHEMA
+	jschema_state_destroy(&(*parser)->m_validation);
+#endif
+	if ((*parser)->m_saxHandle)
+		yajl_free((*parser)->m_saxHandle);
+	if ((*parser)->m_domHandle)
+		yajl_free((*parser)->m_domHandle);
+	j_free((*parser)->m_domStack);
+	j_free(*parser);
+	*parser = NULL;
+}
+
+/**
+ * Get one of the handles of a parser ready for a new document, allocating it on first use.
+ */
+static yajl_handle jparser_handle(jparser_ref parser, yajl_handle *handle, const yajl_callbacks *callbacks)
+{
+	yajl_parser_config yajl_opts = {
+		0, // comments are not allowed
+		0, // currently only UTF-8 will be supported for input.
+	};
+
+	parser->m_lastHandle = NULL;
+
+	if (*handle != NULL) {
+#if HAVE_YAJL_RESET
+		yajl_reset(*handle);
+		parser->m_lastHandle = *handle;
+		return *handle;
+#else
+		// a stock yajl can't rewind a handle - everything else held by the parser is still re-used
+		yajl_free(*handle);
+#endif
+	}
+
+	*handle = jparse_yajl_alloc(callbacks, &yajl_opts, &parser->m_context);
+	CHECK_ALLOC_RETURN_NULL(*handle);
+	parser->m_lastHandle = *handle;
+	return *handle;
+}
+
+static bool jsax_parse_with_parser_internal(jparser_ref parser, PJSAXCallbacks *callbacks, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	bool parsedOK;
+	yajl_handle handle;
+	JSAXContextRef internalCtxt = &parser->m_context;
+
+	PJ_LOG_TRACE("Parsing '%.*s'", RB_PRINTF(input));
+
+	if (callbacks == NULL)
+		callbacks = &no_callbacks;
+
+	if (!jsax_parse_prepare(schemaInfo))
+		return false;
+
+#ifdef _DEBUG
+	logError = true;
+#endif
+
+	handle = jparser_handle(parser, &parser->m_saxHandle, &my_bounce);
+	if (UNLIKELY(handle == NULL))
+		return false;
+
+	yajl_callbacks yajl_cb = jsax_yajl_callbacks(callbacks);
+
+	internalCtxt->ctxt = (ctxt != NULL ? *ctxt : NULL);
+	internalCtxt->m_handlers = &yajl_cb;
+	internalCtxt->m_errors = schemaInfo->m_errHandler;
+	internalCtxt->m_parseOpts = parser->m_parseOpts;
+	internalCtxt->m_input = input;
+
+#if !BYPASS_SCHEMA
+	internalCtxt->m_validation = &parser->m_validation;
+	if (!jschema_state_reset(internalCtxt->m_validation, schemaInfo)) {
+		PJ_LOG_WARN("Failed to initialize validation state machine");
+		return false;
+	}
+#endif
+
+	parsedOK = jsax_parse_run(handle, internalCtxt, input, schemaInfo, ctxt, logError);
+
+#if !BYPASS_SCHEMA
+	// don't hold on to references to the schema between documents
+	jschema_state_clear(internalCtxt->m_validation);
+#endif
+	internalCtxt->m_handlers = NULL;
+	return parsedOK;
+}
+
+static bool jdom_parse_direct(jparser_ref parser, DomBuilder *builder, raw_buffer input, JSchemaInfoRef schemaInfo, bool allowComments, JParseOptionFlags parseOpts)
+{
+	bool parsedOK;
+	bool logError = false;
+	yajl_handle handle;
+	PJSAXContext oneShotCtxt;
+	JSAXContextRef internalCtxt = (parser != NULL ? &parser->m_context : &oneShotCtxt);
+
+	PJ_LOG_TRACE("Parsing '%.*s'", RB_PRINTF(input));
+
+	if (!jsax_parse_prepare(schemaInfo))
+		return false;
+
+#ifdef _DEBUG
+	logError = true;
+#endif
+
+	*internalCtxt = (PJSAXContext) {
+		.ctxt = builder,
+		.m_handlers = NULL, // dom_direct calls into the builder itself
+		.m_validation = NULL,
+		.m_errors = schemaInfo->m_errHandler,
+		.m_parseOpts = (parser != NULL ? parser->m_parseOpts : parseOpts),
+		.m_input = input,
+	};
+
+	if (parser != NULL) {
+		handle = jparser_handle(parser, &parser->m_domHandle, &dom_direct);
+	} else {
+		yajl_parser_config yajl_opts = {
+			allowComments,
+			0, // currently only UTF-8 will be supported for input.
+		};
+		handle = jparse_yajl_alloc(&dom_direct, &yajl_opts, internalCtxt);
+	}
+	CHECK_ALLOC_RETURN_VALUE(handle, false);
+
+	parsedOK = jsax_parse_run(handle, internalCtxt, input, schemaInfo, NULL, logError);
+
+	if (parser == NULL)
+		yajl_free(handle);
+	return parsedOK;
+}
+
+static bool jsax_parse_stream(JFileStream *stream, PJSAXCallbacks *parser, JSchemaInfoRef schemaInfo, void **ctxt, bool logError, JParseOptionFlags parseOpts)
+{
+	bool parsedOK;
+
+	if (parser == NULL)
+		parser = &no_callbacks;
+
+	if (!jsax_parse_prepare(schemaInfo))
+		return false;
+
+#ifdef _DEBUG
+	logError = true;
+#endif
+
+	yajl_callbacks yajl_cb = jsax_yajl_callbacks(parser);
+
+	yajl_parser_config yajl_opts = {
+		0, // comments are not allowed
+		0, // currently only UTF-8 will be supported for input.
+	};
+
+	PJSAXContext internalCtxt = {
+		.ctxt = (ctxt != NULL ? *ctxt : NULL),
+		.m_handlers = &yajl_cb,
+		.m_errors = schemaInfo->m_errHandler,
+		.m_parseOpts = parseOpts,
+	};
+
+#if !BYPASS_SCHEMA
+	internalCtxt.m_validation = jschema_init(schemaInfo);
+	if (internalCtxt.m_validation == NULL) {
+		PJ_LOG_WARN("Failed to initialize validation state machine");
+		return false;
+	}
+#endif
+
+	yajl_handle handle = jparse_yajl_alloc(&my_bounce, &yajl_opts, &internalCtxt);
+
+	parsedOK = jsax_parse_run_stream(handle, &internalCtxt, stream, schemaInfo, ctxt, logError);
+
+#if !BYPASS_SCHEMA
+	jschema_state_release(&internalCtxt.m_validation);
+#endif
+	yajl_free(handle);
+	return parsedOK;
+}
+
+/**
+ * @param parser The parser the DOM's allocator, stack & parse options come from (NULL for the defaults).
+ */
+static bool jdom_parse_stream(jparser_ref parser, JFileStream *stream, JSchemaInfoRef schemaInfo, jvalue_ref *value)
+{
+	PJSAXCallbacks callbacks = dom_callbacks;
+	DomBuilder builder;
+	void *domCtxt = &builder;
+	bool parsedOK;
+	JParseOptionFlags parseOpts = (parser != NULL ? parser->m_parseOpts : JPARSE_OPT_NONE);
+
+	dom_builder_init(&builder, parser);
+
+	if (schemaInfo->m_schema == jschema_all()) {
+		bool logError = false;
+
+		parsedOK = jsax_parse_prepare(schemaInfo);
+		if (parsedOK) {
+#ifdef _DEBUG
+			logError = true;
+#endif
+			yajl_parser_config yajl_opts = {
+				0, // comments are not allowed
+				0, // currently only UTF-8 will be supported for input.
+			};
+
+			PJSAXContext internalCtxt = {
+				.ctxt = &builder,
+				.m_handlers = NULL, // dom_direct calls into the builder itself
+				.m_validation = NULL,
+				.m_errors = schemaInfo->m_errHandler,
+				.m_parseOpts = parseOpts,
+			};
+
+			yajl_handle handle = jparse_yajl_alloc(&dom_direct, &yajl_opts, &internalCtxt);
+			parsedOK = jsax_parse_run_stream(handle, &internalCtxt, stream, schemaInfo, NULL, logError);
+			yajl_free(handle);
+		}
+	} else {
+		parsedOK = jsax_parse_stream(stream, &callbacks, schemaInfo, &domCtxt, false /* don't log errors*/, parseOpts);
+	}
+
+	return jdom_parse_result(parser, &builder, parsedOK, j_str_to_buffer("", 0), DOMOPT_NOOPT, value);
+}
+
+bool jsax_parse_file(PJSAXCallbacks *parser, const char *file, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	CHECK_POINTER_RETURN_VALUE(file, false);
+	CHECK_POINTER_RETURN_VALUE(schemaInfo, false);
+
+	bool parsedOK;
+	JFileStream *stream;
+
+	stream = jfile_stream_open(file);
+	if (stream == NULL)
+		return false;
+
+	parsedOK = jsax_parse_stream(stream, parser, schemaInfo, ctxt, logError, JPARSE_OPT_NONE);
+	jfile_stream_close(&stream);
+	return parsedOK;
+}
+
+bool jsax_parse_reader(PJSAXCallbacks *parser, jinput_reader read, void *readCtxt, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	CHECK_POINTER_RETURN_VALUE(read, false);
+	CHECK_POINTER_RETURN_VALUE(schemaInfo, false);
+
+	bool parsedOK;
+	JFileStream *stream;
+
+	stream = jfile_stream_open_reader(read, readCtxt);
+	if (stream == NULL)
+		return false;
+
+	parsedOK = jsax_parse_stream(stream, parser, schemaInfo, ctxt, logError, JPARSE_OPT_NONE);
+	jfile_stream_close(&stream);
+	return parsedOK;
+}
+
+/**
+ * @param parser The parser to allocate the DOM as set up for or NULL for the defaults.
+ */
+static jvalue_ref jdom_parse_reader_internal(jparser_ref parser, jinput_reader read, void *readCtxt, JSchemaInfoRef schemaInfo)
+{
+	CHECK_POINTER_RETURN_VALUE(read, jnull());
+	CHECK_POINTER_RETURN_VALUE(schemaInfo, jnull());
+
+	jvalue_ref result;
+	JFileStream *stream;
+
+	stream = jfile_stream_open_reader(read, readCtxt);
+	if (stream == NULL)
+		return jnull();
+
+	jdom_parse_stream(parser, stream, schemaInfo, &result);
+	jfile_stream_close(&stream);
+	return result;
+}
+
+jvalue_ref jdom_parse_reader(jinput_reader read, void *readCtxt, JSchemaInfoRef schemaInfo)
+{
+	return jdom_parse_reader_internal(NULL, read, readCtxt, schemaInfo);
+}
+
+jvalue_ref jdom_parse_reader_with_parser(jparser_ref parser, jinput_reader read, void *readCtxt, JSchemaInfoRef schemaInfo)
+{
+	CHECK_POINTER_RETURN_VALUE(parser, jnull());
+	return jdom_parse_reader_internal(parser, read, readCtxt, schemaInfo);
+}
+
+bool jsax_parse_with_parser(jparser_ref parser, PJSAXCallbacks *callbacks, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	CHECK_POINTER_RETURN_VALUE(parser, false);
+	return jsax_parse_with_parser_internal(parser, callbacks, input, schemaInfo, ctxt, logError);
+}
+
+/**
+ * @return False if the callback asked us to stop.
+ */
+static bool multi_parse_document(jparser_ref parser, MultiParse *multi, raw_buffer document, JSchemaInfoRef schemaInfo, bool *parsedOK)
+{
+	if (multi->m_onDom != NULL) {
+		// no optimization hints - the document is only a slice of the input
+		jvalue_ref dom = jdom_parse_internal(parser, document, DOMOPT_NOOPT, schemaInfo, false, JPARSE_OPT_NONE);
+		*parsedOK = !jis_null(dom);
+		return multi->m_onDom(multi->m_ctxt, dom);
+	}
+
+	*parsedOK = jsax_parse_with_parser_internal(parser, multi->m_callbacks, document, schemaInfo, multi->m_data, false);
+	return multi->m_onSax == NULL || multi->m_onSax(multi->m_data != NULL ? *multi->m_data : NULL, *parsedOK);
+}
+
+#if HAVE_YAJL_GET_BYTES_CONSUMED
+/**
+ * Where to look for the next document after the one starting at offset failed to parse.
+ *
+ * yajl stops right after the character it choked on.  If that was a line break or the first character
+ * of a line, the previous line was most likely cut short and the failing line is the next document, so
+ * we resume at its start instead of skipping it.  Otherwise the rest of the line is skipped.
+ */
+static size_t multi_resume_offset(raw_buffer input, size_t offset, size_t failed)
+{
+	size_t lineStart = failed;
+
+	while (lineStart > offset && input.m_str[lineStart - 1] != '\n')
+		lineStart--;
+
+	if (lineStart > offset && skip_whitespace(input, lineStart) + 1 >= failed)
+		return lineStart;
+	return next_line(input, failed);
+}
+#endif
+
+bool jparse_multi_internal(jparser_ref parser, raw_buffer input, JSchemaInfoRef schemaInfo, MultiParse *multi)
+{
+	bool allOK = true;
+	bool parsedOK;
+	bool keepGoing = true;
+	size_t offset = skip_whitespace(input, 0);
+
+	while (keepGoing && offset < input.m_len) {
+#if HAVE_YAJL_GET_BYTES_CONSUMED
+		raw_buffer document = j_str_to_buffer(input.m_str + offset, input.m_len - offset);
+		size_t consumed;
+
+		keepGoing = multi_parse_document(parser, multi, document, schemaInfo, &parsedOK);
+
+		// yajl stops at the end of the first document & tells us how far it got
+		consumed = (parser->m_lastHandle != NULL ? yajl_get_bytes_consumed(parser->m_lastHandle) : 0);
+		if (parsedOK && consumed > 0)
+			offset += consumed;
+		else
+			offset = multi_resume_offset(input, offset, offset + consumed);
+#else
+		// without yajl telling us where a document ended, every document has to be on a line of its own
+		size_t end = next_line(input, offset);
+		raw_buffer document = j_str_to_buffer(input.m_str + offset, end - offset);
+
+		keepGoing = multi_parse_document(parser, multi, document, schemaInfo, &parsedOK);
+		offset = end;
+#endif
+		allOK = allOK && parsedOK;
+		offset = skip_whitespace(input, offset);
+	}
+
+	return allOK;
+}
+
+bool jdom_parse_multi(raw_buffer input, JSchemaInfoRef schemaInfo, jdom_multi_callback onDocument, void *ctxt)
+{
+	MultiParse multi = {
+		.m_onDom = onDocument,
+		.m_ctxt = ctxt,
+	};
+	jparser_ref parser;
+	bool result;
+
+	CHECK_POINTER_RETURN_VALUE(onDocument, false);
+
+	parser = jparser_create(JPARSE_OPT_NONE);
+	if (UNLIKELY(parser == NULL))
+		return false;
+
+	result = jparse_multi_internal(parser, input, schemaInfo, &multi);
+	jparser_release(&parser);
+	return result;
+}
+
+bool jsax_parse_multi(PJSAXCallbacks *callbacks, raw_buffer input, JSchemaInfoRef schemaInfo, void **data, jsax_multi_callback onDocument)
+{
+	MultiParse multi = {
+		.m_callbacks = callbacks,
+		.m_data = data,
+		.m_onSax = onDocument,
+	};
+	jparser_ref parser;
+	bool result;
+
+	parser = jparser_create(JPARSE_OPT_NONE);
+	if (UNLIKELY(parser == NULL))
+		return false;
+
+	result = jparse_multi_internal(parser, input, schemaInfo, &multi);
+	jparser_release(&parser);
+	return result;
 }
 
 bool jsax_parse_ex(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
 {
-	return jsax_parse_internal(parser, input, schemaInfo, ctxt, logError, false);
+	return jsax_parse_internal(parser, input, schemaInfo, ctxt, logError, false, JPARSE_OPT_NONE);
+}
+
+bool jsax_parse_opts(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError, JParseOptionFlags parseOpts)
+{
+	return jsax_parse_internal(parser, input, schemaInfo, ctxt, logError, false, parseOpts);
 }
 
 bool jsax_parse(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schema)
@@ -845,6 +1700,144 @@ bool jsax_parse(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schema)
 	return jsax_parse_ex(parser, input, schema, NULL, false);
 }
 
+/**
+ * Decode CBOR input with a context that has already been set up, reporting failure the same way
+ * jsax_parse_run does for text.
+ */
+static bool jcbor_parse_run(const CborCallbacks *callbacks, JSAXContextRef internalCtxt, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	size_t offset;
+	CborStatus parseResult;
+	uint64_t start = jstats_start();
+
+	parseResult = jcbor_parse(input, callbacks, internalCtxt, &offset);
+	if (ctxt != NULL) *ctxt = jsax_getContext(internalCtxt);
+
+	switch (parseResult) {
+		case CBOR_OK:
+			jsax_parse_stats(start, input.m_len, true);
+			return true;
+		case CBOR_CANCELED:
+			if (ERR_HANDLER_FAILED(schemaInfo->m_errHandler, m_unknown, internalCtxt))
+				break;
+			PJ_LOG_WARN("Client claims they handled an unknown error at offset %zu of CBOR input", offset);
+			jsax_parse_stats(start, input.m_len, true);
+			return true;
+		case CBOR_TRUNCATED:
+		case CBOR_INVALID:
+		default:
+			if (ERR_HANDLER_FAILED(schemaInfo->m_errHandler, m_parser, internalCtxt))
+				break;
+			PJ_LOG_WARN("Client claims they handled malformed CBOR input at offset %zu", offset);
+			jsax_parse_stats(start, input.m_len, true);
+			return true;
+	}
+
+	jsax_parse_stats(start, input.m_len, false);
+
+	if (UNLIKELY(logError)) {
+		PJ_LOG_WARN("Parser reason for failure: %s at offset %zu of CBOR input",
+			parseResult == CBOR_CANCELED ? "client canceled" : (parseResult == CBOR_TRUNCATED ? "premature end of input" : "malformed input"),
+			offset);
+	}
+	return false;
+}
+
+/**
+ * @param toDom Whether the callbacks are the DOM builder's (which takes numbers natively).
+ */
+static bool jsax_parse_cbor_internal(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError, bool toDom)
+{
+	bool parsedOK;
+
+	if (parser == NULL)
+		parser = &no_callbacks;
+
+	if (!jsax_parse_prepare(schemaInfo))
+		return false;
+
+#ifdef _DEBUG
+	logError = true;
+#endif
+
+	yajl_callbacks yajl_cb = jsax_yajl_callbacks(parser);
+
+	PJSAXContext internalCtxt = {
+		.ctxt = (ctxt != NULL ? *ctxt : NULL),
+		.m_handlers = &yajl_cb,
+		.m_errors = schemaInfo->m_errHandler,
+		.m_parseOpts = JPARSE_OPT_NONE,
+		.m_integer = (toDom ? dom_integer : NULL),
+		.m_floating = (toDom ? dom_floating : NULL),
+	};
+
+#if !BYPASS_SCHEMA
+	internalCtxt.m_validation = jschema_init(schemaInfo);
+	if (internalCtxt.m_validation == NULL) {
+		PJ_LOG_WARN("Failed to initialize validation state machine");
+		return false;
+	}
+#endif
+
+	parsedOK = jcbor_parse_run(&cbor_bounce, &internalCtxt, input, schemaInfo, ctxt, logError);
+
+#if !BYPASS_SCHEMA
+	jschema_state_release(&internalCtxt.m_validation);
+#endif
+	return parsedOK;
+}
+
+bool jsax_parse_cbor(PJSAXCallbacks *parser, raw_buffer input, JSchemaInfoRef schemaInfo, void **ctxt, bool logError)
+{
+	return jsax_parse_cbor_internal(parser, input, schemaInfo, ctxt, logError, false);
+}
+
+jvalue_ref jdom_parse_cbor(raw_buffer input, JSchemaInfoRef schemaInfo)
+{
+	jvalue_ref result;
+	PJSAXCallbacks callbacks = dom_callbacks;
+	DomBuilder builder;
+	void *domCtxt = &builder;
+	bool parsedOK;
+
+	dom_builder_init(&builder, NULL);
+
+	if (schemaInfo->m_schema == jschema_all()) {
+		// no validation layer - the decoder calls straight into the DOM builder
+		parsedOK = jsax_parse_prepare(schemaInfo);
+		if (parsedOK) {
+			PJSAXContext internalCtxt = {
+				.ctxt = &builder,
+				.m_errors = schemaInfo->m_errHandler,
+				.m_parseOpts = JPARSE_OPT_NONE,
+			};
+			parsedOK = jcbor_parse_run(&cbor_dom_direct, &internalCtxt, input, schemaInfo, NULL, false);
+		}
+	} else {
+		parsedOK = jsax_parse_cbor_internal(&callbacks, input, schemaInfo, &domCtxt, false, true);
+	}
+
+	result = builder.m_root;
+
+	if (builder.m_depth != 0) {
+		PJ_LOG_ERR("state machine indicates invalid input");
+		parsedOK = false;
+	}
+	dom_builder_finish(&builder, NULL);
+
+	if (!parsedOK || result == NULL) {
+		PJ_LOG_ERR("Parser failure");
+		j_release(&result);
+		return jnull();
+	}
+	return result;
+}
+
+/**
+ * Handlers that aren't set accept whatever is injected, just as they do for parsed input.
+ */
+#define INJECT_CALLBACK(callback, ...) ((callback) == NULL || (callback)(__VA_ARGS__))
+
 static inline bool jsax_parse_inject_internal(JSAXContextRef ctxt, jvalue_ref key, jvalue_ref value)
 {
 	assert (ctxt != NULL);
@@ -855,7 +1848,7 @@ static inline bool jsax_parse_inject_internal(JSAXContextRef ctxt, jvalue_ref ke
 
 	if (key) {
 		str = jstring_get_fast(key);
-		if (UNLIKELY(!cbs->yajl_map_key(ctxt, (const unsigned char *)str.m_str, str.m_len)))
+		if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_map_key, ctxt, (const unsigned char *)str.m_str, str.m_len)))
 			return false;
 	}
 
@@ -863,16 +1856,16 @@ static inline bool jsax_parse_inject_internal(JSAXContextRef ctxt, jvalue_ref ke
 		case JV_OBJECT:
 		{
 			jobject_key_value keyval;
-			if (UNLIKELY(!cbs->yajl_start_map(ctxt)))
+			if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_start_map, ctxt)))
 				return false;
 
 			for (jobject_iter i = jobj_iter_init(value); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
 				jobj_iter_deref(i, &keyval);
-				if (UNLIKELY(!jsax_parse_inject(ctxt, keyval.key, keyval.value)))
+				if (UNLIKELY(!jsax_parse_inject_internal(ctxt, keyval.key, keyval.value)))
 					return false;
 			}
 
-			if (UNLIKELY(!cbs->yajl_end_map(ctxt)))
+			if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_end_map, ctxt)))
 				return false;
 			break;
 		}
@@ -880,23 +1873,23 @@ static inline bool jsax_parse_inject_internal(JSAXContextRef ctxt, jvalue_ref ke
 		{
 			jvalue_ref item;
 
-			if (UNLIKELY(!cbs->yajl_start_array(ctxt)))
+			if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_start_array, ctxt)))
 				return false;
 
-			for (ssize_t i = jarray_size(value) - 1; i >= 0; i--) {
+			for (ssize_t i = 0, size = jarray_size(value); i < size; i++) {
 				item = jarray_get(value, i);
-				if (UNLIKELY(!jsax_parse_inject(ctxt, NULL, item)))
+				if (UNLIKELY(!jsax_parse_inject_internal(ctxt, NULL, item)))
 					return false;
 			}
 
-			if (UNLIKELY(!cbs->yajl_end_array(ctxt)))
+			if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_end_array, ctxt)))
 				return false;
 			break;
 		}
 		case JV_STR:
 		{
 			str = jstring_get_fast(value);
-			if (UNLIKELY(!cbs->yajl_string(ctxt, (const unsigned char *)str.m_str, str.m_len)))
+			if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_string, ctxt, (const unsigned char *)str.m_str, str.m_len)))
 				return false;
 
 			break;
@@ -909,20 +1902,20 @@ static inline bool jsax_parse_inject_internal(JSAXContextRef ctxt, jvalue_ref ke
 			CHECK_CONDITION_RETURN_VALUE(value->value.val_num.m_type != NUM_RAW, false, "Some internal problem parsing schema");
 
 			str = jnumber_deref_raw(value);
-			if (UNLIKELY(!cbs->yajl_number(ctxt, str.m_str, str.m_len)))
+			if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_number, ctxt, str.m_str, str.m_len)))
 				return false;
 
 			break;
 		}
 		case JV_BOOL:
 		{
-			if (UNLIKELY(!cbs->yajl_boolean(ctxt, jboolean_deref(value))))
+			if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_boolean, ctxt, jboolean_deref(value))))
 				return false;
 			break;
 		}
 		case JV_NULL:
 		{
-			if (UNLIKELY(!cbs->yajl_null(ctxt)))
+			if (UNLIKELY(!INJECT_CALLBACK(cbs->yajl_null, ctxt)))
 				return false;
 			break;
 		}
@@ -939,7 +1932,261 @@ static inline bool jsax_parse_inject_internal(JSAXContextRef ctxt, jvalue_ref ke
 bool jsax_parse_inject(JSAXContextRef ctxt, jvalue_ref key, jvalue_ref value)
 {
 	assert (jis_string(key));
-	assert (jis_object(value));
 
 	return jsax_parse_inject_internal(ctxt, key, value);
 }
+
+/*
+ * Validating a DOM directly.  The DOM is walked depth-first, feeding the validation state machine the same events
+ * the parser would for the generated text.  Defaults injected by the schema go through the DOM builder, which is
+ * pointed at the object they are missing from.
+ */
+#if !BYPASS_SCHEMA
+/**
+ * Where the value being validated is, kept on the machine stack by the walk so that a path only gets put together
+ * if validation fails.
+ */
+typedef struct ValidationPath {
+	const struct ValidationPath *m_parent;
+	jvalue_ref m_key; /// the key the value is under in its object (NULL if it's in an array)
+	ssize_t m_index; /// the index of the value in its array
+} ValidationPath;
+
+/**
+ * @return The length of a path component once escaped as a JSON pointer (excluding the leading '/').
+ */
+static size_t path_component_length(const ValidationPath *path, char *index, size_t indexSize)
+{
+	if (path->m_key == NULL)
+		return snprintf(index, indexSize, "%zd", path->m_index);
+
+	raw_buffer key = jstring_get_fast(path->m_key);
+	size_t length = key.m_len;
+	for (size_t i = 0; i < key.m_len; i++) {
+		if (key.m_str[i] == '~' || key.m_str[i] == '/')
+			length++;
+	}
+	return length;
+}
+
+/**
+ * @return The JSON pointer to the value at path (NULL if out of memory).
+ */
+static char* path_to_pointer(const ValidationPath *path)
+{
+	char index[24];
+	size_t length = 0;
+	char *pointer, *end;
+
+	for (const ValidationPath *i = path; i->m_parent != NULL; i = i->m_parent)
+		length += 1 + path_component_length(i, index, sizeof(index));
+
+	pointer = (char *)j_malloc(length + 1);
+	CHECK_ALLOC_RETURN_NULL(pointer);
+
+	// filled in from the end since the path is walked from the value up
+	end = pointer + length;
+	*end = '\0';
+	for (const ValidationPath *i = path; i->m_parent != NULL; i = i->m_parent) {
+		size_t componentLength = path_component_length(i, index, sizeof(index));
+		if (i->m_key == NULL) {
+			end -= componentLength;
+			memcpy(end, index, componentLength);
+		} else {
+			raw_buffer key = jstring_get_fast(i->m_key);
+			for (ssize_t c = key.m_len - 1; c >= 0; c--) {
+				switch (key.m_str[c]) {
+					case '~':
+						*--end = '0';
+						*--end = '~';
+						break;
+					case '/':
+						*--end = '1';
+						*--end = '~';
+						break;
+					default:
+						*--end = key.m_str[c];
+						break;
+				}
+			}
+		}
+		*--end = '/';
+	}
+	assert(end == pointer);
+
+	return pointer;
+}
+
+/**
+ * Check the result of one step of validation, giving the error handler a chance to accept it anyway.
+ *
+ * @return False if validation must stop (with failure filled in).
+ */
+static bool validation_step(JSAXContextRef ctxt, bool valid, JValidationCheck check, jvalue_ref value, const ValidationPath *path, JValidationFailure *failure)
+{
+	if (LIKELY(valid))
+		return true;
+
+	if (SCHEMA_HANDLER_FAILED(ctxt)) {
+		if (failure != NULL) {
+			failure->m_check = check;
+			failure->m_value = value;
+			failure->m_path = path_to_pointer(path);
+		}
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Inject the defaults missing from obj (if there are any) into it.
+ */
+static bool validate_object_end(JSAXContextRef ctxt, jvalue_ref obj)
+{
+	DomBuilder *builder = getDOMContext(ctxt);
+	bool valid;
+
+	builder->m_stack[0] = (DomFrame) { .m_container = obj, .m_key = NULL, .m_isObject = true };
+	builder->m_depth = 1;
+
+	valid = jschema_obj_end(ctxt, ctxt->m_validation);
+
+	// keys left waiting for their value by a failed injection
+	for (size_t i = 0; i < builder->m_depth; i++) {
+		if (builder->m_stack[i].m_key != NULL)
+			j_release(&builder->m_stack[i].m_key);
+	}
+	builder->m_depth = 0;
+	return valid;
+}
+
+static bool validate_value(JSAXContextRef ctxt, jvalue_ref value, const ValidationPath *path, JValidationFailure *failure)
+{
+	ValidationStateRef validation = ctxt->m_validation;
+	raw_buffer str;
+
+	switch (value->m_type) {
+		case JV_OBJECT:
+		{
+			jobject_key_value keyval;
+
+			if (!validation_step(ctxt, jschema_obj(ctxt, validation), JVALIDATION_VALUE, value, path, failure))
+				return false;
+
+			for (jobject_iter i = jobj_iter_init(value); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
+				jobj_iter_deref(i, &keyval);
+				ValidationPath child = { .m_parent = path, .m_key = keyval.key, .m_index = 0 };
+
+				str = jstring_get_fast(keyval.key);
+				if (!validation_step(ctxt, jschema_key(ctxt, validation, str), JVALIDATION_KEY, keyval.value, &child, failure))
+					return false;
+				if (!validate_value(ctxt, keyval.value, &child, failure))
+					return false;
+			}
+
+			return validation_step(ctxt, validate_object_end(ctxt, value), JVALIDATION_OBJECT, value, path, failure);
+		}
+		case JV_ARRAY:
+		{
+			ssize_t size = jarray_size(value);
+
+			if (!validation_step(ctxt, jschema_arr(ctxt, validation), JVALIDATION_VALUE, value, path, failure))
+				return false;
+
+			for (ssize_t i = 0; i < size; i++) {
+				ValidationPath child = { .m_parent = path, .m_key = NULL, .m_index = i };
+				if (!validate_value(ctxt, jarray_get(value, i), &child, failure))
+					return false;
+			}
+
+			return validation_step(ctxt, jschema_arr_end(ctxt, validation), JVALIDATION_ARRAY, value, path, failure);
+		}
+		case JV_STR:
+			str = jstring_get_fast(value);
+			return validation_step(ctxt, jschema_str(ctxt, validation, str), JVALIDATION_VALUE, value, path, failure);
+		case JV_NUM:
+		{
+			// numbers that weren't parsed are checked as the generator would write them
+			char formatted[JDOUBLE_FORMAT_SIZE];
+			switch (value->value.val_num.m_type) {
+				case NUM_RAW:
+					str = value->value.val_num.value.raw;
+					break;
+				case NUM_INT:
+					str = j_str_to_buffer(formatted, snprintf(formatted, sizeof(formatted), "%" PRId64, value->value.val_num.value.integer));
+					break;
+				case NUM_FLOAT:
+					str = j_str_to_buffer(formatted, jdouble_format(value->value.val_num.value.floating, formatted));
+					break;
+				default:
+					PJ_LOG_ERR("Unrecognized number type %d", value->value.val_num.m_type);
+					return validation_step(ctxt, false, JVALIDATION_VALUE, value, path, failure);
+			}
+			return validation_step(ctxt, jschema_num(ctxt, validation, str), JVALIDATION_VALUE, value, path, failure);
+		}
+		case JV_BOOL:
+			return validation_step(ctxt, jschema_bool(ctxt, validation, jboolean_deref(value)), JVALIDATION_VALUE, value, path, failure);
+		case JV_NULL:
+			return validation_step(ctxt, jschema_null(ctxt, validation), JVALIDATION_VALUE, value, path, failure);
+	}
+
+	PJ_LOG_ERR("Unrecognized value type %d", value->m_type);
+	return validation_step(ctxt, false, JVALIDATION_VALUE, value, path, failure);
+}
+#endif /* !BYPASS_SCHEMA */
+
+bool jvalue_validate(jvalue_ref val, JSchemaInfoRef schemaInfo, JValidationFailure *failure)
+{
+	if (failure != NULL)
+		*failure = (JValidationFailure) { .m_check = JVALIDATION_OK, .m_value = NULL, .m_path = NULL };
+
+	if (!jsax_parse_prepare(schemaInfo)) {
+		if (failure != NULL)
+			failure->m_check = JVALIDATION_ERROR;
+		return false;
+	}
+
+#if !BYPASS_SCHEMA
+	if (schemaInfo->m_schema == jschema_all())
+		return true;
+
+	struct ValidationState validation = { 0 };
+	yajl_callbacks injection = jsax_yajl_callbacks((PJSAXCallbacks *)&dom_callbacks);
+	DomBuilder builder;
+	PJSAXContext ctxt = {
+		.ctxt = &builder,
+		.m_handlers = &injection,
+		.m_validation = &validation,
+		.m_errors = schemaInfo->m_errHandler,
+		.m_parseOpts = JPARSE_OPT_NONE,
+		.m_input = { 0 },
+	};
+	ValidationPath root = { .m_parent = NULL, .m_key = NULL, .m_index = 0 };
+	bool valid;
+
+	if (!jschema_state_reset(&validation, schemaInfo)) {
+		PJ_LOG_WARN("Failed to initialize validation state machine");
+		jschema_state_destroy(&validation);
+		if (failure != NULL)
+			failure->m_check = JVALIDATION_ERROR;
+		return false;
+	}
+	dom_builder_init(&builder, NULL);
+
+	uint64_t start = jstats_start();
+	valid = validate_value(&ctxt, val, &root, failure);
+	JSTATS_ADD_TIME(m_validateTime, start);
+
+	dom_builder_finish(&builder, NULL);
+	jschema_state_destroy(&validation);
+	return valid;
+#else
+	return true;
+#endif
+}
+
+void jvalidation_failure_clear(JValidationFailure *failure)
+{
+	j_free(failure->m_path);
+	*failure = (JValidationFailure) { .m_check = JVALIDATION_OK, .m_value = NULL, .m_path = NULL };
+}
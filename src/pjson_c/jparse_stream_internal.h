@@ -22,9 +22,111 @@ LICENSE@@@ */
 #include <jtypes.h>
 #include <jcallbacks.h>
 #include <jparse_stream.h>
+#include <string.h>
 
 PJSON_LOCAL jvalue_ref jdom_parse_ex(raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, bool allowComments);
 
+/**
+ * Same as jdom_parse_with_parser (parser may be NULL) except that a JSON null that was parsed successfully can be
+ * told apart from a failure.
+ *
+ * @param value Set to the DOM, or a JSON null on failure.
+ * @return True if the input was parsed successfully & accepted by the schema.
+ */
+PJSON_LOCAL bool jdom_parse_value(jparser_ref parser, raw_buffer input, JDOMOptimizationFlags optimizationMode, JSchemaInfoRef schemaInfo, bool allowComments, JParseOptionFlags parseOpts, jvalue_ref *value);
+
+typedef struct MultiParse {
+	jdom_multi_callback m_onDom; /// set when building a DOM for every document
+	PJSAXCallbacks *m_callbacks; /// used if m_onDom isn't set
+	void **m_data;
+	jsax_multi_callback m_onSax;
+	void *m_ctxt; /// for m_onDom
+} MultiParse;
+
+static inline size_t skip_whitespace(raw_buffer input, size_t offset)
+{
+	while (offset < input.m_len) {
+		switch (input.m_str[offset]) {
+			case ' ':
+			case '\t':
+			case '\n':
+			case '\r':
+				offset++;
+				break;
+			default:
+				return offset;
+		}
+	}
+	return offset;
+}
+
+/**
+ * @return The offset of the start of the line following offset (input.m_len if there isn't one).
+ */
+static inline size_t next_line(raw_buffer input, size_t offset)
+{
+	const char *newline = memchr(input.m_str + offset, '\n', input.m_len - offset);
+	return (newline != NULL ? (size_t)(newline - input.m_str) + 1 : input.m_len);
+}
+
+
+/**
+ * Parse every document found in input with the given parser.
+ *
+ * @see jdom_parse_multi
+ * @see jsax_parse_multi
+ */
+PJSON_LOCAL bool jparse_multi_internal(jparser_ref parser, raw_buffer input, JSchemaInfoRef schemaInfo, MultiParse *multi);
+
+/**
+ * Read (or map) the whole of a file into memory.
+ *
+ * @return False if the file couldn't be loaded (the reason has already been logged).  Otherwise input must
+ *         eventually be handed to jparse_unload_file.
+ */
+PJSON_LOCAL bool jparse_load_file(const char *file, JFileOptimizationFlags flags, raw_buffer *input);
+
+PJSON_LOCAL void jparse_unload_file(raw_buffer input, JFileOptimizationFlags flags);
+
+/**
+ * Reads a file (or the input of a jinput_reader) a chunk at a time, inflating it on the way if it is gzip
+ * compressed, so that it can be parsed without ever being held in memory in its entirety.
+ */
+typedef struct JFileStream JFileStream;
+
+/**
+ * @return NULL if the file couldn't be opened (the reason has already been logged).
+ */
+PJSON_LOCAL JFileStream* jfile_stream_open(const char *file);
+
+/**
+ * Same as jfile_stream_open for input supplied by a reader instead of a file.
+ */
+PJSON_LOCAL JFileStream* jfile_stream_open_reader(jinput_reader read, void *ctxt);
+
+/**
+ * Whether the contents of the file are being inflated.
+ */
+PJSON_LOCAL bool jfile_stream_compressed(JFileStream *stream);
+
+/**
+ * Whether a file starts with the gzip magic, found out by reading just those two bytes (without setting up a
+ * whole JFileStream).
+ *
+ * @return False if the file couldn't be read (the reason has already been logged).
+ */
+PJSON_LOCAL bool jfile_compressed(const char *file, bool *compressed);
+
+/**
+ * Read the next chunk of the (decompressed) contents.
+ *
+ * @param chunk Set to the data read, which stays valid until the next read.  Empty at the end of the file.
+ * @return False if the file couldn't be read or isn't valid compressed data (the reason has already been logged).
+ */
+PJSON_LOCAL bool jfile_stream_read(JFileStream *stream, raw_buffer *chunk);
+
+PJSON_LOCAL void jfile_stream_close(JFileStream **stream);
+
 /**
  * This should be safe (in terms of not breaking JSON syntax) since only the schema is using it
  * and it can only have well-formed objects.
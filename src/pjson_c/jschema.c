@@ -54,11 +54,15 @@ LICENSE@@@ */
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <inttypes.h>
+#include <string.h>
 
 #include "schema_keys.h"
 #include "liblog.h"
+#include "jallocator_internal.h"
 #include "jschema_internal.h"
 #include "jvalue/num_conversion.h"
+#include "jschema_pattern.h"
+#include "jstats_internal.h"
 #include "jparse_stream_internal.h"
 
 #define TRACE_SCHEMA_REF(format, pointer, ...) PJ_SCHEMA_TRACE("TRACE jschema_ref: %p " format, pointer, ##__VA_ARGS__)
@@ -68,15 +72,27 @@ LICENSE@@@ */
 #define TRACE_SCHEMA_RESOLUTION(format, pointer, ...) PJ_SCHEMA_TRACE("TRACE schema $ref %p: " format, pointer, ##__VA_ARGS__)
 
 #if !BYPASS_SCHEMA
-static const bool DEFAULT_ADDITIONAL_PROPERTIES_VALUE = true;
-
 static bool jschema_release_internal2(SchemaWrapperRef schema) NON_NULL(1);
 static void jschema_release_internal(SchemaWrapperRef *schema) NON_NULL(1);
 static void j_release_wrapper(jvalue_ref *value) NON_NULL(1);
+static SchemaWrapperRef jschema_wrap_prepare(jvalue_ref parent);
 
 static JSchemaResolutionResult noop_bad_resolver(JSchemaResolverRef resolver,
 		jschema_ref *resolvedSchema);
 
+/*
+ * Schema references are counted atomically so that a (fully resolved) schema can be shared between threads.
+ */
+#ifdef ATOMIC_ADD
+#define SCHEMA_REF_INC(schema) ATOMIC_INC(&(schema)->m_refCnt)
+#define SCHEMA_REF_DEC(schema) ATOMIC_DEC(&(schema)->m_refCnt)
+#define SCHEMA_REF_GET(schema) ATOMIC_ADD(&(schema)->m_refCnt, 0)
+#else
+#define SCHEMA_REF_INC(schema) (++(schema)->m_refCnt)
+#define SCHEMA_REF_DEC(schema) (--(schema)->m_refCnt)
+#define SCHEMA_REF_GET(schema) ((schema)->m_refCnt)
+#endif
+
 static struct JSchemaResolver NOOP_BAD_RESOLVER = {
 	.m_resolve = noop_bad_resolver,
 	.m_ctxt = NULL,
@@ -100,268 +116,73 @@ static void ensureArrayInitialized(jvalue_ref *arrRef)
 }
 #endif
 
-#if ALLOW_LOCAL_REFS
-static void nextToken(raw_buffer *token, const char *lastPosition) NON_NULL(1, 2);
-static void nextToken(raw_buffer *token, const char *lastPosition)
-{
-	assert(token != NULL);
-	assert(lastPosition != NULL);
-	assert(token->m_str + token->m_len < lastPosition);
-
-	for (; token->m_str + token->m_len < lastPosition; token->m_len ++) {
-		switch (token->m_str[token->m_len]) {
-		case '[':
-		case '.':
-		case ']':
-			return;
-		}
-	}
-}
-
-static bool resolveLocalSchema(SchemaWrapperRef schema, raw_buffer path) NON_NULL(1);
-static bool resolveLocalSchema(SchemaWrapperRef schema, raw_buffer path)
+jschema_ref jschema_copy(jschema_ref schema)
 {
-	jvalue_ref toLookup = schema->m_top;
-	raw_buffer nextObject = {
-			.m_len = 0,
-			.m_str = path.m_str + 1,
-	};
-	const char *lastPosition = path.m_str + path.m_len;
-
-	assert(toLookup != NULL);
-	if (UNLIKELY(toLookup == NULL))
-		return false;
-
-	assert(path.m_len >= 1);
-	assert(path.m_str[0] == '$');
-	assert(nextObject.m_str[0] == '.');
-
-	while (nextObject.m_str + nextObject.m_len < lastPosition) {
-		switch (nextObject.m_str[0]) {
-			case '[':
-			{
-				int32_t index;
-				jvalue_ref indexStr;
-
-				CHECK_CONDITION_RETURN_VALUE(!jis_array(toLookup), false, "Attempt to access indexed element of instance that isn't an array");
-
-				nextObject.m_str++;
-				nextObject.m_len = 0;
-				nextToken(&nextObject, lastPosition);
-
-				CHECK_CONDITION_RETURN_VALUE(nextObject.m_len == 0, false,
-						"Invalid array index provided in reference: '%.*s'", RB_PRINTF(path));
-				CHECK_CONDITION_RETURN_VALUE(nextObject.m_str[nextObject.m_len] != ']', false, "Invalid array index provided in reference");
-
-				indexStr = jnumber_create_unsafe(nextObject, NULL);
-				CHECK_CONDITION_RETURN_VALUE(CONV_OK != jnumber_get_i32(indexStr, &index), false,
-						"Invalid array index '%.*s' in reference: '%.*s'", RB_PRINTF(nextObject), RB_PRINTF(path));
-
-				nextObject.m_str++;	// skip ']'
-				break;
-			}
-			case '.':
-				CHECK_CONDITION_RETURN_VALUE(!jis_object(toLookup), false, "Attempt to access key of instance that isn't an object");
-
-				nextObject.m_str++;
-				nextObject.m_len = 0;
-				nextToken(&nextObject, lastPosition);
-
-				CHECK_CONDITION_RETURN_VALUE(!jobject_get_exists(toLookup, nextObject, &toLookup), false, "Key '%.*s' in reference: '%.*s' is invalid", RB_PRINTF(nextObject), RB_PRINTF(path));
-				assert(!jis_null(toLookup));
-				break;
-			case ']':
-				PJ_SCHEMA_ERR("Unexpected ']' character in reference: '%.*s'", RB_PRINTF(path));
-				return false;
-		}
-	}
-	assert(jis_object(toLookup));
-	TRACE_STATE_ARRAY("adding %p", schema->m_validation, toLookup);
-	jarray_put(schema->m_validation, 0, toLookup);
-	return true;
-}
-#endif
+#if !BYPASS_SCHEMA
+	SchemaWrapperRef schemaImpl = (SchemaWrapperRef)schema;
+	assert(schemaImpl != jschema_all());
+	assert(SCHEMA_REF_GET(schemaImpl) > 0);
+	int refCnt UNUSED_VAR = SCHEMA_REF_INC(schemaImpl);
 
-#if ALLOW_LOCAL_REFS
-#define STACK_SCHEMA_WRAPPER(self, top) \
-	{\
-		.m_refCnt = 1,\
-		.m_validation = jarray_create_var(NULL, self, NULL),\
-		.m_top = top,\
-	}
-#else
-#define STACK_SCHEMA_WRAPPER(self, top) \
-	{\
-		.m_refCnt = 1,\
-		.m_validation = jarray_create_var(NULL, jvalue_copy(self), NULL)\
-	}
+	TRACE_SCHEMA_REF("inc refcnt to %d", schemaImpl, refCnt);
+//	PJ_SCHEMA_DBG("Referencing schema %p: %d", schema, schemaImpl->m_refCnt);
 #endif
-
-#if 0
-static jvalue_ref top_schema(SchemaWrapperRef schema)
-{
-	SANITY_CHECK_POINTER(schema);
-	assert(schema != NULL);
-	assert(jis_array(schema->m_validation));
-	assert(jarray_size(schema->m_validation) >= 1);
-	assert(jis_object(jarray_get(schema->m_validation, 0)));
-	return jarray_get(schema->m_validation, 0);
+	return schema;
 }
-#endif
 
-#if !BYPASS_SCHEMA
-static jvalue_ref last_schema(SchemaWrapperRef schema)
+jschema_ref jschema_duplicate(jschema_ref schema)
 {
-	SANITY_CHECK_POINTER(schema);
-	assert(schema != NULL);
-	assert(jis_array(schema->m_validation));
-	assert(jarray_size(schema->m_validation) >= 1);
-	assert(jis_object(jarray_get(schema->m_validation, jarray_size(schema->m_validation) - 1)));
-	return jarray_get(schema->m_validation, jarray_size(schema->m_validation) - 1);
-}
+#if !BYPASS_SCHEMA
+	SchemaWrapperRef schemaImpl = (SchemaWrapperRef)schema;
+	SchemaWrapperRef duplicate;
+	jvalue_ref top = NULL;
 
-static jvalue_ref top_schema(SchemaWrapperRef schema)
-{
-	SANITY_CHECK_POINTER(schema);
-	assert(schema != NULL);
-	assert(jis_array(schema->m_validation));
-	assert(jarray_size(schema->m_validation) >= 1);
-	assert(jis_object(jarray_get(schema->m_validation, 0)));
-	return jarray_get(schema->m_validation, 0);
-}
+	// the built-in schemas are never modified or freed
+	if (schemaImpl == jschema_all() || jis_null_schema(schemaImpl))
+		return schema;
 
-#if TRACK_SCHEMA_PARSING
-#define RESOLVE_SCHEMA(parseState, schema, resolver) resolveSchema(parseState, schema, resolver)
-#else
-#define RESOLVE_SCHEMA(parseState, schema, resolver) resolveSchema(schema, resolver)
-#endif
-
-#if TRACK_SCHEMA_PARSING
-static bool resolveSchema(ValidationStateRef parseState, SchemaWrapperRef schema, SchemaResolutionRef resolver) NON_NULL(1, 2);
-static bool resolveSchema(ValidationStateRef parseState, SchemaWrapperRef schema, SchemaResolutionRef resolver)
-#else
-static bool resolveSchema(SchemaWrapperRef schema, SchemaResolutionRef resolver) NON_NULL(1, 2);
-static bool resolveSchema(SchemaWrapperRef schema, SchemaResolutionRef resolver)
-#endif
-{
-	jvalue_ref ref;
-	assert(schema != NULL);
-	SANITY_CHECK_POINTER(schema);
-	SANITY_CHECK_POINTER(schema->m_validation);
-	assert(jis_array(schema->m_validation));
-
-	jvalue_ref toResolve = last_schema(schema);
-	assert(!jis_null(toResolve));
-
-	ref = jobject_get(toResolve, J_CSTR_TO_BUF(SK_REF));
-	if (!jis_null(ref)) {
-		TRACE_SCHEMA_RESOLUTION("resolving w/ refcnt %d", toResolve, toResolve->m_refCnt);
-
-		raw_buffer refStr;
-		SchemaWrapperRef resolvedRemote;
-
-		// need to resolve a reference
-		if (UNLIKELY(jobject_size(toResolve) != 1)) {
-			CHECK_CONDITION_RETURN_VALUE(
-					jobject_size(toResolve) != 2 || !jobject_containskey(toResolve, J_CSTR_TO_BUF(SK_DESCRIPTION)),
-					false,
-					"Schema is invalid - contains an external reference in addition to other key/values that aren't a description field");
-		}
-		CHECK_CONDITION_RETURN_VALUE(!jis_string(ref), false, "External reference is invalid - must be a string");
-
-		refStr = jstring_get_fast(ref);
-		assert(refStr.m_str != NULL);
-		if (UNLIKELY(refStr.m_len <= 0)) {
-			const char * invalidSchemaAsStr = jvalue_tostring(toResolve, jschema_all());
-			PJ_SCHEMA_ERR("No valid schema reference: %s", invalidSchemaAsStr);
-			return false;
-		}
+	assert(SCHEMA_REF_GET(schemaImpl) > 0);
 
-		if (UNLIKELY(refStr.m_str[0] == '$')) {
 #if ALLOW_LOCAL_REFS
-			return resolveLocalSchema(schema, refStr);
-#else
-			PJ_SCHEMA_WARN("$ is reserved for referencing within the schema.  This isn't currently supported");
+	top = jvalue_duplicate(schemaImpl->m_top);
+	CHECK_ALLOC_RETURN_NULL(top);
 #endif
-		}
+	duplicate = jschema_wrap_prepare(top);
+	j_release_wrapper(&top);
 
-		resolver->m_resolver->m_ctxt = schema;
-		resolver->m_resolver->m_resourceToResolve = refStr;
-		START_TRACKING_SCHEMA(parseState);
-		if (SCHEMA_RESOLVED != resolver->m_resolver->m_resolve(resolver->m_resolver, &resolvedRemote)) {
-			END_TRACKING_SCHEMA(parseState);
-			PJ_SCHEMA_ERR("Resolver failed to resolve %.*s", RB_PRINTF(refStr));
-			return false;
-		}
-		END_TRACKING_SCHEMA(parseState);
-		PJ_SCHEMA_DBG("Resolved remote reference for %.*s", RB_PRINTF(refStr));
-
-		assert(resolvedRemote != NULL);
-		assert(jis_array(resolvedRemote->m_validation));
-
-		int lastElement = jarray_size(schema->m_validation) - 1;
-		TRACE_STATE_ARRAY("removing %p w/ refCnt %d", schema->m_validation, jarray_get(schema->m_validation, lastElement), jarray_get(schema->m_validation, lastElement)->m_refCnt);
-		jarray_remove(schema->m_validation, lastElement);
-		if (!jarray_splice_append(schema->m_validation, resolvedRemote->m_validation, SPLICE_TRANSFER)) {
-			PJ_SCHEMA_ERR("Failed to append resolved schema for %.*s", RB_PRINTF(refStr));
-			jschema_release_internal(&resolvedRemote);
-			return false;
+	for (ssize_t i = 0; i < jarray_size(schemaImpl->m_validation); i++) {
+		jvalue_ref element = jarray_get(schemaImpl->m_validation, i);
+#if ALLOW_LOCAL_REFS
+		// the parsed schema is usually its own top - keep the two shared in the copy as well
+		if (element == schemaImpl->m_top) {
+			jarray_append(duplicate->m_validation, jvalue_copy(duplicate->m_top));
+			continue;
 		}
-//		schema->m_validation = resolvedRemote->m_validation;
-//		schema->m_top = resolvedRemote->m_top;
-
-		jschema_release_internal(&resolvedRemote);
-
-		assert(jis_array(schema->m_validation));
-
-		return true;
-	} else if (!jis_null(ref = jobject_get(top_schema(schema), J_CSTR_TO_BUF(SK_EXTENDS)))) {
-		SchemaWrapper extensionWrapper = STACK_SCHEMA_WRAPPER(ref, schema->m_top);
-		CHECK_CONDITION_RETURN_VALUE(!RESOLVE_SCHEMA(parseState, &extensionWrapper, resolver), false, "Failed to resolve inheritance");
-#ifndef NDEBUG
-		for (ssize_t i = jarray_size(extensionWrapper.m_validation) - 1; i >= 0; i--)
-			assert(jis_object(jarray_get(extensionWrapper.m_validation, i)));
 #endif
-
-		TRACE_STATE_ARRAY("splicing in %p", schema->m_validation, extensionWrapper.m_validation);
-		CHECK_CONDITION_RETURN_VALUE(!jarray_splice_append(schema->m_validation, extensionWrapper.m_validation, SPLICE_TRANSFER), false, "Failed to splice extension");
-		assert(jis_array(extensionWrapper.m_validation));
-
-		TRACE_STATE_ARRAY("intermediary destroyed", extensionWrapper.m_validation);
-		j_release_wrapper(&extensionWrapper.m_validation);
+		jarray_append(duplicate->m_validation, jvalue_duplicate(element));
 	}
-	// else nothing to do - no reference to resolve
-
-	return true;
-}
-#endif
 
-jschema_ref jschema_copy(jschema_ref schema)
-{
-#if !BYPASS_SCHEMA
-	SchemaWrapperRef schemaImpl = (SchemaWrapperRef)schema;
-	assert(schemaImpl != jschema_all());
-	assert(schemaImpl->m_refCnt > 0);
-	schemaImpl->m_refCnt++;
-
-	TRACE_SCHEMA_REF("inc refcnt to %d", schemaImpl, schemaImpl->m_refCnt);
-//	PJ_SCHEMA_DBG("Referencing schema %p: %d", schema, schemaImpl->m_refCnt);
-#endif
+	// strings that pointed into the memory map have all been copied
+	return duplicate;
+#else
 	return schema;
+#endif
 }
 
 #if !BYPASS_SCHEMA
 static bool jschema_release_internal2(SchemaWrapperRef schema)
 {
 	assert (!jis_null_schema(schema));
-	assert (schema->m_refCnt > 0);
+	assert (SCHEMA_REF_GET(schema) > 0);
 
 	if (schema == jschema_all())
 		return false;
 
 //	PJ_SCHEMA_DBG("Unreferencing schema %p: %d", schema, schema->m_refCnt - 1);
-	if (--schema->m_refCnt == 0) {
+	int refCnt = SCHEMA_REF_DEC(schema);
+	if (refCnt == 0) {
 		TRACE_SCHEMA_REF("releasing validation array %p", schema, schema->m_validation);
+		jschema_nodes_release(schema);
 //		PJ_SCHEMA_DBG("Releasing schema %p validation array", schema);
 		j_release_wrapper(&schema->m_validation);
 #if ALLOW_LOCAL_REFS
@@ -374,11 +195,11 @@ static bool jschema_release_internal2(SchemaWrapperRef schema)
 			SANITY_CLEAR_VAR(schema->m_backingMMapSize, -1);
 		}
 		return true;
-	} else if (UNLIKELY(schema->m_refCnt < 0)) {
+	} else if (UNLIKELY(refCnt < 0)) {
 		PJ_LOG_ERR("reference counter messed up - memory corruption and/or random crashes are possible");
 		assert(false);
 	} else {
-		TRACE_SCHEMA_REF("dec refcnt to %d", schema, schema->m_refCnt);
+		TRACE_SCHEMA_REF("dec refcnt to %d", schema, refCnt);
 	}
 
 	return false;
@@ -397,7 +218,7 @@ static void jschema_release_internal(SchemaWrapperRef *schemaImpl)
 		TRACE_SCHEMA_REF("freed", *schemaImpl);
 
 		assert((*schemaImpl)->m_refCnt == 0);
-		free(*schemaImpl);
+		j_free(*schemaImpl);
 	}
 
 released_schema:
@@ -415,7 +236,7 @@ void jschema_release(jschema_ref *schema)
 #if !BYPASS_SCHEMA
 static SchemaWrapperRef jschema_wrap_prepare(jvalue_ref parent)
 {
-	SchemaWrapperRef schema = (SchemaWrapperRef)malloc(sizeof(SchemaWrapper));
+	SchemaWrapperRef schema = (SchemaWrapperRef)j_malloc(sizeof(SchemaWrapper));
 	schema->m_refCnt = 1;
 #if ALLOW_LOCAL_REFS
 	schema->m_top = jvalue_copy(parent);
@@ -425,6 +246,12 @@ static SchemaWrapperRef jschema_wrap_prepare(jvalue_ref parent)
 	schema->m_backingMMap = NULL;
 	schema->m_backingMMapSize = 0;
 
+	schema->m_root = NULL;
+	schema->m_nodes = NULL;
+	schema->m_references = NULL;
+	schema->m_numReferences = 0;
+	schema->m_referencesCapacity = 0;
+
 	TRACE_SCHEMA_REF("created w/ refcnt %d", schema, schema->m_refCnt);
 
 //	PJ_SCHEMA_DBG("Allocating schema %p with parent %p", schema, parent);
@@ -566,146 +393,7 @@ jschema_ref jschema_parse_ex(raw_buffer input, JSchemaOptimizationFlags inputOpt
 #endif
 }
 
-#ifndef OPT_TYPE_PARSING
-// in the absence of how much faster this makes this, we do things correctly
-#define OPT_TYPE_PARSING 0
-#endif /* OPT_TYPE_PARSING */
-
-#if OPTIMIZE_TYPE_PARSING
-#define PICK_TYPE(buffer, strliteral, type) \
-	do { \
-		assert(buffer.m_len == sizeof(strliteral) - 1); \
-		if (buffer.m_str[0] == strliteral[0]) { \
-			return type; \
-		} \
-	} while (0)
-#else
-#define PICK_TYPE(buffer, strliteral, type) \
-	do {\
-		assert(buffer.m_len == sizeof(strliteral) - 1); \
-		if (memcmp(buffer.m_str, strliteral, sizeof(strliteral) - 1) == 0) {\
-			return type; \
-		}\
-	} while(0)
-#endif /* OPTIMIZE_TYPE_PARSING */
-
 #if !BYPASS_SCHEMA
-static SchemaType parseType(raw_buffer input)
-{
-	// TODO: STATIC VALIDATION POSSIBILITY OF SCHEMA
-	if (input.m_len == 0)
-		return ST_ERR;
-
-	switch (input.m_len) {
-	case 3:
-		PICK_TYPE(input, "any", ST_ANY);
-		break;
-	case 4:
-		PICK_TYPE(input, "null", ST_NULL);
-		break;
-	case 5:
-		PICK_TYPE(input, "array", ST_ARR);
-		break;
-	case 6:
-		switch (input.m_str[0]) {
-		case 'o':
-			PICK_TYPE(input, "object", ST_OBJ);
-			break;
-		case 's':
-			PICK_TYPE(input, "string", ST_STR);
-			break;
-		case 'n':
-			PICK_TYPE(input, "number", ST_NUM);
-			break;
-		}
-		break;
-	case 7:
-		switch (input.m_str[0]) {
-		case 'i':
-			PICK_TYPE(input, "integer", ST_INT);
-			break;
-		case 'b':
-			PICK_TYPE(input, "boolean", ST_BOOL);
-			break;
-		}
-		break;
-	}
-	PJ_LOG_WARN("Ignoring unsupported type %.*s", (int)input.m_len, input.m_str);
-	return ST_ANY;
-}
-
-static SchemaTypeBitField determinePossibilities_internal(SchemaTypeBitField field, jvalue_ref schemaType)
-{
-	if ((field & ST_ANY) == ST_ANY)
-		return field;
-
-	if (jis_null(schemaType)) {
-		return ST_ANY;
-	}
-	if (jis_string(schemaType)) {
-		return field | parseType(jstring_get_fast(schemaType));
-	}
-	if (jis_array(schemaType)) {
-		for (ssize_t i = jarray_size(schemaType) - 1; i >= 0 && (field & ST_ANY) != ST_ANY; i--)
-			field |= determinePossibilities_internal(field, jarray_get(schemaType, i));
-		return field;
-	}
-	PJ_LOG_WARN("Schema type/disallowed field contains an unsupported JSON type: %u", schemaType->m_type);
-	return ST_ANY;
-}
-
-static void determinePossibilities(SchemaStateRef state)
-{
-	SchemaTypeBitField parsed = 0;
-	jvalue_ref typeParameter;
-
-	// TODO: STATIC VALIDATION POSSIBILITY OF SCHEMA
-	// here we have to be careful - m_validation is the inheritance tree.  So the types are actually restricted
-	// as we move further down the inheritance tree.  if the user breaks the tree, we catch this
-	// by disallowing all schemas
-	ssize_t numInheritanceSchemas = jarray_size(state->m_schema->m_validation);
-	jvalue_ref parent;
-
-	// initialize the types with the most lax types possible
-	state->m_allowedTypes = ST_ANY;
-	state->m_disallowedTypes = 0;
-
-	// keep restricting moving up the inheritance tree
-	for (ssize_t i = 0; i < numInheritanceSchemas; i++) {
-		parent = jarray_get(state->m_schema->m_validation, i);
-		// we are restricting further - must have at most the types that were allowed previously
-		// otherwise, we assume the parent provides acceptable parameters
-		if (!jis_null(typeParameter = jobject_get(parent, J_CSTR_TO_BUF(SK_TYPE)))) {
-			parsed = determinePossibilities_internal(0, typeParameter);
-			if ((parsed & state->m_allowedTypes) != parsed) {
-				PJ_LOG_WARN("Schema type specified in %zd from top conflicts with one of its parent types - violates more restricting schema rule for inheritance", i);
-				assert(false);	// this is a problem with the schema - force handling of this in debug mode
-
-				// this is an error condition - this schema will fail any input
-				state->m_allowedTypes = 0;
-				state->m_disallowedTypes = ST_ANY;
-				return;
-			}
-			// update with the current value (which may have restricted the types allowed further)
-			state->m_allowedTypes = parsed;
-		}
-
-		if (!jis_null(typeParameter = jobject_get(parent, J_CSTR_TO_BUF(SK_DISALLLOWED)))) {
-			if ((parsed & state->m_disallowedTypes) != state->m_disallowedTypes) {
-				// if the child doesn't specify at least all of its parent disallowed types, then it can allow more
-				PJ_LOG_WARN("Schema type specified in %zd from top conflicts with one of its parent disallowed types - violates more restricting schema rule for inheritance", i);
-				assert(false);	// this is a problem with the schema - force handling of this in debug mode
-
-				// this is an error condition - this schema will fail any input
-				state->m_allowedTypes = 0;
-				state->m_disallowedTypes = ST_ANY;
-				return;
-			}
-			state->m_disallowedTypes = parsed;
-		}
-	}
-}
-
 static void validation_destroy(ValidationStateRef *statePtr)
 {
 	ValidationStateRef state;
@@ -718,11 +406,9 @@ static void validation_destroy(ValidationStateRef *statePtr)
 
 	if (state) {
 		TRACE_VALIDATION_STATE("destroyed", state);
-		TRACE_SCHEMA_STATE("destroyed", state->m_state);
 
-		free(state->m_state);
-		SANITY_KILL_POINTER(state->m_state);
-		free(state);
+		jschema_state_destroy(state);
+		j_free(state);
 	}
 
 	SANITY_KILL_POINTER(*statePtr);
@@ -737,7 +423,7 @@ static JSchemaResolutionResult noop_bad_resolver(JSchemaResolverRef resolver,
 
 static void assert_valid_schema(SchemaWrapperRef schema)
 {
-	assert(schema->m_refCnt > 0);
+	assert(SCHEMA_REF_GET(schema) > 0);
 	assert(!jis_null(schema->m_validation));
 	assert(schema->m_validation->m_refCnt > 0);
 #if ALLOW_LOCAL_REFS
@@ -747,19 +433,22 @@ static void assert_valid_schema(SchemaWrapperRef schema)
 }
 #endif
 
-ValidationStateRef jschema_init(JSchemaInfoRef schemaInfo)
-{
 #if !BYPASS_SCHEMA
-	ValidationStateRef validation = (ValidationStateRef) malloc(sizeof(struct ValidationState));
-	CHECK_POINTER_RETURN_NULL(validation);
+/**
+ * Set up the top-level state of an (empty) validation state machine for the given schema.
+ *
+ * @return False if the top-level state couldn't be created, in which case validation->m_state is left NULL.
+ */
+static bool push_new_state(ValidationStateRef parseState, SchemaNodeRef node) NON_NULL(1, 2);
 
-	validation->m_state = calloc(1, sizeof(struct SchemaState));
-	if (validation->m_state == NULL) {
-		validation_destroy(&validation);
-		return NULL;
-	}
+static bool validation_init(ValidationStateRef validation, JSchemaInfoRef schemaInfo) NON_NULL(1, 2);
+static bool validation_init(ValidationStateRef validation, JSchemaInfoRef schemaInfo)
+{
+	SchemaNodeRef root;
 
-	TRACE_VALIDATION_STATE("created", validation);
+	assert(validation->m_state == NULL);
+	assert(validation->m_schema == NULL);
+	END_TRACKING_SCHEMA(validation);
 
 	assert(schemaInfo->m_schema != NULL);
 	assert_valid_schema(schemaInfo->m_schema);
@@ -772,19 +461,41 @@ ValidationStateRef jschema_init(JSchemaInfoRef schemaInfo)
 	validation->m_resolutionHandlers.m_resolver = schemaInfo->m_resolver;
 	validation->m_resolutionHandlers.m_errorHandler = schemaInfo->m_errHandler;
 
+	// the states point into the nodes compiled for the schema - keep it alive for as long as they are
+	validation->m_schema =
+			((schemaInfo->m_schema != jschema_all()) ?
+					jschema_copy(schemaInfo->m_schema) :
+					jschema_all());
+
 	// only one top-level state possible - when we allow more complex unions, this will have to change
-	if (!RESOLVE_SCHEMA(validation, schemaInfo->m_schema, &validation->m_resolutionHandlers)) {
+	root = jschema_root_node(validation->m_schema);
+	if (root == NULL || !push_new_state(validation, root)) {
 		PJ_LOG_ERR("Failed to initialize validation state because requested schema failed to resolve");
+		jschema_release_internal(&validation->m_schema);
+		validation->m_schema = NULL;
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+ValidationStateRef jschema_init(JSchemaInfoRef schemaInfo)
+{
+#if !BYPASS_SCHEMA
+	ValidationStateRef validation = (ValidationStateRef) j_malloc(sizeof(struct ValidationState));
+	CHECK_POINTER_RETURN_NULL(validation);
+	validation->m_state = NULL;
+	validation->m_stateBlock = NULL;
+	validation->m_schema = NULL;
+
+	TRACE_VALIDATION_STATE("created", validation);
+
+	if (!validation_init(validation, schemaInfo)) {
 		validation_destroy(&validation);
 		return NULL;
 	}
 
-	validation->m_state->m_schema =
-			((schemaInfo->m_schema != jschema_all()) ?
-					jschema_copy(schemaInfo->m_schema) :
-					jschema_all());
-	determinePossibilities(validation->m_state);
-
 	return validation;
 #else
 	return NULL;
@@ -793,60 +504,131 @@ ValidationStateRef jschema_init(JSchemaInfoRef schemaInfo)
 
 #if !BYPASS_SCHEMA
 /**
- * @return The parent of state
+ * Take the next state off the stack of states kept by the validation.  Everything but the space for tracking the
+ * keys of larger objects is reset.
+ *
+ * @return The state to fill in or NULL if the stack couldn't grow
  */
-static SchemaStateRef destroy_state(SchemaStateRef *state)
+static SchemaStateRef take_state(ValidationStateRef parseState) NON_NULL(1);
+static SchemaStateRef take_state(ValidationStateRef parseState)
 {
-	SchemaStateRef parent;
+	SchemaStateBlock *block = parseState->m_stateBlock;
+	SchemaStateRef state;
+	PropertyBits *seenKeysBuffer;
+	size_t seenKeysCapacity;
+
+	if (block == NULL || block->m_used == SCHEMA_STATE_BLOCK_SIZE) {
+		if (block == NULL || block->m_next == NULL) {
+			SchemaStateBlock *grown = (SchemaStateBlock *)j_calloc(1, sizeof(SchemaStateBlock));
+			CHECK_ALLOC_RETURN_NULL(grown);
+			grown->m_prev = block;
+			if (block != NULL)
+				block->m_next = grown;
+			block = grown;
+		} else {
+			block = block->m_next;
+		}
+		assert(block->m_used == 0);
+		parseState->m_stateBlock = block;
+	}
+
+	state = &block->m_states[block->m_used++];
+	seenKeysBuffer = state->m_seenKeysBuffer;
+	seenKeysCapacity = state->m_seenKeysCapacity;
+	memset(state, 0, sizeof(struct SchemaState));
+	state->m_seenKeysBuffer = seenKeysBuffer;
+	state->m_seenKeysCapacity = seenKeysCapacity;
 
-	assert(state != NULL);
-	SANITY_CHECK_POINTER(*state);
+	return state;
+}
+
+/**
+ * Pop the current state (which is always the last one taken from the stack).
+ *
+ * @return The parent of the state
+ */
+static SchemaStateRef destroy_state(ValidationStateRef parseState) NON_NULL(1);
+static SchemaStateRef destroy_state(ValidationStateRef parseState)
+{
+	SchemaStateBlock *block = parseState->m_stateBlock;
+	SchemaStateRef state = parseState->m_state;
 
-	parent = (*state)->m_parent;
-	TRACE_SCHEMA_STATE("destroyed - parent is %p", *state, parent);
+	SANITY_CHECK_POINTER(state);
+	assert(block != NULL && block->m_used > 0);
+	assert(state == &block->m_states[block->m_used - 1]);
 
-	if ((*state)->m_seenKeys != NULL)
-		j_release_wrapper(&((*state)->m_seenKeys));
-	jschema_release_internal(&((*state)->m_schema));
-	free(*state);
+	TRACE_SCHEMA_STATE("destroyed - parent is %p", state, state->m_parent);
 
-	SANITY_KILL_POINTER(*state);
+	parseState->m_state = state->m_parent;
+	if (--block->m_used == 0 && block->m_prev != NULL)
+		parseState->m_stateBlock = block->m_prev;
 
-	return parent;
+	return parseState->m_state;
 }
 
 /**
- * Destroy branch between state & all parents up to terminating (non-inclusive).
- *
- * @param state Pointer to the SchemaState reference to destroy
- * @param terminating The SchemaState reference to stop termination at (doesn't get destroyed itself)
- *        NULL implicitly means to top-level.
+ * Pop every state (i.e. give up on validating the document).
  */
-static SchemaStateRef destroy_branch(SchemaStateRef *state, SchemaStateRef terminating) NON_NULL(1);
-static SchemaStateRef destroy_branch(SchemaStateRef *state, SchemaStateRef terminating)
+static void destroy_branch(ValidationStateRef parseState) NON_NULL(1);
+static void destroy_branch(ValidationStateRef parseState)
 {
-	TRACE_SCHEMA_STATE("destroying between %p & %p", NULL, *state, terminating);
-	SchemaStateRef parent = NULL;
+	TRACE_SCHEMA_STATE("destroying branch", parseState->m_state);
 
-	assert(state != NULL);
-	SANITY_CHECK_POINTER(*state);
-	SANITY_CHECK_POINTER(terminating);
+	while (parseState->m_state != NULL)
+		destroy_state(parseState);
+}
+#endif
 
-	while (*state != terminating) {
-		SANITY_CHECK_POINTER(*state);
-		assert(*state != NULL);
+void jschema_state_clear(ValidationStateRef state)
+{
+#if !BYPASS_SCHEMA
+	SANITY_CHECK_POINTER(state);
 
-		parent = destroy_state(state);
-		state = &parent;
+	// if we get a parser failure at certain stages, this can
+	// cause the state machine to be left in an indeterminate state.
+	// the states themselves are kept for the next document
+	destroy_branch(state);
 
-		assert(parent != NULL || terminating == NULL);
+	if (state->m_schema != NULL) {
+		jschema_release_internal(&state->m_schema);
+		state->m_schema = NULL;
 	}
+#endif
+}
+
+void jschema_state_destroy(ValidationStateRef state)
+{
+#if !BYPASS_SCHEMA
+	SchemaStateBlock *block;
+	size_t i;
 
-	SANITY_KILL_POINTER(*state);
+	SANITY_CHECK_POINTER(state);
 
-	return parent;
+	jschema_state_clear(state);
+
+	block = state->m_stateBlock;
+	while (block != NULL && block->m_prev != NULL)
+		block = block->m_prev;
+	while (block != NULL) {
+		SchemaStateBlock *next = block->m_next;
+		for (i = 0; i < SCHEMA_STATE_BLOCK_SIZE; i++)
+			j_free(block->m_states[i].m_seenKeysBuffer);
+		j_free(block);
+		block = next;
+	}
+	state->m_stateBlock = NULL;
+#endif
 }
+
+bool jschema_state_reset(ValidationStateRef state, JSchemaInfoRef schemaInfo)
+{
+#if !BYPASS_SCHEMA
+	jschema_state_clear(state);
+	return validation_init(state, schemaInfo);
+#else
+	return true;
 #endif
+}
 
 void jschema_state_release(ValidationStateRef *refPtr)
 {
@@ -858,14 +640,8 @@ void jschema_state_release(ValidationStateRef *refPtr)
 
 	TRACE_VALIDATION_STATE("destroyed", state);
 
-	// if we get a parser failure at certain stages, this can
-	// cause the state machine to be left in an indeterminate state.
-	// make sure to clean up after ourselves to prevent memory leaks
-	SchemaStateRef toCheck = state->m_state;
-	while (toCheck != NULL) {
-		toCheck = destroy_state(&toCheck);
-	}
-	free(state);
+	jschema_state_destroy(state);
+	j_free(state);
 
 	SANITY_KILL_POINTER(*refPtr);
 #endif
@@ -908,170 +684,31 @@ static void increment_num_items(SchemaStateRef parent)
 }
 #endif
 
-#if TRACK_SCHEMA_PARSING
-#define ADD_INHERITED_SCHEMA(parseState, wrapper, inherited, resolver) addInheritedSchema(parseState, wrapper, inherited, resolver)
-#else
-#define ADD_INHERITED_SCHEMA(parseState, wrapper, inherited, resolver) addInheritedSchema(wrapper, inherited, resolver)
-#endif
-
-#if TRACK_SCHEMA_PARSING
-static bool addInheritedSchema(ValidationStateRef parseState, SchemaWrapperRef wrapper, jvalue_ref inherited, SchemaResolutionRef resolver) NON_NULL(1, 2, 3, 4);
-static bool addInheritedSchema(ValidationStateRef parseState, SchemaWrapperRef wrapper, jvalue_ref inherited, SchemaResolutionRef resolver)
-#else
-static bool addInheritedSchema(SchemaWrapperRef wrapper, jvalue_ref inherited, SchemaResolutionRef resolver) NON_NULL(1, 2, 3);
-static bool addInheritedSchema(SchemaWrapperRef wrapper, jvalue_ref inherited, SchemaResolutionRef resolver)
-#endif
+static bool push_new_state(ValidationStateRef parseState, SchemaNodeRef node)
 {
-	assert(jis_array(wrapper->m_validation));
-	assert(!jis_all_schema_hierarchy(inherited));
-	assert(!jis_empty_schema_dom(inherited));
-
-	SchemaWrapper inheritedWrapper = STACK_SCHEMA_WRAPPER(inherited, wrapper->m_top);
-	if (UNLIKELY(!RESOLVE_SCHEMA(parseState, &inheritedWrapper, resolver)))
-		return false;
-
-	TRACE_STATE_ARRAY("splicing %p", wrapper->m_validation, inheritedWrapper.m_validation);
-	if (UNLIKELY(!jarray_splice_append(wrapper->m_validation, inheritedWrapper.m_validation, SPLICE_COPY))) {
-		PJ_LOG_ERR("Failed to append to JSON array");
-		assert(false);
+	bool compiled;
+
+	// compiled the first time the input reaches this part of the schema (which may have to resolve external references)
+	START_TRACKING_SCHEMA(parseState);
+	compiled = jschema_node_compile(parseState->m_schema, node, &parseState->m_resolutionHandlers);
+	END_TRACKING_SCHEMA(parseState);
+	if (UNLIKELY(!compiled)) {
+		PJ_SCHEMA_ERR("Failed to compile schema");
+		JSTATS_VALIDATION_FAILED(JSTATS_FAIL_SCHEMA);
 		return false;
 	}
 
-	TRACE_STATE_ARRAY("intermediary freed", inheritedWrapper.m_validation);
-	j_release_wrapper(&inheritedWrapper.m_validation);
-
-	return true;
-}
-
-static bool push_new_state(ValidationStateRef parseState, SchemaWrapperRef schema)
-{
-	SchemaStateRef nextState = (SchemaStateRef) calloc(1, sizeof(struct SchemaState));
+	SchemaStateRef nextState = take_state(parseState);
 	CHECK_POINTER_RETURN_VALUE(nextState, false); // check for out-of-memory
+	JSTATS_ADD(m_schemaStates, 1);
 	nextState->m_parent = parseState->m_state;
-	nextState->m_schema = jschema_copy(schema);
-	determinePossibilities(nextState);
+	nextState->m_node = node;
+	nextState->m_allowedTypes = node->m_allowedTypes;
 
 	TRACE_SCHEMA_STATE("created", nextState);
 
-	if (nextState->m_disallowedTypes == ST_ANY || nextState->m_allowedTypes == 0) {
-		PJ_SCHEMA_WARN("Schema disallows all input");
-		destroy_state(&nextState);
-		return false;
-	}
-
 	parseState->m_state = nextState;
-
-#if defined _DEBUG && 0
-#if PJSON_SCHEMA_TRACE
-	PJ_SCHEMA_DBG("<------------------Schema stack");
-	SchemaStateRef toMatch = parseState->m_state;
-	while (toMatch) {
-		PJ_SCHEMA_DBG("Schemas to match against are: %s\n", jvalue_tostring(toMatch->m_schema->m_validation, jschema_all()));
-		toMatch = toMatch->m_parent;
-	}
-	PJ_SCHEMA_DBG("Schema stack--------------------->");
-#endif
-#endif
-	return true;
-}
-
-static bool push_next_array_state(ValidationStateRef parseState)
-{
-	// the schema proposal makes this annoying.  these are the following conditions
-	//     items:  an array - tuple typed schemas
-	//     items:  an object - schema applies to all elements
-	//     additionalProperties: any items falling outside of items must match this
-	//                           true or missing - default to everything schema
-	//                           false - default to null schema
-	//                           if items is missing, this is equivalent to it having this value
-	//                           if items is an object, then this property will never be used
-
-	jvalue_ref itemsProperty;
-	jvalue_ref elementSchema;
-	jvalue_ref additionalProperties;
-	jvalue_ref arraySchema;
-
-	assert(parseState->m_state->m_allowedTypes == ST_ARR);
-
-#if ALLOW_LOCAL_REFS
-	SchemaWrapperRef nextArraySchema = jschema_wrap_prepare(parseState->m_state->m_schema->m_top);
-#else
-	SchemaWrapperRef nextArraySchema = jschema_wrap_prepare(NULL);
-#endif
-
-	jvalue_ref currentSchemaStack = parseState->m_state->m_schema->m_validation;
-	jvalue_ref validationHierarchy = nextArraySchema->m_validation;
-
-	// we need to go over the entire inheritance tree at the current state
-	// this is because the schema in the next state will have a pseudo-inheritance
-	// based on the current inheritance
-
-	// resolve schema takes the last schema on the stack and expands it fully
-	// (in terms of inheritance)
-	ssize_t numSchemas = jarray_size(currentSchemaStack);
-	for (ssize_t i = 0; i < numSchemas; i++) {
-		arraySchema = jarray_get(currentSchemaStack, i);
-
-		assert(jis_object(arraySchema));
-
-		itemsProperty = jobject_get(arraySchema, J_CSTR_TO_BUF(SK_ITEMS));
-		if (jis_object(itemsProperty)) {
-			if (!ADD_INHERITED_SCHEMA(parseState, nextArraySchema, itemsProperty, &parseState->m_resolutionHandlers)) {
-				PJ_SCHEMA_ERR("Failed to resolve all items schema");
-				goto schema_gen_failure;
-			}
-		} else if (jis_array(itemsProperty) && parseState->m_state->m_numItems <= jarray_size(itemsProperty)) {
-			// we are in a valid position to grab a schema from "items"
-			assert(parseState->m_state->m_numItems > 0);
-			elementSchema = jarray_get(itemsProperty, parseState->m_state->m_numItems - 1);
-			assert(!jis_all_schema_hierarchy(validationHierarchy));
-			jarray_append(validationHierarchy, jvalue_copy(elementSchema));
-
-			if (!RESOLVE_SCHEMA(parseState, nextArraySchema, &parseState->m_resolutionHandlers)) {
-				PJ_SCHEMA_ERR("Failed to resolve items schema %zu", parseState->m_state->m_numItems);
-				goto schema_gen_failure;
-			}
-		} else {
-			assert (jis_null(itemsProperty));
-			// "items" failed to be valid for supplying a schema
-			// now we look at "additionalProperties"
-
-			additionalProperties = jobject_get(arraySchema, J_CSTR_TO_BUF(SK_MORE_PROPS));
-			if (jis_null(additionalProperties) || jis_boolean(additionalProperties)) {
-				bool additionalAllowed = jis_null(additionalProperties) ?
-						DEFAULT_ADDITIONAL_PROPERTIES_VALUE : jboolean_deref(additionalProperties);
-				if (!additionalAllowed) {
-					PJ_SCHEMA_ERR("No more properties in schema allowed");
-					goto schema_gen_failure;
-				}
-
-				assert(!jis_all_schema_hierarchy(validationHierarchy));
-//				jarray_append(validationHierarchy, jobject_create());
-			} else {
-				assert(jis_object(additionalProperties));
-
-				assert(!jis_all_schema_hierarchy(validationHierarchy));
-				jarray_append(validationHierarchy, jvalue_copy(additionalProperties));
-				if (!RESOLVE_SCHEMA(parseState, nextArraySchema, &parseState->m_resolutionHandlers)) {
-					PJ_SCHEMA_ERR("Failed to resolve additionalProperties schema");
-					goto schema_gen_failure;
-				}
-			}
-		}
-	}
-
-	if (!push_new_state(parseState, nextArraySchema))
-		goto schema_gen_failure;
-
-	jschema_release_internal(&nextArraySchema);
-
-	// wow - we found the schema to validate against for the next array item
-	// pat on the back yet?
 	return true;
-
-schema_gen_failure:
-	jschema_release_internal(&nextArraySchema);
-	return false;
 }
 
 static SchemaStateRef getNextStateSimple(ValidationStateRef parseState) NON_NULL(1);
@@ -1083,9 +720,23 @@ static SchemaStateRef getNextStateSimple(ValidationStateRef parseState)
 	SchemaStateRef toMatch = parseState->m_state;
 	if ((toMatch->m_allowedTypes & ST_ARR) == ST_ARR) {
 		if (toMatch->m_arrayOpened) {
+			SchemaNodeRef itemSchema;
+
 			increment_num_items_unsafe(toMatch);
 
-			if (!push_next_array_state(parseState)) {
+			// tuple-typed schemas first, then whatever applies to the rest of the elements
+			if (toMatch->m_numItems <= toMatch->m_node->m_numItems)
+				itemSchema = toMatch->m_node->m_items[toMatch->m_numItems - 1];
+			else
+				itemSchema = toMatch->m_node->m_additionalItems;
+
+			if (itemSchema == NULL) {
+				PJ_SCHEMA_ERR("No more items in schema allowed");
+				JSTATS_VALIDATION_FAILED(JSTATS_FAIL_ITEMS);
+				return NULL;
+			}
+
+			if (!push_new_state(parseState, itemSchema)) {
 				return NULL;
 			}
 
@@ -1105,13 +756,15 @@ static SchemaStateRef getNextState(ValidationStateRef parseState, SchemaType typ
 	if (toMatch == NULL)
 		return NULL;
 
-	if ((toMatch->m_disallowedTypes & type) == type) {
-		PJ_SCHEMA_INFO("Pruning schema - disallowed type %d matched disallowed types %d", type, toMatch->m_disallowedTypes);
+	if ((toMatch->m_node->m_disallowedTypes & type) == type) {
+		PJ_SCHEMA_INFO("Pruning schema - disallowed type %d matched disallowed types %d", type, toMatch->m_node->m_disallowedTypes);
+		JSTATS_VALIDATION_FAILED(JSTATS_FAIL_TYPE);
 		return NULL;
 	}
 
 	if ((toMatch->m_allowedTypes & type) != type) {
 		PJ_SCHEMA_INFO("Pruning schema - type %d didn't match allowed types with %d", type, toMatch->m_allowedTypes);
+		JSTATS_VALIDATION_FAILED(JSTATS_FAIL_TYPE);
 		return NULL;
 	}
 
@@ -1145,10 +798,24 @@ bool jschema_obj(JSAXContextRef sax, ValidationStateRef parseState)
 	if (toMatch == NULL)
 		goto schema_failure;
 
-	assert(jis_null(toMatch->m_seenKeys));
-	// use object instead of array for hash-based lookup which will
-	// help us on object end
-	toMatch->m_seenKeys = jobject_create();
+	assert(toMatch->m_seenKeys == NULL);
+	// the keys are tracked by their slot in the node's properties - an object with more properties than fit in
+	// a single word gets a bitset of its own (which stays with the state's slot for the next large object)
+	if (toMatch->m_node->m_numProperties > PROPERTY_BITS_PER_WORD) {
+		size_t words = PROPERTY_BITS_WORDS(toMatch->m_node->m_numProperties);
+		if (toMatch->m_seenKeysCapacity < words) {
+			PropertyBits *grown = (PropertyBits *)j_realloc(toMatch->m_seenKeysBuffer, words * sizeof(PropertyBits));
+			if (grown == NULL) {
+				PJ_LOG_ERR("Out of memory");
+				goto schema_failure;
+			}
+			toMatch->m_seenKeysBuffer = grown;
+			toMatch->m_seenKeysCapacity = words;
+		}
+		memset(toMatch->m_seenKeysBuffer, 0, words * sizeof(PropertyBits));
+		toMatch->m_seenKeys = toMatch->m_seenKeysBuffer;
+	}
+	toMatch->m_seenKeysInline = 0;
 
 	// we managed to validate something against the schema - really???
 	return true;
@@ -1156,8 +823,7 @@ bool jschema_obj(JSAXContextRef sax, ValidationStateRef parseState)
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to complete object validation against schema");
 	// TODO : only support 1 state at a time currently
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
@@ -1165,25 +831,9 @@ schema_failure:
 }
 
 #if !BYPASS_SCHEMA
-static bool is_required_key_present(jvalue_ref seenKeys, jvalue_ref requiredKey, jvalue_ref actualKey) NON_NULL(1, 2, 3);
-static bool is_required_key_present(jvalue_ref seenKeys, jvalue_ref requiredKey, jvalue_ref actualKey)
+static inline PropertyBits* seen_keys(SchemaStateRef state)
 {
-	assert(jis_object(seenKeys));
-	assert(jis_string(requiredKey));
-	assert(jis_string(actualKey));
-
-	if (!jobject_containskey2(seenKeys, requiredKey)) {
-#if !PJSON_NO_LOGGING
-		raw_buffer propKey = jstring_get_fast(actualKey);
-		raw_buffer expectedKey = jstring_get_fast(requiredKey);
-		PJ_SCHEMA_WARN("Key %.*s is required by %.*s but was not encountered",
-				(int)propKey.m_len, propKey.m_str,
-				(int)expectedKey.m_len, expectedKey.m_str);
-#endif /* PJSON_NO_LOGGING */
-		return false;
-	}
-
-	return true;
+	return state->m_seenKeys != NULL ? state->m_seenKeys : &state->m_seenKeysInline;
 }
 #endif
 
@@ -1202,111 +852,61 @@ bool jschema_obj_end(JSAXContextRef sax, ValidationStateRef parseState)
 	// only support 1 state at a time currently
 	// more will require careful thought about how to properly manage them
 	SchemaStateRef toMatch = parseState->m_state;
-
-	PJ_SCHEMA_TRACE("1. Object end: Going from schema state\n%s\nto\n%s",
-		jvalue_tostring(parseState->m_state->m_schema->m_validation, jschema_all()),
-		parseState->m_state->m_parent ? jvalue_tostring(parseState->m_state->m_parent->m_schema->m_validation, jschema_all()) : "");
+	SchemaNodeRef node = toMatch->m_node;
+	PropertyBits *seen = seen_keys(toMatch);
 
 	assert(toMatch->m_allowedTypes == ST_OBJ);
-	assert(jis_object(toMatch->m_seenKeys));
-
-	// an alternative implementation might iterate in reverse (starting with the parent schema
-	// moving down the inheritance tree).  however, what this gives us is a way of detecting
-	// if there's an inconsistency in the schema (something accepted by a child that is rejected by a parent)
-	// TODO : is there any performance reason to choose one over the other?  need real-world examples to begin answering.
-	ssize_t numSchemas = jarray_size(toMatch->m_schema->m_validation);
-	for (ssize_t i = 0; i < numSchemas; i++) {
-		jvalue_ref schemaToValidate = jarray_get(toMatch->m_schema->m_validation, i);
-		assert(jis_object(schemaToValidate));
-
-		// TODO: Determine if there is a bug here if `properties' is ommitted in the schema,
-		//  but `additionalProperties' isn't.
-		jvalue_ref propertiesList = jobject_get(schemaToValidate, J_CSTR_TO_BUF(SK_PROPS));
-		if (!jis_null(propertiesList)) {
-			jobject_key_value property;
-			jvalue_ref value;
-
-			for (jobject_iter i = jobj_iter_init(propertiesList); jobj_iter_is_valid(i); i = jobj_iter_next(i)) {
-				if (!jobj_iter_deref(i, &property)) {
-					PJ_SCHEMA_ERR("Failed to dereference iterator over properties list");
+
+	// only the properties that are required but missing or that were seen & require others need looking at -
+	// they're handled in the order of the properties so that a default injected for one counts as seen for
+	// those after it
+	for (size_t word = 0; word < PROPERTY_BITS_WORDS(node->m_numProperties); word++) {
+		PropertyBits missing = node->m_requiredKeys[word] & ~seen[word];
+		PropertyBits present = node->m_dependentKeys[word] & seen[word];
+		PropertyBits pending = missing | present;
+
+		while (pending != 0) {
+			size_t slot = word * PROPERTY_BITS_PER_WORD + property_bits_pop(&pending);
+			SchemaPropertyRef property = &node->m_properties[slot];
+
+			if (missing & ((PropertyBits)1 << (slot % PROPERTY_BITS_PER_WORD))) {
+				// we have a required key in the schema but not in the input - does it provide
+				// a default value we can use?
+				if (property->m_default == NULL) {
+					PJ_SCHEMA_INFO("Key %.*s isn't optional but it is missing", RB_PRINTF(property->m_keyBuf));
+					JSTATS_VALIDATION_FAILED(JSTATS_FAIL_REQUIRED);
 					goto schema_failure;
 				}
-				if (!jobject_containskey2(toMatch->m_seenKeys, property.key)) {
-					// we haven't seen the key from the list of keys
-					// we have schemas for.  is it optional?
-					bool optional;
-
-					assert(jis_object(property.value));
-
-					jvalue_ref isOptional = jobject_get(property.value, J_CSTR_TO_BUF(SK_OPTIONAL));
-					assert(jis_null(isOptional) || jis_boolean(isOptional));
-					if (jis_null(isOptional))
-						optional = false;
-					else
-						optional = jboolean_deref(isOptional);
-
-
-					if (!optional) {
-						// we have a required key in the schema but not in the input - does it provide
-						// a default value we can use?
-						jvalue_ref defaultVal;
-						if (!jobject_get_exists(property.value, J_CSTR_TO_BUF(SK_DEFAULT), &defaultVal)) {
-							raw_buffer keyStr UNUSED_VAR;
-							keyStr = jstring_get_fast(property.key);
-							PJ_SCHEMA_INFO("Key %.*s isn't optional but it is missing", RB_PRINTF(keyStr));
-							goto schema_failure;
-						}
-						if (!jsax_parse_inject(sax, property.key, defaultVal)) {
-							raw_buffer keyStr UNUSED_VAR;
-							keyStr = jstring_get_fast(property.key);
-							PJ_SCHEMA_INFO("The default value for key '%.*s' violates the schema", RB_PRINTF(keyStr));
-							goto schema_failure;
-						}
-					}
-
-					// the key is optional and we haven't seen it
-					// not a problem
-				} else {
-					// we encountered a key - does it require any keys to be present?
-					if (!jis_null(value = jobject_get(property.value, J_CSTR_TO_BUF(SK_REQUIRED)))) {
-						// EXTENSION: required can be a value or a list of values
-						if (jis_string(value)) {
-							if (!is_required_key_present(toMatch->m_seenKeys, value, property.key))
-								goto schema_failure;
-						} else {
-							assert(jis_array(value));
-							jvalue_ref requiredKey;
-
-							for (ssize_t i = jarray_size(property.value) - 1; i >= 0; i--) {
-								requiredKey = jarray_get(property.value, i);
-								if (!is_required_key_present(toMatch->m_seenKeys, requiredKey, property.key))
-									goto schema_failure;
-							}
-						}
-					}
+				if (!jsax_parse_inject(sax, property->m_key, property->m_default)) {
+					PJ_SCHEMA_INFO("The default value for key '%.*s' violates the schema", RB_PRINTF(property->m_keyBuf));
+					goto schema_failure;
+				}
+				continue;
+			}
+
+			// we encountered a key - does it require any keys to be present?
+			for (size_t j = 0; j < property->m_numRequiredSlots; j++) {
+				uint32_t required = property->m_requiredSlots[j];
+				if (!(seen[required / PROPERTY_BITS_PER_WORD] & ((PropertyBits)1 << (required % PROPERTY_BITS_PER_WORD)))) {
+					PJ_SCHEMA_WARN("Key %.*s is required by %.*s but was not encountered",
+							RB_PRINTF(node->m_properties[required].m_keyBuf), RB_PRINTF(property->m_keyBuf));
+					JSTATS_VALIDATION_FAILED(JSTATS_FAIL_REQUIRED);
+					goto schema_failure;
 				}
 			}
-		} else {
-			// no properties list - any logic here is handled by the key validator
 		}
 	}
 
 	// pop-up to parent
 	// we managed to validate against an entire object - really??? wow
-
-	PJ_SCHEMA_TRACE("2. Object end: Going from schema state\n%s\nto\n%s",
-		jvalue_tostring(parseState->m_state->m_schema->m_validation, jschema_all()),
-		parseState->m_state->m_parent ? jvalue_tostring(parseState->m_state->m_parent->m_schema->m_validation, jschema_all()) : "");
-
-	parseState->m_state = destroy_state(&(parseState->m_state));
+	destroy_state(parseState);
 
 	return true;
 
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to complete object validation against schema");
 	// TODO : only support 1 state at a time currently
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
@@ -1335,8 +935,7 @@ bool jschema_arr(JSAXContextRef sax, ValidationStateRef parseState)
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to begin array validation against schema");
 	// TODO : only support 1 state at a time currently
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
@@ -1351,68 +950,29 @@ bool jschema_arr_end(JSAXContextRef sax, ValidationStateRef parseState)
 	SANITY_CHECK_POINTER(parseState);
 
 	SchemaStateRef toMatch = parseState->m_state;
-	jvalue_ref numItems, schemaToValidate;
+	SchemaNodeRef node = toMatch->m_node;
 
 	assert(toMatch->m_seenKeys == NULL);
 	assert(toMatch->m_allowedTypes == ST_ARR);
 
-	int64_t minItemsSoFar = INT64_MAX;
-	int64_t maxItemsSoFar = -1;
-
-	ssize_t numSchemas = jarray_size(toMatch->m_schema->m_validation);
-	for (ssize_t i = 0; i < numSchemas; i++) {
-		schemaToValidate = jarray_get(toMatch->m_schema->m_validation, i);
-		assert(jis_object(schemaToValidate));
-
-		numItems = jobject_get(schemaToValidate, J_CSTR_TO_BUF(SK_MIN_ITEMS));
-		if (!jis_null(numItems)) {
-			int64_t minRequired;
-			if (CONV_OK != jnumber_get_i64(numItems, &minRequired) || minRequired < 0) {
-				PJ_SCHEMA_ERR("Minimum number of items is not a valid integer > 0");
-				goto schema_failure;
-			}
-			if (minRequired > minItemsSoFar) {
-				PJ_SCHEMA_ERR("Schema violation - inherited minimum items is bigger than parent (child is more generic than parent)");
-				goto schema_failure;
-			}
-			minItemsSoFar = minRequired;
-			if (toMatch->m_numItems < minItemsSoFar) {
-				PJ_SCHEMA_WARN("Too few items in array: %zd but schema expects at least %"PRId64, toMatch->m_numItems, minItemsSoFar);
-				goto schema_failure;
-			}
-		}
-
-		numItems = jobject_get(schemaToValidate, J_CSTR_TO_BUF(SK_MAX_ITEMS));
-		if (!jis_null(numItems)) {
-			int64_t maxRequired;
-			if (CONV_OK != jnumber_get_i64(numItems, &maxRequired) || maxRequired < 0) {
-				PJ_SCHEMA_ERR("Maximum number of items is not a valid integer > 0");
-				goto schema_failure;
-			}
-			if (maxRequired < maxItemsSoFar) {
-				PJ_SCHEMA_ERR("Schema violation - inherited minimum items is bigger than parent (child is more generic than parent)");
-				goto schema_failure;
-			}
-			maxItemsSoFar = maxRequired;
-			if (toMatch->m_numItems > maxItemsSoFar) {
-				PJ_SCHEMA_WARN("Too many items in array: %zd but schema expects at least %"PRId64, toMatch->m_numItems, minItemsSoFar);
-				goto schema_failure;
-			}
-		}
+	if ((int64_t)toMatch->m_numItems < node->m_minItems) {
+		PJ_SCHEMA_WARN("Too few items in array: %zd but schema expects at least %"PRId64, toMatch->m_numItems, node->m_minItems);
+		JSTATS_VALIDATION_FAILED(JSTATS_FAIL_ITEMS);
+		goto schema_failure;
+	}
+	if ((int64_t)toMatch->m_numItems > node->m_maxItems) {
+		PJ_SCHEMA_WARN("Too many items in array: %zd but schema expects at most %"PRId64, toMatch->m_numItems, node->m_maxItems);
+		JSTATS_VALIDATION_FAILED(JSTATS_FAIL_ITEMS);
+		goto schema_failure;
 	}
-
-	PJ_SCHEMA_TRACE("Array End: Going from schema state\n%s\nto\n%s",
-		jvalue_tostring(parseState->m_state->m_schema->m_validation, jschema_all()),
-		jvalue_tostring(parseState->m_state->m_parent->m_schema->m_validation, jschema_all()));
 
 	SANITY_CLEAR_VAR(parseState->m_state->m_arrayOpened, false);
-	parseState->m_state = destroy_state(&(parseState->m_state));
+	destroy_state(parseState);
 	return true;
 
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to complete array validation against schema");
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
@@ -1427,91 +987,58 @@ bool jschema_key(JSAXContextRef sax, ValidationStateRef parseState, raw_buffer o
 	SANITY_CHECK_POINTER(parseState);
 
 	SchemaStateRef toMatch = parseState->m_state;
-	jvalue_ref schemaToValidate, specificSchema;
+	SchemaPropertyRef property;
+	SchemaNodeRef valueSchema;
 
 	assert(toMatch->m_allowedTypes == ST_OBJ);
 	assert(toMatch->m_arrayOpened == false);
 
-#if ALLOW_LOCAL_REFS
-	SchemaWrapperRef valueSchema = jschema_wrap_prepare(toMatch->m_schema->m_top);
-#else
-	SchemaWrapperRef valueSchema = jschema_wrap_prepare(NULL);
-#endif
-
-	jobject_put(toMatch->m_seenKeys, jstring_create_copy(objKey), jnull());
-
-	ssize_t numSchemas = jarray_size(toMatch->m_schema->m_validation);
-	for (ssize_t i = 0; i < numSchemas; i++) {
-		schemaToValidate = jarray_get(toMatch->m_schema->m_validation, i);
-		assert(jis_object(schemaToValidate));
-
-		specificSchema = jobject_get(schemaToValidate, J_CSTR_TO_BUF(SK_PROPS));
-		if (!jis_null(specificSchema)) {
-			assert(jis_object(specificSchema));
-			specificSchema = jobject_get(specificSchema, objKey);
-			if (!jis_null(specificSchema)) {
-				assert(jis_object(specificSchema));
-				goto append_schema;
-			}
-			PJ_SCHEMA_ERR("Schema problem - schema for instance key %.*s is null instead of object",
-					(int)objKey.m_len, objKey.m_str);
-		}
-
-		// properties field either didn't contain the key or didn't exist
-		// let's use additionalProperties if it exists
-		specificSchema = jobject_get(schemaToValidate, J_CSTR_TO_BUF(SK_MORE_PROPS));
-		if (jis_null(specificSchema) || jis_boolean(specificSchema)) {
-			bool additionalAllowed = jis_null(specificSchema) ?
-					DEFAULT_ADDITIONAL_PROPERTIES_VALUE : jboolean_deref(specificSchema);
-			if (additionalAllowed) {
-				// append the empty object (match everything)
-				assert(!jis_all_schema_hierarchy(valueSchema->m_validation));
-//				jarray_append(valueSchema->m_validation, jobject_create());
-			} else {
-				PJ_SCHEMA_ERR("Schema violation - key without specific key and no unspecified properties allowed");
-				goto schema_failure;
-			}
-		} else {
-			assert(jis_object(specificSchema));
-			goto append_schema;
-		}
-		continue;
-
-append_schema:
-		assert(!jis_all_schema_hierarchy(valueSchema->m_validation));
-		// if specificSchema is a reference, resolve schema will release it for us
-		// if it's not, then it will be untouched (i.e. remain the last element in the array)
-		// & we'll release ownership of the copy
-		specificSchema = jvalue_copy(specificSchema);
-		TRACE_STATE_ARRAY("adding %p", valueSchema->m_validation, specificSchema);
-		jarray_append(valueSchema->m_validation, specificSchema);
-		if (!RESOLVE_SCHEMA(parseState, valueSchema, &parseState->m_resolutionHandlers)) {
-			PJ_SCHEMA_ERR("Failed to resolve schema in properties for key %.*s", RB_PRINTF(objKey));
-			goto schema_failure;
-		}
-		assert(jis_array(valueSchema->m_validation));
-//		if (specificSchema == jarray_get(valueSchema->m_validation, jarray_size(valueSchema->m_validation) - 1))
-//			j_release(&specificSchema);
+	// properties field either didn't contain the key or didn't exist
+	// let's use additionalProperties
+	property = jschema_node_property(toMatch->m_node, objKey);
+	if (property != NULL) {
+		size_t slot = property - toMatch->m_node->m_properties;
+		seen_keys(toMatch)[slot / PROPERTY_BITS_PER_WORD] |= (PropertyBits)1 << (slot % PROPERTY_BITS_PER_WORD);
+		valueSchema = property->m_schema;
+	} else {
+		valueSchema = toMatch->m_node->m_additionalProperties;
+	}
+	if (valueSchema == NULL) {
+		PJ_SCHEMA_ERR("Schema violation - key without specific key and no unspecified properties allowed");
+		JSTATS_VALIDATION_FAILED(JSTATS_FAIL_PROPERTIES);
+		goto schema_failure;
 	}
 
 	if (!push_new_state(parseState, valueSchema))
 		goto schema_failure;
 
-	jschema_release_internal(&valueSchema);
-
 	return true;
 
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to validate key '%.*s' against schema", RB_PRINTF(objKey));
-	jschema_release_internal(&valueSchema);
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
 #endif
 }
 
+#if !BYPASS_SCHEMA
+/**
+ * @return The number of characters (rather than bytes) in the UTF-8 string
+ */
+static int64_t utf8_length(raw_buffer str)
+{
+	int64_t length = 0;
+	for (size_t i = 0; i < str.m_len; i++) {
+		// count everything but the continuation bytes
+		if (((unsigned char)str.m_str[i] & 0xC0) != 0x80)
+			length++;
+	}
+	return length;
+}
+#endif
+
 bool jschema_str(JSAXContextRef sax, ValidationStateRef parseState, raw_buffer str)
 {
 #if !BYPASS_SCHEMA
@@ -1522,101 +1049,50 @@ bool jschema_str(JSAXContextRef sax, ValidationStateRef parseState, raw_buffer s
 		goto schema_failure;
 	}
 
-	// check the min string length
-	// check the max string length
-	// we do this by building up the range of valid values
-	int64_t minLength = -1;
-	int64_t maxLength = -1; // count on overflow semantics
-
-	{
-		jvalue_ref property;
-		jvalue_ref schemaToCheck;
-		ssize_t arrayLen = jarray_size(toMatch->m_schema->m_validation);
-		int64_t specifiedLen;
-
-		for (ssize_t i = 0; i < arrayLen; i++) {
-			schemaToCheck = jarray_get(toMatch->m_schema->m_validation, i);
-			property = jobject_get(schemaToCheck, J_CSTR_TO_BUF(SK_MIN_LEN));
-
-			if (!jis_null(property)) {
-				if (CONV_OK != jnumber_get_i64(property, &specifiedLen)) {
-					PJ_SCHEMA_WARN("String length min limit is out of bounds - clamping");
-					specifiedLen = 0;
-				}
-				if (minLength == -1)
-					minLength = specifiedLen;
-				else if (specifiedLen > minLength) {
-					assert(false);
-					PJ_SCHEMA_ERR("Schema is invalid - inherited schema has length bounds outside of its parent");
-					goto schema_failure;
-				}
+	SchemaNodeRef node = toMatch->m_node;
 
-				if (str.m_len < specifiedLen) {
-					PJ_SCHEMA_ERR("String '%.*s' doesn't meet the minimum length of %"PRId64,
-							RB_PRINTF(str), specifiedLen);
-				}
-			}
-
-			property = jobject_get(schemaToCheck, J_CSTR_TO_BUF(SK_MAX_LEN));
-			if (!jis_null(property)) {
-				if (CONV_OK != jnumber_get_i64(property, &specifiedLen)) {
-					PJ_SCHEMA_WARN("String length max limit is out of bounds - clamping");
-					specifiedLen = INT64_MAX;
-				}
-				if (maxLength == -1)
-					maxLength = specifiedLen;
-				else if (specifiedLen < maxLength) {
-					assert(false);
-					PJ_SCHEMA_ERR("Schema is invalid - inherited schema has length bounds outside of its parent");
-					goto schema_failure;
-				}
-
-				if (str.m_len > specifiedLen) {
-					PJ_SCHEMA_ERR("String '%.*s' doesn't meet the minimum length of %"PRId64,
-							RB_PRINTF(str), specifiedLen);
-				}
-			}
-
-			property = jobject_get(schemaToCheck, J_CSTR_TO_BUF(SK_ENUM));
-			if (!jis_null(property)) {
-				if (jis_array(property)) {
-					jvalue_ref enumValue;
-					for (ssize_t i = jarray_size(property) - 1; i >= 0; i--) {
-						enumValue = jarray_get(property, i);
-						if (jis_string(enumValue) && jstring_equal2(enumValue, str))
-							goto matched_enum;
-					}
-
-					PJ_SCHEMA_WARN("Enums specified but string '%.*s' failed to match against '%s",
-							(int) str.m_len, str.m_str, jvalue_tostring(property, jschema_all()));
-					goto schema_failure;
-				} else {
-					PJ_SCHEMA_ERR("Invalid enum type %d", property->m_type);
-					goto schema_failure;
-				}
-			}
+	// a string is never longer in characters than in bytes
+	if ((int64_t)str.m_len < node->m_minLength || (int64_t)str.m_len > node->m_maxLength) {
+		int64_t length = utf8_length(str);
+		if (length < node->m_minLength) {
+			PJ_SCHEMA_INFO("String '%.*s' doesn't meet the minimum length of %"PRId64,
+					RB_PRINTF(str), node->m_minLength);
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_LENGTH);
+			goto schema_failure;
+		}
+		if (length > node->m_maxLength) {
+			PJ_SCHEMA_INFO("String '%.*s' exceeds the maximum length of %"PRId64,
+					RB_PRINTF(str), node->m_maxLength);
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_LENGTH);
+			goto schema_failure;
+		}
+	}
 
-matched_enum:
-			property = jobject_get(schemaToCheck, J_CSTR_TO_BUF(SK_REGEXP));
-			if (!jis_null(property)) {
-				if (!jis_string(property)) {
-					PJ_SCHEMA_ERR("Invalid regexp type %d", property->m_type);
-					goto schema_failure;
-				}
+	for (size_t i = 0; i < node->m_numEnums; i++) {
+		if (!jschema_enum_has_string(&node->m_enums[i], str)) {
+			PJ_SCHEMA_WARN("Enums specified but string '%.*s' failed to match against '%s",
+					(int) str.m_len, str.m_str, jvalue_tostring(node->m_enums[i].m_values, jschema_all()));
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_ENUM);
+			goto schema_failure;
+		}
+	}
 
-				// TODO: test regexp
-			}
+	for (size_t i = 0; i < node->m_numPatterns; i++) {
+		if (!pattern_match(node->m_patterns[i], str)) {
+			PJ_SCHEMA_INFO("String '%.*s' doesn't match the pattern '%s'",
+					RB_PRINTF(str), pattern_source(node->m_patterns[i]));
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_PATTERN);
+			goto schema_failure;
 		}
 	}
 
-	parseState->m_state = destroy_state(&(parseState->m_state));
+	destroy_state(parseState);
 
 	return true;
 
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to validate string '%.*s' against schema", RB_PRINTF(str));
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
@@ -1629,14 +1105,13 @@ bool jschema_num(JSAXContextRef sax, ValidationStateRef parseState, raw_buffer n
 	schema_breakpoint("number");
 
 	SchemaStateRef toMatch = getNextStateSimple(parseState);
-	jvalue_ref numValue = NULL;
+	SchemaNodeRef node;
+	SchemaNumber number;
 
 	if (toMatch == NULL)
 		goto schema_failure;
 
-	PJ_SCHEMA_TRACIER("1. Number: Using schema state\n%s\nwithin\n%s",
-		jvalue_tostring(parseState->m_state->m_schema->m_validation, jschema_all()),
-		jvalue_tostring(parseState->m_state->m_parent->m_schema->m_validation, jschema_all()));
+	node = toMatch->m_node;
 
 	assert ((ST_NUM & ST_INT) == ST_INT);
 #ifdef __GNUC__
@@ -1644,17 +1119,19 @@ bool jschema_num(JSAXContextRef sax, ValidationStateRef parseState, raw_buffer n
 	assert (__builtin_popcount(ST_NUM) == 2); // 2 bit set
 #endif
 
-	if ((toMatch->m_disallowedTypes & ST_NUM) != 0) {
+	if ((node->m_disallowedTypes & ST_NUM) != 0) {
 		// if integer or number were specified
-		if ((toMatch->m_disallowedTypes & ST_NUM) == ST_INT)
+		if ((node->m_disallowedTypes & ST_NUM) == ST_INT)
 			// see note at top regarding disallowed ints/numbers
 			PJ_SCHEMA_WARN("Using an undefined mode within the schema - please specify number as disallowed instead of integer");
 		PJ_SCHEMA_INFO("Got a number but it's not allowed according to the schema");
+		JSTATS_VALIDATION_FAILED(JSTATS_FAIL_TYPE);
 		goto schema_failure;
 	}
 
 	if ((toMatch->m_allowedTypes & ST_INT) == 0) {
 		PJ_SCHEMA_INFO("A number is not in the allowed types at this position");
+		JSTATS_VALIDATION_FAILED(JSTATS_FAIL_TYPE);
 		goto schema_failure;
 	}
 
@@ -1664,6 +1141,7 @@ bool jschema_num(JSAXContextRef sax, ValidationStateRef parseState, raw_buffer n
 
 		if (conversion != CONV_OK) {
 			PJ_SCHEMA_WARN("Number %.*s isn't actually a number or is too big.  Errors: %x", (int)num.m_len, num.m_str, conversion);
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_TYPE);
 			goto schema_failure;
 		}
 
@@ -1672,111 +1150,54 @@ bool jschema_num(JSAXContextRef sax, ValidationStateRef parseState, raw_buffer n
 			//       the assumption is that an integer must be a simple integer
 			//       no exponents or decimal points
 			PJ_SCHEMA_INFO("Expecting an integer but got a number");
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_TYPE);
 			goto schema_failure;
 		}
 	}
 
-	jvalue_ref arraySchema;
-	jvalue_ref limit;
-	jvalue_ref minimumSoFar = NULL;
-	jvalue_ref maximumSoFar = NULL;
-	bool maximumValidated = false;
-	bool minimumValidated = false;
-
 	// delay actually parsing until we need it
-	//
-	ssize_t numSchemas = jarray_size(toMatch->m_schema->m_validation);
-	for (ssize_t i = 0; i < numSchemas; i++) {
-		arraySchema = jarray_get(toMatch->m_schema->m_validation, i);
-		assert (jis_object(arraySchema));
-
-		if (!jis_null(limit = jobject_get(arraySchema, J_CSTR_TO_BUF(SK_MIN_VALUE)))) {
-			if (!jis_number(limit)) {
-				PJ_SCHEMA_ERR("Minimum value must be a number");
-				assert(false);
-				goto schema_failure;
-			}
-
-			if (minimumSoFar != NULL && jnumber_compare(minimumSoFar, limit) < 0) {
-				PJ_SCHEMA_ERR("Schema inheritance violation - child schema accepts a potentially wider range of numbers");
-				goto schema_failure;
-			}
-			minimumSoFar = limit;
-
-			if (!minimumValidated) {
-				if (UNLIKELY(numValue == NULL))
-					numValue = jnumber_create_converted(num);
-				if (jnumber_compare(limit, numValue) < 0) {
-					PJ_SCHEMA_INFO("Schema violation - number '%.*s' is too small",
-							(int)num.m_len, num.m_str);
-					goto schema_failure;
-				}
-				minimumValidated = true;
-			}
+	if (node->m_hasMinimum || node->m_hasMaximum || node->m_numEnums > 0) {
+		if (!jschema_number_parse(num, &number)) {
+			PJ_SCHEMA_WARN("Number %.*s can't be compared against the schema", (int)num.m_len, num.m_str);
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_RANGE);
+			goto schema_failure;
 		}
 
-		if (!jis_null(limit = jobject_get(arraySchema, J_CSTR_TO_BUF(SK_MAX_VALUE)))) {
-			if (!jis_number(limit)) {
-				PJ_SCHEMA_ERR("Maximum value must be a number");
-				assert(false);
-				goto schema_failure;
-			}
-
-			if (maximumSoFar != NULL && jnumber_compare(maximumSoFar, limit) > 0) {
-				PJ_SCHEMA_ERR("Schema inheritance violation - child schema accepts a potentially wider range of numbers");
-				goto schema_failure;
-			}
-			maximumSoFar = limit;
-
-			if (!maximumValidated) {
-				if (UNLIKELY(numValue == NULL))
-					numValue = jnumber_create_converted(num);
-
-				if (jnumber_compare(limit, numValue) < 0) {
-					PJ_SCHEMA_INFO("Schema violation - number '%.*s' is too small",
-							(int)num.m_len, num.m_str);
-					goto schema_failure;
-				}
-				maximumValidated = false;
-			}
+		if (node->m_hasMinimum && jschema_number_compare(&number, &node->m_minimum) < 0) {
+			PJ_SCHEMA_INFO("Schema violation - number '%.*s' is too small",
+					(int)num.m_len, num.m_str);
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_RANGE);
+			goto schema_failure;
 		}
 
-		if (!jis_null(limit = jobject_get(arraySchema, J_CSTR_TO_BUF(SK_ENUM)))) {
-			if (!jis_array(limit)) {
-				PJ_SCHEMA_ERR("Enum must be an array");
-				goto schema_failure;
-			}
-			if (UNLIKELY(numValue == NULL))
-				numValue = jnumber_create_converted(num);
+		if (node->m_hasMaximum && jschema_number_compare(&number, &node->m_maximum) > 0) {
+			PJ_SCHEMA_INFO("Schema violation - number '%.*s' is too big",
+					(int)num.m_len, num.m_str);
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_RANGE);
+			goto schema_failure;
+		}
 
-			jvalue_ref enumValue;
-			for (ssize_t j = jarray_size(limit) - 1; j >= 0; j--) {
-				enumValue = jarray_get(limit, j);
-				if (jis_number(enumValue) && jnumber_compare(enumValue, numValue) == 0)
+		for (size_t i = 0; i < node->m_numEnums; i++) {
+			const SchemaEnum *enums = &node->m_enums[i];
+			for (size_t j = 0; j < enums->m_numNumbers; j++) {
+				if (jschema_number_compare(&enums->m_numbers[j], &number) == 0)
 					goto enum_found;
 			}
 
 			PJ_SCHEMA_INFO("Number not found in enums");
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_ENUM);
 			goto schema_failure;
-
 enum_found:
 			;
 		}
 	}
 
-	PJ_SCHEMA_TRACIER("2. Number: Going from schema state\n%s\nto\n%s",
-		jvalue_tostring(parseState->m_state->m_schema->m_validation, jschema_all()),
-		jvalue_tostring(parseState->m_state->m_parent->m_schema->m_validation, jschema_all()));
-
-	parseState->m_state = destroy_state(&parseState->m_state);
-	j_release(&numValue);
+	destroy_state(parseState);
 	return true;
 
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to validate number '%.*s' against schema", RB_PRINTF(num));
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
-	j_release(&numValue);
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
@@ -1792,43 +1213,21 @@ bool jschema_bool(JSAXContextRef sax, ValidationStateRef parseState, bool truth)
 	if (toMatch == NULL)
 		goto schema_failure;
 
-	ssize_t numSchemas = jarray_size(toMatch->m_schema->m_validation);
-	jvalue_ref schema;
-	jvalue_ref enums;
-	for (ssize_t i = 0; i < numSchemas; i++) {
-		schema = jarray_get(toMatch->m_schema->m_validation, i);
-		assert(jis_object(schema));
-		if (!jis_null(enums = jobject_get(schema, J_CSTR_TO_BUF(SK_ENUM)))) {
-			if (!jis_array(enums)) {
-				PJ_SCHEMA_ERR("Enum must be an array");
-				goto schema_failure;
-			}
-
-			jvalue_ref enumValue;
-			for (ssize_t j = jarray_size(enums) - 1; j >= 0; j--) {
-				enumValue = jarray_get(enums, j);
-				if (jis_boolean(enumValue) && jboolean_deref(enumValue) == truth)
-					goto enum_found;
-			}
-
+	for (size_t i = 0; i < toMatch->m_node->m_numEnums; i++) {
+		const SchemaEnum *enums = &toMatch->m_node->m_enums[i];
+		if (!(truth ? enums->m_hasTrue : enums->m_hasFalse)) {
 			PJ_SCHEMA_INFO("Boolean %d not found in enums", (int)truth);
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_ENUM);
 			goto schema_failure;
-enum_found:
-			;
 		}
 	}
 
-	PJ_SCHEMA_TRACIER("Boolean: Going from schema state\n%s\nto\n%s",
-		jvalue_tostring(parseState->m_state->m_schema->m_validation, jschema_all()),
-		jvalue_tostring(parseState->m_state->m_parent->m_schema->m_validation, jschema_all()));
-
-	parseState->m_state = destroy_state(&parseState->m_state);
+	destroy_state(parseState);
 	return true;
 
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to validate boolean '%s' against schema", (truth ? "true" : "false"));
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
@@ -1844,43 +1243,20 @@ bool jschema_null(JSAXContextRef sax, ValidationStateRef parseState)
 	if (toMatch == NULL)
 		goto schema_failure;
 
-	ssize_t numSchemas = jarray_size(toMatch->m_schema->m_validation);
-	jvalue_ref schema;
-	jvalue_ref enums;
-	for (ssize_t i = 0; i < numSchemas; i++) {
-		schema = jarray_get(toMatch->m_schema->m_validation, i);
-		assert(jis_object(schema));
-		if (!jis_null(enums = jobject_get(schema, J_CSTR_TO_BUF(SK_ENUM)))) {
-			if (!jis_array(enums)) {
-				PJ_SCHEMA_ERR("Enum must be an array");
-				goto schema_failure;
-			}
-
-			jvalue_ref enumValue;
-			for (ssize_t j = jarray_size(enums) - 1; j >= 0; j--) {
-				enumValue = jarray_get(enums, j);
-				if (jis_null(enumValue))
-					goto enum_found;
-			}
-
+	for (size_t i = 0; i < toMatch->m_node->m_numEnums; i++) {
+		if (!toMatch->m_node->m_enums[i].m_hasNull) {
 			PJ_SCHEMA_INFO("Null not found in enums");
+			JSTATS_VALIDATION_FAILED(JSTATS_FAIL_ENUM);
 			goto schema_failure;
-enum_found:
-			;
 		}
 	}
 
-	PJ_SCHEMA_TRACIER("Null: Going from schema state\n%s\nto\n%s",
-		jvalue_tostring(parseState->m_state->m_schema->m_validation, jschema_all()),
-		jvalue_tostring(parseState->m_state->m_parent->m_schema->m_validation, jschema_all()));
-
-	parseState->m_state = destroy_state(&parseState->m_state);
+	destroy_state(parseState);
 	return true;
 
 schema_failure:
 	PJ_SCHEMA_INFO("Failed to validate null against schema");
-	destroy_branch(&(parseState->m_state), NULL);
-	parseState->m_state = NULL;
+	destroy_branch(parseState);
 	return false;
 #else
 	return true;
@@ -0,0 +1,1235 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+/***
+ * Turns the schema DOM into the SchemaNode tree the validator walks.
+ *
+ * Every position in the input is validated against the AND of a chain of schemas: the schema for that position
+ * plus whatever it pulls in through $ref & extends.  Rather than walking that chain for every key/value of every
+ * document, a node folds it into plain fields once:
+ *    - allowed types are the intersection of every "type", disallowed types the union of every "disallowed"
+ *    - string length & item count limits keep the tightest bound, numeric limits are converted to native numbers
+ *    - every key listed under "properties" anywhere in the chain gets a slot in a hash table with the chain of
+ *      schemas for its value, whether it's required, its default & the keys it requires
+ *    - keys that aren't listed & array elements get a node built the same way from additionalProperties/items
+ *
+ * Compilation is lazy - the nodes for nested values are created when their parent is compiled but aren't compiled
+ * themselves until validation (or jschema_compile) first reaches them.  This keeps recursive schemas (through $ref)
+ * finite & means a schema used for a single small document doesn't pay for the parts the document never touches.
+ */
+
+#include <jschema.h>
+#include <jobject.h>
+#include <jobject_internal.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "schema_keys.h"
+#include "liblog.h"
+#include "jallocator_internal.h"
+#include "jschema_internal.h"
+#include "jvalue/num_conversion.h"
+#include "jschema_pattern.h"
+#include "jstats_internal.h"
+
+#if !BYPASS_SCHEMA
+
+/** $ref & extends expansion deeper than this is assumed to be circular */
+#define MAX_SCHEMA_EXPANSION_DEPTH 64
+
+/** how many hash seeds to try (per table size) to find a collision-free layout for the properties */
+#define PROPERTY_TABLE_SEED_ATTEMPTS 16
+
+typedef enum {
+	EXPANSION_OK,
+	EXPANSION_FAILED,
+	EXPANSION_DEFERRED, /// an external reference needs resolving but there's no resolver available yet
+} ExpansionResult;
+
+static SchemaNode ANY_NODE = {
+	.m_flags = SCHEMA_NODE_COMPILED,
+	.m_allowedTypes = ST_ANY,
+	.m_disallowedTypes = 0,
+	.m_minLength = 0,
+	.m_maxLength = INT64_MAX,
+	.m_minItems = 0,
+	.m_maxItems = INT64_MAX,
+	// no properties & anything goes for any key/element
+	.m_additionalProperties = &ANY_NODE,
+	.m_additionalItems = &ANY_NODE,
+};
+
+SchemaNodeRef jschema_node_any(void)
+{
+	return &ANY_NODE;
+}
+
+static uint32_t key_hash(raw_buffer key, uint32_t seed)
+{
+	// FNV-1a with the seed mixed into the offset basis & a final avalanche so that each seed gives
+	// an independent layout
+	uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+	for (size_t i = 0; i < key.m_len; i++) {
+		hash ^= (unsigned char)key.m_str[i];
+		hash *= 16777619u;
+	}
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+static inline bool property_matches(const SchemaProperty *property, uint32_t hash, raw_buffer key)
+{
+	return property->m_hash == hash &&
+		property->m_keyBuf.m_len == key.m_len &&
+		memcmp(property->m_keyBuf.m_str, key.m_str, key.m_len) == 0;
+}
+
+SchemaPropertyRef jschema_node_property(SchemaNodeRef node, raw_buffer key)
+{
+	if (node->m_numProperties == 0)
+		return NULL;
+
+	uint32_t hash = key_hash(key, node->m_propertySeed);
+	for (uint32_t slot = hash & node->m_propertyMask; ; slot = (slot + 1) & node->m_propertyMask) {
+		int32_t index = node->m_propertyTable[slot];
+		if (index < 0)
+			return NULL;
+		if (property_matches(&node->m_properties[index], hash, key))
+			return &node->m_properties[index];
+	}
+}
+
+bool jschema_enum_has_string(const SchemaEnum *enums, raw_buffer str)
+{
+	if (enums->m_strings == NULL)
+		return false;
+
+	uint32_t hash = key_hash(str, 0);
+	for (uint32_t slot = hash & enums->m_stringMask; ; slot = (slot + 1) & enums->m_stringMask) {
+		const SchemaEnumString *member = &enums->m_strings[slot];
+		if (!member->m_used)
+			return false;
+		if (member->m_hash == hash && member->m_str.m_len == str.m_len &&
+			memcmp(member->m_str.m_str, str.m_str, str.m_len) == 0)
+			return true;
+	}
+}
+
+/**
+ * Lay out the properties table with seed.
+ *
+ * @return False if any of the keys didn't land in their home slot (the table is still usable through probing)
+ */
+static bool property_table_fill(SchemaNodeRef node, uint32_t seed)
+{
+	bool perfect = true;
+
+	memset(node->m_propertyTable, 0xff, (node->m_propertyMask + 1) * sizeof(node->m_propertyTable[0]));
+	node->m_propertySeed = seed;
+
+	for (size_t i = 0; i < node->m_numProperties; i++) {
+		SchemaPropertyRef property = &node->m_properties[i];
+		uint32_t slot;
+
+		property->m_hash = key_hash(property->m_keyBuf, seed);
+		slot = property->m_hash & node->m_propertyMask;
+		if (node->m_propertyTable[slot] >= 0) {
+			perfect = false;
+			do {
+				slot = (slot + 1) & node->m_propertyMask;
+			} while (node->m_propertyTable[slot] >= 0);
+		}
+		node->m_propertyTable[slot] = (int32_t)i;
+	}
+
+	return perfect;
+}
+
+/**
+ * Build the hash table over the keys in node->m_properties.  The table is made collision-free if that can be done
+ * cheaply (a few seeds at up to 8x the number of keys), so that a lookup is a single hash, compare & memcmp.
+ * Otherwise linear probing over a table twice the number of keys is used.
+ */
+static bool property_table_build(SchemaNodeRef node)
+{
+	uint32_t minSize = 8;
+	while (minSize < 2 * node->m_numProperties)
+		minSize <<= 1;
+
+	for (uint32_t size = minSize; size <= 4 * minSize; size <<= 1) {
+		int32_t *table = j_realloc(node->m_propertyTable, size * sizeof(table[0]));
+		CHECK_ALLOC_RETURN_VALUE(table, false);
+		node->m_propertyTable = table;
+		node->m_propertyMask = size - 1;
+
+		for (uint32_t seed = 0; seed < PROPERTY_TABLE_SEED_ATTEMPTS; seed++) {
+			if (property_table_fill(node, seed))
+				return true;
+		}
+	}
+
+	node->m_propertyTable = j_realloc(node->m_propertyTable, minSize * sizeof(node->m_propertyTable[0]));
+	CHECK_ALLOC_RETURN_VALUE(node->m_propertyTable, false);
+	node->m_propertyMask = minSize - 1;
+	property_table_fill(node, 0);
+	return true;
+}
+
+bool jschema_number_parse(raw_buffer num, SchemaNumber *result)
+{
+	ConversionResultFlags conversion;
+
+	if (CONV_OK == jstr_to_i64(&num, &result->m_value.m_integer)) {
+		result->m_isInteger = true;
+		return true;
+	}
+
+	result->m_isInteger = false;
+	conversion = jstr_to_double(&num, &result->m_value.m_floating);
+	// losing precision beyond what a double can hold is fine for comparisons
+	return (conversion & ~(CONV_PRECISION_LOSS | CONV_OVERFLOW | CONV_INFINITY)) == CONV_OK;
+}
+
+static bool number_from_jvalue(jvalue_ref value, SchemaNumber *result)
+{
+	raw_buffer raw;
+
+	if (!jis_number(value))
+		return false;
+
+	if (CONV_OK == jnumber_get_raw(value, &raw))
+		return jschema_number_parse(raw, result);
+
+	if (CONV_OK == jnumber_get_i64(value, &result->m_value.m_integer)) {
+		result->m_isInteger = true;
+		return true;
+	}
+	result->m_isInteger = false;
+	return CONV_OK == jnumber_get_f64(value, &result->m_value.m_floating);
+}
+
+#ifndef OPT_TYPE_PARSING
+// in the absence of how much faster this makes this, we do things correctly
+#define OPT_TYPE_PARSING 0
+#endif /* OPT_TYPE_PARSING */
+
+#if OPTIMIZE_TYPE_PARSING
+#define PICK_TYPE(buffer, strliteral, type) \
+	do { \
+		assert(buffer.m_len == sizeof(strliteral) - 1); \
+		if (buffer.m_str[0] == strliteral[0]) { \
+			return type; \
+		} \
+	} while (0)
+#else
+#define PICK_TYPE(buffer, strliteral, type) \
+	do {\
+		assert(buffer.m_len == sizeof(strliteral) - 1); \
+		if (memcmp(buffer.m_str, strliteral, sizeof(strliteral) - 1) == 0) {\
+			return type; \
+		}\
+	} while(0)
+#endif /* OPTIMIZE_TYPE_PARSING */
+
+static SchemaType parseType(raw_buffer input)
+{
+	if (input.m_len == 0)
+		return ST_ERR;
+
+	switch (input.m_len) {
+	case 3:
+		PICK_TYPE(input, "any", ST_ANY);
+		break;
+	case 4:
+		PICK_TYPE(input, "null", ST_NULL);
+		break;
+	case 5:
+		PICK_TYPE(input, "array", ST_ARR);
+		break;
+	case 6:
+		switch (input.m_str[0]) {
+		case 'o':
+			PICK_TYPE(input, "object", ST_OBJ);
+			break;
+		case 's':
+			PICK_TYPE(input, "string", ST_STR);
+			break;
+		case 'n':
+			PICK_TYPE(input, "number", ST_NUM);
+			break;
+		}
+		break;
+	case 7:
+		switch (input.m_str[0]) {
+		case 'i':
+			PICK_TYPE(input, "integer", ST_INT);
+			break;
+		case 'b':
+			PICK_TYPE(input, "boolean", ST_BOOL);
+			break;
+		}
+		break;
+	}
+	PJ_LOG_WARN("Ignoring unsupported type %.*s", (int)input.m_len, input.m_str);
+	return ST_ANY;
+}
+
+static SchemaTypeBitField determinePossibilities_internal(SchemaTypeBitField field, jvalue_ref schemaType)
+{
+	if ((field & ST_ANY) == ST_ANY)
+		return field;
+
+	if (jis_null(schemaType)) {
+		return ST_ANY;
+	}
+	if (jis_string(schemaType)) {
+		return field | parseType(jstring_get_fast(schemaType));
+	}
+	if (jis_array(schemaType)) {
+		for (ssize_t i = jarray_size(schemaType) - 1; i >= 0 && (field & ST_ANY) != ST_ANY; i--)
+			field |= determinePossibilities_internal(field, jarray_get(schemaType, i));
+		return field;
+	}
+	PJ_LOG_WARN("Schema type/disallowed field contains an unsupported JSON type: %u", schemaType->m_type);
+	return ST_ANY;
+}
+
+static void release_node(SchemaNodeRef node)
+{
+	for (size_t i = 0; i < node->m_numEnums; i++) {
+		j_free(node->m_enums[i].m_strings);
+		j_free(node->m_enums[i].m_numbers);
+	}
+	j_free(node->m_enums);
+
+	for (size_t i = 0; i < node->m_numPatterns; i++)
+		pattern_release(node->m_patterns[i]);
+	j_free(node->m_patterns);
+
+	for (size_t i = 0; i < node->m_numProperties; i++) {
+		if (node->m_properties[i].m_requires != NULL)
+			j_release(&node->m_properties[i].m_requires);
+		j_free(node->m_properties[i].m_requiredSlots);
+	}
+	j_free(node->m_properties);
+	j_free(node->m_propertyTable);
+	j_free(node->m_requiredKeys);
+	j_free(node->m_items);
+
+	if (node->m_sources != NULL)
+		j_release(&node->m_sources);
+	if (node->m_chain != NULL)
+		j_release(&node->m_chain);
+	j_free(node);
+}
+
+void jschema_nodes_release(SchemaWrapperRef schema)
+{
+	SchemaNodeRef node = schema->m_nodes;
+	while (node != NULL) {
+		SchemaNodeRef next = node->m_next;
+		release_node(node);
+		node = next;
+	}
+	schema->m_nodes = NULL;
+	schema->m_root = NULL;
+
+	for (size_t i = 0; i < schema->m_numReferences; i++) {
+		SchemaReference *reference = &schema->m_references[i];
+		// a self-reference doesn't hold a reference count (or the schema could never be freed)
+		if (reference->m_resolved != NULL && reference->m_resolved != schema)
+			jschema_release(&reference->m_resolved);
+		j_free((char *)reference->m_ref.m_str);
+	}
+	j_free(schema->m_references);
+	schema->m_references = NULL;
+	schema->m_numReferences = schema->m_referencesCapacity = 0;
+}
+
+/**
+ * @return The cache entry for ref, creating it (unresolved) if create is set
+ */
+static SchemaReference* find_reference(SchemaWrapperRef schema, raw_buffer ref, bool create)
+{
+	SchemaReference *reference;
+
+	for (size_t i = 0; i < schema->m_numReferences; i++) {
+		reference = &schema->m_references[i];
+		if (reference->m_ref.m_len == ref.m_len && memcmp(reference->m_ref.m_str, ref.m_str, ref.m_len) == 0)
+			return reference;
+	}
+
+	if (!create)
+		return NULL;
+
+	if (schema->m_numReferences == schema->m_referencesCapacity) {
+		size_t capacity = schema->m_referencesCapacity ? schema->m_referencesCapacity * 2 : 4;
+		SchemaReference *grown = j_realloc(schema->m_references, capacity * sizeof(grown[0]));
+		CHECK_ALLOC_RETURN_NULL(grown);
+		schema->m_references = grown;
+		schema->m_referencesCapacity = capacity;
+	}
+
+	char *copy = j_malloc(ref.m_len);
+	CHECK_ALLOC_RETURN_NULL(copy);
+	memcpy(copy, ref.m_str, ref.m_len);
+
+	reference = &schema->m_references[schema->m_numReferences++];
+	reference->m_ref.m_str = copy;
+	reference->m_ref.m_len = ref.m_len;
+	reference->m_resolved = NULL;
+	reference->m_node = NULL;
+	return reference;
+}
+
+/**
+ * @return True if the schema is nothing but an external reference (the only other key allowed is the description)
+ */
+static bool is_reference_only(jvalue_ref schema, raw_buffer *ref)
+{
+	jvalue_ref refValue;
+
+	if (!jis_object(schema) || !jobject_get_exists(schema, J_CSTR_TO_BUF(SK_REF), &refValue) || !jis_string(refValue))
+		return false;
+	if (jobject_size(schema) != 1 &&
+		(jobject_size(schema) != 2 || !jobject_containskey(schema, J_CSTR_TO_BUF(SK_DESCRIPTION))))
+		return false;
+
+	*ref = jstring_get_fast(refValue);
+	return ref->m_len > 0;
+}
+
+/**
+ * Create an (uncompiled) node owned by schema, taking ownership of sources.
+ *
+ * Values whose schema is just an external reference all share the one node for that reference - that way a schema
+ * referring back to itself compiles to a cycle instead of an endless tree.
+ *
+ * @return The node or NULL if out of memory.  If there are no sources the node that accepts anything is returned.
+ */
+static SchemaNodeRef create_node(SchemaWrapperRef schema, jvalue_ref sources)
+{
+	SchemaReference *reference = NULL;
+	raw_buffer ref;
+
+	if (jarray_size(sources) == 0) {
+		j_release(&sources);
+		return jschema_node_any();
+	}
+
+	if (jarray_size(sources) == 1 && is_reference_only(jarray_get(sources, 0), &ref)) {
+		reference = find_reference(schema, ref, true);
+		if (reference != NULL && reference->m_node != NULL) {
+			j_release(&sources);
+			return reference->m_node;
+		}
+	}
+
+	SchemaNodeRef node = j_calloc(1, sizeof(SchemaNode));
+	if (UNLIKELY(node == NULL)) {
+		PJ_LOG_ERR("Out of memory");
+		j_release(&sources);
+		return NULL;
+	}
+
+	node->m_sources = sources;
+	node->m_next = schema->m_nodes;
+	schema->m_nodes = node;
+
+	if (reference != NULL)
+		reference->m_node = node;
+	return node;
+}
+
+SchemaNodeRef jschema_root_node(SchemaWrapperRef schema)
+{
+	if (schema == jschema_all())
+		return jschema_node_any();
+
+	if (schema->m_root == NULL)
+		schema->m_root = create_node(schema, jvalue_copy(schema->m_validation));
+
+	return schema->m_root;
+}
+
+/**
+ * @return The schema ref resolves to - from the cache if it has been resolved before, otherwise through the
+ *         resolver (the result is then cached for the lifetime of schema).  NULL if it can't be resolved.
+ */
+static SchemaWrapperRef resolve_reference(SchemaWrapperRef schema, raw_buffer ref, SchemaResolutionRef resolution)
+{
+	SchemaReference *reference = find_reference(schema, ref, true);
+	SchemaWrapperRef resolved;
+
+	if (UNLIKELY(reference == NULL))
+		return NULL;
+	if (reference->m_resolved != NULL)
+		return reference->m_resolved;
+
+	resolution->m_resolver->m_ctxt = schema;
+	resolution->m_resolver->m_resourceToResolve = ref;
+	JSTATS_ADD(m_resolverCalls, 1);
+	if (SCHEMA_RESOLVED != resolution->m_resolver->m_resolve(resolution->m_resolver, &resolved)) {
+		PJ_SCHEMA_ERR("Resolver failed to resolve %.*s", RB_PRINTF(ref));
+		return NULL;
+	}
+	PJ_SCHEMA_DBG("Resolved remote reference for %.*s", RB_PRINTF(ref));
+
+	assert(resolved != NULL);
+	if (UNLIKELY(jis_null_schema(resolved))) {
+		PJ_SCHEMA_ERR("Reference %.*s resolved to an invalid schema", RB_PRINTF(ref));
+		return NULL;
+	}
+
+	// the resolver may have added references itself (i.e. through a nested validation) - look the entry up again
+	reference = find_reference(schema, ref, true);
+	if (UNLIKELY(reference == NULL)) {
+		if (resolved != schema)
+			jschema_release(&resolved);
+		return NULL;
+	}
+
+	reference->m_resolved = resolved;
+	if (resolved == schema)
+		// a self-reference - we're already alive as long as our nodes
+		jschema_release(&resolved);
+
+	return reference->m_resolved;
+}
+
+static ExpansionResult expand_schema(SchemaWrapperRef schema, jvalue_ref chain, jvalue_ref toExpand, SchemaResolutionRef resolution, int depth);
+
+static ExpansionResult expand_reference(SchemaWrapperRef schema, jvalue_ref chain, jvalue_ref toExpand, jvalue_ref ref, SchemaResolutionRef resolution, int depth)
+{
+	raw_buffer refStr;
+	SchemaReference *cached;
+	SchemaWrapperRef resolved;
+	ExpansionResult result = EXPANSION_OK;
+
+	if (UNLIKELY(jobject_size(toExpand) != 1)) {
+		CHECK_CONDITION_RETURN_VALUE(
+				jobject_size(toExpand) != 2 || !jobject_containskey(toExpand, J_CSTR_TO_BUF(SK_DESCRIPTION)),
+				EXPANSION_FAILED,
+				"Schema is invalid - contains an external reference in addition to other key/values that aren't a description field");
+	}
+	CHECK_CONDITION_RETURN_VALUE(!jis_string(ref), EXPANSION_FAILED, "External reference is invalid - must be a string");
+
+	refStr = jstring_get_fast(ref);
+	if (UNLIKELY(refStr.m_len <= 0)) {
+		PJ_SCHEMA_ERR("No valid schema reference: %s", jvalue_tostring(toExpand, jschema_all()));
+		return EXPANSION_FAILED;
+	}
+
+	if (UNLIKELY(refStr.m_str[0] == '$'))
+		PJ_SCHEMA_WARN("$ is reserved for referencing within the schema.  This isn't currently supported");
+
+	cached = find_reference(schema, refStr, false);
+	if (cached != NULL && cached->m_resolved != NULL)
+		resolved = cached->m_resolved;
+	else if (resolution == NULL)
+		return EXPANSION_DEFERRED;
+	else if ((resolved = resolve_reference(schema, refStr, resolution)) == NULL)
+		return EXPANSION_FAILED;
+
+	if (resolved == jschema_all())
+		return EXPANSION_OK;
+
+	for (ssize_t i = 0; i < jarray_size(resolved->m_validation) && result == EXPANSION_OK; i++)
+		result = expand_schema(schema, chain, jarray_get(resolved->m_validation, i), resolution, depth + 1);
+
+	return result;
+}
+
+/**
+ * Append toExpand to chain along with everything it pulls in through $ref & extends.
+ */
+static ExpansionResult expand_schema(SchemaWrapperRef schema, jvalue_ref chain, jvalue_ref toExpand, SchemaResolutionRef resolution, int depth)
+{
+	jvalue_ref ref;
+	ExpansionResult result = EXPANSION_OK;
+
+	if (UNLIKELY(depth > MAX_SCHEMA_EXPANSION_DEPTH)) {
+		PJ_SCHEMA_ERR("Schema references/extensions nest too deeply - probably circular");
+		return EXPANSION_FAILED;
+	}
+	CHECK_CONDITION_RETURN_VALUE(!jis_object(toExpand), EXPANSION_FAILED, "Schema is invalid - must be an object");
+
+	if (jobject_get_exists(toExpand, J_CSTR_TO_BUF(SK_REF), &ref))
+		return expand_reference(schema, chain, toExpand, ref, resolution, depth);
+
+	jarray_append(chain, jvalue_copy(toExpand));
+
+	if (jobject_get_exists(toExpand, J_CSTR_TO_BUF(SK_EXTENDS), &ref)) {
+		if (jis_array(ref)) {
+			for (ssize_t i = 0; i < jarray_size(ref) && result == EXPANSION_OK; i++)
+				result = expand_schema(schema, chain, jarray_get(ref, i), resolution, depth + 1);
+		} else if (!jis_null(ref)) {
+			result = expand_schema(schema, chain, ref, resolution, depth + 1);
+		}
+	}
+
+	return result;
+}
+
+static bool compile_types(SchemaNodeRef node)
+{
+	jvalue_ref type;
+
+	node->m_allowedTypes = ST_ANY;
+	node->m_disallowedTypes = 0;
+
+	for (ssize_t i = 0; i < jarray_size(node->m_chain); i++) {
+		jvalue_ref element = jarray_get(node->m_chain, i);
+
+		if (!jis_null(type = jobject_get(element, J_CSTR_TO_BUF(SK_TYPE))))
+			node->m_allowedTypes &= determinePossibilities_internal(0, type);
+		if (!jis_null(type = jobject_get(element, J_CSTR_TO_BUF(SK_DISALLLOWED))))
+			node->m_disallowedTypes |= determinePossibilities_internal(0, type);
+	}
+
+	if (node->m_allowedTypes == 0 || node->m_disallowedTypes == ST_ANY) {
+		PJ_SCHEMA_WARN("Schema disallows all input");
+		return false;
+	}
+	return true;
+}
+
+static bool compile_limit(jvalue_ref element, const char *key, int64_t *limit, bool isMax, const char *description)
+{
+	jvalue_ref value;
+	int64_t specified;
+
+	if (jis_null(value = jobject_get(element, j_cstr_to_buffer(key))))
+		return true;
+
+	if (!jis_number(value) || CONV_OK != jnumber_get_i64(value, &specified) || specified < 0) {
+		PJ_SCHEMA_ERR("%s is not a valid integer >= 0", description);
+		return false;
+	}
+
+	if (isMax ? specified < *limit : specified > *limit)
+		*limit = specified;
+	return true;
+}
+
+static bool compile_numeric_limit(jvalue_ref element, const char *key, bool *hasLimit, SchemaNumber *limit, bool isMax, const char *description)
+{
+	jvalue_ref value;
+	SchemaNumber specified;
+
+	if (jis_null(value = jobject_get(element, j_cstr_to_buffer(key))))
+		return true;
+
+	if (!number_from_jvalue(value, &specified)) {
+		PJ_SCHEMA_ERR("%s value must be a number", description);
+		return false;
+	}
+
+	if (!*hasLimit || (isMax ? jschema_number_compare(&specified, limit) < 0 : jschema_number_compare(&specified, limit) > 0)) {
+		*limit = specified;
+		*hasLimit = true;
+	}
+	return true;
+}
+
+/**
+ * Put the string members of the enum into a hash set (at most half full) so that checking a string against a
+ * long enum is a single lookup.
+ */
+static bool compile_enum_strings(SchemaEnum *compiled, jvalue_ref values)
+{
+	size_t numStrings = 0;
+	uint32_t size = 8;
+
+	for (ssize_t i = 0; i < jarray_size(values); i++) {
+		if (jis_string(jarray_get(values, i)))
+			numStrings++;
+	}
+	if (numStrings == 0)
+		return true;
+
+	while (size < 2 * numStrings)
+		size <<= 1;
+	compiled->m_strings = j_calloc(size, sizeof(compiled->m_strings[0]));
+	CHECK_ALLOC_RETURN_VALUE(compiled->m_strings, false);
+	compiled->m_stringMask = size - 1;
+
+	for (ssize_t i = 0; i < jarray_size(values); i++) {
+		jvalue_ref value = jarray_get(values, i);
+		raw_buffer str;
+		uint32_t hash, slot;
+
+		if (!jis_string(value))
+			continue;
+
+		str = jstring_get_fast(value);
+		hash = key_hash(str, 0);
+		for (slot = hash & compiled->m_stringMask; compiled->m_strings[slot].m_used; slot = (slot + 1) & compiled->m_stringMask) {
+			if (compiled->m_strings[slot].m_hash == hash && compiled->m_strings[slot].m_str.m_len == str.m_len &&
+				memcmp(compiled->m_strings[slot].m_str.m_str, str.m_str, str.m_len) == 0)
+				break;
+		}
+		compiled->m_strings[slot].m_str = str;
+		compiled->m_strings[slot].m_hash = hash;
+		compiled->m_strings[slot].m_used = true;
+	}
+	return true;
+}
+
+static bool compile_enum(SchemaEnum *compiled, jvalue_ref values)
+{
+	memset(compiled, 0, sizeof(*compiled));
+	compiled->m_values = values;
+
+	if (!compile_enum_strings(compiled, values))
+		return false;
+
+	for (ssize_t i = 0; i < jarray_size(values); i++) {
+		jvalue_ref value = jarray_get(values, i);
+
+		if (jis_null(value)) {
+			compiled->m_hasNull = true;
+		} else if (jis_boolean(value)) {
+			if (jboolean_deref(value))
+				compiled->m_hasTrue = true;
+			else
+				compiled->m_hasFalse = true;
+		} else if (jis_number(value)) {
+			SchemaNumber *grown = j_realloc(compiled->m_numbers, (compiled->m_numNumbers + 1) * sizeof(grown[0]));
+			CHECK_ALLOC_RETURN_VALUE(grown, false);
+			compiled->m_numbers = grown;
+			if (number_from_jvalue(value, &compiled->m_numbers[compiled->m_numNumbers]))
+				compiled->m_numNumbers++;
+		}
+	}
+	return true;
+}
+
+static bool compile_simple_keywords(SchemaNodeRef node)
+{
+	jvalue_ref value;
+	ssize_t numSchemas = jarray_size(node->m_chain);
+
+	node->m_minLength = 0;
+	node->m_maxLength = INT64_MAX;
+	node->m_minItems = 0;
+	node->m_maxItems = INT64_MAX;
+
+	for (ssize_t i = 0; i < numSchemas; i++) {
+		jvalue_ref element = jarray_get(node->m_chain, i);
+
+		if (!compile_limit(element, SK_MIN_LEN, &node->m_minLength, false, "Minimum string length") ||
+			!compile_limit(element, SK_MAX_LEN, &node->m_maxLength, true, "Maximum string length") ||
+			!compile_limit(element, SK_MIN_ITEMS, &node->m_minItems, false, "Minimum number of items") ||
+			!compile_limit(element, SK_MAX_ITEMS, &node->m_maxItems, true, "Maximum number of items") ||
+			!compile_numeric_limit(element, SK_MIN_VALUE, &node->m_hasMinimum, &node->m_minimum, false, "Minimum") ||
+			!compile_numeric_limit(element, SK_MAX_VALUE, &node->m_hasMaximum, &node->m_maximum, true, "Maximum"))
+		{
+			return false;
+		}
+
+		if (!jis_null(value = jobject_get(element, J_CSTR_TO_BUF(SK_REGEXP)))) {
+			if (!jis_string(value)) {
+				PJ_SCHEMA_ERR("Invalid regexp type %d", value->m_type);
+				return false;
+			}
+
+			SchemaPattern **grown = j_realloc(node->m_patterns, (node->m_numPatterns + 1) * sizeof(grown[0]));
+			CHECK_ALLOC_RETURN_VALUE(grown, false);
+			node->m_patterns = grown;
+			if ((node->m_patterns[node->m_numPatterns] = pattern_compile(jstring_get_fast(value))) == NULL)
+				return false;
+			node->m_numPatterns++;
+		}
+
+		if (!jis_null(value = jobject_get(element, J_CSTR_TO_BUF(SK_ENUM)))) {
+			if (!jis_array(value)) {
+				PJ_SCHEMA_ERR("Enum must be an array");
+				return false;
+			}
+
+			SchemaEnum *grown = j_realloc(node->m_enums, (node->m_numEnums + 1) * sizeof(grown[0]));
+			CHECK_ALLOC_RETURN_VALUE(grown, false);
+			node->m_enums = grown;
+			if (!compile_enum(&node->m_enums[node->m_numEnums++], value))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * What an element of the chain says about a key/item it has no specific schema for.
+ *
+ * @return False if the element doesn't allow it, otherwise true (with the schema to apply appended to sources if
+ *         there is one).
+ */
+static bool append_additional(jvalue_ref element, jvalue_ref sources)
+{
+	jvalue_ref additional = jobject_get(element, J_CSTR_TO_BUF(SK_MORE_PROPS));
+
+	if (jis_boolean(additional))
+		return jboolean_deref(additional);
+	if (!jis_null(additional))
+		jarray_append(sources, jvalue_copy(additional));
+	return true;
+}
+
+static bool compile_property(SchemaWrapperRef schema, SchemaNodeRef node, SchemaPropertyRef property)
+{
+	jvalue_ref sources = jarray_create(NULL);
+	jvalue_ref propertySchema, value;
+	bool rejected = false;
+	bool missingDefault = false;
+
+	CHECK_ALLOC_RETURN_VALUE(sources, false);
+
+	for (ssize_t i = 0; i < jarray_size(node->m_chain); i++) {
+		jvalue_ref element = jarray_get(node->m_chain, i);
+		jvalue_ref properties = jobject_get(element, J_CSTR_TO_BUF(SK_PROPS));
+
+		if (!jis_object(properties) || !jobject_get_exists(properties, property->m_keyBuf, &propertySchema)) {
+			if (!append_additional(element, sources))
+				rejected = true;
+			continue;
+		}
+
+		if (!jis_object(propertySchema)) {
+			PJ_SCHEMA_ERR("Schema problem - schema for instance key %.*s is not an object", RB_PRINTF(property->m_keyBuf));
+			j_release(&sources);
+			return false;
+		}
+		jarray_append(sources, jvalue_copy(propertySchema));
+
+		value = jobject_get(propertySchema, J_CSTR_TO_BUF(SK_OPTIONAL));
+		if (!jis_boolean(value) || !jboolean_deref(value)) {
+			property->m_required = true;
+			if (jobject_get_exists(propertySchema, J_CSTR_TO_BUF(SK_DEFAULT), &value)) {
+				if (property->m_default == NULL)
+					property->m_default = value;
+			} else {
+				missingDefault = true;
+			}
+		}
+
+		// EXTENSION: required can be a value or a list of values
+		if (!jis_null(value = jobject_get(propertySchema, J_CSTR_TO_BUF(SK_REQUIRED)))) {
+			if (property->m_requires == NULL)
+				property->m_requires = jarray_create(NULL);
+			if (jis_string(value)) {
+				jarray_append(property->m_requires, jvalue_copy(value));
+			} else if (jis_array(value)) {
+				for (ssize_t j = 0; j < jarray_size(value); j++) {
+					if (!jis_string(jarray_get(value, j))) {
+						PJ_SCHEMA_ERR("Keys required by %.*s must be strings", RB_PRINTF(property->m_keyBuf));
+						j_release(&sources);
+						return false;
+					}
+					jarray_append(property->m_requires, jvalue_copy(jarray_get(value, j)));
+				}
+			} else {
+				PJ_SCHEMA_ERR("Keys required by %.*s must be a string or an array of strings", RB_PRINTF(property->m_keyBuf));
+				j_release(&sources);
+				return false;
+			}
+		}
+	}
+
+	// a default can only be used if every schema insisting on the key is satisfied by it being absent
+	if (missingDefault)
+		property->m_default = NULL;
+
+	if (rejected) {
+		j_release(&sources);
+		property->m_schema = NULL;
+		return true;
+	}
+
+	property->m_schema = create_node(schema, sources);
+	return property->m_schema != NULL;
+}
+
+static bool add_property_key(SchemaNodeRef node, jvalue_ref key, size_t capacity, bool checkDuplicates)
+{
+	raw_buffer keyBuf = jstring_get_fast(key);
+
+	if (checkDuplicates) {
+		for (size_t i = 0; i < node->m_numProperties; i++) {
+			if (node->m_properties[i].m_keyBuf.m_len == keyBuf.m_len &&
+				memcmp(node->m_properties[i].m_keyBuf.m_str, keyBuf.m_str, keyBuf.m_len) == 0)
+				return true;
+		}
+	}
+
+	assert(node->m_numProperties < capacity);
+	node->m_properties[node->m_numProperties].m_key = key;
+	node->m_properties[node->m_numProperties].m_keyBuf = keyBuf;
+	node->m_numProperties++;
+	return true;
+}
+
+/**
+ * Give every key that's required by a property but isn't listed itself a property of its own (after the listed
+ * ones), so that the validator can track all of them by slot.
+ */
+static bool add_required_keys(SchemaNodeRef node)
+{
+	size_t numListed = node->m_numProperties;
+	size_t capacity = numListed;
+
+	for (size_t i = 0; i < numListed; i++) {
+		if (node->m_properties[i].m_requires != NULL)
+			capacity += jarray_size(node->m_properties[i].m_requires);
+	}
+	if (capacity == numListed)
+		return true;
+
+	SchemaProperty *grown = j_realloc(node->m_properties, capacity * sizeof(grown[0]));
+	CHECK_ALLOC_RETURN_VALUE(grown, false);
+	memset(grown + numListed, 0, (capacity - numListed) * sizeof(grown[0]));
+	node->m_properties = grown;
+
+	for (size_t i = 0; i < numListed; i++) {
+		jvalue_ref requires = node->m_properties[i].m_requires;
+		for (ssize_t j = 0; requires != NULL && j < jarray_size(requires); j++)
+			add_property_key(node, jarray_get(requires, j), capacity, true);
+	}
+	return true;
+}
+
+/**
+ * Once the properties table is built: the schema of the keys added by add_required_keys, the slots each
+ * property requires & the bitsets the validator checks the keys of an object against.
+ */
+static bool compile_required_keys(SchemaNodeRef node, size_t numListed)
+{
+	size_t words = PROPERTY_BITS_WORDS(node->m_numProperties);
+
+	if (words == 0)
+		return true;
+
+	node->m_requiredKeys = j_calloc(2 * words, sizeof(PropertyBits));
+	CHECK_ALLOC_RETURN_VALUE(node->m_requiredKeys, false);
+	node->m_dependentKeys = node->m_requiredKeys + words;
+
+	for (size_t i = 0; i < node->m_numProperties; i++) {
+		SchemaPropertyRef property = &node->m_properties[i];
+		PropertyBits bit = (PropertyBits)1 << (i % PROPERTY_BITS_PER_WORD);
+
+		if (i >= numListed)
+			property->m_schema = node->m_additionalProperties;
+
+		if (property->m_required)
+			node->m_requiredKeys[i / PROPERTY_BITS_PER_WORD] |= bit;
+
+		if (property->m_requires == NULL || jarray_size(property->m_requires) == 0)
+			continue;
+
+		property->m_requiredSlots = j_malloc(jarray_size(property->m_requires) * sizeof(property->m_requiredSlots[0]));
+		CHECK_ALLOC_RETURN_VALUE(property->m_requiredSlots, false);
+		for (ssize_t j = 0; j < jarray_size(property->m_requires); j++) {
+			SchemaPropertyRef required = jschema_node_property(node, jstring_get_fast(jarray_get(property->m_requires, j)));
+			assert(required != NULL);
+			property->m_requiredSlots[property->m_numRequiredSlots++] = (uint32_t)(required - node->m_properties);
+		}
+		node->m_dependentKeys[i / PROPERTY_BITS_PER_WORD] |= bit;
+	}
+	return true;
+}
+
+static bool compile_properties(SchemaWrapperRef schema, SchemaNodeRef node)
+{
+	size_t numListed = 0;
+	jvalue_ref properties;
+	jobject_key_value property;
+	size_t capacity = 0;
+	bool firstWithProperties = true;
+	ssize_t numSchemas = jarray_size(node->m_chain);
+
+	for (ssize_t i = 0; i < numSchemas; i++) {
+		properties = jobject_get(jarray_get(node->m_chain, i), J_CSTR_TO_BUF(SK_PROPS));
+		if (jis_null(properties))
+			continue;
+		if (!jis_object(properties)) {
+			PJ_SCHEMA_ERR("Schema problem - properties must be an object");
+			return false;
+		}
+		capacity += jobject_size(properties);
+	}
+
+	if (capacity > 0) {
+		node->m_properties = j_calloc(capacity, sizeof(SchemaProperty));
+		CHECK_ALLOC_RETURN_VALUE(node->m_properties, false);
+
+		for (ssize_t i = 0; i < numSchemas; i++) {
+			properties = jobject_get(jarray_get(node->m_chain, i), J_CSTR_TO_BUF(SK_PROPS));
+			if (jis_null(properties))
+				continue;
+
+			for (jobject_iter iter = jobj_iter_init(properties); jobj_iter_is_valid(iter); iter = jobj_iter_next(iter)) {
+				if (!jobj_iter_deref(iter, &property)) {
+					PJ_SCHEMA_ERR("Failed to dereference iterator over properties list");
+					return false;
+				}
+				// keys within a single object are already unique
+				add_property_key(node, property.key, capacity, !firstWithProperties);
+			}
+			firstWithProperties = false;
+		}
+
+		for (size_t i = 0; i < node->m_numProperties; i++) {
+			if (!compile_property(schema, node, &node->m_properties[i]))
+				return false;
+		}
+
+		numListed = node->m_numProperties;
+		if (!add_required_keys(node) || !property_table_build(node))
+			return false;
+	}
+
+	// keys that aren't listed anywhere
+	jvalue_ref sources = jarray_create(NULL);
+	bool rejected = false;
+	CHECK_ALLOC_RETURN_VALUE(sources, false);
+
+	for (ssize_t i = 0; i < numSchemas; i++) {
+		if (!append_additional(jarray_get(node->m_chain, i), sources))
+			rejected = true;
+	}
+
+	if (rejected) {
+		j_release(&sources);
+		node->m_additionalProperties = NULL;
+	} else {
+		node->m_additionalProperties = create_node(schema, sources);
+		if (node->m_additionalProperties == NULL)
+			return false;
+	}
+
+	return compile_required_keys(node, numListed);
+}
+
+/**
+ * The schemas for the element at index (or for the elements past all the tuples if index < 0).
+ *
+ * The rules, per element of the chain:
+ *     items:  an object - schema applies to all elements
+ *     items:  an array - tuple typed schemas
+ *     additionalProperties: any items falling outside of items must match this
+ *                           true or missing - default to everything schema
+ *                           false - no elements allowed
+ *                           if items is missing, this is equivalent to it having this value
+ *                           if items is an object, then this property will never be used
+ */
+static bool compile_item(SchemaWrapperRef schema, SchemaNodeRef node, ssize_t index, SchemaNodeRef *result)
+{
+	jvalue_ref sources = jarray_create(NULL);
+	bool rejected = false;
+
+	CHECK_ALLOC_RETURN_VALUE(sources, false);
+
+	for (ssize_t i = 0; i < jarray_size(node->m_chain); i++) {
+		jvalue_ref element = jarray_get(node->m_chain, i);
+		jvalue_ref items = jobject_get(element, J_CSTR_TO_BUF(SK_ITEMS));
+
+		if (jis_object(items))
+			jarray_append(sources, jvalue_copy(items));
+		else if (jis_array(items) && index >= 0 && index < jarray_size(items))
+			jarray_append(sources, jvalue_copy(jarray_get(items, index)));
+		else if (!append_additional(element, sources))
+			rejected = true;
+	}
+
+	if (rejected) {
+		j_release(&sources);
+		*result = NULL;
+		return true;
+	}
+
+	*result = create_node(schema, sources);
+	return *result != NULL;
+}
+
+static bool compile_items(SchemaWrapperRef schema, SchemaNodeRef node)
+{
+	jvalue_ref items;
+	size_t numTuples = 0;
+
+	for (ssize_t i = 0; i < jarray_size(node->m_chain); i++) {
+		items = jobject_get(jarray_get(node->m_chain, i), J_CSTR_TO_BUF(SK_ITEMS));
+		if (jis_array(items)) {
+			if ((size_t)jarray_size(items) > numTuples)
+				numTuples = jarray_size(items);
+		} else if (!jis_null(items) && !jis_object(items)) {
+			PJ_SCHEMA_ERR("Schema problem - items must be an object or an array");
+			return false;
+		}
+	}
+
+	if (numTuples > 0) {
+		node->m_items = j_calloc(numTuples, sizeof(node->m_items[0]));
+		CHECK_ALLOC_RETURN_VALUE(node->m_items, false);
+		node->m_numItems = numTuples;
+
+		for (size_t j = 0; j < numTuples; j++) {
+			if (!compile_item(schema, node, j, &node->m_items[j]))
+				return false;
+		}
+	}
+
+	return compile_item(schema, node, -1, &node->m_additionalItems);
+}
+
+bool jschema_node_compile(SchemaWrapperRef schema, SchemaNodeRef node, SchemaResolutionRef resolution)
+{
+	ExpansionResult expansion = EXPANSION_OK;
+	jvalue_ref chain;
+
+	if (LIKELY(node->m_flags & SCHEMA_NODE_COMPILED))
+		return !(node->m_flags & SCHEMA_NODE_INVALID);
+
+	chain = jarray_create(NULL);
+	CHECK_ALLOC_RETURN_VALUE(chain, false);
+
+	for (ssize_t i = 0; i < jarray_size(node->m_sources) && expansion == EXPANSION_OK; i++)
+		expansion = expand_schema(schema, chain, jarray_get(node->m_sources, i), resolution, 0);
+
+	if (expansion == EXPANSION_DEFERRED) {
+		j_release(&chain);
+		return true;
+	}
+
+	node->m_chain = chain;
+	node->m_flags = SCHEMA_NODE_COMPILED;
+	j_release(&node->m_sources);
+	node->m_sources = NULL;
+
+	if (expansion != EXPANSION_OK ||
+		!compile_types(node) ||
+		!compile_simple_keywords(node) ||
+		!compile_properties(schema, node) ||
+		!compile_items(schema, node))
+	{
+		node->m_flags |= SCHEMA_NODE_INVALID;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Compile every node of the schema that can be compiled.  Compiling a node creates the nodes for its values
+ * (at the head of m_nodes), so this goes over the nodes until a pass doesn't compile anything new - walking the
+ * list rather than the tree finds the nodes below ones that were compiled earlier & needs no cycle detection.
+ */
+static bool compile_all(SchemaWrapperRef schema, SchemaResolutionRef resolution)
+{
+	bool progress;
+
+	do {
+		progress = false;
+		for (SchemaNodeRef node = schema->m_nodes; node != NULL; node = node->m_next) {
+			bool compiled = (node->m_flags & SCHEMA_NODE_COMPILED);
+
+			if (!jschema_node_compile(schema, node, resolution))
+				return false;
+			// if it's still not compiled, it needs an external reference resolved - compiled on first use
+			if (!compiled && (node->m_flags & SCHEMA_NODE_COMPILED))
+				progress = true;
+		}
+	} while (progress);
+
+	return true;
+}
+#endif
+
+bool jschema_compile(jschema_ref schema)
+{
+#if !BYPASS_SCHEMA
+	SchemaWrapperRef schemaImpl = (SchemaWrapperRef)schema;
+	SchemaNodeRef root;
+
+	if (jis_null_schema(schemaImpl))
+		return false;
+
+	root = jschema_root_node(schemaImpl);
+	CHECK_POINTER_RETURN_VALUE(root, false);
+
+	return compile_all(schemaImpl, NULL);
+#else
+	return true;
+#endif
+}
+
+bool jschema_resolve_all(jschema_ref schema, JSchemaResolverRef resolver)
+{
+#if !BYPASS_SCHEMA
+	SchemaWrapperRef schemaImpl = (SchemaWrapperRef)schema;
+	struct SchemaResolution resolution = {
+		.m_resolver = resolver,
+		.m_errorHandler = NULL,
+	};
+	SchemaNodeRef root;
+
+	if (jis_null_schema(schemaImpl))
+		return false;
+
+	if (resolver == NULL || resolver->m_resolve == NULL)
+		resolution.m_resolver = jget_garbage_resolver();
+
+	root = jschema_root_node(schemaImpl);
+	CHECK_POINTER_RETURN_VALUE(root, false);
+
+	return compile_all(schemaImpl, &resolution);
+#else
+	return true;
+#endif
+}
+
+bool jschema_fully_compiled(SchemaWrapperRef schema)
+{
+#if !BYPASS_SCHEMA
+	if (schema == jschema_all())
+		return true;
+	if (schema->m_root == NULL)
+		return false;
+
+	for (SchemaNodeRef node = schema->m_nodes; node != NULL; node = node->m_next) {
+		if (!(node->m_flags & SCHEMA_NODE_COMPILED))
+			return false;
+	}
+#endif
+	return true;
+}
+
+bool jschema_reference(SchemaWrapperRef schema, size_t index, raw_buffer *ref, bool *resolved)
+{
+#if !BYPASS_SCHEMA
+	if (schema == jschema_all() || index >= schema->m_numReferences)
+		return false;
+
+	*ref = schema->m_references[index].m_ref;
+	*resolved = (schema->m_references[index].m_resolved != NULL);
+	return true;
+#else
+	return false;
+#endif
+}
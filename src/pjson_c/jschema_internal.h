@@ -32,6 +32,16 @@ LICENSE@@@ */
 PJSON_LOCAL ValidationStateRef jschema_init(JSchemaInfoRef schemaToUse) NON_NULL(1);
 PJSON_LOCAL void jschema_state_release(ValidationStateRef *state) NON_NULL(1);
 
+/*
+ * For validation states that are kept around between documents (i.e. owned by a jparser_ref).
+ * jschema_state_reset prepares the state machine for validating a new document against schemaToUse,
+ * jschema_state_clear drops whatever is left over from the last document (including the schema references) but keeps
+ * the stack of states for the next one, jschema_state_destroy frees that too.
+ */
+PJSON_LOCAL bool jschema_state_reset(ValidationStateRef state, JSchemaInfoRef schemaToUse) NON_NULL(1, 2);
+PJSON_LOCAL void jschema_state_clear(ValidationStateRef state) NON_NULL(1);
+PJSON_LOCAL void jschema_state_destroy(ValidationStateRef state) NON_NULL(1);
+
 PJSON_LOCAL bool jschema_isvalid(ValidationStateRef parseState);
 
 PJSON_LOCAL bool jschema_obj(JSAXContextRef sax, ValidationStateRef parseState);
@@ -56,4 +66,102 @@ PJSON_LOCAL bool jis_empty_schema(SchemaWrapperRef schema);
 
 PJSON_LOCAL JSchemaResolverRef jget_garbage_resolver();
 
+/*
+ * Schema compilation (see jschema_compile.c).
+ *
+ * jschema_root_node returns the (possibly not yet compiled) node for the schema as a whole.
+ * jschema_node_compile compiles node if it hasn't been already, resolving any $ref through resolution.  If resolution
+ * is NULL, nodes that need an external reference resolved are left for later & true is returned.
+ * jschema_nodes_release frees everything compiled for schema.
+ */
+PJSON_LOCAL SchemaNodeRef jschema_node_any(void);
+PJSON_LOCAL SchemaNodeRef jschema_root_node(SchemaWrapperRef schema) NON_NULL(1);
+PJSON_LOCAL bool jschema_node_compile(SchemaWrapperRef schema, SchemaNodeRef node, SchemaResolutionRef resolution) NON_NULL(1, 2);
+PJSON_LOCAL void jschema_nodes_release(SchemaWrapperRef schema) NON_NULL(1);
+
+/**
+ * Whether every node of schema has been compiled (& so every reference resolved), i.e. validating against it
+ * no longer changes it & it may be used by several threads at once (see jschema_compile & jschema_resolve_all).
+ */
+PJSON_LOCAL bool jschema_fully_compiled(SchemaWrapperRef schema) NON_NULL(1);
+
+/**
+ * Go over the external references ($ref) schema has come across so far.
+ *
+ * @param index Starts at 0.
+ * @param ref Set to the reference as written (not NULL-terminated).
+ * @param resolved Set to whether the reference has been resolved.
+ * @return False once index is past the last reference.
+ */
+PJSON_LOCAL bool jschema_reference(SchemaWrapperRef schema, size_t index, raw_buffer *ref, bool *resolved) NON_NULL(1, 3, 4);
+
+/**
+ * @return The property of the node for key or NULL if the key isn't one of its properties
+ */
+PJSON_LOCAL SchemaPropertyRef jschema_node_property(SchemaNodeRef node, raw_buffer key) NON_NULL(1);
+PJSON_LOCAL bool jschema_enum_has_string(const SchemaEnum *enums, raw_buffer str) NON_NULL(1);
+
+/**
+ * Remove the lowest property from a non-empty word of a PropertyBits set.
+ *
+ * @return The position within the word of the property removed
+ */
+static inline unsigned int property_bits_pop(PropertyBits *word)
+{
+#ifdef __GNUC__
+	unsigned int bit = __builtin_ctzll(*word);
+#else
+	unsigned int bit = 0;
+	while (!(*word & ((PropertyBits)1 << bit)))
+		bit++;
+#endif
+	*word &= *word - 1;
+	return bit;
+}
+
+/**
+ * Convert a JSON number (from the input or the schema) for comparison with jschema_number_compare.
+ *
+ * @return False if num isn't a number that can be represented
+ */
+PJSON_LOCAL bool jschema_number_parse(raw_buffer num, SchemaNumber *result) NON_NULL(2);
+
+/**
+ * Compare an integer with a floating point number without rounding the integer to a double first (which would
+ * make e.g. 9007199254740995 & 9007199254740996.0 equal).
+ */
+static inline int jschema_number_compare_mixed(int64_t integer, double floating)
+{
+	// 2^63 - every int64_t is below it & at least -2^63
+	if (floating >= 9223372036854775808.0)
+		return -1;
+	if (floating < -9223372036854775808.0)
+		return 1;
+
+	// both the truncation & the fractional part are exact within that range
+	int64_t whole = (int64_t)floating;
+	if (integer != whole)
+		return (integer > whole) - (integer < whole);
+	double fraction = floating - (double)whole;
+	return (fraction < 0) - (fraction > 0);
+}
+
+/**
+ * @return <0, 0 or >0 if a is less than, equal to or greater than b.  Integers are compared as such & only
+ *         numbers that aren't integral are compared as doubles.
+ */
+static inline int jschema_number_compare(const SchemaNumber *a, const SchemaNumber *b)
+{
+	if (a->m_isInteger && b->m_isInteger)
+		return (a->m_value.m_integer > b->m_value.m_integer) - (a->m_value.m_integer < b->m_value.m_integer);
+	if (a->m_isInteger)
+		return jschema_number_compare_mixed(a->m_value.m_integer, b->m_value.m_floating);
+	if (b->m_isInteger)
+		return -jschema_number_compare_mixed(b->m_value.m_integer, a->m_value.m_floating);
+
+	double x = a->m_value.m_floating;
+	double y = b->m_value.m_floating;
+	return (x > y) - (x < y);
+}
+
 #endif /* JSCHEMA_INTERNAL_H_ */
@@ -0,0 +1,270 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+/***
+ * The "pattern" keyword.
+ *
+ * Patterns are compiled once, when the schema node they belong to is compiled, & matched as is for every string
+ * validated against that node.  With PCRE the native API is used (rather than its POSIX wrapper) so that the
+ * pattern can be studied & JIT compiled up-front & the input matched in place without NULL-terminating it.
+ *
+ * A compiled pattern is never modified by matching.  The only mutable state a match needs (the PCRE JIT stack or,
+ * for POSIX engines that can't match a bounded string, a NULL-terminated copy of the input) is cached per thread
+ * so that a schema can be shared by any number of validating threads without locking.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "liblog.h"
+#include "jallocator_internal.h"
+#include "regexp.h"
+#include "jschema_pattern.h"
+#include <pjson_pthread.h>
+#include <compiler/unused_attribute.h>
+
+#if !USE_POSIX_REGEXP && defined(PCRE_STUDY_JIT_COMPILE)
+#define PATTERN_JIT 1
+#endif
+
+#if PATTERN_JIT || (USE_POSIX_REGEXP && !defined(REG_STARTEND))
+#define PATTERN_SCRATCH 1
+#endif
+
+/** the initial & largest size of the stack a JIT compiled pattern is matched with */
+#define JIT_STACK_START (32 * 1024)
+#define JIT_STACK_MAX (512 * 1024)
+
+struct SchemaPattern {
+	char *m_source; /// the expression as written in the schema
+#if USE_POSIX_REGEXP
+	regex_t m_regex;
+#else
+	pcre *m_code;
+	pcre_extra *m_extra; /// what studying the pattern produced (NULL if it found nothing to speed up)
+#endif
+};
+
+#if PATTERN_SCRATCH
+/**
+ * The per-thread state for matching.  Allocated on a thread's first match & freed when the thread exits.
+ */
+typedef struct PatternScratch {
+#if PATTERN_JIT
+	pcre_jit_stack *m_jitStack;
+#endif
+#if USE_POSIX_REGEXP
+	char *m_buffer;
+	size_t m_capacity;
+#endif
+} PatternScratch;
+
+static void scratch_free(void *data)
+{
+	PatternScratch *scratch = (PatternScratch *)data;
+#if PATTERN_JIT
+	if (scratch->m_jitStack != NULL)
+		pcre_jit_stack_free(scratch->m_jitStack);
+#endif
+#if USE_POSIX_REGEXP
+	j_free(scratch->m_buffer);
+#endif
+	j_free(scratch);
+}
+
+#if HAVE_PTHREAD
+static pthread_key_t scratchKey;
+static pthread_once_t scratchKeyOnce = PTHREAD_ONCE_INIT;
+static bool scratchKeyValid = false;
+
+static void scratch_key_create(void)
+{
+	scratchKeyValid = (pthread_key_create(&scratchKey, scratch_free) == 0);
+}
+
+static PatternScratch* thread_scratch(void)
+{
+	PatternScratch *scratch;
+
+	pthread_once(&scratchKeyOnce, scratch_key_create);
+	if (UNLIKELY(!scratchKeyValid))
+		return NULL;
+
+	scratch = (PatternScratch *)pthread_getspecific(scratchKey);
+	if (scratch == NULL) {
+		scratch = (PatternScratch *)j_calloc(1, sizeof(PatternScratch));
+		CHECK_ALLOC_RETURN_NULL(scratch);
+		if (pthread_setspecific(scratchKey, scratch) != 0) {
+			j_free(scratch);
+			return NULL;
+		}
+	}
+	return scratch;
+}
+#else
+static PatternScratch* thread_scratch(void)
+{
+	static PatternScratch scratch;
+	return &scratch;
+}
+#endif /* HAVE_PTHREAD */
+#endif /* PATTERN_SCRATCH */
+
+#if PATTERN_JIT
+/**
+ * PCRE asks for the JIT stack at the start of every match - hand it the calling thread's.  NULL makes PCRE fall back
+ * to a small stack on the machine stack, so failing to allocate one only limits how deep a match may backtrack.
+ */
+static pcre_jit_stack* thread_jit_stack(void *unused UNUSED_VAR)
+{
+	PatternScratch *scratch = thread_scratch();
+	if (scratch == NULL)
+		return NULL;
+	if (scratch->m_jitStack == NULL)
+		scratch->m_jitStack = pcre_jit_stack_alloc(JIT_STACK_START, JIT_STACK_MAX);
+	return scratch->m_jitStack;
+}
+#endif
+
+SchemaPattern* pattern_compile(raw_buffer source)
+{
+	SchemaPattern *pattern;
+
+	if (memchr(source.m_str, '\0', source.m_len) != NULL) {
+		PJ_SCHEMA_ERR("Pattern '%.*s' contains a NUL character", RB_PRINTF(source));
+		return NULL;
+	}
+
+	pattern = (SchemaPattern *)j_calloc(1, sizeof(SchemaPattern));
+	CHECK_ALLOC_RETURN_NULL(pattern);
+
+	pattern->m_source = (char *)j_malloc(source.m_len + 1);
+	if (pattern->m_source == NULL) {
+		j_free(pattern);
+		PJ_LOG_ERR("Out of memory");
+		return NULL;
+	}
+	memcpy(pattern->m_source, source.m_str, source.m_len);
+	pattern->m_source[source.m_len] = '\0';
+
+#if USE_POSIX_REGEXP
+	int error = regcomp(&pattern->m_regex, pattern->m_source, REG_EXTENDED | REG_NOSUB);
+	if (error != 0) {
+		char reason[128];
+		regerror(error, &pattern->m_regex, reason, sizeof(reason));
+		PJ_SCHEMA_ERR("Invalid pattern '%s': %s", pattern->m_source, reason);
+		j_free(pattern->m_source);
+		j_free(pattern);
+		return NULL;
+	}
+#else
+	const char *reason;
+	int offset;
+
+	// the schema spec calls for ECMA 262 regular expressions
+	pattern->m_code = pcre_compile(pattern->m_source, PCRE_UTF8 | PCRE_JAVASCRIPT_COMPAT | PCRE_DOLLAR_ENDONLY,
+			&reason, &offset, NULL);
+	if (pattern->m_code == NULL) {
+		PJ_SCHEMA_ERR("Invalid pattern '%s' at offset %d: %s", pattern->m_source, offset, reason);
+		j_free(pattern->m_source);
+		j_free(pattern);
+		return NULL;
+	}
+
+#if PATTERN_JIT
+	pattern->m_extra = pcre_study(pattern->m_code, PCRE_STUDY_JIT_COMPILE, &reason);
+	if (pattern->m_extra != NULL)
+		pcre_assign_jit_stack(pattern->m_extra, thread_jit_stack, NULL);
+#else
+	pattern->m_extra = pcre_study(pattern->m_code, 0, &reason);
+#endif
+	if (pattern->m_extra == NULL && reason != NULL)
+		PJ_SCHEMA_WARN("Failed to study pattern '%s' (it will be matched unoptimized): %s", pattern->m_source, reason);
+#endif /* USE_POSIX_REGEXP */
+
+	return pattern;
+}
+
+bool pattern_match(const SchemaPattern *pattern, raw_buffer str)
+{
+	const char *subject = str.m_str != NULL ? str.m_str : "";
+
+#if USE_POSIX_REGEXP
+#ifdef REG_STARTEND
+	regmatch_t bounds[1];
+
+	bounds[0].rm_so = 0;
+	bounds[0].rm_eo = str.m_len;
+	return regexec(&pattern->m_regex, subject, 1, bounds, REG_STARTEND) == 0;
+#else
+	PatternScratch *scratch = thread_scratch();
+
+	if (UNLIKELY(scratch == NULL))
+		return false;
+	if (scratch->m_capacity < str.m_len + 1) {
+		char *grown = (char *)j_realloc(scratch->m_buffer, str.m_len + 1);
+		CHECK_ALLOC_RETURN_VALUE(grown, false);
+		scratch->m_buffer = grown;
+		scratch->m_capacity = str.m_len + 1;
+	}
+	memcpy(scratch->m_buffer, subject, str.m_len);
+	scratch->m_buffer[str.m_len] = '\0';
+	return regexec(&pattern->m_regex, scratch->m_buffer, 0, NULL, 0) == 0;
+#endif /* REG_STARTEND */
+#else
+	int result;
+
+	if (UNLIKELY(str.m_len > INT_MAX)) {
+		PJ_SCHEMA_ERR("String of %zu bytes is too long to match against pattern '%s'", str.m_len, pattern->m_source);
+		return false;
+	}
+
+	// no captures are needed so PCRE gets no output vector
+	result = pcre_exec(pattern->m_code, pattern->m_extra, subject, (int)str.m_len, 0, 0, NULL, 0);
+	if (result < 0 && result != PCRE_ERROR_NOMATCH)
+		PJ_SCHEMA_WARN("Failed to match pattern '%s' (PCRE error %d)", pattern->m_source, result);
+	return result >= 0;
+#endif /* USE_POSIX_REGEXP */
+}
+
+const char* pattern_source(const SchemaPattern *pattern)
+{
+	return pattern->m_source;
+}
+
+void pattern_release(SchemaPattern *pattern)
+{
+	if (pattern == NULL)
+		return;
+
+#if USE_POSIX_REGEXP
+	regfree(&pattern->m_regex);
+#else
+#ifdef PCRE_STUDY_JIT_COMPILE
+	if (pattern->m_extra != NULL)
+		pcre_free_study(pattern->m_extra);
+#else
+	if (pattern->m_extra != NULL)
+		pcre_free(pattern->m_extra);
+#endif
+	pcre_free(pattern->m_code);
+#endif
+	j_free(pattern->m_source);
+	j_free(pattern);
+}
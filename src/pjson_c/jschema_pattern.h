@@ -0,0 +1,71 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JSCHEMA_PATTERN_H_
+#define JSCHEMA_PATTERN_H_
+
+#include <stdbool.h>
+#include <japi.h>
+#include <jtypes.h>
+#include <compiler/nonnull_attribute.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A compiled "pattern" keyword.  Opaque so that only jschema_pattern.c depends on the regular expression engine.
+ *
+ * A pattern is immutable once compiled & may be matched from any number of threads at once - whatever scratch
+ * space the engine needs for a match is kept per thread.
+ */
+typedef struct SchemaPattern SchemaPattern;
+
+/**
+ * Compile a regular expression from a schema.  With PCRE the pattern is also studied & JIT compiled
+ * (when the library supports it).
+ *
+ * @param source The regular expression (need not be NULL-terminated)
+ * @return The compiled pattern or NULL if the expression is invalid (the reason is logged).
+ */
+PJSON_LOCAL SchemaPattern* pattern_compile(raw_buffer source);
+
+/**
+ * Determine whether a pattern matches anywhere within a string (patterns aren't implicitly anchored).
+ *
+ * @param pattern The compiled pattern
+ * @param str The string to search (need not be NULL-terminated)
+ * @return True if the pattern matches, false if it doesn't (or the engine failed).
+ */
+PJSON_LOCAL bool pattern_match(const SchemaPattern *pattern, raw_buffer str) NON_NULL(1);
+
+/**
+ * @return The regular expression the pattern was compiled from (NULL-terminated, for messages).
+ */
+PJSON_LOCAL const char* pattern_source(const SchemaPattern *pattern) NON_NULL(1);
+
+/**
+ * Free a compiled pattern.
+ */
+PJSON_LOCAL void pattern_release(SchemaPattern *pattern);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSCHEMA_PATTERN_H_ */
@@ -0,0 +1,920 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+/***
+ * A registry of schema files that are parsed, resolved & compiled once and then shared.
+ *
+ * Two locks protect a registry:
+ *    - m_lock (read/write) protects the hash tables & the schema pointer of every entry.  Lookups only ever hold
+ *      it for reading & just long enough to take a reference to a schema.
+ *    - m_updateLock serializes everything that adds or replaces schemas.  Files are parsed & resolved with only
+ *      this lock held - m_lock is taken for writing just to link the finished entries in or to swap a reloaded
+ *      schema in, so readers are never held up by the filesystem or the parser.
+ *
+ * A schema is only published once it is fully resolved & compiled, which makes it immutable apart from its
+ * (atomic) reference count.  Resolving copies the schemas referred to into the schema, so every entry remembers
+ * the references it was resolved with & is rebuilt whenever one of the entries it refers to changes.
+ */
+
+#include <jschema.h>
+#include <jschema_registry.h>
+#include <jobject.h>
+#include "liblog.h"
+#include "jallocator_internal.h"
+#include "jschema_internal.h"
+#include <pjson_pthread.h>
+#include <assert.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define REGISTRY_MIN_BUCKETS 64
+
+#if HAVE_PTHREAD
+#define REGISTRY_READ_LOCK(registry) pthread_rwlock_rdlock(&(registry)->m_lock)
+#define REGISTRY_WRITE_LOCK(registry) pthread_rwlock_wrlock(&(registry)->m_lock)
+#define REGISTRY_UNLOCK(registry) pthread_rwlock_unlock(&(registry)->m_lock)
+#define REGISTRY_BEGIN_UPDATE(registry) pthread_mutex_lock(&(registry)->m_updateLock)
+#define REGISTRY_END_UPDATE(registry) pthread_mutex_unlock(&(registry)->m_updateLock)
+#else
+#define REGISTRY_READ_LOCK(registry) do {} while (0)
+#define REGISTRY_WRITE_LOCK(registry) do {} while (0)
+#define REGISTRY_UNLOCK(registry) do {} while (0)
+#define REGISTRY_BEGIN_UPDATE(registry) do {} while (0)
+#define REGISTRY_END_UPDATE(registry) do {} while (0)
+#endif
+
+/**
+ * The external references a schema was resolved with (names or paths of registered files, as written).
+ */
+typedef struct RegistryRefs {
+	char **m_refs;
+	size_t m_count;
+	size_t m_capacity;
+} RegistryRefs;
+
+typedef struct RegistryEntry {
+	char *m_path; /// the canonical path of the file
+	const char *m_name; /// the file name without the extension (points into m_path)
+	size_t m_pathLen;
+	size_t m_nameLen;
+	uint64_t m_pathHash;
+	uint64_t m_nameHash;
+
+	jschema_ref m_schema; /// the current version - only replaced with m_lock held for writing
+	uint64_t m_contentHash; /// of the contents m_schema was parsed from
+	time_t m_mtime; /// of the file when it was last (re)loaded
+	off_t m_size;
+	RegistryRefs m_refs; /// the references m_schema was resolved with (only used with m_updateLock held)
+	unsigned int m_rebuildRound; /// see entry_rebuild_dependents
+
+	struct RegistryEntry *m_nextByPath;
+	struct RegistryEntry *m_nextByName;
+	struct RegistryEntry *m_nextByContent;
+} RegistryEntry;
+
+struct jschema_registry {
+#if HAVE_PTHREAD
+	pthread_rwlock_t m_lock;
+	pthread_mutex_t m_updateLock;
+#endif
+	RegistryEntry **m_byPath;
+	RegistryEntry **m_byName;
+	RegistryEntry **m_byContent;
+	size_t m_numBuckets; /// always a power of 2
+	size_t m_numEntries;
+	unsigned int m_rebuildRound; /// see entry_rebuild_dependents
+};
+
+/**
+ * The context of the resolver used while loading - references resolve to the schemas being loaded along with
+ * the one being resolved first, then to the ones already registered.
+ */
+typedef struct RegistryResolution {
+	jschema_registry_ref m_registry;
+	RegistryEntry **m_batch;
+	size_t m_batchSize;
+	RegistryEntry *m_reloading; /// the entry being reloaded (if any) ...
+	jschema_ref m_reloadedSchema; /// ... & its new version, which isn't published yet
+} RegistryResolution;
+
+static uint64_t hash_bytes(const void *data, size_t len)
+{
+	const unsigned char *bytes = data;
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static inline size_t bucket(jschema_registry_ref registry, uint64_t hash)
+{
+	return (size_t)hash & (registry->m_numBuckets - 1);
+}
+
+static inline raw_buffer schema_contents(jschema_ref schema)
+{
+	SchemaWrapperRef schemaImpl = (SchemaWrapperRef)schema;
+	return j_str_to_buffer(schemaImpl->m_backingMMap, schemaImpl->m_backingMMapSize);
+}
+
+static bool same_contents(jschema_ref schema, jschema_ref other)
+{
+	raw_buffer contents = schema_contents(schema);
+	raw_buffer otherContents = schema_contents(other);
+
+	return contents.m_len == otherContents.m_len && memcmp(contents.m_str, otherContents.m_str, contents.m_len) == 0;
+}
+
+static bool entry_is(RegistryEntry *entry, const char *key, size_t keyLen)
+{
+	return (keyLen == entry->m_pathLen && memcmp(key, entry->m_path, keyLen) == 0) ||
+		(keyLen == entry->m_nameLen && memcmp(key, entry->m_name, keyLen) == 0);
+}
+
+static void refs_clear(RegistryRefs *refs)
+{
+	for (size_t i = 0; i < refs->m_count; i++)
+		j_free(refs->m_refs[i]);
+	j_free(refs->m_refs);
+	memset(refs, 0, sizeof(RegistryRefs));
+}
+
+/**
+ * @return False if out of memory.
+ */
+static bool refs_add(RegistryRefs *refs, const char *ref, size_t refLen)
+{
+	for (size_t i = 0; i < refs->m_count; i++) {
+		if (strlen(refs->m_refs[i]) == refLen && memcmp(refs->m_refs[i], ref, refLen) == 0)
+			return true;
+	}
+
+	if (refs->m_count == refs->m_capacity) {
+		size_t capacity = (refs->m_capacity != 0 ? refs->m_capacity * 2 : 4);
+		char **grown = j_realloc(refs->m_refs, capacity * sizeof(char *));
+		CHECK_ALLOC_RETURN_VALUE(grown, false);
+		refs->m_refs = grown;
+		refs->m_capacity = capacity;
+	}
+
+	char *copy = j_malloc(refLen + 1);
+	CHECK_ALLOC_RETURN_VALUE(copy, false);
+	memcpy(copy, ref, refLen);
+	copy[refLen] = '\0';
+	refs->m_refs[refs->m_count++] = copy;
+	return true;
+}
+
+/**
+ * @return True if entry was resolved with a reference to dependency.
+ */
+static bool entry_refers_to(RegistryEntry *entry, RegistryEntry *dependency)
+{
+	for (size_t i = 0; i < entry->m_refs.m_count; i++) {
+		if (entry_is(dependency, entry->m_refs.m_refs[i], strlen(entry->m_refs.m_refs[i])))
+			return true;
+	}
+	return false;
+}
+
+static RegistryEntry* find_by_path(jschema_registry_ref registry, const char *path, size_t pathLen)
+{
+	RegistryEntry *entry = registry->m_byPath[bucket(registry, hash_bytes(path, pathLen))];
+
+	while (entry != NULL && (entry->m_pathLen != pathLen || memcmp(entry->m_path, path, pathLen) != 0))
+		entry = entry->m_nextByPath;
+	return entry;
+}
+
+static RegistryEntry* find_by_name(jschema_registry_ref registry, const char *name, size_t nameLen)
+{
+	RegistryEntry *entry = registry->m_byName[bucket(registry, hash_bytes(name, nameLen))];
+
+	while (entry != NULL && (entry->m_nameLen != nameLen || memcmp(entry->m_name, name, nameLen) != 0))
+		entry = entry->m_nextByName;
+	return entry;
+}
+
+/**
+ * @return The entry for key, looking it up as a path first & then as a name.
+ */
+static RegistryEntry* find(jschema_registry_ref registry, const char *key, size_t keyLen)
+{
+	RegistryEntry *entry = find_by_path(registry, key, keyLen);
+	return entry != NULL ? entry : find_by_name(registry, key, keyLen);
+}
+
+/**
+ * @return A registered schema parsed from the same contents as schema (other than skip's) or NULL.
+ */
+static jschema_ref find_by_contents(jschema_registry_ref registry, uint64_t contentHash, jschema_ref schema, RegistryEntry *skip)
+{
+	for (RegistryEntry *entry = registry->m_byContent[bucket(registry, contentHash)]; entry != NULL; entry = entry->m_nextByContent) {
+		if (entry != skip && entry->m_contentHash == contentHash && same_contents(entry->m_schema, schema))
+			return entry->m_schema;
+	}
+	return NULL;
+}
+
+static void link_entry(jschema_registry_ref registry, RegistryEntry *entry)
+{
+	size_t index = bucket(registry, entry->m_pathHash);
+	entry->m_nextByPath = registry->m_byPath[index];
+	registry->m_byPath[index] = entry;
+
+	index = bucket(registry, entry->m_nameHash);
+	entry->m_nextByName = registry->m_byName[index];
+	registry->m_byName[index] = entry;
+
+	index = bucket(registry, entry->m_contentHash);
+	entry->m_nextByContent = registry->m_byContent[index];
+	registry->m_byContent[index] = entry;
+}
+
+static void unlink_contents(jschema_registry_ref registry, RegistryEntry *entry)
+{
+	RegistryEntry **link = &registry->m_byContent[bucket(registry, entry->m_contentHash)];
+
+	while (*link != entry)
+		link = &(*link)->m_nextByContent;
+	*link = entry->m_nextByContent;
+}
+
+/**
+ * Make room for numAdded more entries.  Must hold m_lock for writing.
+ */
+static bool registry_reserve(jschema_registry_ref registry, size_t numAdded)
+{
+	size_t numBuckets = registry->m_numBuckets;
+	RegistryEntry **byPath = registry->m_byPath;
+
+	while (registry->m_numEntries + numAdded > numBuckets)
+		numBuckets *= 2;
+	if (numBuckets == registry->m_numBuckets)
+		return true;
+
+	RegistryEntry **byName = j_calloc(numBuckets, sizeof(RegistryEntry *));
+	RegistryEntry **byContent = j_calloc(numBuckets, sizeof(RegistryEntry *));
+	registry->m_byPath = j_calloc(numBuckets, sizeof(RegistryEntry *));
+	if (UNLIKELY(byName == NULL || byContent == NULL || registry->m_byPath == NULL)) {
+		PJ_LOG_ERR("Out of memory");
+		j_free(byName);
+		j_free(byContent);
+		j_free(registry->m_byPath);
+		registry->m_byPath = byPath;
+		return false;
+	}
+
+	j_free(registry->m_byName);
+	j_free(registry->m_byContent);
+	registry->m_byName = byName;
+	registry->m_byContent = byContent;
+
+	size_t oldNumBuckets = registry->m_numBuckets;
+	registry->m_numBuckets = numBuckets;
+	for (size_t i = 0; i < oldNumBuckets; i++) {
+		RegistryEntry *entry = byPath[i];
+		while (entry != NULL) {
+			RegistryEntry *next = entry->m_nextByPath;
+			link_entry(registry, entry);
+			entry = next;
+		}
+	}
+	j_free(byPath);
+	return true;
+}
+
+/**
+ * @param path The canonical path of the file (ownership is transferred to the entry).
+ */
+static RegistryEntry* entry_create(char *path)
+{
+	RegistryEntry *entry = j_calloc(1, sizeof(RegistryEntry));
+	if (UNLIKELY(entry == NULL)) {
+		PJ_LOG_ERR("Out of memory");
+		free(path);
+		return NULL;
+	}
+
+	const char *name = strrchr(path, '/');
+	const char *extension;
+
+	name = (name != NULL ? name + 1 : path);
+	extension = strrchr(name, '.');
+
+	entry->m_path = path;
+	entry->m_pathLen = strlen(path);
+	entry->m_pathHash = hash_bytes(path, entry->m_pathLen);
+	entry->m_name = name;
+	entry->m_nameLen = (extension != NULL && extension != name ? (size_t)(extension - name) : strlen(name));
+	entry->m_nameHash = hash_bytes(name, entry->m_nameLen);
+	return entry;
+}
+
+static void entry_release(RegistryEntry *entry)
+{
+	if (entry->m_schema != NULL)
+		jschema_release(&entry->m_schema);
+	refs_clear(&entry->m_refs);
+	free(entry->m_path);
+	j_free(entry);
+}
+
+/**
+ * Read, parse & compile the file of the entry.  Everything touched belongs to the entry, so entries may be
+ * loaded on several threads at once.
+ *
+ * @return False if the file isn't a valid schema.
+ */
+static bool entry_load(RegistryEntry *entry)
+{
+	struct stat fileInfo;
+	jschema_ref schema;
+
+	if (stat(entry->m_path, &fileInfo) == -1) {
+		PJ_LOG_WARN("Unable to get information for schema file %s", entry->m_path);
+		return false;
+	}
+
+	schema = jschema_parse_file(entry->m_path, NULL);
+	if (schema == NULL)
+		return false;
+
+	// the parts behind external references are compiled once they have been resolved
+	if (!jschema_compile(schema)) {
+		PJ_LOG_WARN("Schema file %s is not a valid schema", entry->m_path);
+		jschema_release(&schema);
+		return false;
+	}
+
+	raw_buffer contents = schema_contents(schema);
+	entry->m_schema = schema;
+	entry->m_contentHash = hash_bytes(contents.m_str, contents.m_len);
+	entry->m_mtime = fileInfo.st_mtime;
+	entry->m_size = fileInfo.st_size;
+	return true;
+}
+
+#if HAVE_PTHREAD
+typedef struct RegistryLoader {
+	RegistryEntry **m_entries;
+	size_t m_numEntries;
+	size_t m_next; /// the next entry to claim
+	pthread_mutex_t m_lock;
+} RegistryLoader;
+
+static void* loader_worker(void *ctxt)
+{
+	RegistryLoader *loader = ctxt;
+
+	for (;;) {
+		pthread_mutex_lock(&loader->m_lock);
+		size_t i = loader->m_next++;
+		pthread_mutex_unlock(&loader->m_lock);
+
+		if (i >= loader->m_numEntries)
+			break;
+		entry_load(loader->m_entries[i]);
+	}
+	return NULL;
+}
+#endif
+
+/**
+ * Load all of the entries, on nthreads threads (including the calling one) if possible.
+ */
+static void entries_load(RegistryEntry **entries, size_t numEntries, unsigned int nthreads)
+{
+#if HAVE_PTHREAD
+	if (nthreads == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (online > 0 ? (unsigned int)online : 1);
+	}
+	if (nthreads > numEntries)
+		nthreads = numEntries;
+
+	if (nthreads > 1) {
+		RegistryLoader loader = {
+			.m_entries = entries,
+			.m_numEntries = numEntries,
+		};
+		pthread_t *threads = j_calloc(nthreads - 1, sizeof(pthread_t));
+		unsigned int started = 0;
+
+		// lazily initialized - make sure that happens before there is any chance of a race
+		(void)jschema_all();
+
+		pthread_mutex_init(&loader.m_lock, NULL);
+		for (; threads != NULL && started < nthreads - 1; started++) {
+			if (pthread_create(&threads[started], NULL, loader_worker, &loader) != 0) {
+				PJ_LOG_WARN("Failed to start schema loading thread - carrying on with fewer");
+				break;
+			}
+		}
+		loader_worker(&loader);
+		for (unsigned int i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+		pthread_mutex_destroy(&loader.m_lock);
+		j_free(threads);
+		return;
+	}
+#endif
+
+	for (size_t i = 0; i < numEntries; i++)
+		entry_load(entries[i]);
+}
+
+static JSchemaResolutionResult registry_resolve(JSchemaResolverRef resolver, jschema_ref *resolvedSchema)
+{
+	RegistryResolution *resolution = resolver->m_userCtxt;
+	const char *ref = resolver->m_resourceToResolve.m_str;
+	size_t refLen = resolver->m_resourceToResolve.m_len;
+	RegistryEntry *entry = NULL;
+	jschema_ref resolved = NULL;
+
+	if (resolution->m_reloading != NULL && entry_is(resolution->m_reloading, ref, refLen)) {
+		resolved = resolution->m_reloadedSchema;
+	} else {
+		for (size_t i = 0; i < resolution->m_batchSize && resolved == NULL; i++) {
+			entry = resolution->m_batch[i];
+			if (entry != NULL && entry->m_schema != NULL && entry_is(entry, ref, refLen))
+				resolved = entry->m_schema;
+		}
+		// the tables only change with m_updateLock held, which the loading thread holds
+		if (resolved == NULL && (entry = find(resolution->m_registry, ref, refLen)) != NULL)
+			resolved = entry->m_schema;
+	}
+
+	if (resolved == NULL) {
+		PJ_SCHEMA_ERR("No schema %.*s is registered", (int)refLen, ref);
+		return SCHEMA_NOT_FOUND;
+	}
+
+	*resolvedSchema = jschema_copy(resolved);
+	return SCHEMA_RESOLVED;
+}
+
+/**
+ * Resolve every external reference of schema (the entry's new version) & compile what's behind them.
+ *
+ * @param refs Set to the references resolved (only on success).
+ */
+static bool entry_resolve(RegistryResolution *resolution, RegistryEntry *entry, jschema_ref schema, RegistryRefs *refs)
+{
+	struct JSchemaResolver resolver = {
+		.m_resolve = registry_resolve,
+		.m_userCtxt = resolution,
+	};
+	RegistryRefs resolved = { 0 };
+	raw_buffer ref;
+	bool isResolved;
+
+	if (!jschema_resolve_all(schema, &resolver)) {
+		PJ_LOG_WARN("Unable to resolve the references of schema file %s", entry->m_path);
+		return false;
+	}
+
+	// the references are taken from the schema rather than from the resolver calls - a schema shared by
+	// identical files is only resolved (& so only calls the resolver) for the first of them
+	for (size_t i = 0; jschema_reference((SchemaWrapperRef)schema, i, &ref, &isResolved); i++) {
+		// without it the schema wouldn't be rebuilt when what it refers to changes
+		if (isResolved && !refs_add(&resolved, ref.m_str, ref.m_len)) {
+			refs_clear(&resolved);
+			PJ_LOG_WARN("Unable to resolve the references of schema file %s", entry->m_path);
+			return false;
+		}
+	}
+
+	*refs = resolved;
+	return true;
+}
+
+/**
+ * Finish loading a batch of entries & publish them.  Must hold m_updateLock.  The entries that fail are released
+ * (& set to NULL).
+ *
+ * @return The number of entries published.
+ */
+static int entries_register(jschema_registry_ref registry, RegistryEntry **entries, size_t numEntries)
+{
+	RegistryResolution resolution = {
+		.m_registry = registry,
+		.m_batch = entries,
+		.m_batchSize = numEntries,
+	};
+	int numRegistered = 0;
+
+	// identical files share one schema - registered ones first, then earlier ones in the batch
+	for (size_t i = 0; i < numEntries; i++) {
+		RegistryEntry *entry = entries[i];
+		jschema_ref same;
+
+		if (entry->m_schema == NULL)
+			continue;
+
+		same = find_by_contents(registry, entry->m_contentHash, entry->m_schema, NULL);
+		for (size_t j = 0; j < i && same == NULL; j++) {
+			RegistryEntry *other = entries[j];
+			if (other->m_schema != NULL && other->m_contentHash == entry->m_contentHash && same_contents(other->m_schema, entry->m_schema))
+				same = other->m_schema;
+		}
+
+		if (same != NULL) {
+			jschema_release(&entry->m_schema);
+			entry->m_schema = jschema_copy(same);
+		}
+	}
+
+	// all of the batch is parsed before anything is resolved so the files may refer to each other in any order
+	for (size_t i = 0; i < numEntries; i++) {
+		RegistryEntry *entry = entries[i];
+		if (entry->m_schema != NULL && !entry_resolve(&resolution, entry, entry->m_schema, &entry->m_refs)) {
+			jschema_release(&entry->m_schema);
+			entry->m_schema = NULL;
+		}
+	}
+
+	REGISTRY_WRITE_LOCK(registry);
+	bool reserved = registry_reserve(registry, numEntries);
+	for (size_t i = 0; i < numEntries; i++) {
+		if (reserved && entries[i]->m_schema != NULL) {
+			link_entry(registry, entries[i]);
+			registry->m_numEntries++;
+			numRegistered++;
+		} else {
+			entry_release(entries[i]);
+			entries[i] = NULL;
+		}
+	}
+	REGISTRY_UNLOCK(registry);
+
+	return numRegistered;
+}
+
+/**
+ * Re-read the file of a registered entry & publish the new version if it changed.  Must hold m_updateLock.
+ *
+ * @param rebuild Publish a new version even if the file is unchanged (because something it refers to changed).
+ * @param changed Set to whether a new version was published.
+ */
+static bool entry_reload(jschema_registry_ref registry, RegistryEntry *entry, bool rebuild, bool *changed)
+{
+	RegistryEntry fresh = {
+		.m_path = entry->m_path,
+	};
+	RegistryResolution resolution = {
+		.m_registry = registry,
+		.m_reloading = entry,
+	};
+	jschema_ref same;
+
+	*changed = false;
+	if (!entry_load(&fresh))
+		return false;
+
+	if (!rebuild && fresh.m_contentHash == entry->m_contentHash && same_contents(fresh.m_schema, entry->m_schema)) {
+		// touched but not changed
+		jschema_release(&fresh.m_schema);
+		entry->m_mtime = fresh.m_mtime;
+		entry->m_size = fresh.m_size;
+		return true;
+	}
+
+	// a schema with the same contents may have been resolved against the old versions as well
+	same = (rebuild ? NULL : find_by_contents(registry, fresh.m_contentHash, fresh.m_schema, entry));
+	if (same != NULL) {
+		jschema_release(&fresh.m_schema);
+		fresh.m_schema = jschema_copy(same);
+	}
+
+	resolution.m_reloadedSchema = fresh.m_schema;
+	if (!entry_resolve(&resolution, entry, fresh.m_schema, &fresh.m_refs)) {
+		jschema_release(&fresh.m_schema);
+		return false;
+	}
+
+	REGISTRY_WRITE_LOCK(registry);
+	unlink_contents(registry, entry);
+	jschema_ref old = entry->m_schema;
+	entry->m_schema = fresh.m_schema;
+	entry->m_contentHash = fresh.m_contentHash;
+	entry->m_mtime = fresh.m_mtime;
+	entry->m_size = fresh.m_size;
+	size_t index = bucket(registry, entry->m_contentHash);
+	entry->m_nextByContent = registry->m_byContent[index];
+	registry->m_byContent[index] = entry;
+	REGISTRY_UNLOCK(registry);
+
+	refs_clear(&entry->m_refs);
+	entry->m_refs = fresh.m_refs;
+
+	// whoever still uses the old version keeps it alive
+	jschema_release(&old);
+	*changed = true;
+	return true;
+}
+
+/**
+ * Rebuild every entry that refers to changed - directly or through other entries - so that it picks up the new
+ * version.  Each entry is rebuilt at most once, which also stops reference cycles from going round forever.
+ * Must hold m_updateLock.
+ *
+ * @return The number of entries rebuilt.
+ */
+static int entry_rebuild_dependents(jschema_registry_ref registry, RegistryEntry *changed)
+{
+	RegistryEntry **pending;
+	size_t numPending = 0;
+	int numRebuilt = 0;
+
+	// every entry is queued at most once
+	pending = j_malloc(registry->m_numEntries * sizeof(RegistryEntry *));
+	CHECK_ALLOC_RETURN_VALUE(pending, 0);
+
+	registry->m_rebuildRound++;
+	changed->m_rebuildRound = registry->m_rebuildRound;
+	pending[numPending++] = changed;
+
+	while (numPending > 0) {
+		RegistryEntry *dependency = pending[--numPending];
+
+		for (size_t i = 0; i < registry->m_numBuckets; i++) {
+			for (RegistryEntry *entry = registry->m_byPath[i]; entry != NULL; entry = entry->m_nextByPath) {
+				bool rebuilt;
+
+				if (entry->m_rebuildRound == registry->m_rebuildRound || !entry_refers_to(entry, dependency))
+					continue;
+				entry->m_rebuildRound = registry->m_rebuildRound;
+
+				if (!entry_reload(registry, entry, true, &rebuilt)) {
+					PJ_LOG_WARN("Schema file %s keeps the old version of %s", entry->m_path, dependency->m_path);
+					continue;
+				}
+				numRebuilt++;
+				pending[numPending++] = entry;
+			}
+		}
+	}
+
+	j_free(pending);
+	return numRebuilt;
+}
+
+jschema_registry_ref jschema_registry_create(void)
+{
+	jschema_registry_ref registry = j_calloc(1, sizeof(struct jschema_registry));
+	CHECK_ALLOC_RETURN_NULL(registry);
+
+	registry->m_numBuckets = REGISTRY_MIN_BUCKETS;
+	registry->m_byPath = j_calloc(registry->m_numBuckets, sizeof(RegistryEntry *));
+	registry->m_byName = j_calloc(registry->m_numBuckets, sizeof(RegistryEntry *));
+	registry->m_byContent = j_calloc(registry->m_numBuckets, sizeof(RegistryEntry *));
+	if (UNLIKELY(registry->m_byPath == NULL || registry->m_byName == NULL || registry->m_byContent == NULL)) {
+		PJ_LOG_ERR("Out of memory");
+		j_free(registry->m_byPath);
+		j_free(registry->m_byName);
+		j_free(registry->m_byContent);
+		j_free(registry);
+		return NULL;
+	}
+
+#if HAVE_PTHREAD
+	pthread_rwlock_init(&registry->m_lock, NULL);
+	pthread_mutex_init(&registry->m_updateLock, NULL);
+#endif
+	return registry;
+}
+
+void jschema_registry_release(jschema_registry_ref *registry)
+{
+	jschema_registry_ref registryImpl = *registry;
+
+	if (registryImpl == NULL)
+		return;
+
+	for (size_t i = 0; i < registryImpl->m_numBuckets; i++) {
+		RegistryEntry *entry = registryImpl->m_byPath[i];
+		while (entry != NULL) {
+			RegistryEntry *next = entry->m_nextByPath;
+			entry_release(entry);
+			entry = next;
+		}
+	}
+
+#if HAVE_PTHREAD
+	pthread_mutex_destroy(&registryImpl->m_updateLock);
+	pthread_rwlock_destroy(&registryImpl->m_lock);
+#endif
+	j_free(registryImpl->m_byPath);
+	j_free(registryImpl->m_byName);
+	j_free(registryImpl->m_byContent);
+	j_free(registryImpl);
+	*registry = NULL;
+}
+
+static bool is_schema_file(const char *name)
+{
+	const char *extension = strrchr(name, '.');
+	return extension != NULL && extension != name && (strcmp(extension, ".schema") == 0 || strcmp(extension, ".json") == 0);
+}
+
+int jschema_registry_load_dir(jschema_registry_ref registry, const char *dir, unsigned int nthreads)
+{
+	RegistryEntry **entries = NULL;
+	size_t numEntries = 0;
+	size_t capacity = 0;
+	struct dirent *file;
+	int numRegistered = -1;
+	DIR *listing = opendir(dir);
+
+	if (listing == NULL) {
+		PJ_LOG_WARN("Unable to open schema directory %s", dir);
+		return -1;
+	}
+
+	while ((file = readdir(listing)) != NULL) {
+		char path[PATH_MAX];
+		char *canonical;
+		struct stat fileInfo;
+
+		if (!is_schema_file(file->d_name))
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", dir, file->d_name) >= (int)sizeof(path))
+			continue;
+		if (stat(path, &fileInfo) == -1 || !S_ISREG(fileInfo.st_mode) || (canonical = realpath(path, NULL)) == NULL)
+			continue;
+
+		if (numEntries == capacity) {
+			RegistryEntry **grown;
+			capacity = (capacity != 0 ? capacity * 2 : 64);
+			grown = j_realloc(entries, capacity * sizeof(RegistryEntry *));
+			if (UNLIKELY(grown == NULL)) {
+				PJ_LOG_ERR("Out of memory");
+				free(canonical);
+				goto cleanup;
+			}
+			entries = grown;
+		}
+
+		if ((entries[numEntries] = entry_create(canonical)) == NULL)
+			goto cleanup;
+		numEntries++;
+	}
+
+	REGISTRY_BEGIN_UPDATE(registry);
+
+	// already registered files are left as they are
+	size_t numNew = 0;
+	for (size_t i = 0; i < numEntries; i++) {
+		if (find_by_path(registry, entries[i]->m_path, entries[i]->m_pathLen) != NULL)
+			entry_release(entries[i]);
+		else
+			entries[numNew++] = entries[i];
+	}
+	numEntries = numNew;
+
+	entries_load(entries, numEntries, nthreads);
+	numRegistered = entries_register(registry, entries, numEntries);
+	// ownership has moved to the registry
+	numEntries = 0;
+
+	REGISTRY_END_UPDATE(registry);
+
+cleanup:
+	for (size_t i = 0; i < numEntries; i++)
+		entry_release(entries[i]);
+	j_free(entries);
+	closedir(listing);
+	return numRegistered;
+}
+
+jschema_ref jschema_registry_load(jschema_registry_ref registry, const char *path)
+{
+	jschema_ref schema = NULL;
+	RegistryEntry *entry;
+	char *canonical = realpath(path, NULL);
+
+	if (canonical == NULL) {
+		PJ_LOG_WARN("Unable to find schema file %s", path);
+		return NULL;
+	}
+
+	REGISTRY_BEGIN_UPDATE(registry);
+
+	entry = find_by_path(registry, canonical, strlen(canonical));
+	if (entry != NULL) {
+		free(canonical);
+		schema = jschema_copy(entry->m_schema);
+	} else if ((entry = entry_create(canonical)) != NULL) {
+		entry_load(entry);
+		if (entries_register(registry, &entry, 1) == 1)
+			schema = jschema_copy(entry->m_schema);
+	}
+
+	REGISTRY_END_UPDATE(registry);
+	return schema;
+}
+
+jschema_ref jschema_registry_get(jschema_registry_ref registry, const char *key)
+{
+	jschema_ref schema = NULL;
+	RegistryEntry *entry;
+
+	REGISTRY_READ_LOCK(registry);
+	entry = find(registry, key, strlen(key));
+	if (entry != NULL)
+		schema = jschema_copy(entry->m_schema);
+	REGISTRY_UNLOCK(registry);
+
+	if (schema == NULL && strchr(key, '/') != NULL) {
+		// registered under its canonical path
+		char *canonical = realpath(key, NULL);
+		if (canonical != NULL) {
+			REGISTRY_READ_LOCK(registry);
+			entry = find_by_path(registry, canonical, strlen(canonical));
+			if (entry != NULL)
+				schema = jschema_copy(entry->m_schema);
+			REGISTRY_UNLOCK(registry);
+			free(canonical);
+		}
+	}
+
+	return schema;
+}
+
+bool jschema_registry_reload(jschema_registry_ref registry, const char *path)
+{
+	bool reloaded = false;
+	RegistryEntry *entry;
+	char *canonical = realpath(path, NULL);
+
+	if (canonical == NULL) {
+		PJ_LOG_WARN("Unable to find schema file %s", path);
+		return false;
+	}
+
+	REGISTRY_BEGIN_UPDATE(registry);
+	entry = find_by_path(registry, canonical, strlen(canonical));
+	if (entry != NULL) {
+		bool changed;
+		reloaded = entry_reload(registry, entry, false, &changed);
+		if (changed)
+			entry_rebuild_dependents(registry, entry);
+	} else
+		PJ_LOG_WARN("Schema file %s isn't registered", path);
+	REGISTRY_END_UPDATE(registry);
+
+	free(canonical);
+	return reloaded;
+}
+
+int jschema_registry_refresh(jschema_registry_ref registry)
+{
+	int numReloaded = 0;
+
+	REGISTRY_BEGIN_UPDATE(registry);
+	for (size_t i = 0; i < registry->m_numBuckets; i++) {
+		for (RegistryEntry *entry = registry->m_byPath[i]; entry != NULL; entry = entry->m_nextByPath) {
+			struct stat fileInfo;
+
+			if (stat(entry->m_path, &fileInfo) == -1) {
+				PJ_LOG_WARN("Unable to get information for schema file %s - keeping the schema loaded", entry->m_path);
+				continue;
+			}
+			if (fileInfo.st_mtime == entry->m_mtime && fileInfo.st_size == entry->m_size)
+				continue;
+
+			bool changed;
+			if (entry_reload(registry, entry, false, &changed))
+				numReloaded++;
+			if (changed)
+				numReloaded += entry_rebuild_dependents(registry, entry);
+		}
+	}
+	REGISTRY_END_UPDATE(registry);
+
+	return numReloaded;
+}
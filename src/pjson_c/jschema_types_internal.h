@@ -36,6 +36,133 @@ typedef enum {
 
 typedef unsigned int SchemaTypeBitField;
 
+/**
+ * A number from a schema or from the input, converted to the native representation once so that
+ * checking it against limits/enums doesn't need any further parsing.
+ */
+typedef struct SchemaNumber {
+	bool m_isInteger;
+	union {
+		int64_t m_integer;
+		double m_floating;
+	} m_value;
+} SchemaNumber;
+
+/**
+ * A slot of the hash set over the string members of an enum.
+ */
+typedef struct SchemaEnumString {
+	raw_buffer m_str; /// the string from the schema DOM
+	uint32_t m_hash;
+	bool m_used;
+} SchemaEnumString;
+
+/**
+ * One "enum" keyword of a compiled schema.  Every enum that applies at a position must match.
+ */
+typedef struct SchemaEnum {
+	jvalue_ref m_values; /// the enum array straight from the schema DOM (for messages)
+	SchemaEnumString *m_strings; /// open-addressed hash set of the string members of m_values (NULL if there are none)
+	uint32_t m_stringMask; /// size of m_strings - 1
+	SchemaNumber *m_numbers; /// the numeric members of m_values, converted up-front
+	size_t m_numNumbers;
+	bool m_hasNull;
+	bool m_hasTrue;
+	bool m_hasFalse;
+} SchemaEnum;
+
+struct SchemaNode;
+
+/**
+ * A set of the properties of a node - bit i % PROPERTY_BITS_PER_WORD of word i / PROPERTY_BITS_PER_WORD
+ * stands for m_properties[i].
+ */
+typedef uint64_t PropertyBits;
+
+#define PROPERTY_BITS_PER_WORD 64
+#define PROPERTY_BITS_WORDS(numProperties) (((numProperties) + PROPERTY_BITS_PER_WORD - 1) / PROPERTY_BITS_PER_WORD)
+
+/**
+ * A key listed under "properties" somewhere in the schemas that apply to an object.
+ *
+ * Keys that some property requires but that aren't listed themselves get a property as well (with the
+ * additionalProperties schema) so that every key the validator needs to know about has a slot.
+ */
+typedef struct SchemaProperty {
+	jvalue_ref m_key; /// the key string from the schema DOM
+	raw_buffer m_keyBuf; /// m_key's characters (for comparing against the input)
+	uint32_t m_hash;
+	struct SchemaNode *m_schema; /// the schema for the value - NULL if some schema in the chain rejects the key
+	jvalue_ref m_default; /// the value to inject if the key is missing (NULL if there's none)
+	jvalue_ref m_requires; /// array of the keys that must be present if this one is (as found in the schema)
+	uint32_t *m_requiredSlots; /// the m_properties slots of m_requires
+	size_t m_numRequiredSlots;
+	bool m_required; /// whether the key must be present (i.e. it isn't optional)
+} SchemaProperty, * SchemaPropertyRef;
+
+typedef enum {
+	SCHEMA_NODE_COMPILED = 1,
+	SCHEMA_NODE_INVALID = 2,
+} SchemaNodeFlags;
+
+/**
+ * The compiled form of everything that a value at a single position in the input must satisfy.
+ *
+ * A node is created from the schema DOM(s) that apply at its position.  When it is compiled, $ref & extends
+ * are expanded into m_chain and every keyword across the chain is folded into the fields below, so that
+ * validation never has to look at the schema DOM again.  The nodes for the values nested within are only created
+ * (uncompiled) at that point - they get compiled the first time the input (or jschema_compile) reaches them.
+ */
+typedef struct SchemaNode {
+	unsigned int m_flags; /// SchemaNodeFlags
+	jvalue_ref m_sources; /// array of the schema DOMs the node was created from (released once compiled)
+	jvalue_ref m_chain; /// array of every schema DOM that applies here once $ref & extends are expanded
+
+	SchemaTypeBitField m_allowedTypes; /// the types allowed by every schema in the chain
+	SchemaTypeBitField m_disallowedTypes; /// the types disallowed by any schema in the chain
+
+	int64_t m_minLength;
+	int64_t m_maxLength;
+
+	bool m_hasMinimum;
+	bool m_hasMaximum;
+	SchemaNumber m_minimum;
+	SchemaNumber m_maximum;
+
+	SchemaEnum *m_enums;
+	size_t m_numEnums;
+
+	struct SchemaPattern **m_patterns; /// every "pattern" in the chain, compiled (a string must match all of them)
+	size_t m_numPatterns;
+
+	SchemaProperty *m_properties;
+	size_t m_numProperties;
+	int32_t *m_propertyTable; /// open-addressed index into m_properties keyed by the key hash (-1 marks an empty slot)
+	uint32_t m_propertyMask; /// size of m_propertyTable - 1
+	uint32_t m_propertySeed; /// the hash seed m_propertyTable was laid out with
+	PropertyBits *m_requiredKeys; /// the properties that must be present (PROPERTY_BITS_WORDS(m_numProperties) words)
+	PropertyBits *m_dependentKeys; /// the properties that require others to be present (same size, same allocation)
+	struct SchemaNode *m_additionalProperties; /// the schema for keys not in m_properties - NULL if they aren't allowed
+
+	struct SchemaNode **m_items; /// tuple-typed schemas for the first m_numItems elements (NULL entries are rejected)
+	size_t m_numItems;
+	struct SchemaNode *m_additionalItems; /// the schema for the remaining elements - NULL if there can't be any
+	int64_t m_minItems;
+	int64_t m_maxItems;
+
+	struct SchemaNode *m_next; /// the next node owned by the same schema
+} SchemaNode, * SchemaNodeRef;
+
+/**
+ * An external reference ($ref) encountered while compiling a schema.  Resolved once per root schema
+ * no matter how many places (or documents) use it.
+ */
+typedef struct SchemaReference {
+	raw_buffer m_ref; /// the reference string (owned)
+	struct jschema *m_resolved; /// what the resolver returned for it (NULL until first resolved)
+	SchemaNodeRef m_node; /// the node shared by every value whose schema is just this reference
+} SchemaReference;
+
 /**
  * This structure & any nestested structures (included jvalues)
  * cannot be changed while parsing except to resolve external references
@@ -51,18 +178,40 @@ typedef struct jschema {
 #endif
 	const char *m_backingMMap;
 	size_t m_backingMMapSize;
+	SchemaNodeRef m_root; /// the compiled form of m_validation (created on first use)
+	SchemaNodeRef m_nodes; /// every node compiled for this schema, released along with it
+	SchemaReference *m_references; /// cache of the external references - the compiled nodes point into what they resolved to
+	size_t m_numReferences;
+	size_t m_referencesCapacity;
 } SchemaWrapper, * SchemaWrapperRef;
 
 typedef struct SchemaState {
 	SchemaTypeBitField m_allowedTypes; /// bit-field lookup summary of the high-level types allowed in this position. "minimized" to the concrete type when input is provided
-	SchemaTypeBitField m_disallowedTypes; /// bit-field lookup summary of the high-level types not allowed in this position.
-	SchemaWrapperRef m_schema; /// the schema at the current spot to validate against
+	SchemaNodeRef m_node; /// the (compiled) schema at the current spot to validate against
 	struct SchemaState *m_parent;	/// the state to pop up to when this state has matched/been invalidated
-	jvalue_ref m_seenKeys; /// an array of strings representing the keys that were seen for this object.  Implies m_types is ST_OBJ
+	PropertyBits *m_seenKeys; /// the properties of m_node seen in this object (m_seenKeysInline or m_seenKeysBuffer).  Implies m_types is ST_OBJ
+	PropertyBits m_seenKeysInline; /// the properties seen for objects with no more than PROPERTY_BITS_PER_WORD of them
+	PropertyBits *m_seenKeysBuffer; /// the properties seen for larger objects - kept for whichever state reuses this slot
+	size_t m_seenKeysCapacity; /// the number of words m_seenKeysBuffer has room for
 	size_t m_numItems; /// a counter of the number of elements in this array.  Implies m_types is ST_ARR
 	bool m_arrayOpened; /// whether or not the array schema got the opening bracket (to differentiate between when the array opens and a nested array)
 } * SchemaStateRef;
 
+/** the number of states allocated at a time for the stack of a validation */
+#define SCHEMA_STATE_BLOCK_SIZE 32
+
+/**
+ * A run of the stack of states of a validation.  The states only ever nest, so they're taken & given back in
+ * order.  Blocks are never moved (states point at their parents) or freed until the validation state is
+ * destroyed, so once a validation has been as deep as a document goes, validating more of them doesn't allocate.
+ */
+typedef struct SchemaStateBlock {
+	struct SchemaStateBlock *m_prev;
+	struct SchemaStateBlock *m_next;
+	size_t m_used; /// how many of m_states are on the stack
+	struct SchemaState m_states[SCHEMA_STATE_BLOCK_SIZE];
+} SchemaStateBlock;
+
 typedef struct SchemaResolution {
 	JSchemaResolverRef m_resolver;
 	JErrorCallbacksRef m_errorHandler;
@@ -76,6 +225,8 @@ typedef struct SchemaResolution {
 
 typedef struct ValidationState {
 	SchemaStateRef m_state;
+	SchemaStateBlock *m_stateBlock; /// the block m_state is in (or the first block if the stack is empty)
+	SchemaWrapperRef m_schema; /// the schema being validated against - owns the nodes the states point to
 	struct SchemaResolution m_resolutionHandlers;
 #if TRACK_SCHEMA_PARSING
 	bool m_parsingSchema;
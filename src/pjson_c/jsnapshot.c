@@ -0,0 +1,604 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include <jsnapshot.h>
+#include <jobject.h>
+#include "liblog.h"
+#include "jallocator_internal.h"
+#include "jobject_internal.h"
+#include "jsnapshot_internal.h"
+#include "jparse_stream_internal.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * A snapshot is a header followed by nodes & string data, all aligned to 8 bytes:
+ *
+ * - every value is a fixed size node; scalars are stored in the node itself (strings & raw numbers by offset)
+ * - an array points to a table of its elements' nodes
+ * - an object points to a table of key & value node pairs, sorted by key (bytewise, shorter first)
+ * - strings are followed by a terminating NUL that isn't counted in their length
+ *
+ * Offsets are from the start of the file, so it can be mapped at any address.  A container's table always comes
+ * after the container's node, which keeps a corrupt snapshot from looping back on itself.
+ */
+
+#define SNAPSHOT_MAGIC "PBNJSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER UINT32_C(0x01020304)
+#define SNAPSHOT_ALIGNMENT 8
+
+typedef enum {
+	SNAP_NULL = 0,
+	SNAP_FALSE,
+	SNAP_TRUE,
+	SNAP_INTEGER,
+	SNAP_FLOAT,
+	SNAP_RAW,	/// a number kept as the text it was parsed from
+	SNAP_STRING,
+	SNAP_ARRAY,
+	SNAP_OBJECT,
+} SnapshotType;
+
+#define SNAP_ESCAPE_FREE 1
+
+struct jsnapshot_node {
+	uint32_t m_type;
+	uint32_t m_flags;
+	uint64_t m_count;	/// bytes in a string or raw number, elements in an array, members in an object
+	union {
+		int64_t integer;
+		double floating;
+		uint64_t offset;	/// of the bytes of a string or raw number, or of the table of a container
+	} m_value;
+};
+
+typedef struct jsnapshot_node jsnapshot_node;
+
+typedef struct {
+	char m_magic[8];
+	uint32_t m_version;
+	uint32_t m_byteOrder;	/// SNAPSHOT_BYTE_ORDER as written by the machine that saved it
+	uint64_t m_size;	/// of the whole file
+	jsnapshot_node m_root;
+} jsnapshot_header;
+
+typedef struct SnapshotWriter {
+	char *m_data;
+	size_t m_length;
+	size_t m_capacity;
+} SnapshotWriter;
+
+#define WRITER_NODE(writer, offset) ((jsnapshot_node *)((writer)->m_data + (offset)))
+
+/**
+ * Append zeroed, aligned space to the snapshot.  Any pointer into the data is invalidated.
+ */
+static bool snapshot_alloc(SnapshotWriter *writer, size_t length, uint64_t *offset)
+{
+	size_t start = (writer->m_length + SNAPSHOT_ALIGNMENT - 1) & ~(size_t)(SNAPSHOT_ALIGNMENT - 1);
+	size_t end = start + length;
+	size_t capacity;
+	char *data;
+
+	CHECK_CONDITION_RETURN_VALUE(end < start, false, "Snapshot too big");
+
+	if (end > writer->m_capacity) {
+		capacity = writer->m_capacity * 2;
+		if (capacity < end)
+			capacity = end;
+
+		data = j_realloc(writer->m_data, capacity);
+		CHECK_ALLOC_RETURN_VALUE(data, false);
+
+		writer->m_data = data;
+		writer->m_capacity = capacity;
+	}
+
+	memset(writer->m_data + writer->m_length, 0, end - writer->m_length);
+	writer->m_length = end;
+	*offset = start;
+	return true;
+}
+
+static bool snapshot_put_bytes(SnapshotWriter *writer, uint64_t node, raw_buffer bytes)
+{
+	uint64_t offset;
+
+	if (UNLIKELY(!snapshot_alloc(writer, bytes.m_len + 1, &offset)))
+		return false;
+
+	memcpy(writer->m_data + offset, bytes.m_str, bytes.m_len);
+	WRITER_NODE(writer, node)->m_count = bytes.m_len;
+	WRITER_NODE(writer, node)->m_value.offset = offset;
+	return true;
+}
+
+static int compare_keys(raw_buffer key1, raw_buffer key2)
+{
+	int order = memcmp(key1.m_str, key2.m_str, key1.m_len < key2.m_len ? key1.m_len : key2.m_len);
+
+	if (order != 0)
+		return order;
+	return key1.m_len < key2.m_len ? -1 : key1.m_len > key2.m_len;
+}
+
+static int compare_members(const void *member1, const void *member2)
+{
+	return compare_keys(jstring_get_fast(((const jobject_key_value *)member1)->key),
+	                    jstring_get_fast(((const jobject_key_value *)member2)->key));
+}
+
+static bool snapshot_put_value(SnapshotWriter *writer, uint64_t node, jvalue_ref val);
+
+static bool snapshot_put_array(SnapshotWriter *writer, uint64_t node, jvalue_ref arr)
+{
+	ssize_t size = jarray_size(arr);
+	uint64_t table;
+
+	if (UNLIKELY(!snapshot_alloc(writer, size * sizeof(jsnapshot_node), &table)))
+		return false;
+
+	WRITER_NODE(writer, node)->m_type = SNAP_ARRAY;
+	WRITER_NODE(writer, node)->m_count = size;
+	WRITER_NODE(writer, node)->m_value.offset = table;
+
+	for (ssize_t i = 0; i < size; i++) {
+		if (UNLIKELY(!snapshot_put_value(writer, table + i * sizeof(jsnapshot_node), jarray_get(arr, i))))
+			return false;
+	}
+	return true;
+}
+
+static bool snapshot_put_object(SnapshotWriter *writer, uint64_t node, jvalue_ref obj)
+{
+	size_t size = jobject_size(obj);
+	jobject_key_value *members;
+	uint64_t table;
+	size_t i = 0;
+	bool result = false;
+
+	members = j_malloc((size ? size : 1) * sizeof(jobject_key_value));
+	CHECK_ALLOC_RETURN_VALUE(members, false);
+
+	for (jobject_iter it = jobj_iter_init(obj); jobj_iter_is_valid(it) && i < size; it = jobj_iter_next(it))
+		jobj_iter_deref(it, &members[i++]);
+	assert(i == size);
+
+	qsort(members, size, sizeof(jobject_key_value), compare_members);
+
+	if (UNLIKELY(!snapshot_alloc(writer, 2 * size * sizeof(jsnapshot_node), &table)))
+		goto done;
+
+	WRITER_NODE(writer, node)->m_type = SNAP_OBJECT;
+	WRITER_NODE(writer, node)->m_count = size;
+	WRITER_NODE(writer, node)->m_value.offset = table;
+
+	for (i = 0; i < size; i++) {
+		uint64_t keyNode = table + 2 * i * sizeof(jsnapshot_node);
+		if (UNLIKELY(!snapshot_put_value(writer, keyNode, members[i].key)))
+			goto done;
+		if (UNLIKELY(!snapshot_put_value(writer, keyNode + sizeof(jsnapshot_node), members[i].value)))
+			goto done;
+	}
+	result = true;
+
+done:
+	j_free(members);
+	return result;
+}
+
+static bool snapshot_put_value(SnapshotWriter *writer, uint64_t node, jvalue_ref val)
+{
+	switch (val->m_type) {
+		case JV_NULL:
+			WRITER_NODE(writer, node)->m_type = SNAP_NULL;
+			return true;
+		case JV_BOOL:
+			WRITER_NODE(writer, node)->m_type = jboolean_deref(val) ? SNAP_TRUE : SNAP_FALSE;
+			return true;
+		case JV_NUM:
+			switch (val->value.val_num.m_type) {
+				case NUM_INT:
+					WRITER_NODE(writer, node)->m_type = SNAP_INTEGER;
+					WRITER_NODE(writer, node)->m_value.integer = val->value.val_num.value.integer;
+					return true;
+				case NUM_FLOAT:
+					WRITER_NODE(writer, node)->m_type = SNAP_FLOAT;
+					WRITER_NODE(writer, node)->m_value.floating = val->value.val_num.value.floating;
+					return true;
+				case NUM_RAW:
+					WRITER_NODE(writer, node)->m_type = SNAP_RAW;
+					return snapshot_put_bytes(writer, node, jnumber_deref_raw(val));
+				default:
+					PJ_LOG_ERR("internal error - numeric type is unrecognized (%d)", (int)val->value.val_num.m_type);
+					return false;
+			}
+		case JV_STR:
+			WRITER_NODE(writer, node)->m_type = SNAP_STRING;
+			WRITER_NODE(writer, node)->m_flags = val->value.val_str.m_escapeFree ? SNAP_ESCAPE_FREE : 0;
+			return snapshot_put_bytes(writer, node, jstring_get_fast(val));
+		case JV_ARRAY:
+			return snapshot_put_array(writer, node, val);
+		case JV_OBJECT:
+			return snapshot_put_object(writer, node, val);
+		default:
+			PJ_LOG_ERR("internal error - value type is unrecognized (%d)", (int)val->m_type);
+			return false;
+	}
+}
+
+static bool snapshot_write_file(const char *path, const char *data, size_t length)
+{
+	size_t pathLen = strlen(path);
+	char *temporary;
+	int fd;
+	bool result = false;
+
+	temporary = j_malloc(pathLen + sizeof(".tmp"));
+	CHECK_ALLOC_RETURN_VALUE(temporary, false);
+	memcpy(temporary, path, pathLen);
+	memcpy(temporary + pathLen, ".tmp", sizeof(".tmp"));
+
+	fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		PJ_LOG_WARN("Failed to create snapshot '%s' (%d) : %s", temporary, errno, strerror(errno));
+		j_free(temporary);
+		return false;
+	}
+
+	while (length > 0) {
+		ssize_t written = write(fd, data, length);
+		if (written == -1) {
+			if (errno == EINTR)
+				continue;
+			PJ_LOG_WARN("Failed to write snapshot '%s' (%d) : %s", temporary, errno, strerror(errno));
+			goto done;
+		}
+		data += written;
+		length -= written;
+	}
+
+	if (close(fd) == -1) {
+		fd = -1;
+		PJ_LOG_WARN("Failed to write snapshot '%s' (%d) : %s", temporary, errno, strerror(errno));
+		goto done;
+	}
+	fd = -1;
+
+	if (rename(temporary, path) == -1) {
+		PJ_LOG_WARN("Failed to replace snapshot '%s' (%d) : %s", path, errno, strerror(errno));
+		goto done;
+	}
+	result = true;
+
+done:
+	if (fd != -1)
+		close(fd);
+	if (!result)
+		unlink(temporary);
+	j_free(temporary);
+	return result;
+}
+
+bool jvalue_save_snapshot(jvalue_ref val, const char *path)
+{
+	SnapshotWriter writer = { 0 };
+	jsnapshot_header *header;
+	uint64_t offset;
+	bool result;
+
+	CHECK_POINTER_RETURN_VALUE(path, false);
+	if (val == NULL)
+		val = jnull();
+
+	if (UNLIKELY(!snapshot_alloc(&writer, sizeof(jsnapshot_header), &offset)))
+		return false;
+	assert(offset == 0);
+
+	if (UNLIKELY(!snapshot_put_value(&writer, offsetof(jsnapshot_header, m_root), val))) {
+		j_free(writer.m_data);
+		return false;
+	}
+
+	header = (jsnapshot_header *)writer.m_data;
+	memcpy(header->m_magic, SNAPSHOT_MAGIC, sizeof(header->m_magic));
+	header->m_version = SNAPSHOT_VERSION;
+	header->m_byteOrder = SNAPSHOT_BYTE_ORDER;
+	header->m_size = writer.m_length;
+
+	result = snapshot_write_file(path, writer.m_data, writer.m_length);
+	j_free(writer.m_data);
+	return result;
+}
+
+/**
+ * Find what a node refers to, making sure it's within the mapping.
+ */
+static const char* snapshot_data(const char *base, size_t size, const jsnapshot_node *node, size_t itemSize)
+{
+	uint64_t offset = node->m_value.offset;
+
+	if (UNLIKELY(offset > size || offset % SNAPSHOT_ALIGNMENT != 0 ||
+	             node->m_count > (size - offset) / itemSize)) {
+		PJ_LOG_WARN("Corrupt snapshot - node %p refers to data outside of the file", node);
+		return NULL;
+	}
+	return base + offset;
+}
+
+static raw_buffer snapshot_bytes(const char *base, size_t size, const jsnapshot_node *node)
+{
+	const char *bytes = snapshot_data(base, size, node, 1);
+
+	// there's always a terminating NUL after the bytes
+	if (bytes == NULL || bytes + node->m_count == base + size)
+		return j_str_to_buffer(NULL, 0);
+	return j_str_to_buffer(bytes, node->m_count);
+}
+
+/**
+ * Turn a node into a value.
+ *
+ * @return The value, or NULL if the snapshot is corrupt.
+ */
+static jvalue_ref snapshot_value(const char *base, size_t size, const jsnapshot_node *node)
+{
+	jvalue_ref result;
+	raw_buffer bytes;
+
+	switch (node->m_type) {
+		case SNAP_NULL:
+			return jnull();
+		case SNAP_FALSE:
+		case SNAP_TRUE:
+			return jboolean_create(node->m_type == SNAP_TRUE);
+		case SNAP_INTEGER:
+			return jnumber_create_i64(node->m_value.integer);
+		case SNAP_FLOAT:
+			return jnumber_create_f64(node->m_value.floating);
+		case SNAP_RAW:
+			bytes = snapshot_bytes(base, size, node);
+			if (bytes.m_str == NULL || bytes.m_len == 0)
+				return NULL;
+			return jnumber_create_unsafe(bytes, NULL);
+		case SNAP_STRING:
+			bytes = snapshot_bytes(base, size, node);
+			if (bytes.m_str == NULL)
+				return NULL;
+			result = jstring_create_nocopy(bytes);
+			if ((node->m_flags & SNAP_ESCAPE_FREE) && jis_string(result))
+				jstring_set_escape_free(result);
+			return result;
+		case SNAP_ARRAY:
+		case SNAP_OBJECT:
+			// a table is always written after the node referring to it, so offsets only grow on the way down -
+			// one that doesn't could lead back to the node itself (or one of its parents) & nest forever
+			if (UNLIKELY(node->m_value.offset < (uint64_t)((const char *)node - base) + sizeof(jsnapshot_node))) {
+				PJ_LOG_WARN("Corrupt snapshot - node %p refers back to offset %" PRIu64, node, node->m_value.offset);
+				return NULL;
+			}
+			if (snapshot_data(base, size, node, (node->m_type == SNAP_OBJECT ? 2 : 1) * sizeof(jsnapshot_node)) == NULL)
+				return NULL;
+			result = jvalue_create(node->m_type == SNAP_OBJECT ? JV_OBJECT : JV_ARRAY);
+			CHECK_POINTER_RETURN_NULL(result);
+			result->m_snapshot = true;
+			result->value.val_snap.m_base = base;
+			result->value.val_snap.m_size = size;
+			result->value.val_snap.m_node = node;
+			return result;
+		default:
+			PJ_LOG_WARN("Corrupt snapshot - node %p has unknown type %" PRIu32, node, node->m_type);
+			return NULL;
+	}
+}
+
+#define DEREF_SNAP(ref) ((ref)->value.val_snap)
+
+static inline const jsnapshot_node* snapshot_table(jvalue_ref container)
+{
+	return (const jsnapshot_node *)(DEREF_SNAP(container).m_base + DEREF_SNAP(container).m_node->m_value.offset);
+}
+
+size_t jsnapshot_size(jvalue_ref container)
+{
+	assert(container->m_snapshot);
+	return DEREF_SNAP(container).m_node->m_count;
+}
+
+jvalue_ref jsnapshot_array_get(jvalue_ref arr, size_t index)
+{
+	jvalue_ref *element;
+
+	assert(arr->m_snapshot && jis_array(arr));
+	assert(index < jsnapshot_size(arr));
+
+	if (DEREF_SNAP(arr).m_elements == NULL) {
+		DEREF_SNAP(arr).m_elements = j_calloc_with(arr->m_allocator, jsnapshot_size(arr), sizeof(jvalue_ref));
+		CHECK_ALLOC_RETURN_VALUE(DEREF_SNAP(arr).m_elements, jnull());
+	}
+
+	element = &DEREF_SNAP(arr).m_elements[index];
+	if (*element == NULL) {
+		*element = snapshot_value(DEREF_SNAP(arr).m_base, DEREF_SNAP(arr).m_size, &snapshot_table(arr)[index]);
+		if (*element == NULL)
+			return jnull();
+	}
+	return *element;
+}
+
+static bool snapshot_allocate_members(jvalue_ref obj)
+{
+	if (DEREF_SNAP(obj).m_members == NULL) {
+		// zeroed so that the list head (past the last member) has no key
+		DEREF_SNAP(obj).m_members = j_calloc_with(obj->m_allocator, jsnapshot_size(obj) + 1, sizeof(jo_keyval_iter));
+		CHECK_ALLOC_RETURN_VALUE(DEREF_SNAP(obj).m_members, false);
+	}
+	return true;
+}
+
+static bool snapshot_member_value(jvalue_ref obj, size_t index)
+{
+	jobject_key_value *entry = &DEREF_SNAP(obj).m_members[index].entry;
+
+	if (entry->value == NULL)
+		entry->value = snapshot_value(DEREF_SNAP(obj).m_base, DEREF_SNAP(obj).m_size, &snapshot_table(obj)[2 * index + 1]);
+	return entry->value != NULL;
+}
+
+jvalue_ref jsnapshot_object_get(jvalue_ref obj, raw_buffer key)
+{
+	const jsnapshot_node *table = snapshot_table(obj);
+	size_t low = 0, high = jsnapshot_size(obj);
+
+	assert(obj->m_snapshot && jis_object(obj));
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		raw_buffer candidate = snapshot_bytes(DEREF_SNAP(obj).m_base, DEREF_SNAP(obj).m_size, &table[2 * middle]);
+		int order;
+
+		if (UNLIKELY(candidate.m_str == NULL || table[2 * middle].m_type != SNAP_STRING))
+			return NULL;
+
+		order = compare_keys(key, candidate);
+		if (order == 0) {
+			if (!snapshot_allocate_members(obj) || !snapshot_member_value(obj, middle))
+				return jnull();
+			return DEREF_SNAP(obj).m_members[middle].entry.value;
+		}
+		if (order < 0)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	return NULL;
+}
+
+list_head* jsnapshot_object_members(jvalue_ref obj)
+{
+	size_t size = jsnapshot_size(obj);
+	jo_keyval_iter *members;
+
+	assert(obj->m_snapshot && jis_object(obj));
+
+	if (DEREF_SNAP(obj).m_linked)
+		return &DEREF_SNAP(obj).m_members[size].list;
+
+	if (!snapshot_allocate_members(obj))
+		return NULL;
+	members = DEREF_SNAP(obj).m_members;
+
+	for (size_t i = 0; i < size; i++) {
+		if (members[i].entry.key == NULL) {
+			const jsnapshot_node *keyNode = &snapshot_table(obj)[2 * i];
+			if (UNLIKELY(keyNode->m_type != SNAP_STRING || keyNode->m_count == 0)) {
+				PJ_LOG_WARN("Corrupt snapshot - key %p isn't a string", keyNode);
+				return NULL;
+			}
+			members[i].entry.key = snapshot_value(DEREF_SNAP(obj).m_base, DEREF_SNAP(obj).m_size, keyNode);
+			if (members[i].entry.key == NULL)
+				return NULL;
+			// keys can't be removed through iterators
+			members[i].entry.key->m_snapshot = true;
+		}
+		if (!snapshot_member_value(obj, i))
+			return NULL;
+	}
+
+	INIT_LIST_HEAD(&members[size].list);
+	for (size_t i = 0; i < size; i++)
+		ladd_tail(&members[i].list, &members[size].list);
+	DEREF_SNAP(obj).m_linked = true;
+
+	return &members[size].list;
+}
+
+void jsnapshot_destroy(jvalue_ref container)
+{
+	size_t size = jsnapshot_size(container);
+
+	assert(container->m_snapshot);
+
+	if (DEREF_SNAP(container).m_elements) {
+		for (size_t i = 0; i < size; i++)
+			j_release(&DEREF_SNAP(container).m_elements[i]);
+		j_free_with(container->m_allocator, DEREF_SNAP(container).m_elements);
+	}
+
+	if (DEREF_SNAP(container).m_members) {
+		for (size_t i = 0; i < size; i++) {
+			j_release(&DEREF_SNAP(container).m_members[i].entry.key);
+			j_release(&DEREF_SNAP(container).m_members[i].entry.value);
+		}
+		j_free_with(container->m_allocator, DEREF_SNAP(container).m_members);
+	}
+}
+
+jvalue_ref jvalue_open_snapshot(const char *path)
+{
+	const jsnapshot_header *header;
+	raw_buffer input;
+	jvalue_ref result;
+
+	CHECK_POINTER_RETURN_NULL(path);
+
+	if (!jparse_load_file(path, JFileOptMMap, &input))
+		return jnull();
+
+	header = (const jsnapshot_header *)input.m_str;
+	if (input.m_len < sizeof(jsnapshot_header) || memcmp(header->m_magic, SNAPSHOT_MAGIC, sizeof(header->m_magic)) != 0) {
+		PJ_LOG_WARN("'%s' isn't a snapshot", path);
+		goto failure;
+	}
+	if (header->m_version != SNAPSHOT_VERSION || header->m_byteOrder != SNAPSHOT_BYTE_ORDER) {
+		PJ_LOG_WARN("Snapshot '%s' was saved by an incompatible version or on a machine with a different byte order", path);
+		goto failure;
+	}
+	if (header->m_size != (uint64_t)input.m_len) {
+		PJ_LOG_WARN("Snapshot '%s' is truncated", path);
+		goto failure;
+	}
+
+	result = snapshot_value(input.m_str, input.m_len, &header->m_root);
+	if (result == NULL)
+		goto failure;
+
+	if (!result->m_snapshot) {
+		// scalars don't keep the mapping alive
+		jvalue_ref copy = jvalue_duplicate(result);
+		j_release(&result);
+		jparse_unload_file(input, JFileOptMMap);
+		return copy;
+	}
+
+	result->m_backingBuffer = input;
+	result->m_backingBufferMMap = true;
+	return result;
+
+failure:
+	jparse_unload_file(input, JFileOptMMap);
+	return jnull();
+}
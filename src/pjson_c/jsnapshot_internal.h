@@ -0,0 +1,57 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JSNAPSHOT_INTERNAL_H_
+#define JSNAPSHOT_INTERNAL_H_
+
+#include <japi.h>
+#include <jtypes.h>
+#include "jobject_internal.h"
+
+/*
+ * Access to arrays & objects that are views of a snapshot (m_snapshot is set), for jobject.c.
+ */
+
+/**
+ * The number of elements/members.
+ */
+PJSON_LOCAL size_t jsnapshot_size(jvalue_ref container);
+
+/**
+ * @return The element (owned by the array) or a JSON null if it couldn't be read from the snapshot.
+ */
+PJSON_LOCAL jvalue_ref jsnapshot_array_get(jvalue_ref arr, size_t index);
+
+/**
+ * @return The value of the member (owned by the object), or NULL if there is no such key.
+ */
+PJSON_LOCAL jvalue_ref jsnapshot_object_get(jvalue_ref obj, raw_buffer key);
+
+/**
+ * Create every member of the object & link them for iteration (in key order).
+ *
+ * @return The head of the list, or NULL if the members couldn't be read from the snapshot.
+ */
+PJSON_LOCAL list_head* jsnapshot_object_members(jvalue_ref obj);
+
+/**
+ * Release the members created so far.
+ */
+PJSON_LOCAL void jsnapshot_destroy(jvalue_ref container);
+
+#endif /* JSNAPSHOT_INTERNAL_H_ */
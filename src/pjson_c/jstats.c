@@ -0,0 +1,157 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include <jstats.h>
+#include "liblog.h"
+#include "jallocator_internal.h"
+#include "jstats_internal.h"
+#include <pjson_pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+bool jstats_collecting = false;
+
+#if HAVE_PTHREAD
+/**
+ * Every thread that has counted something has a block of its own, linked into a list so they can be added up.
+ * When the thread exits its counts are folded into retired.
+ */
+typedef struct ThreadStats {
+	jstats m_counts;
+	struct ThreadStats *m_prev;
+	struct ThreadStats *m_next;
+} ThreadStats;
+
+static pthread_mutex_t threadsLock = PTHREAD_MUTEX_INITIALIZER;
+static ThreadStats *threads = NULL;
+static jstats retired;
+
+static pthread_key_t statsKey;
+static pthread_once_t statsKeyOnce = PTHREAD_ONCE_INIT;
+static bool statsKeyValid = false;
+#else
+static jstats counts;
+#endif
+
+static void jstats_add(jstats *total, const jstats *counts)
+{
+	// every member is a counter
+	uint64_t *to = (uint64_t *)total;
+	const uint64_t *from = (const uint64_t *)counts;
+	for (size_t i = 0; i < sizeof(jstats) / sizeof(uint64_t); i++)
+		to[i] += from[i];
+}
+
+#if HAVE_PTHREAD
+static void thread_stats_free(void *stats)
+{
+	ThreadStats *thread = (ThreadStats *)stats;
+
+	pthread_mutex_lock(&threadsLock);
+	jstats_add(&retired, &thread->m_counts);
+	if (thread->m_prev != NULL)
+		thread->m_prev->m_next = thread->m_next;
+	else
+		threads = thread->m_next;
+	if (thread->m_next != NULL)
+		thread->m_next->m_prev = thread->m_prev;
+	pthread_mutex_unlock(&threadsLock);
+
+	j_free(thread);
+}
+
+static void stats_key_create(void)
+{
+	statsKeyValid = (pthread_key_create(&statsKey, thread_stats_free) == 0);
+}
+
+jstats* jstats_counters(void)
+{
+	ThreadStats *thread;
+
+	pthread_once(&statsKeyOnce, stats_key_create);
+	if (UNLIKELY(!statsKeyValid))
+		return NULL;
+
+	thread = (ThreadStats *)pthread_getspecific(statsKey);
+	if (thread == NULL) {
+		thread = (ThreadStats *)j_calloc(1, sizeof(ThreadStats));
+		CHECK_ALLOC_RETURN_NULL(thread);
+		if (pthread_setspecific(statsKey, thread) != 0) {
+			j_free(thread);
+			return NULL;
+		}
+
+		pthread_mutex_lock(&threadsLock);
+		thread->m_next = threads;
+		if (threads != NULL)
+			threads->m_prev = thread;
+		threads = thread;
+		pthread_mutex_unlock(&threadsLock);
+	}
+	return &thread->m_counts;
+}
+#else
+jstats* jstats_counters(void)
+{
+	return &counts;
+}
+#endif /* HAVE_PTHREAD */
+
+uint64_t jstats_clock(void)
+{
+	struct timespec now;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+		return 0;
+	// never 0 - that means the clock wasn't started
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec + 1;
+}
+
+void jstats_enable(bool enable)
+{
+	jstats_collecting = enable;
+}
+
+void jstats_snapshot(jstats *stats)
+{
+	CHECK_POINTER(stats);
+
+#if HAVE_PTHREAD
+	pthread_mutex_lock(&threadsLock);
+	*stats = retired;
+	for (ThreadStats *thread = threads; thread != NULL; thread = thread->m_next)
+		jstats_add(stats, &thread->m_counts);
+	pthread_mutex_unlock(&threadsLock);
+#else
+	*stats = counts;
+#endif
+}
+
+void jstats_reset(void)
+{
+#if HAVE_PTHREAD
+	pthread_mutex_lock(&threadsLock);
+	memset(&retired, 0, sizeof(retired));
+	for (ThreadStats *thread = threads; thread != NULL; thread = thread->m_next)
+		memset(&thread->m_counts, 0, sizeof(thread->m_counts));
+	pthread_mutex_unlock(&threadsLock);
+#else
+	memset(&counts, 0, sizeof(counts));
+#endif
+}
@@ -0,0 +1,80 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef JSTATS_INTERNAL_H_
+#define JSTATS_INTERNAL_H_
+
+#include <japi.h>
+#include <jstats.h>
+#include <stddef.h>
+#include "liblog.h"
+
+/*
+ * Counting for jstats_snapshot.  Every counter is only touched if collection has been turned on, so the cost while
+ * it's off is a test of jstats_collecting.
+ */
+
+extern PJSON_LOCAL bool jstats_collecting;
+
+/**
+ * @return The counters of the calling thread (NULL if they couldn't be allocated).
+ */
+PJSON_LOCAL jstats* jstats_counters(void);
+
+/**
+ * @return A monotonic time in nanoseconds.
+ */
+PJSON_LOCAL uint64_t jstats_clock(void);
+
+#define JSTATS_ADD(counter, n) \
+	do { \
+		if (UNLIKELY(jstats_collecting)) { \
+			jstats *counters_ = jstats_counters(); \
+			if (counters_ != NULL) \
+				counters_->counter += (n); \
+		} \
+	} while (0)
+
+#define JSTATS_ALLOCATED(type, nodes, bytes) \
+	do { \
+		if (UNLIKELY(jstats_collecting)) { \
+			jstats *counters_ = jstats_counters(); \
+			if (counters_ != NULL) { \
+				counters_->m_allocations[type].m_nodes += (nodes); \
+				counters_->m_allocations[type].m_bytes += (bytes); \
+			} \
+		} \
+	} while (0)
+
+#define JSTATS_VALIDATION_FAILED(failure) JSTATS_ADD(m_validationFailures[failure], 1)
+
+/**
+ * Timing: start is 0 unless statistics are being collected, in which case the time since then is added to counter.
+ */
+static inline uint64_t jstats_start(void)
+{
+	return UNLIKELY(jstats_collecting) ? jstats_clock() : 0;
+}
+
+#define JSTATS_ADD_TIME(counter, start) \
+	do { \
+		if ((start) != 0) \
+			JSTATS_ADD(counter, jstats_clock() - (start)); \
+	} while (0)
+
+#endif /* JSTATS_INTERNAL_H_ */
@@ -24,6 +24,7 @@ LICENSE@@@ */
 #include <stdbool.h>
 #include <assert.h>
 #include <inttypes.h>
+#include <stdio.h>
 
 #include <jtypes.h>
 
@@ -353,8 +354,7 @@ finish_parse:
 						*integerPortion = INT64_MIN;
 						break;
 					}
-					if (*integerPortion != 0)
-						assert(*integerPortion * 10 > 0);
+					assert(*integerPortion > 0 ? *integerPortion * 10 > 0 : *integerPortion * 10 < 0);
 					*integerPortion *= 10;
 					exponent--;
 				}
@@ -641,6 +641,13 @@ ConversionResultFlags ji64_to_double(int64_t value, double *result)
 	return CONV_OK;
 }
 
+unsigned int jdouble_format(double value, char *buffer)
+{
+	int printed = snprintf(buffer, JDOUBLE_FORMAT_SIZE, "%.14lg", value);
+	assert(printed > 0 && printed < JDOUBLE_FORMAT_SIZE);
+	return (unsigned int)printed;
+}
+
 #if 0
 static ConversionMatrix __conversion = {
 	{ jstr_to_i32, ji32_noop, ji64_to_i32, jdouble_to_i32 },
@@ -66,6 +66,21 @@ PJSON_LOCAL ConversionResultFlags ji64_to_i32(int64_t value, int32_t *result);
 PJSON_LOCAL ConversionResultFlags ji64_to_double(int64_t value, double *result);
 PJSON_LOCAL ConversionResultFlags ji64_to_str(int64_t value, raw_buffer *str);
 
+/**
+ * Room for any double formatted by jdouble_format (including the terminating NUL).
+ */
+#define JDOUBLE_FORMAT_SIZE 32
+
+/**
+ * Formats a double as the generator writes it.  Everything that checks a floating point number as text (e.g. the
+ * schema with numbers decoded from CBOR or held in a DOM) goes through here so that it sees the same text.
+ *
+ * @param value
+ * @param buffer - At least JDOUBLE_FORMAT_SIZE bytes.
+ * @return The length of the text (not counting the NUL).
+ */
+PJSON_LOCAL unsigned int jdouble_format(double value, char *buffer) NON_NULL(2);
+
 #if 0
 typedef ConversionResultFlags (*string_conversion)(const char *string, size_t strLen, void *result);
 typedef ConversionResultFlags (*int32_conversion)(int32_t value, void *result);
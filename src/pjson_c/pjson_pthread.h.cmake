@@ -0,0 +1,5 @@
+#cmakedefine HAVE_PTHREAD 1
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
@@ -0,0 +1,5 @@
+#cmakedefine HAVE_ZLIB 1
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
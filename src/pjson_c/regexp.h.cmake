@@ -2,7 +2,7 @@
 #cmakedefine HAVE_POSIX_REGEXP 1
 
 #if HAVE_PCRE
-    #include <pcreposix.h>
+    #include <pcre.h>
 #elif HAVE_POSIX_REGEXP
     #ifdef NDEBUG
         #warning "Using POSIX regular expressions - this violates the JSON schema spec"
@@ -12,10 +12,11 @@
     #error "No regular expression support provided - schema requires them"
 #endif
 
-#if HAVE_PCRE || HAVE_POSIX_REGEXP
+#if !HAVE_PCRE && HAVE_POSIX_REGEXP
 /* 
  * USE_POSIX_REGEXP determines whether or not we use the POSIX API for accessing the
- * regular expression engine.
+ * regular expression engine.  PCRE is used through its native API so that patterns
+ * can be JIT compiled & matched without NULL-terminating the input.
  */
 #define USE_POSIX_REGEXP 1
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,102 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "utf8_validate.h"
+#include <compiler/builtins.h>
+
+// high bit of every byte within a word - any of them being set means the word isn't pure ASCII
+#define ASCII_WORD_MASK UINT64_C(0x8080808080808080)
+
+/**
+ * Validate a single multi-byte sequence according to table 3-7 of the Unicode standard.
+ *
+ * @return A pointer past the end of the sequence, or NULL if it is malformed.
+ */
+static const unsigned char* utf8_validate_sequence(const unsigned char *s, const unsigned char *end)
+{
+	unsigned char lead = *s;
+	// the valid range for the second byte is narrower than 80..BF for some lead bytes
+	unsigned char lo = 0x80, hi = 0xBF;
+	ptrdiff_t len;
+
+	if (lead < 0xC2) {
+		// stray continuation byte or an overlong 2-byte sequence
+		return NULL;
+	} else if (lead < 0xE0) {
+		len = 2;
+	} else if (lead < 0xF0) {
+		len = 3;
+		if (lead == 0xE0)
+			lo = 0xA0; // overlong
+		else if (lead == 0xED)
+			hi = 0x9F; // surrogates
+	} else if (lead < 0xF5) {
+		len = 4;
+		if (lead == 0xF0)
+			lo = 0x90; // overlong
+		else if (lead == 0xF4)
+			hi = 0x8F; // > U+10FFFF
+	} else {
+		return NULL;
+	}
+
+	if (UNLIKELY(end - s < len))
+		return NULL;
+
+	if (s[1] < lo || s[1] > hi)
+		return NULL;
+
+	for (ptrdiff_t i = 2; i < len; i++) {
+		if ((s[i] & 0xC0) != 0x80)
+			return NULL;
+	}
+
+	return s + len;
+}
+
+bool utf8_validate(const char *str, size_t len)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	const unsigned char *end = s + len;
+
+	while (s < end) {
+		// fast path - skip over pure ASCII a word at a time
+		while (end - s >= (ptrdiff_t)sizeof(uint64_t)) {
+			uint64_t block;
+			memcpy(&block, s, sizeof(block));
+			if (block & ASCII_WORD_MASK)
+				break;
+			s += sizeof(block);
+		}
+
+		while (s < end && *s < 0x80)
+			s++;
+
+		if (s == end)
+			break;
+
+		s = utf8_validate_sequence(s, end);
+		if (UNLIKELY(s == NULL))
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,48 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef UTF8_VALIDATE_H_
+#define UTF8_VALIDATE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <japi.h>
+#include <compiler/nonnull_attribute.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Determine whether or not the buffer is well-formed UTF-8 (RFC 3629).
+ *
+ * Overlong encodings, UTF-16 surrogates, code points beyond U+10FFFF and truncated sequences are all
+ * rejected.  ASCII runs are consumed a machine word at a time so that the common case costs little more
+ * than touching the bytes the lexer has just scanned.
+ *
+ * @param str The buffer to check (need not be NULL-terminated)
+ * @param len The number of bytes in the buffer
+ * @return True if every byte belongs to a valid UTF-8 sequence, false otherwise.
+ */
+PJSON_LOCAL bool utf8_validate(const char *str, size_t len) NON_NULL(1);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTF8_VALIDATE_H_ */
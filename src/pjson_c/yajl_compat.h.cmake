@@ -0,0 +1,9 @@
+#ifndef YAJL_COMPAT_H_
+#define YAJL_COMPAT_H_
+
+// extensions found in the bundled yajl that may be missing from a stock build
+#cmakedefine HAVE_YAJL_GEN_STRING_NOESCAPE 1
+#cmakedefine HAVE_YAJL_RESET 1
+#cmakedefine HAVE_YAJL_GET_BYTES_CONSUMED 1
+
+#endif /* YAJL_COMPAT_H_ */
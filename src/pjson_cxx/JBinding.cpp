@@ -0,0 +1,315 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include <JBinding.h>
+#include <pbnjson.h>
+#include <stdlib.h>
+#include <string.h>
+#include "liblog.h"
+#include <algorithm>
+
+namespace pbnjson {
+
+const JBindingType JBindingString = { JBindingType::BIND_STRING, NULL, 0, NULL, NULL, NULL, NULL };
+const JBindingType JBindingInteger = { JBindingType::BIND_INTEGER, NULL, 0, NULL, NULL, NULL, NULL };
+const JBindingType JBindingNumber = { JBindingType::BIND_NUMBER, NULL, 0, NULL, NULL, NULL, NULL };
+const JBindingType JBindingBoolean = { JBindingType::BIND_BOOLEAN, NULL, 0, NULL, NULL, NULL, NULL };
+
+/**
+ * Binary search of an object's members (they are sorted by key, compared like std::string).
+ */
+static const JBindingMember* find_member(const JBindingType *type, JStringView key)
+{
+	size_t low = 0, high = type->m_memberCount;
+
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		const JBindingMember &member = type->m_members[middle];
+		int order = memcmp(key.data(), member.m_key, std::min(key.size(), member.m_keyLen));
+		if (order == 0)
+			order = (key.size() > member.m_keyLen) - (key.size() < member.m_keyLen);
+		if (order == 0)
+			return &member;
+		if (order < 0)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	return NULL;
+}
+
+JBindingParser::JBindingParser(const JBindingType &type, void *target, JResolver *resolver)
+	: JParser(resolver), m_type(&type), m_target(target), m_member(NULL), m_skipDepth(0), m_started(false)
+{
+}
+
+JBindingParser::JBindingParser(const JBindingParser &other)
+	: JParser(other), m_type(other.m_type), m_target(other.m_target), m_frames(other.m_frames),
+	m_member(other.m_member), m_skipDepth(other.m_skipDepth), m_started(other.m_started)
+{
+}
+
+JBindingParser::~JBindingParser()
+{
+}
+
+bool JBindingParser::parse(const std::string& input, const JSchema &schema, JErrorHandler *errors)
+{
+	reset();
+	return JParser::parse(input, schema, errors);
+}
+
+bool JBindingParser::parse(JInputReader& input, const JSchema &schema, JErrorHandler *errors)
+{
+	reset();
+	return JParser::parse(input, schema, errors);
+}
+
+void JBindingParser::reset()
+{
+	m_frames.clear();
+	m_member = NULL;
+	m_skipDepth = 0;
+	m_started = false;
+}
+
+JBindingParser::Slot JBindingParser::nextSlot(JBindingType::Kind kind, void **value, const JBindingType **type)
+{
+	if (m_skipDepth > 0)
+		return SLOT_SKIP;
+
+	if (m_frames.empty()) {
+		if (m_started)
+			return SLOT_ERROR;
+		*type = m_type;
+	} else if (m_frames.back().m_type->m_kind == JBindingType::BIND_ARRAY) {
+		*type = m_frames.back().m_type->m_items;
+	} else {
+		if (m_member == NULL)
+			return SLOT_SKIP;
+		*type = m_member->m_type;
+	}
+
+	// integers are numbers too - anything else is input the bindings weren't generated for
+	if ((*type)->m_kind != kind && !(kind == JBindingType::BIND_INTEGER && (*type)->m_kind == JBindingType::BIND_NUMBER)) {
+		PJ_LOG_WARN("Value of type %d can't be stored in a member of type %d", kind, (*type)->m_kind);
+		return SLOT_ERROR;
+	}
+
+	if (m_frames.empty()) {
+		m_started = true;
+		*value = m_target;
+	} else if (m_frames.back().m_type->m_kind == JBindingType::BIND_ARRAY) {
+		*value = m_frames.back().m_type->m_append(m_frames.back().m_value);
+	} else {
+		void *object = m_frames.back().m_value;
+		*value = m_member->m_value(object);
+		if (m_member->m_present)
+			*m_member->m_present(object) = true;
+		m_member = NULL;
+	}
+	return SLOT_BOUND;
+}
+
+bool JBindingParser::open(JBindingType::Kind kind)
+{
+	Frame frame;
+
+	switch (nextSlot(kind, &frame.m_value, &frame.m_type)) {
+		case SLOT_ERROR:
+			return false;
+		case SLOT_SKIP:
+			m_skipDepth++;
+			return true;
+		case SLOT_BOUND:
+			break;
+	}
+
+	m_frames.push_back(frame);
+	return true;
+}
+
+bool JBindingParser::close()
+{
+	if (m_skipDepth > 0) {
+		m_skipDepth--;
+		return true;
+	}
+	if (m_frames.empty())
+		return false;
+	m_frames.pop_back();
+	m_member = NULL;
+	return true;
+}
+
+bool JBindingParser::jsonObjectOpen()
+{
+	return open(JBindingType::BIND_OBJECT);
+}
+
+bool JBindingParser::jsonObjectKeyView(JStringView key)
+{
+	if (m_skipDepth == 0)
+		m_member = find_member(m_frames.back().m_type, key);
+	return true;
+}
+
+bool JBindingParser::jsonObjectClose()
+{
+	return close();
+}
+
+bool JBindingParser::jsonArrayOpen()
+{
+	return open(JBindingType::BIND_ARRAY);
+}
+
+bool JBindingParser::jsonArrayClose()
+{
+	return close();
+}
+
+bool JBindingParser::jsonStringView(JStringView s)
+{
+	const JBindingType *type;
+	void *value;
+	Slot slot = nextSlot(JBindingType::BIND_STRING, &value, &type);
+	if (slot == SLOT_BOUND)
+		static_cast<std::string *>(value)->assign(s.data(), s.size());
+	return slot != SLOT_ERROR;
+}
+
+bool JBindingParser::jsonNumber(const std::string& n)
+{
+	// only called for JNUM_CONV_RAW
+	return false;
+}
+
+bool JBindingParser::jsonNumber(int64_t number)
+{
+	const JBindingType *type;
+	void *value;
+	Slot slot = nextSlot(JBindingType::BIND_INTEGER, &value, &type);
+	if (slot == SLOT_BOUND) {
+		if (type->m_kind == JBindingType::BIND_NUMBER)
+			*static_cast<double *>(value) = number;
+		else
+			*static_cast<int64_t *>(value) = number;
+	}
+	return slot != SLOT_ERROR;
+}
+
+bool JBindingParser::jsonNumber(double &number, ConversionResultFlags asFloat)
+{
+	const JBindingType *type;
+	void *value;
+	Slot slot = nextSlot(JBindingType::BIND_NUMBER, &value, &type);
+	if (slot == SLOT_BOUND)
+		*static_cast<double *>(value) = number;
+	return slot != SLOT_ERROR;
+}
+
+bool JBindingParser::jsonBoolean(bool truth)
+{
+	const JBindingType *type;
+	void *value;
+	Slot slot = nextSlot(JBindingType::BIND_BOOLEAN, &value, &type);
+	if (slot == SLOT_BOUND)
+		*static_cast<bool *>(value) = truth;
+	return slot != SLOT_ERROR;
+}
+
+bool JBindingParser::jsonNull()
+{
+	// nothing that allows null is bound, so a null can only be the value of a property that's skipped
+	if (m_skipDepth > 0)
+		return true;
+	return !m_frames.empty() && m_frames.back().m_type->m_kind == JBindingType::BIND_OBJECT && m_member == NULL;
+}
+
+static bool generate(JStreamRef stream, const JBindingType &type, const void *value)
+{
+	// the accessors don't modify anything but they're shared with the parser
+	void *mutableValue = const_cast<void *>(value);
+
+	switch (type.m_kind) {
+		case JBindingType::BIND_STRING:
+		{
+			const std::string &str = *static_cast<const std::string *>(value);
+			stream->string(stream, j_str_to_buffer(str.data(), str.size()));
+			break;
+		}
+		case JBindingType::BIND_INTEGER:
+			stream->integer(stream, *static_cast<const int64_t *>(value));
+			break;
+		case JBindingType::BIND_NUMBER:
+			stream->floating(stream, *static_cast<const double *>(value));
+			break;
+		case JBindingType::BIND_BOOLEAN:
+			stream->boolean(stream, *static_cast<const bool *>(value));
+			break;
+		case JBindingType::BIND_OBJECT:
+			stream->o_begin(stream);
+			for (size_t i = 0; i < type.m_memberCount; i++) {
+				const JBindingMember &member = type.m_members[i];
+				if (member.m_present && !*member.m_present(mutableValue))
+					continue;
+				stream->string(stream, j_str_to_buffer(member.m_key, member.m_keyLen));
+				if (!generate(stream, *member.m_type, member.m_value(mutableValue)))
+					return false;
+			}
+			stream->o_end(stream);
+			break;
+		case JBindingType::BIND_ARRAY:
+		{
+			size_t size = type.m_size(value);
+			stream->a_begin(stream);
+			for (size_t i = 0; i < size; i++) {
+				if (!generate(stream, *type.m_items, type.m_at(mutableValue, i)))
+					return false;
+			}
+			stream->a_end(stream);
+			break;
+		}
+		default:
+			PJ_LOG_ERR("Unknown binding type %d", type.m_kind);
+			return false;
+	}
+	return true;
+}
+
+bool JBindingGenerator::toString(const JBindingType &type, const void *value, std::string &asStr)
+{
+	JStreamRef stream = jstream(jschema_all());
+	StreamStatus status;
+
+	asStr = "";
+	if (UNLIKELY(stream == NULL))
+		return false;
+
+	bool generated = generate(stream, type, value);
+	char *str = stream->finish(stream, &status);
+	if (str == NULL)
+		return false;
+	if (generated && status == GEN_OK)
+		asStr = str;
+	free(str);
+	return generated && status == GEN_OK;
+}
+
+}
@@ -64,12 +64,19 @@ static bool __err_unknown(void *ctxt, JSAXContextRef parseCtxt)
 }
 
 JDomParser::JDomParser(JResolver *resolver)
-	: JParser(resolver), m_optimization(DOMOPT_NOOPT), m_resolver(resolver)
+	: JParser(resolver), m_optimization(DOMOPT_NOOPT), m_resolver(resolver), m_parser(NULL), m_allocator(NULL)
+{
+}
+
+JDomParser::JDomParser(const JDomParser& other)
+	: JParser(other), m_dom(other.m_dom), m_optimization(other.m_optimization), m_resolver(other.m_resolver), m_parser(NULL), m_allocator(other.m_allocator)
 {
 }
 
 JDomParser::~JDomParser()
 {
+	if (m_parser)
+		jparser_release(&m_parser);
 }
 
 JSchemaInfo JDomParser::prepare(const JSchema& schema, const JSchemaResolver& resolver, const JErrorCallbacks& cErrCbs, JErrorHandler *errors)
@@ -109,13 +116,79 @@ JErrorCallbacks JDomParser::prepareCErrorCallbacks() const
 	return cErrCallbacks;
 }
 
+bool JDomParser::parseInput(raw_buffer input, JDOMOptimizationFlags optimization, const JSchema& schema, JErrorHandler *errors)
+{
+	JSchemaResolver resolver = prepareResolver();
+	JErrorCallbacks errCbs = prepareCErrorCallbacks();
+	JSchemaInfo schemaInfo = prepare(schema, resolver, errCbs, errors);
+
+	if (m_parser == NULL)
+		m_parser = jparser_create(JPARSE_OPT_NONE);
+
+	if (m_parser) {
+		jparser_set_allocator(m_parser, m_allocator);
+		m_dom = jdom_parse_with_parser(m_parser, input, optimization, &schemaInfo);
+	} else {
+		m_dom = jdom_parse(input, optimization, &schemaInfo);
+	}
+
+	if (m_dom.isNull()) {
+		if (errors) errors->parseFailed(this, "");
+		return false;
+	}
+
+	return true;
+}
+
 bool JDomParser::parse(const std::string& input, const JSchema& schema, JErrorHandler *errors)
+{
+	return parseInput(strToRawBuffer(input), m_optimization, schema, errors);
+}
+
+bool JDomParser::parse(const char *input, size_t length, const JSchema& schema, JErrorHandler *errors)
+{
+	return parseInput(j_str_to_buffer(input, length), m_optimization, schema, errors);
+}
+
+bool JDomParser::parse(const char *input, size_t length, jdeallocator release, void *owner, const JSchema& schema, JErrorHandler *errors)
+{
+	if (!parseInput(j_str_to_buffer(input, length), DOMOPT_INPUT_OUTLIVES_WITH_NOCHANGE, schema, errors)) {
+		release(owner);
+		return false;
+	}
+
+	if (!jdom_adopt_input(m_dom.peekRaw(), release, owner)) {
+		// a fresh DOM has no input attached yet & a constant one (e.g. the document "") takes owner only to release
+		// it right away, so this is unexpected - but never leave the DOM pointing at an input that's about to go away
+		m_dom = JValue();
+		release(owner);
+		if (errors) errors->misc(this, "couldn't attach the input to the DOM");
+		return false;
+	}
+
+	return true;
+}
+
+static ssize_t __read(void *ctxt, char *buffer, size_t size)
+{
+	return static_cast<JInputReader *>(ctxt)->read(buffer, size);
+}
+
+bool JDomParser::parse(JInputReader& input, const JSchema& schema, JErrorHandler *errors)
 {
 	JSchemaResolver resolver = prepareResolver();
 	JErrorCallbacks errCbs = prepareCErrorCallbacks();
 	JSchemaInfo schemaInfo = prepare(schema, resolver, errCbs, errors);
 
-	m_dom = jdom_parse(strToRawBuffer(input), m_optimization, &schemaInfo);
+	if (m_parser == NULL)
+		m_parser = jparser_create(JPARSE_OPT_NONE);
+
+	if (m_parser) {
+		jparser_set_allocator(m_parser, m_allocator);
+		m_dom = jdom_parse_reader_with_parser(m_parser, __read, &input, &schemaInfo);
+	} else {
+		m_dom = jdom_parse_reader(__read, &input, &schemaInfo);
+	}
 
 	if (m_dom.isNull()) {
 		if (errors) errors->parseFailed(this, "");
@@ -22,6 +22,12 @@ LICENSE@@@ */
 #include <JResolver.h>
 #include "liblog.h"
 
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <istream>
+#include <unistd.h>
+
 namespace pbnjson {
 
 JSchemaResolutionResult sax_schema_resolver(JSchemaResolverRef resolver, jschema_ref *resolvedSchema)
@@ -37,13 +43,13 @@ JSchemaResolutionResult sax_schema_resolver(JSchemaResolverRef resolver, jschema
 class PJSONCXX_LOCAL SaxBounce {
 public:
 	static inline bool oo(JParser *p) { return p->jsonObjectOpen(); }
-	static inline bool ok(JParser *p, const std::string& key) { return p->jsonObjectKey(key); }
+	static inline bool ok(JParser *p, JStringView key) { return p->jsonObjectKeyView(key); }
 	static inline bool oc(JParser *p) { return p->jsonObjectClose(); }
 	static inline bool ao(JParser *p) { return p->jsonArrayOpen(); }
 	static inline bool ac(JParser *p) { return p->jsonArrayClose(); }
 
-	static inline bool s(JParser *p, const std::string& s) { return p->jsonString(s); }
-	static inline bool n(JParser *p, const std::string& n) { return p->jsonNumber(n); }
+	static inline bool s(JParser *p, JStringView s) { return p->jsonStringView(s); }
+	static inline bool n(JParser *p, JStringView n) { return p->jsonNumberView(n); }
 	static inline bool n(JParser *p, int64_t n) { return p->jsonNumber(n); }
 	static inline bool n(JParser *p, double n, ConversionResultFlags f) { return p->jsonNumber(n, f); }
 	static inline bool b(JParser *p, bool v) { return p->jsonBoolean(v); }
@@ -59,7 +65,7 @@ static int __obj_start(JSAXContextRef ctxt)
 
 static int __obj_key(JSAXContextRef ctxt, const char *key, size_t len)
 {
-	return SaxBounce::ok(static_cast<JParser *>(jsax_getContext(ctxt)), std::string(key, len));
+	return SaxBounce::ok(static_cast<JParser *>(jsax_getContext(ctxt)), JStringView(key, len));
 }
 
 static int __obj_end(JSAXContextRef ctxt)
@@ -79,7 +85,7 @@ static int __arr_end(JSAXContextRef ctxt)
 
 static int __string(JSAXContextRef ctxt, const char *str, size_t len)
 {
-	return SaxBounce::s(static_cast<JParser *>(jsax_getContext(ctxt)), std::string(str, len));
+	return SaxBounce::s(static_cast<JParser *>(jsax_getContext(ctxt)), JStringView(str, len));
 }
 
 static int __number(JSAXContextRef ctxt, const char *number, size_t len)
@@ -87,18 +93,17 @@ static int __number(JSAXContextRef ctxt, const char *number, size_t len)
 	JParser *p = static_cast<JParser *>(jsax_getContext(ctxt));
 	switch (SaxBounce::conversionToUse(p)) {
 		case JParser::JNUM_CONV_RAW:
-			return SaxBounce::n(p, std::string(number, len));
+			return SaxBounce::n(p, JStringView(number, len));
 		case JParser::JNUM_CONV_NATIVE:
 		{
-			jvalue_ref toConv = jnumber_create_unsafe(j_str_to_buffer(number, len), NULL);
+			raw_buffer toConv = j_str_to_buffer(number, len);
 			int64_t asInteger;
 			double asFloat;
 			ConversionResultFlags toFloatErrors;
 
-			if (CONV_OK == jnumber_get_i64(toConv, &asInteger)) {
+			if (CONV_OK == jnumber_raw_to_i64(toConv, &asInteger))
 				return SaxBounce::n(p, (asInteger));
-			}
-			toFloatErrors = jnumber_get_f64(toConv, &asFloat);
+			toFloatErrors = jnumber_raw_to_f64(toConv, &asFloat);
 			return SaxBounce::n(p, asFloat, toFloatErrors);
 		}
 		default:
@@ -165,7 +170,88 @@ JParser::~JParser()
 
 }
 
+/**
+ * Reads whatever a stream has buffered (waiting only for the first byte of a chunk).
+ */
+class PJSONCXX_LOCAL StreamReader : public JInputReader {
+public:
+	StreamReader(std::istream &stream) : m_stream(stream) {}
+
+	ssize_t read(char *buffer, size_t size)
+	{
+		m_stream.read(buffer, 1);
+		if (m_stream.bad())
+			return -1;
+		if (m_stream.gcount() == 0)
+			return 0;
+
+		std::streamsize available = m_stream.rdbuf()->in_avail();
+		if (available > 0) {
+			m_stream.read(buffer + 1, std::min<std::streamsize>(available, size - 1));
+			if (m_stream.bad())
+				return -1;
+			return 1 + m_stream.gcount();
+		}
+		return 1;
+	}
+
+private:
+	std::istream &m_stream;
+};
+
+class PJSONCXX_LOCAL FdReader : public JInputReader {
+public:
+	FdReader(int fd) : m_fd(fd) {}
+
+	ssize_t read(char *buffer, size_t size)
+	{
+		ssize_t length;
+
+		do {
+			length = ::read(m_fd, buffer, size);
+		} while (length == -1 && errno == EINTR);
+
+		if (length == -1)
+			PJ_LOG_WARN("Failed to read from file descriptor %d (%d) : %s", m_fd, errno, strerror(errno));
+		return length;
+	}
+
+private:
+	int m_fd;
+};
+
+static ssize_t __read(void *ctxt, char *buffer, size_t size)
+{
+	return static_cast<JInputReader *>(ctxt)->read(buffer, size);
+}
+
 bool JParser::parse(const std::string& input, const JSchema& schema, JErrorHandler *errors)
+{
+	raw_buffer buffer = strToRawBuffer(input);
+	return parseInput(&buffer, NULL, schema, errors);
+}
+
+bool JParser::parse(JInputReader& input, const JSchema& schema, JErrorHandler *errors)
+{
+	return parseInput(NULL, &input, schema, errors);
+}
+
+bool JParser::parse(std::istream& input, const JSchema& schema, JErrorHandler *errors)
+{
+	StreamReader reader(input);
+	return parse(reader, schema, errors);
+}
+
+bool JParser::parseFd(int fd, const JSchema& schema, JErrorHandler *errors)
+{
+	FdReader reader(fd);
+	return parse(reader, schema, errors);
+}
+
+/**
+ * @param input The JSON text or NULL to read it from reader instead.
+ */
+bool JParser::parseInput(const raw_buffer *input, JInputReader *reader, const JSchema& schema, JErrorHandler *errors)
 {
 	PJSAXCallbacks callbacks = {
 		__obj_start, __obj_key, __obj_end, __arr_start, __arr_end, __string, __number, __boolean, __jnull,
@@ -186,7 +272,11 @@ bool JParser::parse(const std::string& input, const JSchema& schema, JErrorHandl
 
 	void *ctxt = this;
 	m_errors = errors;
-	bool parsed = jsax_parse_ex(&callbacks, strToRawBuffer(input), &schemaInfo, &ctxt, false);
+	bool parsed;
+	if (input)
+		parsed = jsax_parse_ex(&callbacks, *input, &schemaInfo, &ctxt, false);
+	else
+		parsed = jsax_parse_reader(&callbacks, __read, reader, &schemaInfo, &ctxt, false);
 
 	if (!parsed) {
 		if (errors) errors->parseFailed(this, "");
@@ -209,7 +299,9 @@ JSchemaResolutionResult JParser::resolve(JSchemaResolverRef resolver, jschema_re
 
 	std::cerr << "Resolving" << resource << std::endl;
 	if (result == SCHEMA_RESOLVED) {
-		*resolvedSchema = jschema_copy(resolvedWrapper.peek());
+		// the resolved schema is cached by the schema being validated against, so it mustn't depend on any
+		// memory the C++ wrapper owns (i.e. a mapped schema file)
+		*resolvedSchema = jschema_duplicate(resolvedWrapper.peek());
 	} else
 		*resolvedSchema = NULL;
 	return result;
@@ -0,0 +1,82 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include <JSchemaRegistry.h>
+
+#include <pbnjson.h>
+
+namespace pbnjson {
+
+JSchemaRegistry::JSchemaRegistry()
+	: m_registry(jschema_registry_create())
+{
+}
+
+JSchemaRegistry::~JSchemaRegistry()
+{
+	if (m_registry)
+		jschema_registry_release(&m_registry);
+}
+
+JSchemaRegistry& JSchemaRegistry::instance()
+{
+	static JSchemaRegistry registry;
+	return registry;
+}
+
+JSchema JSchemaRegistry::wrap(jschema_ref schema)
+{
+	if (schema == NULL)
+		return JSchema(NULL);
+	return JSchema(new JSchema::Resource(schema, JSchema::Resource::TakeSchema));
+}
+
+int JSchemaRegistry::loadDirectory(const std::string &dir, unsigned int threads)
+{
+	if (!m_registry)
+		return -1;
+	return jschema_registry_load_dir(m_registry, dir.c_str(), threads);
+}
+
+JSchema JSchemaRegistry::load(const std::string &path)
+{
+	if (!m_registry)
+		return JSchema(NULL);
+	return wrap(jschema_registry_load(m_registry, path.c_str()));
+}
+
+JSchema JSchemaRegistry::get(const std::string &key) const
+{
+	if (!m_registry)
+		return JSchema(NULL);
+	return wrap(jschema_registry_get(m_registry, key.c_str()));
+}
+
+bool JSchemaRegistry::reload(const std::string &path)
+{
+	return m_registry && jschema_registry_reload(m_registry, path.c_str());
+}
+
+int JSchemaRegistry::refresh()
+{
+	if (!m_registry)
+		return 0;
+	return jschema_registry_refresh(m_registry);
+}
+
+}
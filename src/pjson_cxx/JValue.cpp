@@ -82,31 +82,36 @@ JValue::JValue(const double& value)
 {
 }
 
+// without zero-copy strings, the library makes the only copy - m_input isn't needed
 template <>
 JValue::JValue(const std::string &value)
+#if PBNJSON_ZERO_COPY_STL_STR
 	: m_input(value)
+#endif
 {
+#if PBNJSON_ZERO_COPY_STL_STR
 	PJ_DBG_CXX_STR(std::cerr << "Have handle to string at " << (void*)m_input.c_str() << std::endl);
 	assert(m_input.c_str() == value.c_str());
-#if PBNJSON_ZERO_COPY_STL_STR
 	m_jval = jstring_create_nocopy(strToRawBuffer(m_input));
 	assert(jstring_get_fast(m_jval).m_str == m_input.c_str());
 	assert(jstring_get_fast(m_jval).m_len == m_input.length());
 #else
-	m_jval = jstring_create_utf8(m_input.c_str(), m_input.size());
+	m_jval = jstring_create_utf8(value.c_str(), value.size());
 #endif
 }
 
 JValue::JValue(const char *str)
+#if PBNJSON_ZERO_COPY_STL_STR
 	: m_input(str)
+#endif
 {
-	PJ_DBG_CXX_STR(std::cerr << "Have handle to string at " << (void*)m_input.c_str() << std::endl);
 #if PBNJSON_ZERO_COPY_STL_STR
+	PJ_DBG_CXX_STR(std::cerr << "Have handle to string at " << (void*)m_input.c_str() << std::endl);
 	m_jval = jstring_create_nocopy(strToRawBuffer(m_input));
 	assert(jstring_get_fast(m_jval).m_str == m_input.c_str() || m_input.length() == 0);
 	assert(jstring_get_fast(m_jval).m_len == m_input.length());
 #else
-	m_jval = jstring_create_utf8(m_input.c_str(), m_input.size());
+	m_jval = jstring_create_utf8(str, -1);
 #endif
 }
 
@@ -118,7 +123,9 @@ JValue::JValue(const bool& value)
 
 template<>
 JValue::JValue(const NumericString& value)
+#if PBNJSON_ZERO_COPY_STL_STR
 	: m_input(value)
+#endif
 {
 #if PBNJSON_ZERO_COPY_STL_STR
 	m_jval = jnumber_create_unsafe(strToRawBuffer(m_input), NULL);
@@ -28,11 +28,16 @@ LICENSE@@@ */
 #include <QMetaType>
 #include <iostream>
 #include <cassert>
+#include <cstring>
 #include <limits>
+#include <vector>
+#include <algorithm>
 #include <execinfo.h>
 #include <QList>
 #include <QString>
 #include <QFileInfo>
+#include <QTemporaryFile>
+#include <QFile>
 
 #include <pbnjson.h>
 
@@ -345,6 +350,822 @@ void TestParse::testParseFile()
 	QVERIFY(identical(inputNoMMap, inputMMap));
 }
 
+void TestParse::testParseUTF8Validation_data()
+{
+	QTest::addColumn<QByteArray>("input");
+	QTest::addColumn<bool>("valid");
+
+	QTest::newRow("ascii") << QByteArray("[\"a plain string longer than a machine word\"]") << true;
+	QTest::newRow("multibyte") << QByteArray("{\"k\xc3\xa9y\":[\"\xe2\x82\xac\xf0\x9f\x98\x80\"]}") << true;
+	QTest::newRow("overlong") << QByteArray("[\"\xc0\xaf\"]") << false;
+	QTest::newRow("surrogate") << QByteArray("[\"\xed\xa0\x80\"]") << false;
+	QTest::newRow("beyond U+10FFFF") << QByteArray("[\"abc\xf4\x90\x80\x80\"]") << false;
+	QTest::newRow("invalid key") << QByteArray("{\"\xff\":1}") << false;
+	QTest::newRow("truncated") << QByteArray("[\"aaaaaaaaaaaaaaaa\xe2\x82\"]") << false;
+}
+
+static bool countParserError(void *ctxt, JSAXContextRef parseCtxt)
+{
+	++*static_cast<int *>(ctxt);
+	return false;
+}
+
+struct ChunkedInput
+{
+	const char *data;
+	size_t size;
+	size_t offset;
+};
+
+static ssize_t readChunk(void *ctxt, char *buffer, size_t size)
+{
+	// hand the input out a few bytes at a time so sequences straddle reads
+	ChunkedInput *input = static_cast<ChunkedInput *>(ctxt);
+	size_t n = std::min(std::min(size, static_cast<size_t>(3)), input->size - input->offset);
+	memcpy(buffer, input->data + input->offset, n);
+	input->offset += n;
+	return n;
+}
+
+void TestParse::testParseUTF8Validation()
+{
+	QFETCH(QByteArray, input);
+	QFETCH(bool, valid);
+
+	int parserErrors = 0;
+	struct JErrorCallbacks errors = { countParserError, NULL, NULL, &parserErrors };
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, &errors);
+
+	raw_buffer buffer = j_str_to_buffer(input.constData(), input.size());
+
+	// validation is opt-in - the default parser lets anything through
+	jvalue_ref lenient = manage(jdom_parse(buffer, DOMOPT_NOOPT, &schemaInfo));
+	QVERIFY(!jis_null(lenient));
+	QCOMPARE(parserErrors, 0);
+
+	jvalue_ref strict = manage(jdom_parse_opts(buffer, DOMOPT_NOOPT, &schemaInfo, JPARSE_OPT_VALIDATE_UTF8));
+	QCOMPARE(!jis_null(strict), valid);
+	QCOMPARE(parserErrors, valid ? 0 : 1);
+
+	QCOMPARE(jsax_parse_opts(NULL, buffer, &schemaInfo, NULL, false, JPARSE_OPT_VALIDATE_UTF8), valid);
+
+	// streamed input follows the options of the parser it goes through,
+	// both with and without a schema to validate against
+	jschema_ref schema = manage(jschema_parse(j_cstr_to_buffer("{\"type\":[\"array\",\"object\"]}"), JSCHEMA_DOM_NOOPT, NULL));
+	JSchemaInfo validatingInfo;
+	jschema_info_init(&validatingInfo, schema, NULL, NULL);
+	JSchemaInfo *infos[] = { &schemaInfo, &validatingInfo };
+
+	jparser_ref lenientParser = jparser_create(JPARSE_OPT_NONE);
+	jparser_ref strictParser = jparser_create(JPARSE_OPT_VALIDATE_UTF8);
+	QVERIFY(lenientParser != NULL && strictParser != NULL);
+
+	for (size_t i = 0; i < sizeof(infos) / sizeof(infos[0]); i++) {
+		ChunkedInput chunked = { input.constData(), static_cast<size_t>(input.size()), 0 };
+		QVERIFY(!jis_null(manage(jdom_parse_reader(readChunk, &chunked, infos[i]))));
+
+		chunked.offset = 0;
+		QVERIFY(!jis_null(manage(jdom_parse_reader_with_parser(lenientParser, readChunk, &chunked, infos[i]))));
+
+		chunked.offset = 0;
+		QCOMPARE(!jis_null(manage(jdom_parse_reader_with_parser(strictParser, readChunk, &chunked, infos[i]))), valid);
+	}
+
+	jparser_release(&strictParser);
+	jparser_release(&lenientParser);
+}
+
+void TestParse::testParseSerializeEscapes()
+{
+	// strings without escapes in the input are copied verbatim by the generator,
+	// the others still have to go through escaping
+	const char *input = "{\"plain key\":\"a fairly long plain string value\","
+		"\"esc\\\"key\":\"tab\\there \\u0001 \\\\ \\\" end\",\"arr\":[\"x\",\"\",\"y\\nz\"]}";
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+	jvalue_ref parsed = manage(jdom_parse(j_cstr_to_buffer(input), DOMOPT_NOOPT, &schemaInfo));
+	QVERIFY(jis_object(parsed));
+	QCOMPARE(std::string(jvalue_tostring(parsed, jschema_all())), std::string(input));
+
+	jvalue_ref created = manage(jobject_create());
+	QVERIFY(jobject_put(created, J_CSTR_TO_JVAL("k\"1"), jstring_create("line1\nline2\x01 quote\" back\\ and a long safe tail")));
+	QCOMPARE(std::string(jvalue_tostring(created, jschema_all())),
+			std::string("{\"k\\\"1\":\"line1\\nline2\\u0001 quote\\\" back\\\\ and a long safe tail\"}"));
+}
+
+void TestParse::testParserReuse()
+{
+	// failed documents in between must not leak any state into the following ones
+	const char *inputs[] = {
+		"{\"a\":[1,2,{\"b\":\"x\"}],\"c\":null}",
+		"{\"a\":[1,",
+		"[\"q\",true,false,[[{}]]]",
+		"{\"a\" 1}",
+		"{\"a\":{\"b\":{\"c\":1}}}",
+	};
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+	jparser_ref parser = jparser_create(JPARSE_OPT_NONE);
+	QVERIFY(parser != NULL);
+
+	for (int round = 0; round < 3; round++) {
+		for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+			jvalue_ref expected = manage(jdom_parse(j_cstr_to_buffer(inputs[i]), DOMOPT_NOOPT, &schemaInfo));
+			jvalue_ref actual = manage(jdom_parse_with_parser(parser, j_cstr_to_buffer(inputs[i]), DOMOPT_NOOPT, &schemaInfo));
+			QCOMPARE(jis_null(actual), jis_null(expected));
+			if (!jis_null(expected))
+				QCOMPARE(std::string(jvalue_tostring(actual, jschema_all())), std::string(jvalue_tostring(expected, jschema_all())));
+		}
+
+		QVERIFY(jsax_parse_with_parser(parser, NULL, j_cstr_to_buffer(inputs[0]), &schemaInfo, NULL, false));
+		QVERIFY(!jsax_parse_with_parser(parser, NULL, j_cstr_to_buffer(inputs[1]), &schemaInfo, NULL, false));
+	}
+
+	jparser_release(&parser);
+	QVERIFY(parser == NULL);
+}
+
+void TestParse::testParseDeepNesting()
+{
+	// deep enough for the DOM builder to outgrow its preallocated stack (but within what the generator allows)
+	std::string input;
+	for (int i = 0; i < 50; i++)
+		input += "{\"k\":[";
+	input += "1";
+	for (int i = 0; i < 50; i++)
+		input += "]}";
+	std::string truncated = input.substr(0, input.size() - 3);
+
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+	jparser_ref parser = jparser_create(JPARSE_OPT_NONE);
+	QVERIFY(parser != NULL);
+
+	for (int round = 0; round < 2; round++) {
+		jvalue_ref parsed = manage(jdom_parse(j_str_to_buffer(input.c_str(), input.size()), DOMOPT_NOOPT, &schemaInfo));
+		QVERIFY(jis_object(parsed));
+		QCOMPARE(std::string(jvalue_tostring(parsed, jschema_all())), input);
+
+		parsed = manage(jdom_parse_with_parser(parser, j_str_to_buffer(input.c_str(), input.size()), DOMOPT_NOOPT, &schemaInfo));
+		QVERIFY(jis_object(parsed));
+		QCOMPARE(std::string(jvalue_tostring(parsed, jschema_all())), input);
+
+		QVERIFY(jis_null(manage(jdom_parse(j_str_to_buffer(truncated.c_str(), truncated.size()), DOMOPT_NOOPT, &schemaInfo))));
+		QVERIFY(jis_null(manage(jdom_parse_with_parser(parser, j_str_to_buffer(truncated.c_str(), truncated.size()), DOMOPT_NOOPT, &schemaInfo))));
+	}
+
+	jparser_release(&parser);
+}
+
+static std::string manyProperties(const std::string &schema)
+{
+	std::string properties;
+	for (int i = 0; i < 70; i++)
+		properties += QString("%1\"p%2\":").arg(i ? "," : "").arg(i).toStdString() + schema;
+	return properties;
+}
+
+void TestParse::testParserReuseWithSchema()
+{
+	// nests deeper than a block of validation states & has more properties than fit in a word, so a reused parser
+	// goes through every kind of state it keeps between documents
+	std::string nested = "{\"type\":\"integer\"}";
+	for (int i = 0; i < 49; i++)
+		nested = "{\"type\":\"object\",\"properties\":{\"k\":{\"type\":\"array\",\"items\":" + nested + "}}}";
+	std::string schema = "{\"type\":\"object\",\"properties\":{\"k\":{\"type\":\"array\",\"optional\":true,\"items\":" + nested + "}," +
+			manyProperties("{\"type\":\"object\",\"optional\":true,\"properties\":{" +
+					manyProperties("{\"type\":\"integer\",\"optional\":true}") + "}}") + "}}";
+
+	std::string deep, deepBad;
+	for (int i = 0; i < 50; i++)
+		deep += "{\"k\":[";
+	deepBad = deep + "\"x\"";
+	deep += "1";
+	for (int i = 0; i < 50; i++) {
+		deep += "]}";
+		deepBad += "]}";
+	}
+
+	std::string inputs[] = {
+		deep,
+		"{\"p3\":{\"p68\":1,\"p0\":2},\"p69\":{\"p1\":2}}",
+		deepBad,
+		"{\"p3\":{\"p68\":\"s\"}}",
+		"{\"k\":[{\"k\":[]}],\"p5\":{}}",
+		"{\"p3\":{\"p1\":1,\"p2\":[",
+	};
+	bool valid[] = { true, true, false, false, true, false };
+
+	jschema_ref parsedSchema = jschema_parse(j_str_to_buffer(schema.c_str(), schema.size()), JSCHEMA_DOM_NOOPT, NULL);
+	QVERIFY(parsedSchema != NULL);
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, parsedSchema, NULL, NULL);
+
+	jparser_ref parser = jparser_create(JPARSE_OPT_NONE);
+	QVERIFY(parser != NULL);
+
+	for (int round = 0; round < 3; round++) {
+		for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+			raw_buffer input = j_str_to_buffer(inputs[i].c_str(), inputs[i].size());
+			QCOMPARE(!jis_null(manage(jdom_parse(input, DOMOPT_NOOPT, &schemaInfo))), valid[i]);
+			QCOMPARE(!jis_null(manage(jdom_parse_with_parser(parser, input, DOMOPT_NOOPT, &schemaInfo))), valid[i]);
+			QCOMPARE(jsax_parse_with_parser(parser, NULL, input, &schemaInfo, NULL, false), valid[i]);
+		}
+	}
+
+	jparser_release(&parser);
+	jschema_release(&parsedSchema);
+}
+
+static bool collectDocument(void *ctxt, jvalue_ref dom)
+{
+	std::vector<std::string> *docs = static_cast<std::vector<std::string> *>(ctxt);
+	docs->push_back(jis_null(dom) ? std::string("<failed>") : std::string(jvalue_tostring(dom, jschema_all())));
+	j_release(&dom);
+	return docs->size() < 4;
+}
+
+static bool countDocument(void *ctxt, bool parsedOK)
+{
+	return true;
+}
+
+void TestParse::testParseMulti()
+{
+	const char *input = "{\"a\":1}\n[\"b\"]{\"c\":2}  \n{\"bad\" 1}\n\n{\"d\":3}\n{\"e\":4}\n";
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+	// the callback asks to stop after the 4th document
+	std::vector<std::string> docs;
+	QVERIFY(!jdom_parse_multi(j_cstr_to_buffer(input), &schemaInfo, collectDocument, &docs));
+	QCOMPARE((int)docs.size(), 4);
+	QCOMPARE(docs[0], std::string("{\"a\":1}"));
+	QCOMPARE(docs[1], std::string("[\"b\"]"));
+	QCOMPARE(docs[2], std::string("{\"c\":2}"));
+	QCOMPARE(docs[3], std::string("<failed>"));
+
+	// every document is validated on its own
+	jschema_ref schema = manage(jschema_parse(j_cstr_to_buffer("{\"type\":\"object\"}"), JSCHEMA_DOM_NOOPT, NULL));
+	QVERIFY(schema != NULL);
+	JSchemaInfo objectsOnly;
+	jschema_info_init(&objectsOnly, schema, NULL, NULL);
+	docs.clear();
+	QVERIFY(jdom_parse_multi(j_cstr_to_buffer("{\"a\":1} {\"b\":2}\n{\"c\":3}"), &objectsOnly, collectDocument, &docs));
+	QCOMPARE((int)docs.size(), 3);
+	docs.clear();
+	QVERIFY(!jdom_parse_multi(j_cstr_to_buffer("{\"a\":1}\n[2]\n{\"c\":3}"), &objectsOnly, collectDocument, &docs));
+	QCOMPARE((int)docs.size(), 3);
+	QCOMPARE(docs[1], std::string("<failed>"));
+	QCOMPARE(docs[2], std::string("{\"c\":3}"));
+
+	// a line that was cut short doesn't take the next document down with it
+	docs.clear();
+	QVERIFY(!jdom_parse_multi(j_cstr_to_buffer("{\"a\":1\n{\"b\":2}\ntru\n{\"c\":3}\n"), &schemaInfo, collectDocument, &docs));
+	QCOMPARE((int)docs.size(), 4);
+	QCOMPARE(docs[0], std::string("<failed>"));
+	QCOMPARE(docs[1], std::string("{\"b\":2}"));
+	QCOMPARE(docs[2], std::string("<failed>"));
+	QCOMPARE(docs[3], std::string("{\"c\":3}"));
+
+	QVERIFY(jsax_parse_multi(NULL, j_cstr_to_buffer("{\"a\":1}\n[\"b\"]\n"), &schemaInfo, NULL, countDocument));
+	QVERIFY(!jsax_parse_multi(NULL, j_cstr_to_buffer(input), &schemaInfo, NULL, NULL));
+}
+
+static bool checkDocumentOrder(void *ctxt, jvalue_ref dom)
+{
+	std::vector<int64_t> *ids = static_cast<std::vector<int64_t> *>(ctxt);
+	int64_t id = -1;
+	if (jis_object(dom))
+		jnumber_get_i64(jobject_get(dom, J_CSTR_TO_BUF("id")), &id);
+	ids->push_back(id);
+	j_release(&dom);
+	return true;
+}
+
+static bool stopAtFirstDocument(void *ctxt, jvalue_ref dom)
+{
+	checkDocumentOrder(ctxt, dom);
+	return false;
+}
+
+void TestParse::testParseParallelNdjson()
+{
+	// big enough to be split up between the workers
+	const int numDocuments = 20000;
+	std::string input;
+	for (int i = 0; i < numDocuments; i++)
+		input += "{\"id\":" + QString::number(i).toStdString() + ",\"tags\":[\"a\",\"b\"]}\n";
+
+	jschema_ref schema = manage(jschema_parse(j_cstr_to_buffer("{\"type\":\"object\",\"properties\":{\"id\":{\"type\":\"integer\"}}}"), JSCHEMA_DOM_NOOPT, NULL));
+	QVERIFY(schema != NULL);
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, schema, NULL, NULL);
+
+	std::vector<int64_t> ids;
+	QVERIFY(jparse_parallel_ndjson(j_str_to_buffer(input.data(), input.size()), &schemaInfo, 4, JPARALLEL_OPT_ORDERED, checkDocumentOrder, &ids));
+	QCOMPARE((int)ids.size(), numDocuments);
+	for (int i = 0; i < numDocuments; i++)
+		QCOMPARE(ids[i], (int64_t)i);
+
+	// every document still shows up exactly once when delivered as soon as it's ready
+	ids.clear();
+	QVERIFY(jparse_parallel_ndjson(j_str_to_buffer(input.data(), input.size()), &schemaInfo, 4, JPARALLEL_OPT_NONE, checkDocumentOrder, &ids));
+	QCOMPARE((int)ids.size(), numDocuments);
+	std::sort(ids.begin(), ids.end());
+	for (int i = 0; i < numDocuments; i++)
+		QCOMPARE(ids[i], (int64_t)i);
+
+	// a document rejected by the schema fails on its own
+	input.replace(input.find("{\"id\":100,"), 9, "{\"id\":\"x\"");
+	ids.clear();
+	QVERIFY(!jparse_parallel_ndjson(j_str_to_buffer(input.data(), input.size()), &schemaInfo, 0, JPARALLEL_OPT_ORDERED, checkDocumentOrder, &ids));
+	QCOMPARE((int)ids.size(), numDocuments);
+	QCOMPARE(ids[100], (int64_t)-1);
+	QCOMPARE(ids[101], (int64_t)101);
+
+	// stopping early only accounts for the documents delivered, no matter how many more were parsed
+	ids.clear();
+	QVERIFY(jparse_parallel_ndjson(j_str_to_buffer(input.data(), input.size()), &schemaInfo, 4, JPARALLEL_OPT_ORDERED, stopAtFirstDocument, &ids));
+	QCOMPARE((int)ids.size(), 1);
+	QCOMPARE(ids[0], (int64_t)0);
+	ids.clear();
+	QVERIFY(jparse_parallel_ndjson(j_str_to_buffer(input.data(), input.size()), &schemaInfo, 4, JPARALLEL_OPT_NONE, stopAtFirstDocument, &ids));
+	QCOMPARE((int)ids.size(), 1);
+	QVERIFY(ids[0] >= 0);
+}
+
+void TestParse::testParseArrayParallel()
+{
+	const int numElements = 20000;
+	std::string records;
+	for (int i = 0; i < numElements; i++)
+		records += std::string(i ? ",\n" : "") + "{\"id\":" + QString::number(i).toStdString() + ",\"name\":\"],\\\"}\"}";
+	std::string input = "{\"meta\":{\"records\":1},\"data\":{\"records\":[" + records + "]}}";
+
+	jschema_ref schema = manage(jschema_parse(j_cstr_to_buffer("{\"type\":\"object\",\"properties\":{\"id\":{\"type\":\"integer\"}}}"), JSCHEMA_DOM_NOOPT, NULL));
+	QVERIFY(schema != NULL);
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, schema, NULL, NULL);
+
+	jvalue_ref parsed = manage(jdom_parse_array_parallel(j_str_to_buffer(input.data(), input.size()), "/data/records", DOMOPT_NOOPT, &schemaInfo, 4));
+	QVERIFY(jis_array(parsed));
+	QCOMPARE((int)jarray_size(parsed), numElements);
+	for (int i = 0; i < numElements; i++) {
+		int64_t id;
+		QVERIFY(jnumber_get_i64(jobject_get(jarray_get(parsed, i), J_CSTR_TO_BUF("id")), &id) == CONV_OK);
+		QCOMPARE(id, (int64_t)i);
+	}
+
+	// the whole document being the array
+	std::string array = "[" + records + "]";
+	parsed = manage(jdom_parse_array_parallel(j_str_to_buffer(array.data(), array.size()), NULL, DOMOPT_NOOPT, &schemaInfo, 0));
+	QCOMPARE((int)jarray_size(parsed), numElements);
+
+	QVERIFY(jis_null(manage(jdom_parse_array_parallel(j_str_to_buffer(input.data(), input.size()), "/meta/records", DOMOPT_NOOPT, &schemaInfo, 4))));
+	QVERIFY(jis_null(manage(jdom_parse_array_parallel(j_str_to_buffer(input.data(), input.size()), "/data/missing", DOMOPT_NOOPT, &schemaInfo, 4))));
+
+	// malformed around the elements, threaded or not
+	JSchemaInfo anything;
+	jschema_info_init(&anything, jschema_all(), NULL, NULL);
+	const char *malformed[] = {
+		"[1,2,]", "[1,2 , ]", "[,1]", "[1,,2]", "[1,2] junk", "[1,2]]", "[1,2",
+	};
+	const char *nestedMalformed[] = {
+		"{\"a\":[1,2]", "{\"a\":[1,2]} x", "{\"a\":[1,2],}", "{\"a\":[1,2] \"b\":1}", "{\"a\":[1,2],\"b\"}",
+	};
+	for (unsigned int nthreads = 1; nthreads <= 2; nthreads++) {
+		QVERIFY(jis_array(manage(jdom_parse_array_parallel(j_cstr_to_buffer(" [1,2] \n"), NULL, DOMOPT_NOOPT, &anything, nthreads))));
+		QVERIFY(jis_array(manage(jdom_parse_array_parallel(j_cstr_to_buffer("{\"a\":[1,2],\"b\":{\"c\":[]}}"), "/a", DOMOPT_NOOPT, &anything, nthreads))));
+		for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++)
+			QVERIFY(jis_null(manage(jdom_parse_array_parallel(j_cstr_to_buffer(malformed[i]), NULL, DOMOPT_NOOPT, &anything, nthreads))));
+		for (size_t i = 0; i < sizeof(nestedMalformed) / sizeof(nestedMalformed[0]); i++)
+			QVERIFY(jis_null(manage(jdom_parse_array_parallel(j_cstr_to_buffer(nestedMalformed[i]), "/a", DOMOPT_NOOPT, &anything, nthreads))));
+	}
+
+	// keys are matched after undoing the JSON pointer escapes; dots are just part of a key
+	const char *escaped = "{\"a.b\":{\"c/d~e\":[1]},\"a\":{\"b\":{}}}";
+	QVERIFY(jis_array(manage(jdom_parse_array_parallel(j_cstr_to_buffer(escaped), "/a.b/c~1d~0e", DOMOPT_NOOPT, &anything, 1))));
+	QVERIFY(jis_null(manage(jdom_parse_array_parallel(j_cstr_to_buffer(escaped), "/a.b/c/d~e", DOMOPT_NOOPT, &anything, 1))));
+	QVERIFY(jis_null(manage(jdom_parse_array_parallel(j_cstr_to_buffer(escaped), "/a.b/c~1d~2e", DOMOPT_NOOPT, &anything, 1))));
+	QVERIFY(jis_null(manage(jdom_parse_array_parallel(j_cstr_to_buffer(escaped), "a.b/c~1d~0e", DOMOPT_NOOPT, &anything, 1))));
+	QVERIFY(jis_array(manage(jdom_parse_array_parallel(j_cstr_to_buffer("{\"\":[]}"), "/", DOMOPT_NOOPT, &anything, 1))));
+
+	// a single element rejected by the schema fails the whole array
+	input.replace(input.find("{\"id\":100,"), 9, "{\"id\":\"x\"");
+	QVERIFY(jis_null(manage(jdom_parse_array_parallel(j_str_to_buffer(input.data(), input.size()), "/data/records", DOMOPT_NOOPT, &schemaInfo, 4))));
+}
+
+void TestParse::testParseTopLevelScalar()
+{
+	// a document may be a lone scalar - a number that ends the input included
+	const char *scalars[] = { "5", "-1.5e3", "\"s\"", "true" };
+	jschema_ref schema = manage(jschema_parse(j_cstr_to_buffer("{\"type\":[\"number\",\"string\",\"boolean\"]}"), JSCHEMA_DOM_NOOPT, NULL));
+	jschema_ref small = manage(jschema_parse(j_cstr_to_buffer("{\"type\":\"integer\",\"maximum\":4}"), JSCHEMA_DOM_NOOPT, NULL));
+	QVERIFY(schema != NULL && small != NULL);
+	JSchemaInfo anything, validating, tooSmall;
+	jschema_info_init(&anything, jschema_all(), NULL, NULL);
+	jschema_info_init(&validating, schema, NULL, NULL);
+	jschema_info_init(&tooSmall, small, NULL, NULL);
+	jparser_ref parser = jparser_create(JPARSE_OPT_NONE);
+	QVERIFY(parser != NULL);
+
+	for (size_t i = 0; i < sizeof(scalars) / sizeof(scalars[0]); i++) {
+		raw_buffer input = j_cstr_to_buffer(scalars[i]);
+		JSchemaInfo *infos[] = { &anything, &validating };
+		for (size_t k = 0; k < sizeof(infos) / sizeof(infos[0]); k++) {
+			jvalue_ref parsed = manage(jdom_parse(input, DOMOPT_NOOPT, infos[k]));
+			QVERIFY(!jis_null(parsed));
+			QCOMPARE(std::string(jvalue_tostring(parsed, jschema_all())), std::string(scalars[i]));
+			parsed = manage(jdom_parse_with_parser(parser, input, DOMOPT_NOOPT, infos[k]));
+			QCOMPARE(std::string(jvalue_tostring(parsed, jschema_all())), std::string(scalars[i]));
+			QVERIFY(jsax_parse(NULL, input, infos[k]));
+		}
+	}
+
+	int64_t integer;
+	QVERIFY(jnumber_get_i64(manage(jdom_parse(j_cstr_to_buffer("5"), DOMOPT_NOOPT, &anything)), &integer) == CONV_OK);
+	QCOMPARE(integer, (int64_t)5);
+	raw_buffer string = jstring_get_fast(manage(jdom_parse(j_cstr_to_buffer("\"s\""), DOMOPT_NOOPT, &anything)));
+	QCOMPARE(std::string(string.m_str, string.m_len), std::string("s"));
+
+	// the schema applies to the scalar as it would to an object
+	QVERIFY(jis_null(manage(jdom_parse(j_cstr_to_buffer("5"), DOMOPT_NOOPT, &tooSmall))));
+	QVERIFY(!jsax_parse(NULL, j_cstr_to_buffer("5"), &tooSmall));
+	QVERIFY(!jis_null(manage(jdom_parse(j_cstr_to_buffer("4"), DOMOPT_NOOPT, &tooSmall))));
+
+	jparser_release(&parser);
+}
+
+void TestParse::testParseCbor()
+{
+	const char *json = "{\"int\":[0,23,24,-1,-25,4294967296,-9223372036854775807],\"float\":[1.5,0.1],"
+		"\"str\":\"quote\\\" & \\u00e9\",\"bool\":[true,false],\"null\":null,\"empty\":[{},[]]}";
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+	jvalue_ref parsed = manage(jdom_parse(j_cstr_to_buffer(json), DOMOPT_NOOPT, &schemaInfo));
+	QVERIFY(jis_object(parsed));
+
+	size_t length;
+	char *encoded = jvalue_to_cbor(parsed, &length);
+	QVERIFY(encoded != NULL);
+	raw_buffer cbor = j_str_to_buffer(encoded, length);
+	jvalue_ref decoded = manage(jdom_parse_cbor(cbor, &schemaInfo));
+	QVERIFY(identical(parsed, decoded));
+
+	// numbers are decoded without going through text
+	int64_t integer;
+	double floating;
+	QVERIFY(jnumber_get_i64(jarray_get(jobject_get(decoded, J_CSTR_TO_BUF("int")), 6), &integer) == CONV_OK);
+	QCOMPARE(integer, -INT64_C(9223372036854775807));
+	QVERIFY(jnumber_get_f64(jarray_get(jobject_get(decoded, J_CSTR_TO_BUF("float")), 1), &floating) == CONV_OK);
+	QCOMPARE(floating, 0.1);
+
+	// every prefix of the encoding is rejected
+	for (size_t i = 0; i < length; i++)
+		QVERIFY(jis_null(jdom_parse_cbor(j_str_to_buffer(encoded, i), &schemaInfo)));
+	free(encoded);
+
+	// well-known encodings, including indefinite lengths & tags
+	QByteArray wellKnown = QByteArray::fromHex("bf616b9ff93c00c11a000f4240f6f77f6261626163ffffff");
+	decoded = manage(jdom_parse_cbor(j_str_to_buffer(wellKnown.constData(), wellKnown.size()), &schemaInfo));
+	QCOMPARE(QString(jvalue_tostring(decoded, jschema_all())), QString("{\"k\":[1,1000000,null,null,\"abc\"]}"));
+
+	const char *malformed[] = {
+		"42", // byte string
+		"a10102", // key that isn't a string
+		"ff", // break outside of an indefinite length
+		"0101", // more than one value
+		"f904007c00", // trailing data after a half-precision float
+		"f97c00", // infinity
+		"f9fc00", // negative infinity
+		"f97e00", // NaN
+		"1c", // reserved additional information
+	};
+	for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+		QByteArray bad = QByteArray::fromHex(malformed[i]);
+		QVERIFY(jis_null(jdom_parse_cbor(j_str_to_buffer(bad.constData(), bad.size()), &schemaInfo)));
+	}
+
+	// validation works the same as for text
+	jschema_ref schema = manage(jschema_parse(j_cstr_to_buffer(
+		"{\"type\":\"object\",\"properties\":{\"n\":{\"type\":\"integer\",\"maximum\":10},"
+		"\"s\":{\"type\":\"string\",\"default\":\"default\"}}}"), JSCHEMA_DOM_NOOPT, NULL));
+	QVERIFY(schema != NULL);
+	jschema_info_init(&schemaInfo, schema, NULL, NULL);
+
+	QByteArray valid = QByteArray::fromHex("a1616e05");
+	QByteArray invalid = QByteArray::fromHex("a1616e0b");
+	decoded = manage(jdom_parse_cbor(j_str_to_buffer(valid.constData(), valid.size()), &schemaInfo));
+	QCOMPARE(QString(jvalue_tostring(decoded, jschema_all())), QString("{\"n\":5,\"s\":\"default\"}"));
+	QVERIFY(jis_null(jdom_parse_cbor(j_str_to_buffer(invalid.constData(), invalid.size()), &schemaInfo)));
+	QVERIFY(jsax_parse_cbor(NULL, j_str_to_buffer(valid.constData(), valid.size()), &schemaInfo, NULL, false));
+	QVERIFY(!jsax_parse_cbor(NULL, j_str_to_buffer(invalid.constData(), invalid.size()), &schemaInfo, NULL, false));
+
+	// a decoded float is checked as the same text as that float in a DOM
+	schema = manage(jschema_parse(j_cstr_to_buffer("{\"type\":\"number\",\"maximum\":0.3}"), JSCHEMA_DOM_NOOPT, NULL));
+	QVERIFY(schema != NULL);
+	jschema_info_init(&schemaInfo, schema, NULL, NULL);
+
+	double sum = 0.1 + 0.2;
+	QByteArray sumCbor = QByteArray::fromHex("fb3fd3333333333334");
+	jvalue_ref sumDom = manage(jnumber_create_f64(sum));
+	bool domValid = jvalue_validate(sumDom, &schemaInfo, NULL);
+	decoded = manage(jdom_parse_cbor(j_str_to_buffer(sumCbor.constData(), sumCbor.size()), &schemaInfo));
+	QCOMPARE(!jis_null(decoded), domValid);
+	QVERIFY(jnumber_get_f64(decoded, &floating) == CONV_OK);
+	QCOMPARE(floating, sum);
+}
+
+static bool write_file(const QTemporaryFile &file, const QByteArray &contents)
+{
+	QFile out(file.fileName());
+	return out.open(QIODevice::WriteOnly | QIODevice::Truncate) && out.write(contents) == contents.size();
+}
+
+/**
+ * Overwrite one 64-bit field of a snapshot.
+ */
+static QByteArray patchSnapshot(QByteArray image, int offset, uint64_t value)
+{
+	memcpy(image.data() + offset, &value, sizeof(value));
+	return image;
+}
+
+void TestParse::testSnapshot()
+{
+	const char *json = "{\"zeta\":[1,2.5,123456789012345678901234567890],\"alpha\":{\"b\":true,\"a\":false,\"n\":null},"
+		"\"str\":\"quote\\\" & \\u00e9\",\"empty\":[{},[],\"\"]}";
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+	jvalue_ref parsed = manage(jdom_parse(j_cstr_to_buffer(json), DOMOPT_NOOPT, &schemaInfo));
+	QVERIFY(jis_object(parsed));
+
+	QTemporaryFile file;
+	QVERIFY(file.open());
+	std::string path = file.fileName().toStdString();
+
+	QVERIFY(jvalue_save_snapshot(parsed, path.c_str()));
+	jvalue_ref snapshot = manage(jvalue_open_snapshot(path.c_str()));
+	QVERIFY(jis_object(snapshot));
+
+	// members can be looked up before the object is ever iterated over
+	jvalue_ref zeta;
+	QVERIFY(jobject_get_exists(snapshot, J_CSTR_TO_BUF("zeta"), &zeta));
+	QVERIFY(!jobject_get_exists(snapshot, J_CSTR_TO_BUF("missing"), NULL));
+	raw_buffer raw;
+	QVERIFY(jnumber_get_raw(jarray_get(zeta, 2), &raw) == CONV_OK);
+	QCOMPARE(std::string(raw.m_str, raw.m_len), std::string("123456789012345678901234567890"));
+
+	QVERIFY(identical(parsed, snapshot));
+	// members are kept sorted by key
+	QCOMPARE(QString(jvalue_tostring(jobject_get(snapshot, J_CSTR_TO_BUF("alpha")), jschema_all())),
+		QString("{\"a\":false,\"b\":true,\"n\":null}"));
+
+	// the snapshot is read-only
+	jvalue_ref element = manage(jnumber_create_i64(3));
+	QVERIFY(!jarray_append(zeta, element));
+	QVERIFY(!jarray_remove(zeta, 0));
+	QVERIFY(!jobject_set(snapshot, J_CSTR_TO_BUF("zeta"), element));
+	QVERIFY(!jobject_remove(snapshot, J_CSTR_TO_BUF("zeta")));
+	QCOMPARE(jarray_size(zeta), (ssize_t)3);
+
+	// a snapshot of a snapshot is the same
+	// (the first snapshot stays mapped & intact - the file is replaced rather than overwritten)
+	QVERIFY(jvalue_save_snapshot(snapshot, path.c_str()));
+	jvalue_ref reopened = jvalue_open_snapshot(path.c_str());
+	QVERIFY(identical(parsed, reopened));
+	j_release(&reopened);
+	QVERIFY(identical(parsed, snapshot));
+
+	// anything that isn't a complete snapshot is rejected
+	QFile snapshotFile(file.fileName());
+	QVERIFY(snapshotFile.open(QIODevice::ReadWrite));
+	QVERIFY(snapshotFile.resize(snapshotFile.size() - 1));
+	QVERIFY(jis_null(jvalue_open_snapshot(path.c_str())));
+	QVERIFY(snapshotFile.resize(0));
+	QVERIFY(snapshotFile.write(json) > 0);
+	snapshotFile.close();
+	QVERIFY(jis_null(jvalue_open_snapshot(path.c_str())));
+
+	// so is a container whose table isn't past its own node, as it could contain itself
+	// ([[]] is laid out as the root node at 24 within the header, its table at 48 holding the inner array's node)
+	jvalue_ref nested = manage(jdom_parse(j_cstr_to_buffer("[[]]"), DOMOPT_NOOPT, &schemaInfo));
+	QVERIFY(jvalue_save_snapshot(nested, path.c_str()));
+	QVERIFY(snapshotFile.open(QIODevice::ReadOnly));
+	QByteArray image = snapshotFile.readAll();
+	snapshotFile.close();
+	QCOMPARE(image.size(), 72);
+
+	QVERIFY(write_file(file, patchSnapshot(patchSnapshot(image, 56, 1), 64, 48)));
+	snapshot = manage(jvalue_open_snapshot(path.c_str()));
+	QVERIFY(jis_array(snapshot));
+	QVERIFY(jis_null(jarray_get(snapshot, 0)));
+
+	QVERIFY(write_file(file, patchSnapshot(image, 40, 24)));
+	QVERIFY(jis_null(jvalue_open_snapshot(path.c_str())));
+
+	QVERIFY(write_file(file, image));
+	QVERIFY(identical(nested, manage(jvalue_open_snapshot(path.c_str()))));
+}
+
+static int count_numbers(JSAXContextRef ctxt, const char *number, size_t numberLen)
+{
+	++*static_cast<int *>(jsax_getContext(ctxt));
+	return 1;
+}
+
+void TestParse::testParseFileCompressed()
+{
+	const char *json = "{\"a\":[1,2.5,\"str\\u00e9\"],\"b\":{\"c\":null,\"d\":true}}";
+	QByteArray compressed = QByteArray::fromHex(
+		"1f8b08000000000002ffab564a54b28a36d431d233d5512a2e298a29353048b5548ad5514a52b2aa564a56b2ca2bcdc9d1514a51b22a"
+		"292a4dadad05007736213731000000");
+	// two gzip members one after another ("{\"a\":[1," & "2]}")
+	QByteArray concatenated = QByteArray::fromHex(
+		"1f8b08000000000002ffab564a54b28a36d40100446869bf08000000"
+		"1f8b08000000000002ff338aad050074c60ff903000000");
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+	QTemporaryFile file;
+	QVERIFY(file.open());
+	std::string path = file.fileName().toStdString();
+
+	jvalue_ref parsed = manage(jdom_parse(j_cstr_to_buffer(json), DOMOPT_NOOPT, &schemaInfo));
+	QVERIFY(write_file(file, compressed));
+	QVERIFY(identical(parsed, manage(jdom_parse_file(path.c_str(), &schemaInfo, JFileOptNoOpt))));
+	QVERIFY(identical(parsed, manage(jdom_parse_file(path.c_str(), &schemaInfo, JFileOptMMap))));
+
+	int numbers = 0;
+	void *ctxt = &numbers;
+	PJSAXCallbacks callbacks = { 0 };
+	callbacks.m_number = count_numbers;
+	QVERIFY(jsax_parse_file(&callbacks, path.c_str(), &schemaInfo, &ctxt, false));
+	QCOMPARE(numbers, 2);
+
+	// validated just like any other input
+	jschema_ref schema = manage(jschema_parse(j_cstr_to_buffer(
+		"{\"type\":\"object\",\"properties\":{\"a\":{\"type\":\"array\",\"maxItems\":2}}}"), JSCHEMA_DOM_NOOPT, NULL));
+	QVERIFY(schema != NULL);
+	JSchemaInfo restricted;
+	jschema_info_init(&restricted, schema, NULL, NULL);
+	QVERIFY(jis_null(jdom_parse_file(path.c_str(), &restricted, JFileOptNoOpt)));
+
+	QVERIFY(write_file(file, concatenated));
+	QCOMPARE(QString(jvalue_tostring(manage(jdom_parse_file(path.c_str(), &schemaInfo, JFileOptNoOpt)), jschema_all())),
+		QString("{\"a\":[1,2]}"));
+	QVERIFY(jis_object(manage(jdom_parse_file(path.c_str(), &restricted, JFileOptNoOpt))));
+
+	// truncated or damaged compressed data is rejected
+	QVERIFY(write_file(file, compressed.left(compressed.size() - 4)));
+	QVERIFY(jis_null(jdom_parse_file(path.c_str(), &schemaInfo, JFileOptNoOpt)));
+	QVERIFY(!jsax_parse_file(NULL, path.c_str(), &schemaInfo, NULL, false));
+	QByteArray damaged = compressed;
+	damaged[16] = damaged[16] ^ 0xff;
+	QVERIFY(write_file(file, damaged));
+	QVERIFY(jis_null(jdom_parse_file(path.c_str(), &schemaInfo, JFileOptNoOpt)));
+
+	// jsax_parse_file streams uncompressed files too
+	numbers = 0;
+	QVERIFY(write_file(file, QByteArray(json)));
+	QVERIFY(jsax_parse_file(&callbacks, path.c_str(), &schemaInfo, &ctxt, false));
+	QCOMPARE(numbers, 2);
+}
+
+void TestParse::testStats()
+{
+	const char *json = "{\"a\":[1,2,3],\"b\":\"str\",\"c\":{\"d\":null,\"e\":true}}";
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+	jstats stats;
+
+	// nothing is counted until statistics are enabled
+	jstats_reset();
+	manage(jdom_parse(j_cstr_to_buffer(json), DOMOPT_NOOPT, &schemaInfo));
+	jstats_snapshot(&stats);
+	QCOMPARE(stats.m_documentsParsed, (uint64_t)0);
+
+	jstats_enable(true);
+	jvalue_ref parsed = manage(jdom_parse(j_cstr_to_buffer(json), DOMOPT_NOOPT, &schemaInfo));
+	QVERIFY(jis_object(parsed));
+	QVERIFY(jvalue_tostring(parsed, jschema_all()) != NULL);
+	jstats_snapshot(&stats);
+	QCOMPARE(stats.m_documentsParsed, (uint64_t)1);
+	QCOMPARE(stats.m_parseFailures, (uint64_t)0);
+	QCOMPARE(stats.m_bytesParsed, (uint64_t)strlen(json));
+	QCOMPARE(stats.m_allocations[JSTATS_OBJECT].m_nodes, (uint64_t)2);
+	QCOMPARE(stats.m_allocations[JSTATS_ARRAY].m_nodes, (uint64_t)1);
+	QCOMPARE(stats.m_allocations[JSTATS_NUMBER].m_nodes, (uint64_t)3);
+	QCOMPARE(stats.m_allocations[JSTATS_BOOLEAN].m_nodes, (uint64_t)1);
+	QVERIFY(stats.m_allocations[JSTATS_STRING].m_bytes > 0);
+	QVERIFY(stats.m_hashProbes >= 5);
+	QVERIFY(stats.m_parseTime > 0);
+	QVERIFY(stats.m_generateTime > 0);
+
+	// failures are counted by the keyword that failed
+	jschema_ref schema = manage(jschema_parse(j_cstr_to_buffer(
+		"{\"type\":\"object\",\"properties\":{\"n\":{\"type\":\"integer\",\"maximum\":2},"
+		"\"s\":{\"type\":\"string\",\"maxLength\":2}},\"additionalProperties\":false}"), JSCHEMA_DOM_NOOPT, NULL));
+	QVERIFY(schema != NULL);
+	JSchemaInfo restricted;
+	jschema_info_init(&restricted, schema, NULL, NULL);
+
+	jstats_reset();
+	QVERIFY(jis_null(jdom_parse(J_CSTR_TO_BUF("{\"n\":3}"), DOMOPT_NOOPT, &restricted)));
+	QVERIFY(jis_null(jdom_parse(J_CSTR_TO_BUF("{\"n\":\"3\"}"), DOMOPT_NOOPT, &restricted)));
+	QVERIFY(jis_null(jdom_parse(J_CSTR_TO_BUF("{\"s\":\"abc\"}"), DOMOPT_NOOPT, &restricted)));
+	QVERIFY(jis_null(jdom_parse(J_CSTR_TO_BUF("{\"x\":1}"), DOMOPT_NOOPT, &restricted)));
+	QVERIFY(!jvalue_validate(manage(jdom_parse(J_CSTR_TO_BUF("{\"n\":5}"), DOMOPT_NOOPT, &schemaInfo)), &restricted, NULL));
+	jstats_snapshot(&stats);
+	QCOMPARE(stats.m_documentsParsed, (uint64_t)5);
+	QCOMPARE(stats.m_parseFailures, (uint64_t)4);
+	QCOMPARE(stats.m_validationFailures[JSTATS_FAIL_RANGE], (uint64_t)2);
+	QCOMPARE(stats.m_validationFailures[JSTATS_FAIL_TYPE], (uint64_t)1);
+	QCOMPARE(stats.m_validationFailures[JSTATS_FAIL_LENGTH], (uint64_t)1);
+	QCOMPARE(stats.m_validationFailures[JSTATS_FAIL_PROPERTIES], (uint64_t)1);
+	QVERIFY(stats.m_schemaStates > 0);
+	QVERIFY(stats.m_validateTime > 0);
+
+	jstats_enable(false);
+}
+
+struct CountingAllocator {
+	int m_live;
+	int m_total;
+};
+
+static void* counting_malloc(void *ctxt, size_t size)
+{
+	CountingAllocator *counts = static_cast<CountingAllocator *>(ctxt);
+	counts->m_live++;
+	counts->m_total++;
+	return malloc(size);
+}
+
+static void* counting_realloc(void *ctxt, void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return counting_malloc(ctxt, size);
+	static_cast<CountingAllocator *>(ctxt)->m_total++;
+	return realloc(ptr, size);
+}
+
+static void counting_free(void *ctxt, void *ptr)
+{
+	static_cast<CountingAllocator *>(ctxt)->m_live--;
+	free(ptr);
+}
+
+void TestParse::testAllocator()
+{
+	const char *json = "{\"a\":[1,2.5,\"str\",true,null,{\"b\":\"a string long enough to be copied\"}],\"c\":12345678901234567890}";
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, jschema_all(), NULL, NULL);
+
+	CountingAllocator global = { 0, 0 };
+	CountingAllocator document = { 0, 0 };
+	JAllocator globalAllocator = { counting_malloc, counting_realloc, counting_free, &global };
+	JAllocator documentAllocator = { counting_malloc, counting_realloc, counting_free, &document };
+
+	jallocator_set_default(&globalAllocator);
+	QVERIFY(jallocator_default() == &globalAllocator);
+
+	// everything the library allocates goes through the default allocator
+	jvalue_ref parsed = jdom_parse(j_cstr_to_buffer(json), DOMOPT_NOOPT, &schemaInfo);
+	QVERIFY(jis_object(parsed));
+	QVERIFY(global.m_total > 0);
+
+	// documents parsed with a parser come from its allocator - its own state doesn't
+	jparser_ref parser = jparser_create(JPARSE_OPT_NONE);
+	QVERIFY(parser != NULL);
+	jparser_set_allocator(parser, &documentAllocator);
+	jvalue_ref separate = jdom_parse_with_parser(parser, j_cstr_to_buffer(json), DOMOPT_NOOPT, &schemaInfo);
+	QVERIFY(identical(parsed, separate));
+	int documentLive = document.m_live;
+	QVERIFY(documentLive > 0);
+
+	// a container keeps growing from the allocator it was created with
+	for (int i = 0; i < 20; i++)
+		jarray_append(jobject_get(separate, J_CSTR_TO_BUF("a")), jnumber_create_i64(i));
+	QVERIFY(document.m_live > documentLive);
+
+	j_release(&separate);
+	QCOMPARE(document.m_live, 0);
+
+	jparser_release(&parser);
+	j_release(&parsed);
+	QCOMPARE(global.m_live, 0);
+
+	jallocator_set_default(NULL);
+	QVERIFY(jallocator_default() != &globalAllocator);
+}
+
 }
 }
 
@@ -86,6 +86,21 @@ private slots:
 	void testParseDoubleAccuracy();
 	void testParseFile_data();
 	void testParseFile();
+	void testParseUTF8Validation_data();
+	void testParseUTF8Validation();
+	void testParseSerializeEscapes();
+	void testParserReuse();
+	void testParseDeepNesting();
+	void testParserReuseWithSchema();
+	void testParseMulti();
+	void testParseParallelNdjson();
+	void testParseArrayParallel();
+	void testParseTopLevelScalar();
+	void testParseCbor();
+	void testSnapshot();
+	void testParseFileCompressed();
+	void testStats();
+	void testAllocator();
 };
 
 }
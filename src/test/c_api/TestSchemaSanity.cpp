@@ -25,9 +25,53 @@ LICENSE@@@ */
 #include "TestSchemaSanity.h"
 #include <QTest>
 #include <QtDebug>
+#include <QDir>
+#include <QFile>
+#include <string>
+#include <string.h>
+#include <unistd.h>
 
 Q_DECLARE_METATYPE(raw_buffer);
 
+static int resolverCalls = 0;
+
+static JSchemaResolutionResult countingResolver(JSchemaResolverRef resolver, jschema_ref *resolved)
+{
+	resolverCalls++;
+	if (resolver->m_resourceToResolve.m_len != 4 || memcmp(resolver->m_resourceToResolve.m_str, "Item", 4) != 0)
+		return SCHEMA_NOT_FOUND;
+
+	// refers back to itself for the children
+	*resolved = jschema_parse(J_CSTR_TO_BUF("{\"type\":\"object\",\"properties\":{"
+			"\"v\":{\"type\":\"integer\"},"
+			"\"children\":{\"type\":\"array\",\"optional\":true,\"items\":{\"$ref\":\"Item\"}}}}"),
+			JSCHEMA_DOM_NOOPT, NULL);
+	return *resolved ? SCHEMA_RESOLVED : SCHEMA_INVALID;
+}
+
+static bool writeFile(const QDir &dir, const QString &name, const char *contents)
+{
+	QFile file(dir.filePath(name));
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+	return file.write(contents) == (qint64)strlen(contents);
+}
+
+static bool validates(jschema_ref schema, raw_buffer input)
+{
+	JSchemaInfo schemaInfo;
+	jschema_info_init(&schemaInfo, schema, NULL, NULL);
+	return jsax_parse(NULL, input, &schemaInfo);
+}
+
+static bool countValid(void *ctxt, jvalue_ref dom)
+{
+	if (!jis_null(dom))
+		++*static_cast<int *>(ctxt);
+	j_release(&dom);
+	return true;
+}
+
 namespace pjson {
 
 	namespace testc {
@@ -77,6 +121,361 @@ namespace pjson {
 
 			jschema_release(&all);
 		}
+
+		void TestSchemaSanity::testCompiledKeywords_data()
+		{
+			QTest::addColumn<QString>("schema");
+			QTest::addColumn<QString>("input");
+			QTest::addColumn<bool>("valid");
+
+			QTest::newRow("minLength ok") << "{\"type\":\"string\",\"minLength\":2}" << "\"ab\"" << true;
+			QTest::newRow("minLength short") << "{\"type\":\"string\",\"minLength\":2}" << "\"a\"" << false;
+			QTest::newRow("maxLength counts characters") << "{\"type\":\"string\",\"maxLength\":2}" << "\"\u00e9\u00e9\"" << true;
+			QTest::newRow("maxLength long") << "{\"type\":\"string\",\"maxLength\":2}" << "\"abc\"" << false;
+			QTest::newRow("minimum ok") << "{\"type\":\"array\",\"items\":{\"minimum\":-1.5}}" << "[-1.5]" << true;
+			QTest::newRow("minimum small") << "{\"type\":\"array\",\"items\":{\"minimum\":-1.5}}" << "[-1.6]" << false;
+			QTest::newRow("maximum big") << "{\"type\":\"array\",\"items\":{\"maximum\":10}}" << "[0,5,11]" << false;
+			QTest::newRow("negative exponent form") << "{\"type\":\"object\",\"properties\":{\"a\":{\"minimum\":0}}}" << "{\"a\":-1e5}" << false;
+			QTest::newRow("negative exponent form ok") << "{\"type\":\"object\",\"properties\":{\"a\":{\"maximum\":-99999}}}" << "{\"a\":-1E+5}" << true;
+			QTest::newRow("negative exponent overflow") << "{\"type\":\"number\",\"minimum\":0}" << "-1e400" << false;
+			QTest::newRow("negative exponent overflow ok") << "{\"type\":\"number\",\"maximum\":-1e300}" << "-1e400" << true;
+			QTest::newRow("maximum int64") << "{\"type\":\"array\",\"items\":{\"maximum\":9007199254740995}}" << "[9007199254740995,1e2]" << true;
+			QTest::newRow("maximum int64 big") << "{\"type\":\"array\",\"items\":{\"maximum\":9007199254740995}}" << "[9007199254740996]" << false;
+			QTest::newRow("maximum int64 fraction") << "{\"type\":\"array\",\"items\":{\"maximum\":9007199254740995}}" << "[9007199254740995.5]" << false;
+			QTest::newRow("minimum int64 fraction") << "{\"type\":\"array\",\"items\":{\"minimum\":9007199254740993}}" << "[9007199254740992.9]" << false;
+			QTest::newRow("maximum beyond int64") << "{\"type\":\"array\",\"items\":{\"maximum\":5}}" << "[1e19]" << false;
+			QTest::newRow("numeric enum") << "{\"type\":\"array\",\"items\":{\"enum\":[1,2.5]}}" << "[1,2.5]" << true;
+			QTest::newRow("numeric enum miss") << "{\"type\":\"array\",\"items\":{\"enum\":[1,2.5]}}" << "[2]" << false;
+			QTest::newRow("string enum") << "{\"type\":\"array\",\"items\":{\"enum\":[\"a\",\"bc\",\"\",1]}}" << "[\"bc\",\"\",\"a\",1]" << true;
+			QTest::newRow("string enum miss") << "{\"type\":\"array\",\"items\":{\"enum\":[\"a\",\"bc\",\"\",1]}}" << "[\"b\"]" << false;
+			QTest::newRow("disallowed") << "{\"type\":\"array\",\"items\":{\"disallowed\":\"null\"}}" << "[1,null]" << false;
+			QTest::newRow("tuple extra") << "{\"type\":\"array\",\"items\":[{\"type\":\"string\"}],\"additionalProperties\":false}" << "[\"a\",1]" << false;
+			QTest::newRow("tuple rest") << "{\"type\":\"array\",\"items\":[{\"type\":\"string\"}],\"additionalProperties\":{\"type\":\"integer\"}}" << "[\"a\",1,2]" << true;
+			QTest::newRow("extends array") << "{\"extends\":[{\"type\":\"object\"},{\"properties\":{\"b\":{\"type\":\"string\"}}}]}" << "{\"b\":\"x\"}" << true;
+			QTest::newRow("extends array missing") << "{\"extends\":[{\"type\":\"object\"},{\"properties\":{\"b\":{\"type\":\"string\"}}}]}" << "{\"a\":1}" << false;
+			QTest::newRow("required key") << "{\"type\":\"object\",\"properties\":{\"a\":{\"optional\":true,\"required\":\"b\"}}}" << "{\"a\":1}" << false;
+			QTest::newRow("pattern") << "{\"type\":\"string\",\"pattern\":\"^[a-z]+-[0-9]+$\"}" << "\"abc-12\"" << true;
+			QTest::newRow("pattern mismatch") << "{\"type\":\"string\",\"pattern\":\"^[a-z]+-[0-9]+$\"}" << "\"abc-12x\"" << false;
+			QTest::newRow("pattern unanchored") << "{\"type\":\"string\",\"pattern\":\"[0-9]\"}" << "\"abc1def\"" << true;
+			QTest::newRow("pattern per item") << "{\"type\":\"array\",\"items\":{\"pattern\":\"^x\"}}" << "[\"xa\",\"xb\",\"ax\"]" << false;
+			QTest::newRow("patterns in chain") << "{\"extends\":{\"pattern\":\"a\"},\"pattern\":\"b\"}" << "\"ba\"" << true;
+			QTest::newRow("patterns in chain mismatch") << "{\"extends\":{\"pattern\":\"a\"},\"pattern\":\"b\"}" << "\"bb\"" << false;
+			QTest::newRow("required unlisted key") << "{\"type\":\"object\",\"properties\":{\"a\":{\"optional\":true,\"required\":[\"b\"]}}}" << "{\"b\":2,\"a\":1}" << true;
+			QTest::newRow("required unlisted key missing") << "{\"type\":\"object\",\"properties\":{\"a\":{\"optional\":true,\"required\":[\"b\"]}}}" << "{\"a\":1,\"c\":2}" << false;
+			QTest::newRow("no additional properties") << "{\"type\":\"object\",\"properties\":{\"a\":{}},\"additionalProperties\":false}" << "{\"a\":1,\"b\":2}" << false;
+
+			// more properties than fit in a single word of the set of keys seen
+			QString many = "{\"type\":\"object\",\"properties\":{";
+			for (int i = 0; i < 100; i++)
+				many += QString("%1\"k%2\":{%3}").arg(i ? "," : "").arg(i).arg(i == 90 ? "\"required\":\"k3\"" : "\"optional\":true");
+			many += "}}";
+			QTest::newRow("many properties") << many << "{\"k3\":1,\"k90\":2,\"k99\":3}" << true;
+			QTest::newRow("many properties missing") << many << "{\"k3\":1,\"k99\":3}" << false;
+			QTest::newRow("many properties requires") << many << "{\"k90\":2}" << false;
+		}
+
+		void TestSchemaSanity::testCompiledKeywords()
+		{
+			QFETCH(QString, schema);
+			QFETCH(QString, input);
+			QFETCH(bool, valid);
+
+			QByteArray schemaStr = schema.toUtf8();
+			QByteArray inputStr = input.toUtf8();
+
+			jschema_ref parsed = jschema_parse(j_str_to_buffer(schemaStr.constData(), schemaStr.size()), JSCHEMA_DOM_NOOPT, NULL);
+			QVERIFY(parsed != NULL);
+
+			JSchemaInfo schemaInfo;
+			jschema_info_init(&schemaInfo, parsed, NULL, NULL);
+
+			// lazily compiled on first use & compiled up-front must agree
+			QCOMPARE(jsax_parse(NULL, j_str_to_buffer(inputStr.constData(), inputStr.size()), &schemaInfo), valid);
+			QVERIFY(jschema_compile(parsed));
+			QCOMPARE(jsax_parse(NULL, j_str_to_buffer(inputStr.constData(), inputStr.size()), &schemaInfo), valid);
+
+			jschema_ref precompiled = jschema_duplicate(parsed);
+			QVERIFY(jschema_compile(precompiled));
+			jschema_info_init(&schemaInfo, precompiled, NULL, NULL);
+			QCOMPARE(jsax_parse(NULL, j_str_to_buffer(inputStr.constData(), inputStr.size()), &schemaInfo), valid);
+
+			// the DOM of the input must get the same answer without being serialized
+			JSchemaInfo anyInfo;
+			jschema_info_init(&anyInfo, jschema_all(), NULL, NULL);
+			jvalue_ref dom = jdom_parse(j_str_to_buffer(inputStr.constData(), inputStr.size()), DOMOPT_NOOPT, &anyInfo);
+			QVERIFY(!jis_null(dom));
+			bool domValid = jvalue_validate(dom, &schemaInfo, NULL);
+			j_release(&dom);
+			QCOMPARE(domValid, valid);
+
+			jschema_release(&precompiled);
+			jschema_release(&parsed);
+		}
+
+		void TestSchemaSanity::testValidateDom_data()
+		{
+			QTest::addColumn<QString>("schema");
+			QTest::addColumn<QString>("input");
+			QTest::addColumn<int>("check");
+			QTest::addColumn<QString>("path");
+
+			QTest::newRow("valid") << "{\"type\":\"object\",\"properties\":{\"a\":{\"type\":\"integer\"}}}" << "{\"a\":1}" << (int)JVALIDATION_OK << "";
+			QTest::newRow("wrong type") << "{\"type\":\"object\",\"properties\":{\"a\":{\"type\":\"integer\"}}}" << "{\"a\":\"x\"}" << (int)JVALIDATION_VALUE << "/a";
+			QTest::newRow("top-level") << "{\"type\":\"array\"}" << "{}" << (int)JVALIDATION_VALUE << "";
+			QTest::newRow("missing key") << "{\"type\":\"object\",\"properties\":{\"a\":{\"type\":\"integer\"}}}" << "{}" << (int)JVALIDATION_OBJECT << "";
+			QTest::newRow("escaped key") << "{\"type\":\"object\",\"properties\":{\"a\":{}},\"additionalProperties\":false}" << "{\"a\":1,\"b/~c\":2}" << (int)JVALIDATION_KEY << "/b~1~0c";
+			QTest::newRow("array item") << "{\"type\":\"array\",\"items\":{\"type\":\"object\",\"properties\":{\"n\":{\"maxLength\":3}}}}" << "[{\"n\":\"ab\"},{\"n\":\"abcd\"}]" << (int)JVALIDATION_VALUE << "/1/n";
+			QTest::newRow("array size") << "{\"type\":\"array\",\"items\":{\"type\":\"array\",\"maxItems\":1}}" << "[[1],[1,2]]" << (int)JVALIDATION_ARRAY << "/1";
+			QTest::newRow("dependency") << "{\"type\":\"object\",\"properties\":{\"a\":{\"optional\":true},\"b\":{\"optional\":true,\"required\":\"a\"}}}" << "{\"c\":{},\"b\":1}" << (int)JVALIDATION_OBJECT << "";
+		}
+
+		void TestSchemaSanity::testValidateDom()
+		{
+			QFETCH(QString, schema);
+			QFETCH(QString, input);
+			QFETCH(int, check);
+			QFETCH(QString, path);
+
+			QByteArray schemaStr = schema.toUtf8();
+			QByteArray inputStr = input.toUtf8();
+
+			jschema_ref parsed = jschema_parse(j_str_to_buffer(schemaStr.constData(), schemaStr.size()), JSCHEMA_DOM_NOOPT, NULL);
+			QVERIFY(parsed != NULL);
+			JSchemaInfo schemaInfo;
+			jschema_info_init(&schemaInfo, parsed, NULL, NULL);
+			JSchemaInfo anyInfo;
+			jschema_info_init(&anyInfo, jschema_all(), NULL, NULL);
+			jvalue_ref dom = jdom_parse(j_str_to_buffer(inputStr.constData(), inputStr.size()), DOMOPT_NOOPT, &anyInfo);
+			QVERIFY(!jis_null(dom));
+
+			JValidationFailure failure;
+			bool valid = jvalue_validate(dom, &schemaInfo, &failure);
+			QString failedPath = QString::fromUtf8(failure.m_path ? failure.m_path : "");
+			JValidationCheck failedCheck = failure.m_check;
+			bool pathSet = (failure.m_path != NULL);
+			jvalidation_failure_clear(&failure);
+			j_release(&dom);
+			jschema_release(&parsed);
+
+			QCOMPARE(valid, check == JVALIDATION_OK);
+			QCOMPARE((int)failedCheck, check);
+			QCOMPARE(pathSet, !valid);
+			QCOMPARE(failedPath, path);
+		}
+
+		void TestSchemaSanity::testValidateDomDefaults()
+		{
+			jschema_ref parsed = jschema_parse(J_CSTR_TO_BUF("{\"type\":\"object\",\"properties\":{"
+					"\"i\":{\"type\":\"integer\",\"maximum\":5},"
+					"\"f\":{\"type\":\"number\",\"minimum\":1.25},"
+					"\"o\":{\"type\":\"object\",\"default\":{\"x\":[1,\"y\"]}}}}"), JSCHEMA_DOM_NOOPT, NULL);
+			QVERIFY(parsed != NULL);
+			JSchemaInfo schemaInfo;
+			jschema_info_init(&schemaInfo, parsed, NULL, NULL);
+
+			// the parser injects the same default
+			jvalue_ref parsedDom = jdom_parse(J_CSTR_TO_BUF("{\"i\":1,\"f\":2}"), DOMOPT_NOOPT, &schemaInfo);
+			QCOMPARE(std::string(jvalue_tostring(parsedDom, jschema_all())), std::string("{\"i\":1,\"f\":2,\"o\":{\"x\":[1,\"y\"]}}"));
+			j_release(&parsedDom);
+
+			// numbers that weren't parsed & a missing property with a default
+			jvalue_ref created = jobject_create();
+			jobject_put(created, J_CSTR_TO_JVAL("i"), jnumber_create_i64(5));
+			jobject_put(created, J_CSTR_TO_JVAL("f"), jnumber_create_f64(1.5));
+			QVERIFY(jvalue_validate(created, &schemaInfo, NULL));
+			QCOMPARE(std::string(jvalue_tostring(created, jschema_all())), std::string("{\"i\":5,\"f\":1.5,\"o\":{\"x\":[1,\"y\"]}}"));
+			j_release(&created);
+
+			created = jobject_create();
+			jobject_put(created, J_CSTR_TO_JVAL("i"), jnumber_create_i64(6));
+			jobject_put(created, J_CSTR_TO_JVAL("f"), jnumber_create_f64(1.5));
+			JValidationFailure failure;
+			QVERIFY(!jvalue_validate(created, &schemaInfo, &failure));
+			QCOMPARE((int)failure.m_check, (int)JVALIDATION_VALUE);
+			QCOMPARE(failure.m_value, jobject_get(created, J_CSTR_TO_BUF("i")));
+			QCOMPARE(std::string(failure.m_path), std::string("/i"));
+			jvalidation_failure_clear(&failure);
+			QVERIFY(failure.m_path == NULL);
+			j_release(&created);
+
+			jschema_release(&parsed);
+		}
+
+		void TestSchemaSanity::testPatterns()
+		{
+			// a pattern that doesn't compile makes the schema invalid
+			jschema_ref invalid = jschema_parse(J_CSTR_TO_BUF("{\"type\":\"string\",\"pattern\":\"[a-\"}"), JSCHEMA_DOM_NOOPT, NULL);
+			QVERIFY(invalid == NULL || !jschema_compile(invalid));
+			jschema_release(&invalid);
+
+			// the string is matched in place, up to its length, and '$' doesn't match before a trailing newline
+			jschema_ref schema = jschema_parse(J_CSTR_TO_BUF("{\"type\":\"string\",\"pattern\":\"^[a-z]+-[0-9]+$\"}"), JSCHEMA_DOM_NOOPT, NULL);
+			QVERIFY(schema != NULL);
+			QVERIFY(jschema_compile(schema));
+			QVERIFY(validates(schema, J_CSTR_TO_BUF("\"abc-12\"")));
+			QVERIFY(!validates(schema, J_CSTR_TO_BUF("\"abc-12\\n\"")));
+			QVERIFY(!validates(schema, J_CSTR_TO_BUF("\"abc-12x\"")));
+			QVERIFY(!validates(schema, J_CSTR_TO_BUF("\"\"")));
+
+			// one compiled pattern matched from several threads at once
+			std::string lines;
+			for (int i = 0; i < 4000; i++)
+				lines += (i % 4 == 3 ? "\"x_" : "\"abc-") + QString::number(i).toStdString() + "\"\n";
+			JSchemaInfo schemaInfo;
+			jschema_info_init(&schemaInfo, schema, NULL, NULL);
+			int numValid = 0;
+			QVERIFY(!jparse_parallel_ndjson(j_str_to_buffer(lines.data(), lines.size()), &schemaInfo, 4, JPARALLEL_OPT_NONE, countValid, &numValid));
+			QCOMPARE(numValid, 3000);
+
+			jschema_release(&schema);
+		}
+
+		void TestSchemaSanity::testReferenceCache()
+		{
+			raw_buffer schemaStr = J_CSTR_TO_BUF("{\"type\":\"array\",\"items\":{\"$ref\":\"Item\"}}");
+			raw_buffer valid = J_CSTR_TO_BUF("[{\"v\":1,\"children\":[{\"v\":2,\"children\":[{\"v\":3}]}]},{\"v\":4}]");
+			raw_buffer invalid = J_CSTR_TO_BUF("[{\"v\":1,\"children\":[{\"v\":\"x\"}]}]");
+			struct JSchemaResolver resolver = { countingResolver, NULL, };
+			JSchemaInfo schemaInfo;
+
+			// resolved lazily - only the first document needs the resolver
+			jschema_ref lazy = jschema_parse(schemaStr, JSCHEMA_DOM_NOOPT, NULL);
+			QVERIFY(lazy != NULL);
+			jschema_info_init(&schemaInfo, lazy, &resolver, NULL);
+			resolverCalls = 0;
+			for (int i = 0; i < 10; i++) {
+				QVERIFY(jsax_parse(NULL, valid, &schemaInfo));
+				QVERIFY(!jsax_parse(NULL, invalid, &schemaInfo));
+			}
+			QCOMPARE(resolverCalls, 1);
+			jschema_release(&lazy);
+
+			// resolved eagerly - validation needs no resolver at all
+			jschema_ref eager = jschema_parse(schemaStr, JSCHEMA_DOM_NOOPT, NULL);
+			QVERIFY(eager != NULL);
+			resolverCalls = 0;
+			QVERIFY(jschema_resolve_all(eager, &resolver));
+			QCOMPARE(resolverCalls, 1);
+			jschema_info_init(&schemaInfo, eager, NULL, NULL);
+			for (int i = 0; i < 10; i++) {
+				QVERIFY(jsax_parse(NULL, valid, &schemaInfo));
+				QVERIFY(!jsax_parse(NULL, invalid, &schemaInfo));
+			}
+			QCOMPARE(resolverCalls, 1);
+			jschema_release(&eager);
+
+			jschema_ref missing = jschema_parse(J_CSTR_TO_BUF("{\"$ref\":\"Missing\"}"), JSCHEMA_DOM_NOOPT, NULL);
+			QVERIFY(missing != NULL);
+			QVERIFY(!jschema_resolve_all(missing, &resolver));
+			jschema_release(&missing);
+		}
+
+		void TestSchemaSanity::testSchemaRegistry()
+		{
+			QDir dir(QDir::temp().filePath(QString("pbnjson-registry-%1").arg(getpid())));
+			QVERIFY(QDir::temp().mkpath(dir.path()));
+
+			QVERIFY(writeFile(dir, "Record.schema", "{\"type\":\"object\",\"properties\":{\"name\":{\"$ref\":\"Name\"}}}"));
+			QVERIFY(writeFile(dir, "Name.schema", "{\"type\":\"string\",\"maxLength\":3}"));
+			QVERIFY(writeFile(dir, "Alias.json", "{\"type\":\"string\",\"maxLength\":3}"));
+			QVERIFY(writeFile(dir, "Broken.schema", "{\"$ref\":\"Missing\"}"));
+
+			jschema_registry_ref registry = jschema_registry_create();
+			QVERIFY(registry != NULL);
+			QCOMPARE(jschema_registry_load_dir(registry, dir.path().toUtf8().constData(), 2), 3);
+			// already registered
+			QCOMPARE(jschema_registry_load_dir(registry, dir.path().toUtf8().constData(), 2), 0);
+			QVERIFY(jschema_registry_get(registry, "Broken") == NULL);
+
+			jschema_ref record = jschema_registry_get(registry, "Record");
+			jschema_ref name = jschema_registry_get(registry, "Name");
+			jschema_ref alias = jschema_registry_get(registry, dir.filePath("Alias.json").toUtf8().constData());
+			QVERIFY(record != NULL);
+			QVERIFY(name != NULL);
+			// same contents, same schema
+			QVERIFY(alias == name);
+
+			QVERIFY(validates(record, J_CSTR_TO_BUF("{\"name\":\"abc\"}")));
+			QVERIFY(!validates(record, J_CSTR_TO_BUF("{\"name\":\"abcd\"}")));
+
+			// schemas referring to a reloaded one pick up its new version
+			QVERIFY(writeFile(dir, "Name.schema", "{\"type\":\"string\",\"maxLength\":5}"));
+			QVERIFY(jschema_registry_reload(registry, dir.filePath("Name.schema").toUtf8().constData()));
+			jschema_ref longer = jschema_registry_get(registry, "Record");
+			QVERIFY(longer != record);
+			QVERIFY(validates(longer, J_CSTR_TO_BUF("{\"name\":\"abcde\"}")));
+			QVERIFY(!validates(longer, J_CSTR_TO_BUF("{\"name\":\"abcdef\"}")));
+			QVERIFY(!validates(record, J_CSTR_TO_BUF("{\"name\":\"abcde\"}")));
+			jschema_release(&longer);
+
+			// ... through other schemas too, & when picked up by a refresh
+			QVERIFY(writeFile(dir, "Outer.schema", "{\"type\":\"array\",\"items\":{\"$ref\":\"Record\"}}"));
+			jschema_ref outer = jschema_registry_load(registry, dir.filePath("Outer.schema").toUtf8().constData());
+			QVERIFY(outer != NULL);
+			QVERIFY(validates(outer, J_CSTR_TO_BUF("[{\"name\":\"abcde\"}]")));
+			jschema_release(&outer);
+			sleep(1); // the modification time has a resolution of a second
+			QVERIFY(writeFile(dir, "Name.schema", "{\"type\":\"string\",\"maxLength\":1}"));
+			QCOMPARE(jschema_registry_refresh(registry), 3);
+			outer = jschema_registry_get(registry, "Outer");
+			QVERIFY(validates(outer, J_CSTR_TO_BUF("[{\"name\":\"a\"}]")));
+			QVERIFY(!validates(outer, J_CSTR_TO_BUF("[{\"name\":\"ab\"}]")));
+			jschema_release(&outer);
+
+			// Alias shared Name's old contents but doesn't refer to it
+			jschema_ref aliasNow = jschema_registry_get(registry, "Alias");
+			QVERIFY(aliasNow == alias);
+			jschema_release(&aliasNow);
+
+			QVERIFY(writeFile(dir, "Record.schema", "{\"type\":\"object\",\"properties\":{\"name\":{\"type\":\"integer\"}}}"));
+			QVERIFY(jschema_registry_reload(registry, dir.filePath("Record.schema").toUtf8().constData()));
+			jschema_ref reloaded = jschema_registry_get(registry, "Record");
+			QVERIFY(validates(reloaded, J_CSTR_TO_BUF("{\"name\":1}")));
+			// the old version is still around for whoever holds it
+			QVERIFY(validates(record, J_CSTR_TO_BUF("{\"name\":\"abc\"}")));
+
+			// an invalid new version keeps the old one registered
+			QVERIFY(writeFile(dir, "Record.schema", "{\"type\":"));
+			QVERIFY(!jschema_registry_reload(registry, dir.filePath("Record.schema").toUtf8().constData()));
+			jschema_ref kept = jschema_registry_get(registry, "Record");
+			QVERIFY(kept == reloaded);
+
+			// identical files share a schema & are all rebuilt when what they refer to changes
+			const char *twin = "{\"type\":\"object\",\"properties\":{\"y\":{\"$ref\":\"Inner\"}}}";
+			QVERIFY(writeFile(dir, "Inner.schema", "{\"type\":\"object\",\"properties\":{\"x\":{\"type\":\"string\"}}}"));
+			QVERIFY(writeFile(dir, "TwinA.schema", twin));
+			QVERIFY(writeFile(dir, "TwinB.schema", twin));
+			QCOMPARE(jschema_registry_load_dir(registry, dir.path().toUtf8().constData(), 2), 3);
+			jschema_ref twinA = jschema_registry_get(registry, "TwinA");
+			jschema_ref twinB = jschema_registry_get(registry, "TwinB");
+			QVERIFY(twinA != NULL);
+			QVERIFY(twinA == twinB);
+			jschema_release(&twinA);
+			jschema_release(&twinB);
+
+			QVERIFY(writeFile(dir, "Inner.schema", "{\"type\":\"object\",\"properties\":{\"x\":{\"type\":\"number\"}}}"));
+			QVERIFY(jschema_registry_reload(registry, dir.filePath("Inner.schema").toUtf8().constData()));
+			const char *twins[] = { "TwinA", "TwinB" };
+			for (size_t i = 0; i < sizeof(twins) / sizeof(twins[0]); i++) {
+				jschema_ref rebuilt = jschema_registry_get(registry, twins[i]);
+				QVERIFY(validates(rebuilt, J_CSTR_TO_BUF("{\"y\":{\"x\":1}}")));
+				QVERIFY(!validates(rebuilt, J_CSTR_TO_BUF("{\"y\":{\"x\":\"s\"}}")));
+				jschema_release(&rebuilt);
+			}
+
+			jschema_registry_release(&registry);
+			QVERIFY(validates(kept, J_CSTR_TO_BUF("{\"name\":1}")));
+
+			jschema_release(&kept);
+			jschema_release(&reloaded);
+			jschema_release(&alias);
+			jschema_release(&name);
+			jschema_release(&record);
+
+			foreach (QString file, dir.entryList(QDir::Files))
+				dir.remove(file);
+			QDir::temp().rmdir(dir.dirName());
+		}
 	}
 
 }
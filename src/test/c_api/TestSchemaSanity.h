@@ -39,6 +39,14 @@ namespace pjson {
 
 			void testSimpleSchema();
 			void testSchemaReuse();
+			void testCompiledKeywords_data();
+			void testCompiledKeywords();
+			void testValidateDom_data();
+			void testValidateDom();
+			void testValidateDomDefaults();
+			void testPatterns();
+			void testReferenceCache();
+			void testSchemaRegistry();
 		};
 	}
 }
@@ -0,0 +1,160 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#include "TestBinding.h"
+#include "Order.h"
+
+Q_DECLARE_METATYPE(std::string);
+
+namespace pjson {
+	namespace testcxx {
+
+using test::binding::Order;
+
+static const char *fullOrder =
+	"{"
+		"\"id\" : 7,"
+		"\"customer\" : {\"name\" : \"Ann\", \"address\" : {\"street\" : \"Main\", \"city\" : \"Springfield\"}},"
+		"\"lines\" : [{\"sku\" : \"a\", \"price\" : 2, \"quantity\" : 3}, {\"sku\" : \"b\", \"price\" : 1.5, \"quantity\" : 1}],"
+		"\"total\" : 7.5,"
+		"\"paid\" : true,"
+		"\"tags\" : [\"x\", \"y\"],"
+		"\"grid\" : [[1, 2], [], [3]],"
+		"\"Order\" : {\"ref\" : \"o-7\"}"
+	"}";
+
+TestBinding::TestBinding()
+{
+}
+
+TestBinding::~TestBinding()
+{
+}
+
+void TestBinding::testParse()
+{
+	Order order;
+	QVERIFY(test::binding::parse(fullOrder, order));
+
+	QCOMPARE(order.id, (int64_t)7);
+	QCOMPARE(order.customer.name, std::string("Ann"));
+	QVERIFY(!order.customer.has.email);
+	QVERIFY(order.customer.has.address);
+	QCOMPARE(order.customer.address.street, std::string("Main"));
+	QCOMPARE(order.customer.address.city, std::string("Springfield"));
+
+	QCOMPARE(order.lines.size(), (size_t)2);
+	QCOMPARE(order.lines[0].sku, std::string("a"));
+	// an integer in the input is still stored in a number
+	QCOMPARE(order.lines[0].price, 2.0);
+	QCOMPARE(order.lines[0].quantity, (int64_t)3);
+	QCOMPARE(order.lines[1].price, 1.5);
+
+	QCOMPARE(order.total, 7.5);
+	QCOMPARE(order.paid, true);
+	QVERIFY(order.has.tags);
+	QCOMPARE(order.tags.size(), (size_t)2);
+	QCOMPARE(order.tags[1], std::string("y"));
+	QVERIFY(order.has.grid);
+	QCOMPARE(order.grid.size(), (size_t)3);
+	QCOMPARE(order.grid[0].size(), (size_t)2);
+	QVERIFY(order.grid[1].empty());
+	QCOMPARE(order.grid[2][0], (int64_t)3);
+	// a member can't be named like its struct
+	QVERIFY(order.has.Order_);
+	QCOMPARE(order.Order_.ref, std::string("o-7"));
+}
+
+void TestBinding::testParseDefaults()
+{
+	Order order;
+	order.paid = true;
+	order.tags.push_back("stale");
+
+	// the target is reset & "paid" is filled in from its default
+	QVERIFY(test::binding::parse("{\"id\" : 1, \"customer\" : {\"name\" : \"A\"}, \"lines\" : [], \"total\" : 0}", order));
+	QCOMPARE(order.paid, false);
+	QVERIFY(!order.has.tags);
+	QVERIFY(order.tags.empty());
+	QVERIFY(!order.customer.has.address);
+}
+
+void TestBinding::testSkipUnbound()
+{
+	Order order;
+
+	// "note" may be null so it isn't bound & "extra" isn't in the schema at all
+	QVERIFY(test::binding::parse(
+			"{\"id\" : 1, \"customer\" : {\"name\" : \"A\"}, \"lines\" : [], \"total\" : 0, \"note\" : null,"
+			"\"extra\" : {\"a\" : [1, {\"b\" : null}], \"c\" : \"d\"}, \"paid\" : true}", order));
+	QCOMPARE(order.id, (int64_t)1);
+	QCOMPARE(order.paid, true);
+
+	QVERIFY(test::binding::parse(
+			"{\"note\" : \"hi\", \"id\" : 2, \"customer\" : {\"name\" : \"A\"}, \"lines\" : [], \"total\" : 0}", order));
+	QCOMPARE(order.id, (int64_t)2);
+}
+
+void TestBinding::testReject_data()
+{
+	QTest::addColumn<std::string>("input");
+
+	QTest::newRow("not an integer") << std::string("{\"id\" : 7.5, \"customer\" : {\"name\" : \"A\"}, \"lines\" : [], \"total\" : 0}");
+	QTest::newRow("too short") << std::string("{\"id\" : 7, \"customer\" : {\"name\" : \"\"}, \"lines\" : [], \"total\" : 0}");
+	QTest::newRow("no additional properties") << std::string("{\"id\" : 7, \"customer\" : {\"name\" : \"A\", \"x\" : 1}, \"lines\" : [], \"total\" : 0}");
+	QTest::newRow("extended schema") << std::string("{\"id\" : 7, \"customer\" : {\"name\" : \"A\"}, \"lines\" : [{\"sku\" : \"a\", \"quantity\" : 1}], \"total\" : 0}");
+	QTest::newRow("minimum") << std::string("{\"id\" : 7, \"customer\" : {\"name\" : \"A\"}, \"lines\" : [], \"total\" : -1}");
+	QTest::newRow("missing") << std::string("{\"customer\" : {\"name\" : \"A\"}, \"lines\" : [], \"total\" : 0}");
+	QTest::newRow("array") << std::string("[1]");
+	QTest::newRow("syntax") << std::string("{\"id\" : 7,");
+}
+
+void TestBinding::testReject()
+{
+	QFETCH(std::string, input);
+
+	Order order;
+	QVERIFY(!test::binding::parse(input, order));
+}
+
+void TestBinding::testRoundTrip()
+{
+	Order order, parsed;
+	std::string serialized, reserialized;
+
+	QVERIFY(test::binding::parse(fullOrder, order));
+	QVERIFY(test::binding::toString(order, serialized));
+	// optional members that aren't set are left out
+	QVERIFY(serialized.find("email") == std::string::npos);
+
+	QVERIFY(test::binding::parse(serialized, parsed));
+	QVERIFY(test::binding::toString(parsed, reserialized));
+	QCOMPARE(reserialized, serialized);
+
+	order.customer.has.email = true;
+	order.customer.email = "ann@example.com";
+	QVERIFY(test::binding::toString(order, serialized));
+	QVERIFY(test::binding::parse(serialized, parsed));
+	QVERIFY(parsed.customer.has.email);
+	QCOMPARE(parsed.customer.email, order.customer.email);
+}
+
+	}
+}
+
+QTEST_APPLESS_MAIN(pjson::testcxx::TestBinding)
@@ -0,0 +1,49 @@
+/* @@@LICENSE
+*
+*      Copyright (c) 2012 Hewlett-Packard Development Company, L.P.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*
+LICENSE@@@ */
+
+#ifndef TEST_BINDING_H_
+#define TEST_BINDING_H_
+
+#include <QTest>
+
+namespace pjson {
+	namespace testcxx {
+
+/**
+ * The C++ bindings pbnjson_bindgen generates for schemas/binding/Order.schema
+ */
+class TestBinding : public QObject
+{
+	Q_OBJECT
+public:
+	TestBinding();
+	virtual ~TestBinding();
+
+private slots:
+	void testParse();
+	void testParseDefaults();
+	void testSkipUnbound();
+	void testReject_data();
+	void testReject();
+	void testRoundTrip();
+};
+
+	}
+}
+
+#endif // TEST_BINDING_H_
@@ -29,7 +29,9 @@ LICENSE@@@ */
 #include <iostream>
 #include <cassert>
 #include <limits>
+#include <sstream>
 #include <execinfo.h>
+#include <unistd.h>
 
 #include <pbnjson.hpp>
 
@@ -376,6 +378,68 @@ void TestDOM::testParserComplex()
 
 }
 
+/// records what it's called with through the allocation-free callbacks
+class ViewRecorder : public pj::JParser
+{
+public:
+	ViewRecorder(NumberType conversion) : pj::JParser(NULL), m_conversion(conversion) {}
+
+	std::string m_events;
+
+protected:
+	bool jsonObjectOpen() { m_events += "{"; return true; }
+	bool jsonObjectKeyView(pj::JStringView key) { m_events += key.str() + ":"; return true; }
+	bool jsonObjectClose() { m_events += "}"; return true; }
+	bool jsonArrayOpen() { m_events += "["; return true; }
+	bool jsonArrayClose() { m_events += "]"; return true; }
+	bool jsonStringView(pj::JStringView s) { m_events += "'" + s.str() + "' "; return true; }
+	bool jsonNumberView(pj::JStringView n) { m_events += "raw " + n.str() + " "; return true; }
+	bool jsonNumber(int64_t number) { m_events += "int " + QByteArray::number((qlonglong)number).toStdString() + " "; return true; }
+	bool jsonNumber(double &number, ConversionResultFlags asFloat) { m_events += "float " + QByteArray::number(number).toStdString() + " "; return true; }
+	bool jsonBoolean(bool truth) { m_events += truth ? "true " : "false "; return true; }
+	bool jsonNull() { m_events += "null "; return true; }
+	NumberType conversionToUse() const { return m_conversion; }
+
+private:
+	NumberType m_conversion;
+};
+
+/// the same, but through the std::string callbacks the views fall back on
+class StringRecorder : public ViewRecorder
+{
+public:
+	StringRecorder() : ViewRecorder(JNUM_CONV_RAW) {}
+
+protected:
+	bool jsonObjectKeyView(pj::JStringView key) { return JParser::jsonObjectKeyView(key); }
+	bool jsonStringView(pj::JStringView s) { return JParser::jsonStringView(s); }
+	bool jsonNumberView(pj::JStringView n) { return JParser::jsonNumberView(n); }
+	bool jsonObjectKey(const std::string& key) { m_events += key + ":"; return true; }
+	bool jsonString(const std::string& s) { m_events += "'" + s + "' "; return true; }
+	bool jsonNumber(const std::string& n) { m_events += "raw " + n + " "; return true; }
+};
+
+void TestDOM::testParserStringViews()
+{
+	std::string input("{\"a\":[\"x\",5,1.5,true,null],\"b\":{\"c\":\"\"}}");
+	pj::JSchemaFragment schema("{}");
+
+	ViewRecorder views(pj::JParser::JNUM_CONV_RAW);
+	QVERIFY(views.parse(input, schema));
+	QCOMPARE(views.m_events, std::string("{a:['x' raw 5 raw 1.5 true null ]b:{c:'' }}"));
+
+	StringRecorder strings;
+	QVERIFY(strings.parse(input, schema));
+	QCOMPARE(strings.m_events, views.m_events);
+
+	ViewRecorder native(pj::JParser::JNUM_CONV_NATIVE);
+	QVERIFY(native.parse(input, schema));
+	QCOMPARE(native.m_events, std::string("{a:['x' int 5 float 1.5 true null ]b:{c:'' }}"));
+
+	QVERIFY(pj::JStringView("abc", 2) == std::string("ab"));
+	QVERIFY(pj::JStringView("abc", 2) != std::string("abc"));
+}
+
 void TestDOM::testObjectSimple()
 {
 	std::string simpleObjectAsStr;
@@ -611,6 +675,181 @@ void TestDOM::testObjectPut()
 	QCOMPARE(obj["abc"].asString(), std::string("def"));
 }
 
+void TestDOM::testMoveSemantics()
+{
+#if __cplusplus >= 201103L
+	pj::JSchemaFragment schema("{}");
+
+	std::string text(100, 'x');
+	pj::JValue adopted(std::move(text));
+	QVERIFY(adopted.isString());
+	QCOMPARE(adopted.asString(), std::string(100, 'x'));
+	QVERIFY(pj::JValue(std::string("")).isString());
+
+	pj::JValue moved(std::move(adopted));
+	QVERIFY(adopted.isNull());
+	QCOMPARE(moved.asString(), std::string(100, 'x'));
+
+	pj::JValue array = pj::Array();
+	pj::JValue element(5);
+	QVERIFY(array.append(std::move(element)));
+	QVERIFY(element.isNull());
+	array << pj::JValue("abc");
+	QVERIFY(array.put(3, pj::JValue(true)));
+	QCOMPARE(pj::JGenerator::serialize(array, schema), std::string("[5,\"abc\",null,true]"));
+
+	pj::JValue object = pj::Object();
+	pj::JValue value = array;
+	QVERIFY(object.put("array", std::move(value)));
+	QVERIFY(value.isNull());
+	object << pj::JValue::KeyValue("s", std::string("moved"));
+	QCOMPARE(pj::JGenerator::serialize(object["array"], schema), std::string("[5,\"abc\",null,true]"));
+	QCOMPARE(object["s"].asString(), std::string("moved"));
+
+	value = std::move(moved);
+	QVERIFY(moved.isNull());
+	QCOMPARE(value.asString(), std::string(100, 'x'));
+#endif
+}
+
+static int inPlaceReleases = 0;
+
+static void releaseInPlace(void *owner)
+{
+	inPlaceReleases++;
+	delete static_cast<std::string *>(owner);
+}
+
+void TestDOM::testParseInPlace()
+{
+	pj::JSchemaFragment schema("{}");
+	pj::JDomParser parser;
+
+	std::string input("{\"s\":\"in place\",\"n\":[1,2.5]}");
+	QVERIFY(parser.parse(input.data(), input.size(), schema));
+	QCOMPARE(parser.getDom()["s"].asString(), std::string("in place"));
+
+	std::string *owner = new std::string(input);
+	QVERIFY(parser.parse(owner->data(), owner->size(), releaseInPlace, owner, schema));
+	QCOMPARE(inPlaceReleases, 0);
+	{
+		pj::JValue dom = parser.getDom();
+		QCOMPARE(dom["n"][1].asNumber<double>(), 2.5);
+		QCOMPARE(pj::JGenerator::serialize(dom, schema), input);
+	}
+	QVERIFY(parser.parse(std::string("[]"), schema));
+	QCOMPARE(inPlaceReleases, 1);
+
+	// the input is released right away if parsing fails
+	owner = new std::string("{\"s\":");
+	QVERIFY(!parser.parse(owner->data(), owner->size(), releaseInPlace, owner, schema));
+	QCOMPARE(inPlaceReleases, 2);
+
+	// scalar documents: the input stays with the DOM unless the DOM is a constant with nothing to point into
+	owner = new std::string("5");
+	QVERIFY(parser.parse(owner->data(), owner->size(), releaseInPlace, owner, schema));
+	QCOMPARE(inPlaceReleases, 2);
+	QCOMPARE(parser.getDom().asNumber<int64_t>(), (int64_t)5);
+	owner = new std::string("true");
+	QVERIFY(parser.parse(owner->data(), owner->size(), releaseInPlace, owner, schema));
+	QCOMPARE(inPlaceReleases, 3);
+	QVERIFY(parser.getDom().asBool());
+	owner = new std::string("\"\"");
+	QVERIFY(parser.parse(owner->data(), owner->size(), releaseInPlace, owner, schema));
+	QCOMPARE(inPlaceReleases, 5);
+	QCOMPARE(parser.getDom().asString(), std::string());
+	QCOMPARE(pj::JGenerator::serialize(pj::JValue(std::string()), schema), std::string("\"\""));
+
+#if __cplusplus >= 201103L
+	std::string adopted(input);
+	QVERIFY(parser.parse(std::move(adopted), schema));
+	QCOMPARE(parser.getDom()["s"].asString(), std::string("in place"));
+
+	std::shared_ptr<const std::string> shared = std::make_shared<const std::string>(input);
+	QVERIFY(parser.parse(shared, schema));
+	QCOMPARE(shared.use_count(), 2L);
+	QCOMPARE(parser.getDom()["s"].asString(), std::string("in place"));
+	QVERIFY(parser.parse(std::string("[]"), schema));
+	QCOMPARE(shared.use_count(), 1L);
+#endif
+}
+
+/// hands out the input a byte at a time
+class ByteReader : public pj::JInputReader
+{
+public:
+	ByteReader(const std::string &input) : m_input(input), m_offset(0), m_reads(0) {}
+
+	ssize_t read(char *buffer, size_t size)
+	{
+		m_reads++;
+		if (m_offset == m_input.size())
+			return 0;
+		buffer[0] = m_input[m_offset++];
+		return 1;
+	}
+
+	std::string m_input;
+	size_t m_offset;
+	size_t m_reads;
+};
+
+void TestDOM::testParseStreaming()
+{
+	std::string input("{\"name\":\"streamed \\u00e9\",\"ids\":[1,22,333],\"ratio\":0.125}");
+	pj::JSchemaFragment all("{}");
+	pj::JSchemaFragment schema("{\"type\":\"object\",\"properties\":{\"ids\":{\"type\":\"array\",\"items\":{\"type\":\"integer\"}},"
+		"\"limit\":{\"type\":\"integer\",\"default\":10}}}");
+	pj::JDomParser parser;
+
+	// tokens & escapes are split across chunks; validation carries on where it left off
+	ByteReader bytes(input);
+	QVERIFY(parser.parse(bytes, schema));
+	QCOMPARE(parser.getDom()["name"].asString(), std::string("streamed \xc3\xa9"));
+	QCOMPARE(parser.getDom()["ids"][2].asNumber<int64_t>(), (int64_t)333);
+	QCOMPARE(parser.getDom()["limit"].asNumber<int64_t>(), (int64_t)10);
+	QCOMPARE(bytes.m_reads, input.size());
+
+	ByteReader invalid("{\"ids\":[1,\"2\"]}");
+	QVERIFY(!parser.parse(invalid, schema));
+	ByteReader truncated(input.substr(0, input.size() - 1));
+	QVERIFY(!parser.parse(truncated, all));
+
+	// gzip is recognized even when its magic number arrives a byte at a time
+	QByteArray compressed = QByteArray::fromHex(
+		"1f8b08000000000002ffab564a54b28a36d431d233d5512a2e298a29353048b5548ad5514a52b2aa564a56b2ca2bcdc9d1514a51b22a"
+		"292a4dadad05007736213731000000");
+	ByteReader gzipped(std::string(compressed.constData(), compressed.size()));
+	QVERIFY(parser.parse(gzipped, all));
+	QCOMPARE(parser.getDom()["a"][2].asString(), std::string("str\xc3\xa9"));
+	QCOMPARE(parser.getDom()["b"]["d"].asBool(), true);
+
+	// reading stops with the document
+	ByteReader trailing(input + " {\"next\":true}");
+	QVERIFY(parser.parse(trailing, all));
+	QCOMPARE(trailing.m_offset, input.size());
+
+	pj::JDomParser whole;
+	QVERIFY(whole.parse(input, all));
+	std::istringstream stream(input);
+	QVERIFY(parser.parse(stream, all));
+	QCOMPARE(pj::JGenerator::serialize(parser.getDom(), all), pj::JGenerator::serialize(whole.getDom(), all));
+
+	int fds[2];
+	QVERIFY(pipe(fds) == 0);
+	QCOMPARE(write(fds[1], input.data(), input.size()), (ssize_t)input.size());
+	close(fds[1]);
+	QVERIFY(parser.parseFd(fds[0], all));
+	close(fds[0]);
+	QCOMPARE(parser.getDom()["ratio"].asNumber<double>(), 0.125);
+
+	// through the SAX callbacks
+	ViewRecorder views(pj::JParser::JNUM_CONV_RAW);
+	std::istringstream sax("[\"a\",{\"b\":1.5}]");
+	QVERIFY(views.parse(sax, all));
+	QCOMPARE(views.m_events, std::string("['a' {b:raw 1.5 }]"));
+}
+
 void TestDOM::testArraySimple()
 {
 	pj::JValue simple_arr = pj::Array();
@@ -86,11 +86,15 @@ private slots:
 	void testParserObjectComplex();
 	void testParserArray();
 	void testParserComplex();
+	void testParserStringViews();
 
 	void testObjectSimple();
 	void testObjectComplicated();
 	void testObjectIterator();
 	void testObjectPut();
+	void testMoveSemantics();
+	void testParseInPlace();
+	void testParseStreaming();
 	void testArraySimple();
 	void testArrayComplicated();
 	void testStringSimple_data();